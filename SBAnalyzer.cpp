@@ -0,0 +1,514 @@
+#include "SBAnalyzer.h"
+#include "SBSimd.h"
+#include "SBTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+struct SBAnalyzer::Channel
+{
+	std::vector<float>    	ring;
+	std::atomic<bool>     	active = { true };	// requested by setActive
+	std::atomic<uint64_t> 	firstFrame = { 0 };	// first frame of the current active stretch, never while idle
+	bool                  	copying = true;   	// audio thread
+	std::vector<float>    	power;            	// worker: smoothed power per bin
+	bool                  	silent = false;   	// worker: the floor is what readers see
+	uint64_t              	sequence = 0;     	// worker
+	SBSnapshot<SBSpectrum>	snapshot;
+};
+
+struct SBAnalyzer::Pair
+{
+	long                     	left = 0;
+	long                     	right = 0;
+	double                   	product = 0.0;	// worker: smoothed sums over the hops
+	double                   	leftEnergy = 0.0;
+	double                   	rightEnergy = 0.0;
+	bool                     	silent = false;
+	uint64_t                 	sequence = 0;
+	SBSnapshot<SBCorrelation>	snapshot;
+};
+
+struct SBAnalyzer::Worker
+{
+	SBThread              	thread;
+	SBSemaphore           	wake;
+	std::vector<Channel*> 	channels;
+	std::vector<Pair*>    	pairs;
+	std::vector<float>    	samples;	// fftSize
+	std::vector<float>    	other;  	// hopSize, right side of a pair
+	std::vector<SBComplex>	bins;
+	uint64_t              	nextHop = 0;	// end frame of the next window
+	char                  	padding[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t> 	readIndex = { 0 };	// oldest frame still needed
+};
+
+const uint64_t SB_ANALYZER_IDLE = std::numeric_limits<uint64_t>::max();
+
+//
+// Kernels
+//
+
+// Smoothed power of each bin: power = smoothing * power + (1 - smoothing) * |bin|^2.
+static void SB_AccumulatePower(const SBComplex* bins, float* power, size_t count, float smoothing)
+{
+	const float weight = 1.0f - smoothing;
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	const float* values = reinterpret_cast<const float*>(bins);
+	const __m128 previous = _mm_set1_ps(smoothing);
+	const __m128 current = _mm_set1_ps(weight);
+	for (; index + 4 <= count; index += 4)
+	{
+		const __m128 low = _mm_loadu_ps(values + 2 * index);
+		const __m128 high = _mm_loadu_ps(values + 2 * index + 4);
+		const __m128 lowSquared = _mm_mul_ps(low, low);
+		const __m128 highSquared = _mm_mul_ps(high, high);
+		const __m128 magnitude = _mm_add_ps(_mm_shuffle_ps(lowSquared, highSquared, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(lowSquared, highSquared, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm_storeu_ps(power + index, _mm_add_ps(_mm_mul_ps(previous, _mm_loadu_ps(power + index)), _mm_mul_ps(current, magnitude)));
+	}
+#endif
+	for (; index < count; ++index)
+		power[index] = smoothing * power[index] + weight * std::norm(bins[index]);
+}
+
+// 10 * log10(power), floored. log2 from the exponent bits and a polynomial on the mantissa, within 0.001 dB.
+static void SB_PowerToDecibels(const float* power, float* decibels, size_t count)
+{
+	const float floorPower = 1e-20f;	// SB_ANALYZER_FLOOR_DB
+	const float scale = 3.01029996f;	// 10 * log10(2)
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	const __m128 minimum = _mm_set1_ps(floorPower);
+	const __m128i mantissaMask = _mm_set1_epi32(0x007fffff);
+	const __m128i one = _mm_set1_epi32(0x3f800000);
+	const __m128 c1 = _mm_set1_ps(1.438547f), c2 = _mm_set1_ps(-0.6780815f), c3 = _mm_set1_ps(0.3236304f), c4 = _mm_set1_ps(-0.08428509f);
+	const __m128 ones = _mm_set1_ps(1.0f);
+	const __m128 scales = _mm_set1_ps(scale);
+	for (; index + 4 <= count; index += 4)
+	{
+		const __m128i bits = _mm_castps_si128(_mm_max_ps(_mm_loadu_ps(power + index), minimum));
+		const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+		const __m128 x = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantissaMask), one)), ones);	// mantissa - 1, [0, 1)
+		const __m128 polynomial = _mm_mul_ps(x, _mm_add_ps(c1, _mm_mul_ps(x, _mm_add_ps(c2, _mm_mul_ps(x, _mm_add_ps(c3, _mm_mul_ps(x, c4)))))));
+		_mm_storeu_ps(decibels + index, _mm_mul_ps(scales, _mm_add_ps(exponent, polynomial)));
+	}
+#endif
+	for (; index < count; ++index)
+		decibels[index] = scale * std::log2(std::max(power[index], floorPower));
+}
+
+static void SB_MultiplySamples(float* samples, const float* gains, size_t count)
+{
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	for (; index + 4 <= count; index += 4)
+		_mm_storeu_ps(samples + index, _mm_mul_ps(_mm_loadu_ps(samples + index), _mm_loadu_ps(gains + index)));
+#endif
+	for (; index < count; ++index)
+		samples[index] *= gains[index];
+}
+
+static float SB_PeakOf(const float* samples, size_t count)
+{
+	float peak = 0.0f;
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	const __m128 absolute = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peaks = _mm_setzero_ps();
+	for (; index + 4 <= count; index += 4)
+		peaks = _mm_max_ps(peaks, _mm_and_ps(_mm_loadu_ps(samples + index), absolute));
+	peaks = _mm_max_ps(peaks, _mm_movehl_ps(peaks, peaks));
+	peaks = _mm_max_ss(peaks, _mm_shuffle_ps(peaks, peaks, _MM_SHUFFLE(1, 1, 1, 1)));
+	peak = _mm_cvtss_f32(peaks);
+#endif
+	for (; index < count; ++index)
+		peak = std::max(peak, std::fabs(samples[index]));
+	return peak;
+}
+
+static float SB_SumOfSquares(const float* samples, size_t count)
+{
+	float sum = 0.0f;
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	__m128 sums = _mm_setzero_ps();
+	for (; index + 4 <= count; index += 4)
+	{
+		const __m128 x = _mm_loadu_ps(samples + index);
+		sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, sums);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; index < count; ++index)
+		sum += samples[index] * samples[index];
+	return sum;
+}
+
+// Sums of left*right, left^2 and right^2.
+static void SB_CrossSums(const float* left, const float* right, size_t count, double& product, double& leftEnergy, double& rightEnergy)
+{
+	float sums[3] = {};
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	__m128 lr = _mm_setzero_ps(), ll = _mm_setzero_ps(), rr = _mm_setzero_ps();
+	for (; index + 4 <= count; index += 4)
+	{
+		const __m128 x = _mm_loadu_ps(left + index);
+		const __m128 y = _mm_loadu_ps(right + index);
+		lr = _mm_add_ps(lr, _mm_mul_ps(x, y));
+		ll = _mm_add_ps(ll, _mm_mul_ps(x, x));
+		rr = _mm_add_ps(rr, _mm_mul_ps(y, y));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, lr);
+	sums[0] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm_storeu_ps(lanes, ll);
+	sums[1] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm_storeu_ps(lanes, rr);
+	sums[2] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; index < count; ++index)
+	{
+		sums[0] += left[index] * right[index];
+		sums[1] += left[index] * left[index];
+		sums[2] += right[index] * right[index];
+	}
+	product = sums[0];
+	leftEnergy = sums[1];
+	rightEnergy = sums[2];
+}
+
+//
+// SBAnalyzer
+//
+
+SBAnalyzer::SBAnalyzer() = default;
+
+SBAnalyzer::~SBAnalyzer()
+{
+	stop();
+}
+
+bool SBAnalyzer::start(const SBAnalyzerSetup& analyzerSetup)
+{
+	if (!workers.empty() || analyzerSetup.numChannels <= 0 || analyzerSetup.sampleRate <= 0.0)
+		return false;
+	const size_t fftSize = analyzerSetup.fftSize;
+	if (fftSize < 16 || (fftSize & (fftSize - 1)) != 0 || analyzerSetup.hopSize > fftSize)
+		return false;
+	for (const auto& pair : analyzerSetup.correlations)
+	{
+		if (pair.first < 0 || pair.first >= analyzerSetup.numChannels || pair.second < 0 || pair.second >= analyzerSetup.numChannels)
+			return false;
+	}
+
+	setup = analyzerSetup;
+	setup.smoothing = std::min(std::max(setup.smoothing, 0.0f), 0.999f);
+	hopSize = setup.hopSize ? setup.hopSize : fftSize / 4;
+	fft.reset(new SBRealFFT(fftSize));
+
+	// periodic Hann; its sum is fftSize / 2, a full scale sine peaks at fftSize / 4 unscaled
+	const double pi = 3.14159265358979323846;
+	window.resize(fftSize);
+	for (size_t index = 0; index < fftSize; ++index)
+		window[index] = static_cast<float>((0.5 - 0.5 * std::cos(2.0 * pi * static_cast<double>(index) / static_cast<double>(fftSize))) * 4.0 / static_cast<double>(fftSize));
+
+	// allocated (and touched) up front, the audio thread never faults a page in
+	const size_t ringFrames = SB_RoundUpToPowerOfTwo(fftSize + static_cast<size_t>(std::max(setup.bufferSeconds, 0.01) * setup.sampleRate));
+	ringMask = ringFrames - 1;
+	SBSpectrum empty;
+	empty.levels.assign(fft->bins(), SB_ANALYZER_FLOOR_DB);
+	channels.clear();
+	for (long index = 0; index < setup.numChannels; ++index)
+	{
+		std::unique_ptr<Channel> channel(new Channel);
+		channel->ring.assign(ringFrames, 0.0f);
+		channel->active.store(setup.activeChannels, std::memory_order_relaxed);
+		channel->copying = setup.activeChannels;
+		channel->firstFrame.store(setup.activeChannels ? 0 : SB_ANALYZER_IDLE, std::memory_order_relaxed);
+		channel->power.assign(fft->bins(), 0.0f);
+		channel->snapshot.reset(empty);
+		channels.push_back(std::move(channel));
+	}
+	pairs.clear();
+	for (const auto& correlation : setup.correlations)
+	{
+		std::unique_ptr<Pair> pair(new Pair);
+		pair->left = correlation.first;
+		pair->right = correlation.second;
+		pair->snapshot.reset(SBCorrelation());
+		pairs.push_back(std::move(pair));
+	}
+
+	// channels and pairs dealt out in turn; a pair costs about one hop of a channel, so they are not weighed
+	const size_t jobCount = channels.size() + pairs.size();
+	size_t threadCount = setup.threadCount ? setup.threadCount : std::max<size_t>(SB_GetCoreCount() / 2, 1);
+	threadCount = std::min(threadCount, jobCount);
+	for (size_t index = 0; index < threadCount; ++index)
+	{
+		std::unique_ptr<Worker> worker(new Worker);
+		worker->samples.assign(fftSize, 0.0f);
+		worker->other.assign(hopSize, 0.0f);
+		worker->bins.assign(fft->bins(), SBComplex());
+		worker->nextHop = hopSize;
+		workers.push_back(std::move(worker));
+	}
+	for (size_t index = 0; index < channels.size(); ++index)
+		workers[index % threadCount]->channels.push_back(channels[index].get());
+	for (size_t index = 0; index < pairs.size(); ++index)
+		workers[(channels.size() + index) % threadCount]->pairs.push_back(pairs[index].get());
+
+	writeIndex.store(0, std::memory_order_relaxed);
+	dropped.store(0, std::memory_order_relaxed);
+	signalledHop = 0;
+	stopping.store(false, std::memory_order_relaxed);
+
+	SBThreadSetup threadSetup;
+	threadSetup.name = "Analyzer";
+	threadSetup.flushDenormals = true;
+	for (auto& worker : workers)
+	{
+		Worker* target = worker.get();
+		if (!worker->thread.start(threadSetup, [this, target]() { run(*target); }))
+		{
+			stopping.store(true, std::memory_order_release);
+			for (auto& started : workers)
+			{
+				started->wake.signal();
+				started->thread.join();
+			}
+			workers.clear();
+			channels.clear();
+			pairs.clear();
+			return false;
+		}
+	}
+	accepting.store(true, std::memory_order_seq_cst);
+	return true;
+}
+
+void SBAnalyzer::stop()
+{
+	if (workers.empty())
+		return;
+
+	// pushing/accepting pair up so that no push is in flight once accepting is seen false
+	accepting.store(false, std::memory_order_seq_cst);
+	while (pushing.load(std::memory_order_seq_cst))
+		std::this_thread::yield();
+	stopping.store(true, std::memory_order_release);
+	for (auto& worker : workers)
+	{
+		worker->wake.signal();
+		worker->thread.join();
+	}
+	workers.clear();
+	channels.clear();
+	pairs.clear();
+}
+
+bool SBAnalyzer::push(const float* const* inputs, long numChannels, long frameCount)
+{
+	pushing.store(true, std::memory_order_seq_cst);
+	if (!accepting.load(std::memory_order_seq_cst) || frameCount <= 0)
+	{
+		pushing.store(false, std::memory_order_release);
+		return false;
+	}
+
+	const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	uint64_t read = write;
+	for (const auto& worker : workers)
+		read = std::min(read, worker->readIndex.load(std::memory_order_acquire));
+	if (write + frameCount - read > ringMask + 1)
+	{
+		dropped.fetch_add(static_cast<uint64_t>(frameCount), std::memory_order_relaxed);
+		pushing.store(false, std::memory_order_release);
+		return false;
+	}
+
+	const size_t start = static_cast<size_t>(write) & ringMask;
+	const size_t first = std::min<size_t>(frameCount, ringMask + 1 - start);
+	for (size_t index = 0; index < channels.size(); ++index)
+	{
+		Channel& channel = *channels[index];
+		const bool active = channel.active.load(std::memory_order_relaxed);
+		if (active != channel.copying)
+		{
+			// published with writeIndex below
+			channel.copying = active;
+			channel.firstFrame.store(active ? write : SB_ANALYZER_IDLE, std::memory_order_relaxed);
+		}
+		if (!active)
+			continue;
+
+		float* ring = channel.ring.data();
+		if (static_cast<long>(index) < numChannels && inputs[index])
+		{
+			memcpy(ring + start, inputs[index], first * sizeof(float));
+			memcpy(ring, inputs[index] + first, (frameCount - first) * sizeof(float));
+		}
+		else
+		{
+			std::fill_n(ring + start, first, 0.0f);
+			std::fill_n(ring, frameCount - first, 0.0f);
+		}
+	}
+	writeIndex.store(write + frameCount, std::memory_order_release);
+
+	const uint64_t hop = (write + frameCount) / hopSize;
+	if (hop != signalledHop)
+	{
+		signalledHop = hop;
+		for (const auto& worker : workers)
+			worker->wake.signal();
+	}
+	pushing.store(false, std::memory_order_release);
+	return true;
+}
+
+bool SBAnalyzer::setActive(long channel, bool active)
+{
+	if (channel < 0 || channel >= static_cast<long>(channels.size()))
+		return false;
+	channels[channel]->active.store(active, std::memory_order_relaxed);
+	return true;
+}
+
+bool SBAnalyzer::readSpectrum(long channel, SBSpectrum& spectrum) const
+{
+	if (channel < 0 || channel >= static_cast<long>(channels.size()))
+		return false;
+	channels[channel]->snapshot.read(spectrum);
+	return true;
+}
+
+bool SBAnalyzer::readCorrelation(size_t pair, SBCorrelation& correlation) const
+{
+	if (pair >= pairs.size())
+		return false;
+	pairs[pair]->snapshot.read(correlation);
+	return true;
+}
+
+void SBAnalyzer::run(Worker& worker)
+{
+	const double timeout = std::max(static_cast<double>(hopSize) / setup.sampleRate, 0.01);
+	while (!stopping.load(std::memory_order_acquire))
+	{
+		worker.wake.wait(timeout);
+		const uint64_t written = writeIndex.load(std::memory_order_acquire);
+		if (worker.nextHop > written)
+			continue;
+
+		// more than a window behind: the windows in between would only be published to be replaced at once
+		if (written - worker.nextHop >= setup.fftSize)
+			worker.nextHop = written / hopSize * hopSize;
+		for (; worker.nextHop <= written && !stopping.load(std::memory_order_relaxed); worker.nextHop += hopSize)
+		{
+			analyze(worker, worker.nextHop);
+			const uint64_t needed = worker.nextHop + hopSize;
+			worker.readIndex.store(needed > setup.fftSize ? needed - setup.fftSize : 0, std::memory_order_release);
+		}
+	}
+}
+
+void SBAnalyzer::analyze(Worker& worker, uint64_t endFrame)
+{
+	SBTraceScope trace("Analyze");
+	for (Channel* channel : worker.channels)
+		analyzeChannel(worker, *channel, endFrame);
+	for (Pair* pair : worker.pairs)
+		analyzePair(worker, *pair, endFrame);
+}
+
+void SBAnalyzer::analyzeChannel(Worker& worker, Channel& channel, uint64_t endFrame)
+{
+	const uint64_t first = channel.firstFrame.load(std::memory_order_relaxed);	// ordered by the writeIndex load in run()
+	if (first >= endFrame)
+		return;	// idle, or nothing since it became active
+
+	const size_t fftSize = setup.fftSize;
+	float* samples = worker.samples.data();
+	readWindow(channel, first, endFrame, fftSize, samples);
+	const float* hop = samples + fftSize - hopSize;
+	const float peak = SB_PeakOf(hop, hopSize);
+	const float rms = std::sqrt(SB_SumOfSquares(hop, hopSize) / static_cast<float>(hopSize));
+	const bool silent = peak == 0.0f && SB_PeakOf(samples, fftSize - hopSize) == 0.0f;
+	if (silent && channel.silent)
+		return;
+
+	if (silent)
+	{
+		std::fill(channel.power.begin(), channel.power.end(), 0.0f);
+	}
+	else
+	{
+		SB_MultiplySamples(samples, window.data(), fftSize);
+		fft->forward(samples, worker.bins.data());
+		SB_AccumulatePower(worker.bins.data(), channel.power.data(), channel.power.size(), setup.smoothing);
+	}
+
+	SBSpectrum* spectrum = channel.snapshot.back();
+	if (!spectrum)
+		return;	// a reader is still on it, the next hop publishes
+	spectrum->sequence = ++channel.sequence;
+	spectrum->endFrame = endFrame;
+	spectrum->peak = peak;
+	spectrum->rms = rms;
+	SB_PowerToDecibels(channel.power.data(), spectrum->levels.data(), channel.power.size());
+	channel.snapshot.publish();
+	channel.silent = silent;
+}
+
+void SBAnalyzer::analyzePair(Worker& worker, Pair& pair, uint64_t endFrame)
+{
+	// the last hop of both sides
+	const Channel& left = *channels[pair.left];
+	const Channel& right = *channels[pair.right];
+	const uint64_t leftFirst = left.firstFrame.load(std::memory_order_relaxed);
+	const uint64_t rightFirst = right.firstFrame.load(std::memory_order_relaxed);
+	if (leftFirst >= endFrame || rightFirst >= endFrame)
+		return;
+	readWindow(left, leftFirst, endFrame, hopSize, worker.samples.data());
+	readWindow(right, rightFirst, endFrame, hopSize, worker.other.data());
+	double product = 0.0, leftEnergy = 0.0, rightEnergy = 0.0;
+	SB_CrossSums(worker.samples.data(), worker.other.data(), hopSize, product, leftEnergy, rightEnergy);
+	const bool silent = leftEnergy == 0.0 && rightEnergy == 0.0;
+	if (silent && pair.silent)
+		return;
+
+	const double smoothing = silent ? 0.0 : setup.smoothing;
+	pair.product = smoothing * pair.product + (1.0 - smoothing) * product;
+	pair.leftEnergy = smoothing * pair.leftEnergy + (1.0 - smoothing) * leftEnergy;
+	pair.rightEnergy = smoothing * pair.rightEnergy + (1.0 - smoothing) * rightEnergy;
+	SBCorrelation* correlation = pair.snapshot.back();
+	if (!correlation)
+		return;	// a reader is still on it, the next hop publishes
+	const double energy = pair.leftEnergy * pair.rightEnergy;
+	correlation->sequence = ++pair.sequence;
+	correlation->endFrame = endFrame;
+	correlation->correlation = energy > 1e-30 ? static_cast<float>(std::min(std::max(pair.product / std::sqrt(energy), -1.0), 1.0)) : 0.0f;
+	pair.snapshot.publish();
+	pair.silent = silent;
+}
+
+void SBAnalyzer::readWindow(const Channel& channel, uint64_t firstFrame, uint64_t endFrame, size_t frameCount, float* samples) const
+{
+	// frames before the channel became active (or before the first push) read as silence
+	const uint64_t start = std::max(firstFrame, endFrame >= frameCount ? endFrame - frameCount : 0);
+	const size_t zeros = frameCount - static_cast<size_t>(endFrame - start);
+	std::fill_n(samples, zeros, 0.0f);
+
+	const size_t count = frameCount - zeros;
+	const size_t offset = static_cast<size_t>(start) & ringMask;
+	const size_t head = std::min(count, ringMask + 1 - offset);
+	memcpy(samples + zeros, channel.ring.data() + offset, head * sizeof(float));
+	memcpy(samples + zeros + head, channel.ring.data(), (count - head) * sizeof(float));
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "SBFFT.h"
+#include "SBLockFreeQueue.h"
+#include "SBThread.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+struct SBAnalyzerSetup
+{
+	long                            	numChannels = 0;
+	double                          	sampleRate = 48000.0;
+	size_t                          	fftSize = 4096;     	// power of two, at least 16: bins are sampleRate / fftSize apart
+	size_t                          	hopSize = 0;        	// frames between two spectra; 0: fftSize / 4 (Hann windows overlapping by 75%)
+	float                           	smoothing = 0.5f;   	// weight of the previous spectrum and correlation, 0 (none) to below 1
+	std::vector<std::pair<long, long>>	correlations;      	// channel pairs metered for phase correlation
+	double                          	bufferSeconds = 0.5;	// per-channel ring, on top of one window
+	size_t                          	threadCount = 0;    	// workers; 0: half the cores, at least one
+	bool                            	activeChannels = true;	// channels start active; false: idle until setActive
+};
+
+struct SBSpectrum
+{
+	uint64_t          	sequence = 0;	// spectra published for the channel so far, 0 before the first
+	uint64_t          	endFrame = 0;	// pushed frames up to the end of the window
+	float             	peak = 0.0f; 	// over the last hop, linear
+	float             	rms = 0.0f;
+	std::vector<float>	levels;      	// fftSize / 2 + 1 bins, dB relative to a full scale sine (SB_ANALYZER_FLOOR_DB at most)
+};
+
+struct SBCorrelation
+{
+	uint64_t	sequence = 0;
+	uint64_t	endFrame = 0;
+	float   	correlation = 0.0f;	// +1 in phase (mono), 0 unrelated, -1 out of phase; 0 while either side is silent
+};
+
+const float SB_ANALYZER_FLOOR_DB = -200.0f;
+
+// A value published by a single writer and read by any number of threads.
+//
+// Two copies: readers take the front one with an increment on a word that also holds which copy is in front,
+// copy it out and release it with a second increment, so reading never waits nor retries. The writer fills
+// the back copy once every reader that took it has released it (otherwise that publication is skipped,
+// the writer never waits either) and swaps it to the front.
+template<typename T>
+class SBSnapshot
+{
+public:
+	SBSnapshot() = default;
+	SBSnapshot(const SBSnapshot&) = delete;
+	SBSnapshot& operator=(const SBSnapshot&) = delete;
+
+	// writer: both copies, before any reader
+	void reset(const T& value)
+	{
+		values[0] = values[1] = value;
+		state.store(0, std::memory_order_relaxed);
+		released[0].store(0, std::memory_order_relaxed);
+		released[1].store(0, std::memory_order_relaxed);
+		acquired[0] = acquired[1] = 0;
+		front = 0;
+	}
+
+	// writer: the back copy to fill, nullptr while a reader is still on it
+	T* back()
+	{
+		const size_t index = front ^ 1;
+		return released[index].load(std::memory_order_acquire) == acquired[index] ? &values[index] : nullptr;
+	}
+
+	// writer: after filling back()
+	void publish()
+	{
+		const uint64_t previous = state.exchange(front ^ 1, std::memory_order_acq_rel);
+		acquired[front] += previous >> 1;
+		front ^= 1;
+	}
+
+	// any thread; copies into out (allocating only if out is smaller)
+	void read(T& out) const
+	{
+		const size_t index = static_cast<size_t>(state.fetch_add(2, std::memory_order_acquire) & 1);
+		out = values[index];
+		released[index].fetch_add(1, std::memory_order_release);
+	}
+
+private:
+	T                            	values[2];
+	mutable std::atomic<uint64_t>	state = { 0 };	// front index, then twice the readers that took it
+	mutable std::atomic<uint64_t>	released[2] = {};
+	uint64_t                     	acquired[2] = {};	// writer: readers that took each copy while it was in front
+	size_t                       	front = 0;       	// writer
+};
+
+// Spectra and correlation meters of many channels, off the audio thread.
+//
+// push() copies the blocks of the active channels into per-channel rings sharing one write index and wakes the
+// workers once a hop is complete. Channels and correlation pairs are split across the workers, each one windows
+// the last fftSize frames of its channels every hop, runs them through SBRealFFT and publishes smoothed levels
+// through SBSnapshot. Idle channels are neither copied nor analyzed, and a channel in digital silence publishes
+// the floor once and is then skipped until it sounds again. Workers that fall behind jump to the newest hop
+// rather than publishing stale spectra; when the rings are full anyway, blocks are dropped and counted.
+class SBAnalyzer
+{
+public:
+	SBAnalyzer();
+	SBAnalyzer(const SBAnalyzer&) = delete;
+	SBAnalyzer& operator=(const SBAnalyzer&) = delete;
+	~SBAnalyzer();
+
+	// control thread
+	bool start(const SBAnalyzerSetup& setup);
+	void stop();
+	bool running() const { return accepting.load(std::memory_order_relaxed); }
+
+	// audio thread; channels beyond numChannels are ignored, missing ones analyzed as silence
+	bool push(const float* const* channels, long numChannels, long frameCount);
+
+	// any thread, wait-free; false when out of range
+	bool setActive(long channel, bool active);	// takes effect from the next push
+	bool readSpectrum(long channel, SBSpectrum& spectrum) const;
+	bool readCorrelation(size_t pair, SBCorrelation& correlation) const;
+
+	size_t binCount() const { return fft ? fft->bins() : 0; }
+	double binFrequency(size_t bin) const { return static_cast<double>(bin) * setup.sampleRate / static_cast<double>(setup.fftSize); }
+	uint64_t pushedFrames() const { return writeIndex.load(std::memory_order_relaxed); }
+	uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Channel;
+	struct Pair;
+	struct Worker;
+
+	void run(Worker& worker);
+	void analyze(Worker& worker, uint64_t endFrame);
+	void analyzeChannel(Worker& worker, Channel& channel, uint64_t endFrame);
+	void analyzePair(Worker& worker, Pair& pair, uint64_t endFrame);
+	void readWindow(const Channel& channel, uint64_t firstFrame, uint64_t endFrame, size_t frameCount, float* samples) const;
+
+	SBAnalyzerSetup                      	setup;
+	std::unique_ptr<SBRealFFT>           	fft;
+	std::vector<float>                   	window;   	// Hann, scaled so that a full scale sine reads 0 dB
+	std::vector<std::unique_ptr<Channel>>	channels;
+	std::vector<std::unique_ptr<Pair>>   	pairs;
+	std::vector<std::unique_ptr<Worker>> 	workers;
+	size_t                               	ringMask = 0;
+	size_t                               	hopSize = 0;
+	uint64_t                             	signalledHop = 0;	// audio thread: last hop the workers were woken for
+
+	std::atomic<bool>                    	accepting = { false };
+	std::atomic<bool>                    	pushing = { false };
+	std::atomic<bool>                    	stopping = { false };
+	char                                 	padding0[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t>                	writeIndex = { 0 };	// frames, audio thread
+	std::atomic<uint64_t>                	dropped = { 0 };
+};
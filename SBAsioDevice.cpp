@@ -8,6 +8,8 @@
 #include <iostream>
 #include <algorithm>
 #include <unordered_map>
+#include <chrono>
+#include <mutex>
 
 #include <emmintrin.h>
 
@@ -39,6 +41,9 @@ struct SBASIODriver
 {
 	IASIO* handle;
 	mutable volatile long refcount; // refCount are the most common never-const member
+	double loadTime;
+	bool initialized;
+	SBAsioCapabilities capabilities;
 };
 
 //
@@ -57,6 +62,7 @@ struct CLSIDHaser
 	}
 };
 static std::unordered_map<SBAsioDevice::CLSID, SBASIODriver, CLSIDHaser> s_asioDrivers;
+static std::recursive_mutex s_asioDriversMutex;	// drivers are loaded lazily, possibly from startup tasks
 
 //
 // Registry
@@ -285,6 +291,7 @@ void SB_ASIOShutdown()
 {
 	if (--s_coInitializeCount == 0)
 	{
+		std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
 		for (auto& it : s_asioDrivers)
 		{
 			//assert(it.second.refcount == 1);
@@ -302,6 +309,7 @@ SBAsioDriverResult SB_CreateAsioDriver(const SBAsioDevice& device)
 {
 	if (s_coInitializeCount > 0)
 	{
+		std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
 		auto it = s_asioDrivers.find(device.classID);
 		if (it != s_asioDrivers.end())
 		{
@@ -310,10 +318,12 @@ SBAsioDriverResult SB_CreateAsioDriver(const SBAsioDevice& device)
 		}
 		else
 		{
-			// TODO: Support CoCreateInstanceEx for remote audio rendering?
+			// in process only: audio for other machines goes through SBNetAudio, not DCOM
 			CLSID clsid = *reinterpret_cast<const CLSID*>(&device.classID);
 			SBASIODriver driver = {};
+			const auto loadStart = std::chrono::steady_clock::now();
 			long result = CoCreateInstance(clsid, 0, CLSCTX_INPROC_SERVER, clsid, reinterpret_cast<void**>(&driver.handle));
+			driver.loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
 			if (S_OK == result)
 			{
 				_InterlockedIncrement(&driver.refcount);
@@ -336,6 +346,7 @@ SBAsioDriverResult SB_ReleaseAsioDriver(const SBAsioDevice& device)
 {
 	if (s_coInitializeCount > 0)
 	{
+		std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
 		auto it = s_asioDrivers.find(device.classID);
 		if (it != s_asioDrivers.end())
 		{
@@ -362,6 +373,7 @@ SBAsioDriverResult SB_ReleaseAsioDriver(const SBAsioDevice& device)
 IASIO* SB_QueryInterface(const SBAsioDevice& device)
 {
 	IASIO* handle = nullptr;
+	std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
 	auto it = s_asioDrivers.find(device.classID);
 	if (it == s_asioDrivers.end())
 	{
@@ -377,3 +389,99 @@ IASIO* SB_QueryInterface(const SBAsioDevice& device)
 	return handle;
 }
 
+bool SB_IsAsioDriverLoaded(const SBAsioDevice& device)
+{
+	std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
+	return s_asioDrivers.find(device.classID) != s_asioDrivers.end();
+}
+
+double SB_GetAsioDriverLoadTime(const SBAsioDevice& device)
+{
+	std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
+	auto it = s_asioDrivers.find(device.classID);
+	return it != s_asioDrivers.end() ? it->second.loadTime : 0.0;
+}
+
+//
+// Capabilities
+//
+long SBAsioCapabilities::currentClockSource() const
+{
+	for (const ASIOClockSource& source : clockSources)
+	{
+		if (source.isCurrentSource == ASIOBool::True)
+			return source.index;
+	}
+	return -1;
+}
+
+long SBAsioCapabilities::internalClockSource() const
+{
+	for (const ASIOClockSource& source : clockSources)
+	{
+		if (source.associatedChannel < 0)
+			return source.index;
+	}
+	return -1;
+}
+
+SBAsioCapabilities SB_QueryAsioCapabilities(IASIO* handle)
+{
+	static constexpr ASIOSampleRate s_standardRates[] = { 22050.0, 32000.0, 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0, 352800.0, 384000.0 };
+
+	SBAsioCapabilities capabilities;
+	if (!handle || handle->getChannels(&capabilities.numInputs, &capabilities.numOutputs) != ASIOError::OK)
+		return capabilities;
+	handle->getBufferSize(&capabilities.minBufferSize, &capabilities.maxBufferSize, &capabilities.preferredBufferSize, &capabilities.bufferGranularity);
+	if (handle->getSampleRate(&capabilities.sampleRate) != ASIOError::OK)
+		capabilities.sampleRate = 0.0;
+	for (ASIOSampleRate rate : s_standardRates)
+	{
+		if (handle->canSampleRate(rate) == ASIOError::OK)
+			capabilities.sampleRates.push_back(rate);
+	}
+
+	ASIOClockSource sources[32] = {};
+	long numSources = 32;
+	if (handle->getClockSources(sources, &numSources) == ASIOError::OK)
+		capabilities.clockSources.assign(sources, sources + std::min<long>(std::max<long>(numSources, 0), 32));
+	capabilities.valid = true;
+	return capabilities;
+}
+
+bool SB_GetAsioCapabilities(const SBAsioDevice& device, SBAsioCapabilities& capabilities, bool refresh)
+{
+	std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
+	auto it = s_asioDrivers.find(device.classID);
+	if (it == s_asioDrivers.end())
+	{
+		SB_CreateAsioDriver(device);
+		it = s_asioDrivers.find(device.classID);
+		if (it == s_asioDrivers.end())
+			return false;
+	}
+
+	SBASIODriver& driver = it->second;
+	if (!driver.capabilities.valid || refresh)
+	{
+		// an engine initializes the driver itself, only do it for drivers nothing has used yet
+		if (!driver.initialized)
+			driver.initialized = driver.handle->init(GetCurrentProcess()) == ASIOBool::True;
+		if (!driver.initialized)
+			return false;
+		driver.capabilities = SB_QueryAsioCapabilities(driver.handle);
+	}
+	capabilities = driver.capabilities;
+	return capabilities.valid;
+}
+
+void SB_UpdateAsioCapabilities(const SBAsioDevice& device, const SBAsioCapabilities& capabilities)
+{
+	std::lock_guard<std::recursive_mutex> lock(s_asioDriversMutex);
+	auto it = s_asioDrivers.find(device.classID);
+	if (it != s_asioDrivers.end() && capabilities.valid)
+	{
+		it->second.initialized = true;
+		it->second.capabilities = capabilities;
+	}
+}
@@ -129,6 +129,36 @@ enum class ASIOFuture : long
 	GetInternalBufferSamples = 0x25042012	/* ASIOInternalBufferInfo * in params. Deliver size of driver internal buffering, return ASE_SUCCESS if supported */
 };
 
+enum class ASIOMessageSelector : long
+{
+	SelectorSupported = 1,	// selector in <value>, returns 1L if supported, 0 otherwise
+	EngineVersion,			// returns engine (host) asio implementation version, 2 or higher
+	ResetRequest,			// request driver reset. if accepted, this will close the driver and re-open it again
+	BufferSizeChange,		// not yet supported, will currently always return 0L
+	ResyncRequest,			// the driver went out of sync, such that the timestamp is no longer valid
+	LatenciesChanged,		// the drivers latencies have changed
+	SupportsTimeInfo,		// if host returns true here, it will expect the callback bufferSwitchTimeInfo to be called instead of bufferSwitch
+	SupportsTimeCode,		//
+	MMCCommand,				// unused - value: number of commands, message points to mmc commands
+	SupportsInputMonitor,	// kAsioSupportsXXX return 1 if host supports this
+	SupportsInputGain,		// unused and undefined
+	SupportsInputMeter,		// unused and undefined
+	SupportsOutputGain,		// unused and undefined
+	SupportsOutputMeter,	// unused and undefined
+	Overload,				// driver detected an overload
+};
+
+enum class ASIOTimeInfoFlags : unsigned long
+{
+	SystemTimeValid     = 1,     	// must always be valid
+	SamplePositionValid = 1 << 1,	// must always be valid
+	SampleRateValid     = 1 << 2,
+	SpeedValid          = 1 << 3,
+	SampleRateChanged   = 1 << 4,
+	ClockSourceChanged  = 1 << 5,
+};
+inline bool SB_HasFlag(unsigned long flags, ASIOTimeInfoFlags flag) { return (flags & static_cast<unsigned long>(flag)) != 0; }
+
 
 using ASIOSampleRate = double;
 using ASIOSamples = int64_t;
@@ -188,6 +218,12 @@ struct ASIOChannelInfo
 	char name[32];			// dto
 };
 
+struct ASIOInternalBufferInfo
+{
+	long inputSamples;			// size of driver's internal input buffering which is included in getLatencies
+	long outputSamples;			// size of driver's internal output buffering which is included in getLatencies
+};
+
 typedef struct ASIOCallbacks
 {
 	void (*bufferSwitch) (long doubleBufferIndex, ASIOBool directProcess);
@@ -248,7 +284,36 @@ struct IASIO : public IUnknown
 	virtual ASIOError outputReady() = 0;
 };
 
+// Loads the driver on first use; the other queries below never load one.
 IASIO* SB_QueryInterface(const SBAsioDevice& device);
+bool SB_IsAsioDriverLoaded(const SBAsioDevice& device);
+double SB_GetAsioDriverLoadTime(const SBAsioDevice& device);	// seconds spent instantiating the driver, 0 when not loaded
+
+// What a driver supports, as of its last probe.
+struct SBAsioCapabilities
+{
+	long                        	numInputs = 0;
+	long                        	numOutputs = 0;
+	long                        	minBufferSize = 0;
+	long                        	maxBufferSize = 0;
+	long                        	preferredBufferSize = 0;
+	long                        	bufferGranularity = 0;
+	ASIOSampleRate              	sampleRate = 0.0;	// current rate, 0 without a clock
+	std::vector<ASIOSampleRate> 	sampleRates;     	// standard rates canSampleRate accepts with the current clock source
+	std::vector<ASIOClockSource>	clockSources;
+	bool                        	valid = false;
+
+	long currentClockSource() const;	// ASIOClockSource::index, -1 when unknown
+	long internalClockSource() const;	// first source tied to no channel, -1 when there is none
+};
+
+// Probes an initialized driver (no side effect on its state).
+SBAsioCapabilities SB_QueryAsioCapabilities(IASIO* handle);
+
+// Cached next to the loaded driver: probed (loading and initializing the driver) the first time or on refresh.
+// Refresh after anything that changes them, such as a clock source switch or the driver control panel.
+bool SB_GetAsioCapabilities(const SBAsioDevice& device, SBAsioCapabilities& capabilities, bool refresh = false);
+void SB_UpdateAsioCapabilities(const SBAsioDevice& device, const SBAsioCapabilities& capabilities);	// from a probe of an engine's handle
 
 inline std::wstring SB_GetASIOErrorString(ASIOError error)
 {
@@ -21,6 +21,7 @@ using SB_PLATFORM_HANDLE = void*;
 #include <unordered_map>
 #include <iostream>
 
+#include "SBTaskGraph.h"
 struct SBApplicationContext
 {
 	size_t
@@ -29,100 +30,141 @@ struct SBApplicationContext
 		handle = nullptr;
 	std::unordered_map<std::string, std::wstring>
 		folders = {};
+	std::vector<SBAsioDevice>
+		audioDevices = {};	// drivers are only loaded on first use (SB_QueryInterface)
+	std::vector<SBTaskTiming>
+		startup = {};
 
 	operator bool() const { return version > 0 && handle != nullptr && !folders.empty(); }
 };
 
+#include "SBSettings.h"
 struct SBSetup
 {
 	size_t
 		version = 0;
-	std::unordered_map<std::string, std::string>
+	SBSettings
 		settings = {};
 
-	operator bool() const { return version > 0 && !settings.empty(); }
+	operator bool() const { return version > 0 && settings; }
 };
 
 #include <tuple>
 #include "Shlobj.h"
-bool SB_InitializeSystemPath(SBApplicationContext& context)
+using SBFolderCallback = bool (*)(const std::wstring&);
+static bool SB_CreateFolder(const std::wstring& path)
 {
-	using callback_t = bool (*)(const std::wstring&);
-	callback_t createDirCallback = [](const std::wstring& path) -> bool
+	BOOL success = CreateDirectoryW(path.c_str(), NULL);
+	return success || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+static bool SB_VerifyFolder(const std::wstring& path)
+{
+	HANDLE dir = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	if (dir != INVALID_HANDLE_VALUE)
 	{
-		BOOL success = CreateDirectoryW(path.c_str(), NULL);
-		return success || GetLastError() == ERROR_ALREADY_EXISTS;
-	};
-	callback_t verifyDirCallback = [](const std::wstring & path) -> bool
+		CloseHandle(dir);
+		return true;
+	}
+	else
 	{
-		HANDLE dir = CreateFileW(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
-		if (dir != INVALID_HANDLE_VALUE)
-		{
-			CloseHandle(dir);
-			return true;
-		}
-		else
-		{
-			return false;
-		}
-	};
+		return false;
+	}
+}
 
-	std::tuple<std::string, GUID, callback_t> knownFolders[] = {
-		{ SB_USER_PATH, FOLDERID_LocalAppData, createDirCallback },  	// %LOCALAPPDATA% (%USERPROFILE%\AppData\Local)
-		{ SB_DATA_PATH, FOLDERID_ProgramData, verifyDirCallback },   	// %ALLUSERSPROFILE% (%ProgramData%, %SystemDrive%\ProgramData)
-		{ SB_SHARED_PATH, FOLDERID_Public, verifyDirCallback },        	// %PUBLIC% (%SystemDrive%\Users\Public)
-		{ SB_DOCUMENTS_PATH, FOLDERID_Documents, verifyDirCallback },	// %USERPROFILE%\Documents
-	};
+static const std::tuple<std::string, GUID, SBFolderCallback> s_knownFolders[] = {
+	{ SB_USER_PATH, FOLDERID_LocalAppData, &SB_CreateFolder },  	// %LOCALAPPDATA% (%USERPROFILE%\AppData\Local)
+	{ SB_DATA_PATH, FOLDERID_ProgramData, &SB_VerifyFolder },   	// %ALLUSERSPROFILE% (%ProgramData%, %SystemDrive%\ProgramData)
+	{ SB_SHARED_PATH, FOLDERID_Public, &SB_VerifyFolder },        	// %PUBLIC% (%SystemDrive%\Users\Public)
+	{ SB_DOCUMENTS_PATH, FOLDERID_Documents, &SB_VerifyFolder },	// %USERPROFILE%\Documents
+};
 
-	for (const auto& knownFolder : knownFolders)
+std::wstring SB_InitializeSystemFolder(const GUID& folderGUID, SBFolderCallback callback)
+{
+	std::wstring applicationPath;
+	PWSTR	path = nullptr;
+	if (SHGetKnownFolderPath(folderGUID, 0, NULL, &path) == S_OK)
 	{
-		const auto folderName = std::get<0>(knownFolder);
-		const auto folderGUID = std::get<1>(knownFolder);
-		const auto callback   = std::get<2>(knownFolder);
+		applicationPath = std::wstring(path) + std::wstring(L"\\" SB_W_APPLICATION_NAME);
+		CoTaskMemFree(path);
+		path = nullptr;
 
-		PWSTR	path = nullptr;
-		if (SHGetKnownFolderPath(folderGUID, 0, NULL, &path) == S_OK)
+		if (!callback || !callback(applicationPath))
 		{
-			std::wstring applicationPath = std::wstring(path) + std::wstring(L"\\" SB_W_APPLICATION_NAME);
-			CoTaskMemFree(path);
-			path = nullptr;
-
-			if (callback && callback(applicationPath))
-			{
-				context.folders.insert({ folderName, applicationPath });
-			}
+			applicationPath.clear();
 		}
 	}
-	return context;
+	return applicationPath;
 }
 
 bool SB_InitializeSystemAudio(SBApplicationContext& context)
 {
-	SB_ASIOInitialize();
-	std::wcout << "Initializing audio";
-	auto list = SB_EnumerateASIODevices();
-	for (const auto& it : list)
+	// Only reads the registry: instantiating a driver can take seconds, so it is deferred to its first use.
+	context.audioDevices = SB_EnumerateASIODevices();
+	return !context.audioDevices.empty();
+}
+
+#include "SBLatencyMeter.h"
+#include "SBLoopbackAsio.h"
+void SB_ReportRoundTripLatency(const std::wstring& name, const SBLatencyMeasurement& measurement)
+{
+	std::wcout << "\n\t" << name << ": ";
+	if (measurement.valid)
 	{
-		SB_CreateAsioDriver(it);
-		auto handle = SB_QueryInterface(it);
-		handle->init(GetCurrentProcess());
-		ASIOError started = handle->start();
-		std::wcout << "\n\t" << it.name << ": " << SB_GetASIOErrorString(started);
-		handle->Release();
+		std::wcout << measurement.measuredSamples << " samples measured, "
+			<< measurement.reportedSamples() << " reported (" << measurement.reportedInputLatency << " in + " << measurement.reportedOutputLatency << " out, "
+			<< measurement.internalInputSamples << "/" << measurement.internalOutputSamples << " internal), "
+			<< "error " << measurement.errorSamples() << " @ " << measurement.bufferSize << " frames";
+	}
+	else
+	{
+		std::wcout << "no loopback signal found";
+	}
+}
+
+void SB_MeasureRoundTripLatencies(const SBApplicationContext& context)
+{
+	// Output 0 must be wired to input 0 on every device; the software loopback validates the measure itself.
+	std::wcout << "Measuring round-trip latency";
+	SBLatencyMeterSetup setup;
+	if (IASIO* loopback = SB_CreateLoopbackAsio(SBLoopbackAsioSetup()))
+	{
+		SB_ReportRoundTripLatency(L"Software loopback", SB_MeasureRoundTripLatency(loopback, setup));
+		loopback->Release();
+	}
+	for (const auto& it : context.audioDevices)
+	{
+		SB_ReportRoundTripLatency(it.name, SB_MeasureRoundTripLatency(it, setup));
+	}
+	std::wcout << std::endl;
+}
+
+#include "SBSampleMeter.h"
+void SB_MeasureSampleKernels()
+{
+	// Every processing type, whichever SB_SAMPLE_* this build uses for the engine.
+	std::wcout << "Measuring sample kernels (Msamples/s)";
+	for (const SBSampleMeasurement& measurement : SB_MeasureSampleKernels(SBSampleMeterSetup()))
+	{
+		std::wcout << "\n\t" << measurement.type << ": "
+			<< measurement.codeErrors24 << " 24 bit / " << measurement.codeErrors32 << " 32 bit codes lost, "
+			<< "mix error " << measurement.mixErrorDb << " dB, gain error " << measurement.gainErrorDb << " dB, "
+			<< "int24 in " << measurement.fromInt32Rate * 1e-6 << ", out " << measurement.toInt32Rate * 1e-6
+			<< ", mix " << measurement.mixRate * 1e-6 << ", gain " << measurement.gainRate * 1e-6 << ", levels " << measurement.levelsRate * 1e-6
+			<< ", dither " << measurement.ditherRate * 1e-6 << ", shaped " << measurement.shapedDitherRate * 1e-6;
 	}
 	std::wcout << std::endl;
-	return context;
 }
 
 void SB_ShutdownApplicationContext(const SBApplicationContext& context)
 {
 	std::wcout << "Shutdown audio";
-	auto list = SB_EnumerateASIODevices();
-	for (const auto& it : list)
+	for (const auto& it : context.audioDevices)
 	{
+		if (!SB_IsAsioDriverLoaded(it))
+			continue;
 		auto handle = SB_QueryInterface(it);
 		ASIOError stopped = handle->stop();
-		std::wcout << "\n\t" << it.name << ": " << SB_GetASIOErrorString(stopped);
+		std::wcout << "\n\t" << it.name << " (loaded in " << SB_GetAsioDriverLoadTime(it) * 1000.0 << " ms): " << SB_GetASIOErrorString(stopped);
 		handle->Release();
 	}
 	std::wcout << std::endl;
@@ -130,44 +172,79 @@ void SB_ShutdownApplicationContext(const SBApplicationContext& context)
 }
 
 
-SBApplicationContext SB_InitializeApplicationContext()
+#define SB_CONFIGURATION_FILE       	SB_APPLICATION_NAME ".cfg"
+#define SB_CONFIGURATION_BINARY_FILE	SB_CONFIGURATION_FILE ".bin"
+bool SB_ReadConfiguration(const SBApplicationContext& context, SBSetup& setup)
+{
+	// Text config (line pairs: key, then value) is compiled once into a mapped binary snapshot;
+	// SBSetup::settings.reload() picks up later edits.
+	auto it = context.folders.find(SB_USER_PATH);
+	if (it == context.folders.end())
+	{
+		SB_WARNING("No user folder to read the configuration from.");
+		return false;
+	}
+	const std::wstring textPath = it->second + L"\\" SB_WIDEN(SB_CONFIGURATION_FILE);
+	const std::wstring binaryPath = it->second + L"\\" SB_WIDEN(SB_CONFIGURATION_BINARY_FILE);
+	if (setup.settings.load(textPath, binaryPath))
+	{
+		setup.version = setup.settings.snapshot()->generation();
+	}
+	return setup;
+}
+
+void SB_ReportStartupTimings(const SBApplicationContext& context)
+{
+	std::wcout << "Startup";
+	for (const SBTaskTiming& timing : context.startup)
+	{
+		std::wcout << "\n\t" << timing.name.c_str() << ": ";
+		if (timing.skipped)
+			std::wcout << "skipped";
+		else
+			std::wcout << timing.start * 1000.0 << " + " << timing.duration * 1000.0 << " ms (thread " << timing.thread << ")" << (timing.succeeded ? "" : ", failed");
+	}
+	std::wcout << std::endl;
+}
+
+SBApplicationContext SB_InitializeApplicationContext(SBSetup& setup)
 {
 	SBApplicationContext context = {};
 	context.handle = GetCurrentProcess();
-	SB_InitializeSystemPath(context);
+	// COM apartments are per thread: drivers get instantiated later, lazily, from this one.
+	SB_ASIOInitialize();
+
+	// Every folder entry exists before the graph runs, so tasks only ever write to their own value.
+	SBTaskGraph startup;
+	SBTaskGraph::TaskId userFolder = 0;
+	for (const auto& knownFolder : s_knownFolders)
+	{
+		const auto folderName = std::get<0>(knownFolder);
+		std::wstring& path = context.folders[folderName];
+		const SBTaskGraph::TaskId task = startup.add(("folder: " + folderName).c_str(), [&path, &knownFolder]()
+		{
+			path = SB_InitializeSystemFolder(std::get<1>(knownFolder), std::get<2>(knownFolder));
+			return !path.empty();
+		});
+		if (folderName == SB_USER_PATH)
+			userFolder = task;
+	}
+	startup.add("configuration", [&context, &setup]() { return SB_ReadConfiguration(context, setup); }, { userFolder });
 	// Network
 	// Display
 	// Input
 	// Audio
-	SB_InitializeSystemAudio(context);
-	return context;
-}
+	startup.add("audio devices", [&context]() { return SB_InitializeSystemAudio(context); });
+	startup.run();
 
-/*
-//#include "Windows.h"
-#include <fstream>
-SBSetup SB_ReadConfiguration(const SBApplicationContext& context)
-{
-	SBSetup setup;
-	std::ifstream configFile(config.configFilePath.c_str());
-	while (configFile)
-	{
-		std::string key;
-		std::getline(configFile, key);
-		std::string value;
-		std::getline(configFile, value);
-		if (!key.empty())
-		{
-			config.settings.insert({ key, value });
-		}
-		else
-		{
-			SB_WARNING("Invalid key found in config file.");
-		}
+	for (auto it = context.folders.begin(); it != context.folders.end();)
+	{
+		it = it->second.empty() ? context.folders.erase(it) : std::next(it);
 	}
-	return setup;
+	context.startup = startup.timings();
+	SB_ReportStartupTimings(context);
+	return context;
 }
-*/
 
 int main(int argc, char* argv[])
 {
@@ -175,7 +252,17 @@ int main(int argc, char* argv[])
 	//	-	Get system configuration file;
 	//	-	Get user configuration file;
 	//	-	Initialize worker threads;
-	const SBApplicationContext context = SB_InitializeApplicationContext();
+	SBSetup setup;
+	const SBApplicationContext context = SB_InitializeApplicationContext(setup);
+
+	if (argc > 1 && std::string(argv[1]) == "-latency")
+	{
+		SB_MeasureRoundTripLatencies(context);
+	}
+	else if (argc > 1 && std::string(argv[1]) == "-samples")
+	{
+		SB_MeasureSampleKernels();
+	}
 
 	SB_ShutdownApplicationContext(context);
 }
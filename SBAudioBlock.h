@@ -0,0 +1,76 @@
+#pragma once
+
+#include "SBAudioScheduler.h"
+#include "SBParameters.h"
+#include "SBSampleKernels.h"
+
+#include <algorithm>
+
+// One processing period, as handed to the processing callback.
+// Channels are planar buffers of frameCount samples in the processing type of the build (SBAudioSample),
+// already converted from the driver format.
+struct SBAudioBlock
+{
+	SBAudioTimeline            	timeline;
+	long                       	frameCount = 0;
+	long                       	numInputs = 0;
+	long                       	numOutputs = 0;
+	const SBAudioSample* const*	inputs = nullptr;
+	SBAudioSample* const*      	outputs = nullptr;
+	SBAudioEventSlice          	events;
+	SBParameterStore*          	parameters = nullptr;	// ramps already advanced to this block
+};
+
+using SBAudioProcessCallback = void (*)(const SBAudioBlock& block, void* userData);
+
+// Splits the block at every event offset so that events take effect on their exact frame:
+// apply(event) is called right before render(beginFrame, endFrame) of the segment it starts.
+template<typename RenderFunc, typename ApplyFunc>
+inline void SB_ForEachEventSegment(const SBAudioBlock& block, RenderFunc&& render, ApplyFunc&& apply)
+{
+	long frame = 0;
+	for (const SBAudioBlockEvent& blockEvent : block.events)
+	{
+		if (blockEvent.offset > frame)
+		{
+			render(frame, blockEvent.offset);
+			frame = blockEvent.offset;
+		}
+		apply(blockEvent.event);
+	}
+	if (frame < block.frameCount)
+	{
+		render(frame, block.frameCount);
+	}
+}
+
+// Runs one period: slices the events due in it and hands the block to process (outputs are silenced without one).
+// channels holds the inputs then the outputs. The ASIO engine and the offline renderer both go through here,
+// so the same timeline, block size and events give the same samples.
+inline void SB_ProcessAudioBlock(SBAudioScheduler& scheduler, SBParameterStore* parameters, const SBAudioTimeline& timeline, long frameCount,
+	long numInputs, long numOutputs, SBAudioSample* const* channels, SBAudioProcessCallback process, void* userData)
+{
+	scheduler.beginBlock(timeline, frameCount);
+	if (parameters)
+		parameters->beginBlock(scheduler.timeline(), frameCount);
+
+	SBAudioBlock block;
+	block.timeline = scheduler.timeline();
+	block.frameCount = frameCount;
+	block.numInputs = numInputs;
+	block.numOutputs = numOutputs;
+	block.inputs = channels;
+	block.outputs = channels + numInputs;
+	block.events = scheduler.dueEvents();
+	block.parameters = parameters;
+
+	if (process)
+	{
+		process(block, userData);
+	}
+	else
+	{
+		for (long channel = 0; channel < numOutputs; ++channel)
+			std::fill_n(block.outputs[channel], frameCount, SBAudioSample());
+	}
+}
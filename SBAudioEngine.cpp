@@ -0,0 +1,919 @@
+#include "SBAudioEngine.h"
+#include "SBAnalyzer.h"
+#include "SBCapture.h"
+#include "SBDynamics.h"
+#include "SBSession.h"
+#include "SBThread.h"
+#include "SBTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using SBClock = std::chrono::steady_clock;
+
+// Outputs of one driver format, dithered together.
+struct SBOutputDither
+{
+	ASIOSampleType                   	type = ASIOSampleType::Int16_LSB;
+	SBDither                         	dither;
+	std::vector<long>                	channels;	// engine channel indices
+	std::vector<const SBAudioSample*>	inputs;
+	std::vector<int32_t*>            	outputs;
+	std::vector<int32_t>             	scratch; 	// codes of the packed formats (Int16, Int24), channels x bufferSize
+};
+
+struct SBAudioEngine
+{
+	IASIO*                      	handle = nullptr;
+	SBAsioDevice                	device;     	// empty when created from a handle
+	SBAudioEngineSetup          	setup;
+	ASIOCallbacks               	callbacks = {};
+
+	long                        	bufferSize = 0;
+	long                        	numInputs = 0;
+	long                        	numOutputs = 0;
+	std::vector<ASIOBufferInfo> 	bufferInfos;	// inputs first, then outputs
+	std::vector<ASIOChannelInfo>	channelInfos;
+	std::vector<SBAudioSample>  	scratch;
+	std::vector<SBAudioSample*> 	channels;   	// planar views in scratch, inputs first
+	std::vector<float>          	captureScratch;	// float copies of the channels for the capture and the analyzer, non float builds only
+	std::vector<const float*>   	captureChannels;
+	std::vector<float*>         	dynamicsChannels;	// float copies of the outputs for the dynamics, in captureScratch, non float builds only
+	std::vector<const void*>    	sessionInputs;	// driver input buffers of the current half, for the session recorder
+	std::vector<SBSessionSampleType>	sessionTypes;
+	std::vector<SBOutputDither> 	dithers;    	// empty unless setup.dither is active
+	bool                        	useOutputReady = false;
+	bool                        	buffersCreated = false;
+	bool                        	running = false;
+	std::thread::id             	audioThread;	// driver callback thread, configured on its first callback
+	long                        	inputLatency = 0;
+	long                        	outputLatency = 0;
+
+	// adaptive buffer size (control thread)
+	std::vector<long>           	bufferSizes;	// candidates along the driver granularity, ascending
+	size_t                      	bufferSizeIndex = 0;
+	std::vector<SBClock::time_point>	retryAfter;	// per candidate, after it failed
+	std::vector<double>         	retryBackoff;	// seconds, doubled on each failure
+	SBClock::time_point         	stableSince;
+	long                        	checkedOverloadCount = 0;
+	float                       	lastPeakLoad = 0.0f;
+	bool                        	settling = false;
+
+	// clock (control thread)
+	SBAsioCapabilities          	capabilities;
+	bool                        	clockDown = false;	// loss seen by the control thread
+	bool                        	clockFallbackTried = false;
+	bool                        	clockPollable = false;	// getSampleRate failed during the loss, so it tells when the clock is back
+	SBClock::time_point         	clockLostSince;
+	long                        	clockChanges = 0;
+	double                      	clockRecoverySeconds = 0.0;
+
+	SBAudioScheduler            	scheduler;
+	SBAudioTimeline             	timeline;
+	std::atomic<bool>           	timelineValid = { false };
+
+	std::atomic<double>         	sampleRate = { 0.0 };
+	std::atomic<long>           	overloadCount = { 0 };
+	std::atomic<uint32_t>       	peakLoad = { 0 };	// per mille, written by the audio thread
+	std::atomic<bool>           	resetRequested = { false };
+	std::atomic<double>         	reportedSampleRate = { 0.0 };	// last rate reported by the driver, 0: no clock
+	std::atomic<bool>           	clockChangePending = { false };
+	std::atomic<SBClock::rep>   	clockReportTime = { 0 };	// when the pending change was first reported
+	std::atomic<bool>           	clockLost = { false };	// outputs muted, process skipped
+	SBSemaphore                 	events;     	// driver notifications, see SB_WaitAudioEngineEvent
+
+	explicit SBAudioEngine(size_t eventCapacity) : scheduler(eventCapacity) {}
+};
+
+static SBAudioEngine* s_audioEngine = nullptr;
+
+//
+// Sample conversion
+//
+// Bits of the integer formats worth dithering, 0 for the others.
+static int SB_DitherBits(ASIOSampleType type)
+{
+	switch (type)
+	{
+	case ASIOSampleType::Int16_LSB:   return 16;
+	case ASIOSampleType::Int24_LSB:   return 24;
+	case ASIOSampleType::Int32_LSB16: return 16;
+	case ASIOSampleType::Int32_LSB18: return 18;
+	case ASIOSampleType::Int32_LSB20: return 20;
+	case ASIOSampleType::Int32_LSB24: return 24;
+	default:                          return 0;
+	}
+}
+
+static void SB_ConvertToDriver(ASIOSampleType type, const SBAudioSample* source, void* target, long frameCount)
+{
+	int32_t* words = static_cast<int32_t*>(target);
+	switch (type)
+	{
+	case ASIOSampleType::Int16_LSB:   SB_SamplesToInt16(source, static_cast<int16_t*>(target), frameCount); break;
+	case ASIOSampleType::Int24_LSB:   SB_SamplesToInt24(source, static_cast<unsigned char*>(target), frameCount); break;
+	case ASIOSampleType::Int32_LSB:   SB_SamplesToInt32(source, words, frameCount, 32); break;
+	case ASIOSampleType::Int32_LSB16: SB_SamplesToInt32(source, words, frameCount, 16); break;
+	case ASIOSampleType::Int32_LSB18: SB_SamplesToInt32(source, words, frameCount, 18); break;
+	case ASIOSampleType::Int32_LSB20: SB_SamplesToInt32(source, words, frameCount, 20); break;
+	case ASIOSampleType::Int32_LSB24: SB_SamplesToInt32(source, words, frameCount, 24); break;
+	case ASIOSampleType::Float32_LSB: SB_ConvertSamples(source, static_cast<float*>(target), frameCount); break;
+	case ASIOSampleType::Float64_LSB: SB_ConvertSamples(source, static_cast<double*>(target), frameCount); break;
+	default:
+		break;
+	}
+}
+
+//
+// Clock
+//
+// Any thread, the driver reports from wherever it likes: recorded for SB_UpdateAudioEngine.
+static void SB_NotifyClockChange(SBAudioEngine& engine, ASIOSampleRate sampleRate)
+{
+	engine.reportedSampleRate.store(sampleRate);
+	if (sampleRate <= 0.0)
+		engine.clockLost.store(true);
+	if (!engine.clockChangePending.exchange(true))
+	{
+		engine.clockReportTime.store(SBClock::now().time_since_epoch().count());
+		engine.events.signal();
+	}
+}
+
+//
+// Timeline
+//
+static void SB_UpdateTimeline(SBAudioEngine& engine, const ASIOTime* time)
+{
+	SBAudioTimeline& timeline = engine.timeline;
+	const double nominalRate = engine.sampleRate.load(std::memory_order_relaxed);
+	const unsigned long flags = time ? time->timeInfo.flags : 0;
+
+	const ASIOSamples previousPosition = timeline.samplePosition;
+	timeline.sampleRate = SB_HasFlag(flags, ASIOTimeInfoFlags::SampleRateValid) && time->timeInfo.sampleRate > 0.0 ? time->timeInfo.sampleRate : nominalRate;
+	timeline.speed = SB_HasFlag(flags, ASIOTimeInfoFlags::SpeedValid) && time->timeInfo.speed > 0.0 ? time->timeInfo.speed : 1.0;
+	if ((SB_HasFlag(flags, ASIOTimeInfoFlags::SampleRateChanged) && timeline.sampleRate != nominalRate) || SB_HasFlag(flags, ASIOTimeInfoFlags::ClockSourceChanged))
+		SB_NotifyClockChange(engine, timeline.sampleRate);
+
+	// Extrapolate from the previous block whenever the driver does not provide a valid stamp.
+	if (SB_HasFlag(flags, ASIOTimeInfoFlags::SamplePositionValid))
+		timeline.samplePosition = time->timeInfo.samplePosition;
+	else if (engine.timelineValid)
+		timeline.samplePosition = previousPosition + engine.bufferSize;
+
+	if (SB_HasFlag(flags, ASIOTimeInfoFlags::SystemTimeValid))
+		timeline.systemTime = time->timeInfo.systemTime;
+	else if (engine.timelineValid && timeline.sampleRate > 0.0)
+		timeline.systemTime += std::llround(static_cast<double>(timeline.samplePosition - previousPosition) * 1e9 / timeline.sampleRate);
+
+	engine.timelineValid = true;
+}
+
+static SBSessionStamp SB_SessionStamp(const ASIOTime* time)
+{
+	SBSessionStamp stamp;
+	if (time)
+	{
+		stamp.samplePosition = time->timeInfo.samplePosition;
+		stamp.systemTime = time->timeInfo.systemTime;
+		stamp.sampleRate = time->timeInfo.sampleRate;
+		stamp.speed = time->timeInfo.speed;
+		stamp.flags = static_cast<uint32_t>(time->timeInfo.flags);
+	}
+	return stamp;
+}
+
+//
+// Dither
+//
+// Groups the outputs by format, so that all of them go through SBDither in one call per block. Control thread,
+// with the buffers created and the channel formats known.
+static void SB_PrepareOutputDither(SBAudioEngine& engine)
+{
+	engine.dithers.clear();
+	const SBDitherSetup& setup = engine.setup.dither;
+	if (setup.type == SBDitherType::None && setup.shaping == SBNoiseShaping::None)
+		return;
+
+	for (long channel = engine.numInputs; channel < engine.numInputs + engine.numOutputs; ++channel)
+	{
+		const ASIOSampleType type = engine.channelInfos[channel].type;
+		if (!SB_DitherBits(type))
+			continue;
+		auto it = std::find_if(engine.dithers.begin(), engine.dithers.end(), [type](const SBOutputDither& output) { return output.type == type; });
+		if (it == engine.dithers.end())
+		{
+			engine.dithers.emplace_back();
+			it = engine.dithers.end() - 1;
+			it->type = type;
+		}
+		it->channels.push_back(channel);
+	}
+	for (SBOutputDither& output : engine.dithers)
+	{
+		const long count = static_cast<long>(output.channels.size());
+		output.dither.prepare(setup, count, SB_DitherBits(output.type), static_cast<uint32_t>(output.type));
+		output.inputs.resize(count);
+		output.outputs.resize(count);
+		if (output.type == ASIOSampleType::Int16_LSB || output.type == ASIOSampleType::Int24_LSB)
+			output.scratch.assign(static_cast<size_t>(count) * engine.bufferSize, 0);
+	}
+}
+
+static void SB_DitherOutputs(SBAudioEngine& engine, SBOutputDither& output, long doubleBufferIndex)
+{
+	const size_t count = output.channels.size();
+	for (size_t index = 0; index < count; ++index)
+	{
+		const long channel = output.channels[index];
+		output.inputs[index] = engine.channels[channel];
+		output.outputs[index] = output.scratch.empty() ? static_cast<int32_t*>(engine.bufferInfos[channel].buffers[doubleBufferIndex]) : output.scratch.data() + index * engine.bufferSize;
+	}
+	output.dither.quantize(output.inputs.data(), output.outputs.data(), engine.bufferSize);
+	if (output.scratch.empty())
+		return;
+
+	for (size_t index = 0; index < count; ++index)
+	{
+		const int32_t* codes = output.outputs[index];
+		void* target = engine.bufferInfos[output.channels[index]].buffers[doubleBufferIndex];
+		if (output.type == ASIOSampleType::Int16_LSB)
+			SB_PackInt16(codes, static_cast<int16_t*>(target), engine.bufferSize);
+		else
+			SB_PackInt24(codes, static_cast<unsigned char*>(target), engine.bufferSize);
+	}
+}
+
+//
+// ASIO callbacks
+//
+static ASIOTime* SB_AsioBufferSwitchTimeInfo(ASIOTime* params, long doubleBufferIndex, ASIOBool /*directProcess*/)
+{
+	SBAudioEngine* engine = s_audioEngine;
+	if (!engine)
+		return params;
+
+	const SBClock::time_point callbackStart = SBClock::now();
+	if (engine->audioThread != std::this_thread::get_id())
+	{
+		SBThreadSetup threadSetup;
+		threadSetup.name = "ASIO";
+		threadSetup.priority = SBThreadPriority::RealTime;
+		threadSetup.core = engine->setup.audioThreadCore;
+		threadSetup.flushDenormals = true;
+		SB_ConfigureCurrentThread(threadSetup);
+		engine->audioThread = std::this_thread::get_id();
+	}
+	SBTraceScope trace("BufferSwitch");
+	SB_UpdateTimeline(*engine, params);
+
+	const long numChannels = engine->numInputs + engine->numOutputs;
+	if (engine->clockLost.load(std::memory_order_relaxed))
+	{
+		// whatever the driver still delivers is not clocked audio, until SB_UpdateAudioEngine renegotiates
+		for (long channel = engine->numInputs; channel < numChannels; ++channel)
+		{
+			std::fill_n(engine->channels[channel], engine->bufferSize, SBAudioSample());
+		}
+	}
+	else
+	{
+		SBSessionRecorder* session = engine->setup.session;
+		if (session)
+		{
+			for (long channel = 0; channel < engine->numInputs; ++channel)
+			{
+				engine->sessionInputs[channel] = engine->bufferInfos[channel].buffers[doubleBufferIndex];
+				engine->sessionTypes[channel] = static_cast<SBSessionSampleType>(engine->channelInfos[channel].type);
+			}
+			session->beginBlock(engine->scheduler, engine->timeline, SB_SessionStamp(params), engine->sessionTypes.data(), engine->sessionInputs.data(), engine->numInputs, engine->bufferSize);
+		}
+		SB_TraceBegin("ConvertInputs");
+		for (long channel = 0; channel < engine->numInputs; ++channel)
+		{
+			const ASIOBufferInfo& bufferInfo = engine->bufferInfos[channel];
+			SB_SamplesFromDriver(static_cast<long>(engine->channelInfos[channel].type), bufferInfo.buffers[doubleBufferIndex], engine->channels[channel], engine->bufferSize);
+		}
+		SB_TraceEnd("ConvertInputs");
+		if (engine->setup.capture)
+		{
+			const float* const* inputs = SB_FloatChannels(engine->channels.data(), engine->numInputs, engine->bufferSize, engine->captureScratch.data(), engine->captureChannels.data());
+			engine->setup.capture->push(inputs, engine->numInputs, engine->bufferSize);
+		}
+
+		{
+			SBTraceScope processTrace("Process");
+			SB_ProcessAudioBlock(engine->scheduler, engine->setup.parameters, engine->timeline, engine->bufferSize, engine->numInputs, engine->numOutputs, engine->channels.data(), engine->setup.process, engine->setup.userData);
+		}
+		if (engine->setup.dynamics)
+		{
+			SBTraceScope dynamicsTrace("Dynamics");
+			const long count = std::min(engine->numOutputs, engine->setup.dynamics->numChannels());
+			SB_ApplyDynamics(*engine->setup.dynamics, engine->channels.data() + engine->numInputs, count, engine->bufferSize, engine->captureScratch.data(), engine->dynamicsChannels.data());
+		}
+		if (session)
+			session->endBlock(engine->scheduler, engine->setup.parameters);	// the live time covers the dynamics, like the replay
+		if (engine->setup.analyzer)
+		{
+			const float* const* channels = SB_FloatChannels(engine->channels.data(), numChannels, engine->bufferSize, engine->captureScratch.data(), engine->captureChannels.data());
+			engine->setup.analyzer->push(channels, numChannels, engine->bufferSize);
+		}
+	}
+
+	SB_TraceBegin("ConvertOutputs");
+	const bool dithered = !engine->dithers.empty();
+	for (long channel = engine->numInputs; channel < numChannels; ++channel)
+	{
+		const ASIOBufferInfo& bufferInfo = engine->bufferInfos[channel];
+		if (!dithered || !SB_DitherBits(engine->channelInfos[channel].type))
+			SB_ConvertToDriver(engine->channelInfos[channel].type, engine->channels[channel], bufferInfo.buffers[doubleBufferIndex], engine->bufferSize);
+	}
+	for (SBOutputDither& output : engine->dithers)
+	{
+		SB_DitherOutputs(*engine, output, doubleBufferIndex);
+	}
+	SB_TraceEnd("ConvertOutputs");
+
+	if (engine->useOutputReady)
+	{
+		engine->handle->outputReady();
+	}
+
+	const double period = engine->timeline.sampleRate > 0.0 ? engine->bufferSize / engine->timeline.sampleRate : 0.0;
+	if (period > 0.0)
+	{
+		const double elapsed = std::chrono::duration<double>(SBClock::now() - callbackStart).count();
+		const uint32_t load = static_cast<uint32_t>(std::min(elapsed / period, 4.0) * 1000.0);
+		SB_TraceCounter("CallbackLoad", load);	// per mille of the period
+		uint32_t peakLoad = engine->peakLoad.load(std::memory_order_relaxed);
+		while (load > peakLoad && !engine->peakLoad.compare_exchange_weak(peakLoad, load, std::memory_order_relaxed))
+		{
+		}
+	}
+	return params;
+}
+
+static void SB_AsioBufferSwitch(long doubleBufferIndex, ASIOBool directProcess)
+{
+	// Legacy drivers: rebuild the time info from getSamplePosition.
+	ASIOTime time = {};
+	SBAudioEngine* engine = s_audioEngine;
+	if (engine && engine->handle->getSamplePosition(&time.timeInfo.samplePosition, &time.timeInfo.systemTime) == ASIOError::OK)
+	{
+		time.timeInfo.flags = static_cast<unsigned long>(ASIOTimeInfoFlags::SystemTimeValid) | static_cast<unsigned long>(ASIOTimeInfoFlags::SamplePositionValid);
+	}
+	SB_AsioBufferSwitchTimeInfo(&time, doubleBufferIndex, directProcess);
+}
+
+static void SB_AsioSampleRateDidChange(ASIOSampleRate sampleRate)
+{
+	if (SBAudioEngine* engine = s_audioEngine)
+	{
+		SB_NotifyClockChange(*engine, sampleRate);
+	}
+}
+
+static long SB_AsioMessage(long selector, long value, void* /*message*/, double* /*opt*/)
+{
+	SBAudioEngine* engine = s_audioEngine;
+	switch (static_cast<ASIOMessageSelector>(selector))
+	{
+	case ASIOMessageSelector::SelectorSupported:
+		switch (static_cast<ASIOMessageSelector>(value))
+		{
+		case ASIOMessageSelector::EngineVersion:
+		case ASIOMessageSelector::ResetRequest:
+		case ASIOMessageSelector::ResyncRequest:
+		case ASIOMessageSelector::LatenciesChanged:
+		case ASIOMessageSelector::SupportsTimeInfo:
+		case ASIOMessageSelector::Overload:
+			return 1;
+		default:
+			return 0;
+		}
+	case ASIOMessageSelector::EngineVersion:
+		return 2;
+	case ASIOMessageSelector::ResetRequest:
+		if (engine)
+		{
+			engine->resetRequested.store(true);
+			engine->events.signal();
+		}
+		return 1;
+	case ASIOMessageSelector::ResyncRequest:
+		if (engine)
+			engine->timelineValid = false;
+		return 1;
+	case ASIOMessageSelector::LatenciesChanged:
+	case ASIOMessageSelector::SupportsTimeInfo:
+		return 1;
+	case ASIOMessageSelector::Overload:
+		SB_TraceInstant("DriverOverload");
+		if (engine)
+			engine->overloadCount.fetch_add(1, std::memory_order_relaxed);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+//
+// Buffers
+//
+static void SB_QueryBufferSizes(SBAudioEngine& engine, long& preferredSize)
+{
+	long minSize = 0, maxSize = 0, granularity = 0;
+	preferredSize = 0;
+	engine.bufferSizes.clear();
+	if (engine.handle->getBufferSize(&minSize, &maxSize, &preferredSize, &granularity) == ASIOError::OK)
+	{
+		// granularity -1: powers of two between min and max, 0: preferred size only
+		if (granularity == -1 && minSize > 0)
+		{
+			for (long size = minSize; size <= maxSize; size *= 2)
+				engine.bufferSizes.push_back(size);
+		}
+		else if (granularity > 0)
+		{
+			for (long size = minSize; size <= maxSize; size += granularity)
+				engine.bufferSizes.push_back(size);
+		}
+	}
+	if (engine.bufferSizes.empty() && preferredSize > 0)
+	{
+		engine.bufferSizes.push_back(preferredSize);
+	}
+	// the parameter ramps hold maxFrames() values, bigger buffers are not candidates
+	if (const SBParameterStore* parameters = engine.setup.parameters)
+	{
+		const long maxFrames = parameters->maxFrames();
+		engine.bufferSizes.erase(std::remove_if(engine.bufferSizes.begin(), engine.bufferSizes.end(), [maxFrames](long size) { return size > maxFrames; }), engine.bufferSizes.end());
+	}
+	// nothing usable left (query failed, every size filtered out): keep the buffers in use, none before they exist
+	if (engine.bufferSizes.empty() && engine.bufferSize > 0)
+	{
+		engine.bufferSizes.push_back(engine.bufferSize);
+	}
+	engine.retryAfter.assign(engine.bufferSizes.size(), SBClock::time_point());
+	engine.retryBackoff.assign(engine.bufferSizes.size(), 0.0);
+}
+
+static size_t SB_FindBufferSizeIndex(const SBAudioEngine& engine, long bufferSize)
+{
+	const auto it = std::lower_bound(engine.bufferSizes.begin(), engine.bufferSizes.end(), bufferSize);
+	if (it == engine.bufferSizes.end())
+		return engine.bufferSizes.empty() ? 0 : engine.bufferSizes.size() - 1;
+	return static_cast<size_t>(it - engine.bufferSizes.begin());
+}
+
+static ASIOError SB_CreateAsioBuffers(SBAudioEngine& engine, long bufferSize)
+{
+	const long numChannels = engine.numInputs + engine.numOutputs;
+	engine.scratch.assign(static_cast<size_t>(numChannels) * bufferSize, SBAudioSample());
+	engine.channels.resize(numChannels);
+	for (long channel = 0; channel < numChannels; ++channel)
+	{
+		engine.channels[channel] = engine.scratch.data() + static_cast<size_t>(channel) * bufferSize;
+	}
+	if (!std::is_same<SBAudioSample, float>::value)
+	{
+		engine.captureScratch.assign(static_cast<size_t>(numChannels) * bufferSize, 0.0f);
+		engine.captureChannels.resize(numChannels);
+		engine.dynamicsChannels.resize(engine.numOutputs);
+	}
+	engine.sessionInputs.resize(engine.numInputs);
+	engine.sessionTypes.resize(engine.numInputs);
+	engine.bufferSize = bufferSize;
+	engine.bufferSizeIndex = SB_FindBufferSizeIndex(engine, bufferSize);
+
+	SBTraceScope trace("createBuffers");
+	const ASIOError result = engine.handle->createBuffers(engine.bufferInfos.data(), numChannels, bufferSize, &engine.callbacks);
+	engine.buffersCreated = result == ASIOError::OK;
+	if (engine.buffersCreated)
+	{
+		// latencies are only meaningful once the buffers exist
+		engine.inputLatency = engine.outputLatency = 0;
+		engine.handle->getLatencies(&engine.inputLatency, &engine.outputLatency);
+		SB_PrepareOutputDither(engine);
+	}
+	return result;
+}
+
+//
+// Engine
+//
+SBAudioEngine* SB_CreateAudioEngine(const SBAsioDevice& device, const SBAudioEngineSetup& setup)
+{
+	IASIO* handle = SB_QueryInterface(device);
+	if (!handle)
+		return nullptr;
+
+	SBAudioEngine* engine = SB_CreateAudioEngine(handle, setup);
+	handle->Release();
+	if (engine)
+	{
+		engine->device = device;
+		SB_UpdateAsioCapabilities(device, engine->capabilities);
+	}
+	return engine;
+}
+
+SBAudioEngine* SB_CreateAudioEngine(IASIO* handle, const SBAudioEngineSetup& setup)
+{
+	if (s_audioEngine || !handle)
+		return nullptr;
+
+	if (handle->init(GetCurrentProcess()) != ASIOBool::True)
+		return nullptr;
+
+	handle->AddRef();
+	SBAudioEngine* engine = new SBAudioEngine(setup.eventCapacity);
+	engine->handle = handle;
+	engine->setup = setup;
+
+	long numInputs = 0, numOutputs = 0, preferredSize = 0;
+	ASIOSampleRate sampleRate = 0.0;
+	SB_QueryBufferSizes(*engine, preferredSize);
+	if (engine->bufferSizes.empty() ||
+		handle->getChannels(&numInputs, &numOutputs) != ASIOError::OK ||
+		handle->getSampleRate(&sampleRate) != ASIOError::OK)
+	{
+		SB_DestroyAudioEngine(engine);
+		return nullptr;
+	}
+	engine->numInputs = setup.maxInputs >= 0 ? std::min(numInputs, setup.maxInputs) : numInputs;
+	engine->numOutputs = setup.maxOutputs >= 0 ? std::min(numOutputs, setup.maxOutputs) : numOutputs;
+	engine->sampleRate.store(sampleRate);
+	engine->reportedSampleRate.store(sampleRate);
+	engine->capabilities = SB_QueryAsioCapabilities(handle);
+
+	long bufferSize = preferredSize;
+	if (setup.adaptiveBufferSize)
+		bufferSize = engine->bufferSizes.front();
+	else if (setup.bufferSize > 0)
+		bufferSize = engine->bufferSizes[SB_FindBufferSizeIndex(*engine, setup.bufferSize)];
+
+	const long numChannels = engine->numInputs + engine->numOutputs;
+	engine->bufferInfos.resize(numChannels);
+	engine->channelInfos.resize(numChannels);
+	for (long channel = 0; channel < numChannels; ++channel)
+	{
+		const bool isInput = channel < engine->numInputs;
+		ASIOBufferInfo& bufferInfo = engine->bufferInfos[channel];
+		bufferInfo.isInput = isInput ? ASIOBool::True : ASIOBool::False;
+		bufferInfo.channelNum = isInput ? channel : channel - engine->numInputs;
+		ASIOChannelInfo& channelInfo = engine->channelInfos[channel];
+		channelInfo.channel = bufferInfo.channelNum;
+		channelInfo.isInput = bufferInfo.isInput;
+	}
+
+	engine->callbacks.bufferSwitch = &SB_AsioBufferSwitch;
+	engine->callbacks.sampleRateDidChange = &SB_AsioSampleRateDidChange;
+	engine->callbacks.asioMessage = &SB_AsioMessage;
+	engine->callbacks.bufferSwitchTimeInfo = &SB_AsioBufferSwitchTimeInfo;
+
+	// the formats are needed by the output dither, which SB_CreateAsioBuffers prepares
+	for (ASIOChannelInfo& channelInfo : engine->channelInfos)
+	{
+		handle->getChannelInfo(&channelInfo);
+	}
+
+	s_audioEngine = engine;
+	if (SB_CreateAsioBuffers(*engine, bufferSize) != ASIOError::OK)
+	{
+		SB_DestroyAudioEngine(engine);
+		return nullptr;
+	}
+	engine->useOutputReady = handle->outputReady() == ASIOError::OK;
+	return engine;
+}
+
+void SB_DestroyAudioEngine(SBAudioEngine* engine)
+{
+	if (!engine)
+		return;
+
+	if (engine->handle)
+	{
+		engine->handle->stop();
+		SB_ReleaseThread(engine->audioThread);
+		if (engine->buffersCreated)
+			engine->handle->disposeBuffers();
+		engine->handle->Release();
+		engine->handle = nullptr;
+	}
+	if (s_audioEngine == engine)
+		s_audioEngine = nullptr;
+	delete engine;
+}
+
+ASIOError SB_StartAudioEngine(SBAudioEngine* engine)
+{
+	if (!engine || !engine->handle || !engine->buffersCreated)
+		return ASIOError::NotPresent;
+	engine->timelineValid = false;
+	engine->stableSince = SBClock::now();
+	engine->settling = true;
+	SBTraceScope trace("start");
+	const ASIOError result = engine->handle->start();
+	engine->running = result == ASIOError::OK;
+	return result;
+}
+
+ASIOError SB_StopAudioEngine(SBAudioEngine* engine)
+{
+	if (!engine || !engine->handle)
+		return ASIOError::NotPresent;
+	engine->running = false;
+	SBTraceScope trace("stop");
+	const ASIOError result = engine->handle->stop();
+	// no more callbacks: the driver may pick another thread on the next start
+	SB_ReleaseThread(engine->audioThread);
+	engine->audioThread = std::thread::id();
+	return result;
+}
+
+ASIOError SB_SetAudioEngineBufferSize(SBAudioEngine* engine, long bufferSize)
+{
+	if (!engine || !engine->handle || engine->bufferSizes.empty())
+		return ASIOError::NotPresent;
+
+	// stop() guarantees no more callbacks, so the buffers can be swapped from here
+	const bool running = engine->running;
+	if (running)
+		SB_StopAudioEngine(engine);
+	if (engine->buffersCreated)
+	{
+		SBTraceScope trace("disposeBuffers");
+		engine->handle->disposeBuffers();
+		engine->buffersCreated = false;
+	}
+
+	const long previousSize = engine->bufferSize;
+	const long size = engine->bufferSizes[SB_FindBufferSizeIndex(*engine, bufferSize)];
+	ASIOError result = SB_CreateAsioBuffers(*engine, size);
+	if (result != ASIOError::OK && previousSize != size)
+	{
+		SB_CreateAsioBuffers(*engine, previousSize);
+	}
+	engine->peakLoad.store(0);
+	if (running && engine->buffersCreated)
+	{
+		SB_StartAudioEngine(engine);
+	}
+	return result;
+}
+
+//
+// Clock renegotiation
+//
+static void SB_RefreshCapabilities(SBAudioEngine& engine)
+{
+	engine.capabilities = SB_QueryAsioCapabilities(engine.handle);
+	if (engine.device)
+		SB_UpdateAsioCapabilities(engine.device, engine.capabilities);
+}
+
+// Moves the engine to another rate on the buffers it has: the cost is a driver stop/start and clockChanged,
+// the buffers are only recreated when the driver's size grid moved with the rate.
+static bool SB_RenegotiateClock(SBAudioEngine& engine, ASIOSampleRate sampleRate)
+{
+	SBTraceScope trace("RenegotiateClock");
+	const bool running = engine.running;
+	if (running)
+		SB_StopAudioEngine(&engine);
+	engine.sampleRate.store(sampleRate);
+	engine.timelineValid = false;
+	if (engine.setup.clockChanged)
+		engine.setup.clockChanged(sampleRate, engine.setup.userData);
+
+	for (ASIOChannelInfo& channelInfo : engine.channelInfos)
+	{
+		engine.handle->getChannelInfo(&channelInfo);
+	}
+
+	bool recreated = false;
+	long preferredSize = 0;
+	SB_QueryBufferSizes(engine, preferredSize);
+	if (!std::binary_search(engine.bufferSizes.begin(), engine.bufferSizes.end(), engine.bufferSize))
+	{
+		const long size = engine.setup.adaptiveBufferSize ? engine.bufferSizes.front() : engine.bufferSize;
+		recreated = SB_SetAudioEngineBufferSize(&engine, size) == ASIOError::OK;
+	}
+	else if (engine.buffersCreated)
+	{
+		// latencies are in samples, converters and driver buffering often change them with the rate
+		engine.bufferSizeIndex = SB_FindBufferSizeIndex(engine, engine.bufferSize);
+		engine.handle->getLatencies(&engine.inputLatency, &engine.outputLatency);
+		SB_PrepareOutputDither(engine);	// formats may have changed with the rate
+	}
+
+	engine.clockLost.store(false);
+	engine.peakLoad.store(0);
+	if (running && engine.buffersCreated)
+	{
+		SB_StartAudioEngine(&engine);
+	}
+	return recreated;
+}
+
+// The clock is back or moved: renegotiated when the rate differs, otherwise the outputs are only unmuted.
+static bool SB_RecoverClock(SBAudioEngine& engine, ASIOSampleRate sampleRate, SBClock::time_point reportTime)
+{
+	const bool changed = sampleRate != engine.sampleRate.load();
+	if (!changed && !engine.clockDown)
+	{
+		engine.clockLost.store(false);	// a loss reported and recovered between two updates
+		return false;
+	}
+
+	if (changed)
+	{
+		SB_RenegotiateClock(engine, sampleRate);
+	}
+	else
+	{
+		engine.timelineValid = false;
+		engine.clockLost.store(false);
+		if (engine.setup.clockChanged)
+			engine.setup.clockChanged(sampleRate, engine.setup.userData);
+	}
+	engine.clockDown = false;
+	++engine.clockChanges;
+	engine.clockRecoverySeconds = std::chrono::duration<double>(SBClock::now() - reportTime).count();
+	return true;
+}
+
+static bool SB_UpdateClock(SBAudioEngine& engine)
+{
+	ASIOSampleRate sampleRate = 0.0;
+	if (engine.clockChangePending.exchange(false))
+	{
+		const SBClock::time_point reportTime = SBClock::time_point(SBClock::duration(engine.clockReportTime.load()));
+		SB_RefreshCapabilities(engine);	// the clock source, or the rates it allows, may have changed with it
+		sampleRate = engine.reportedSampleRate.load();
+		if (sampleRate > 0.0)
+			return SB_RecoverClock(engine, sampleRate, reportTime);
+		if (!engine.clockDown)
+		{
+			engine.clockDown = true;
+			engine.clockFallbackTried = false;
+			engine.clockPollable = false;
+			engine.clockLostSince = reportTime;
+			engine.clockLost.store(true);
+			if (engine.setup.clockChanged)
+				engine.setup.clockChanged(0.0, engine.setup.userData);
+		}
+		return false;
+	}
+	if (!engine.clockDown)
+		return false;
+
+	// Not every driver reports the relock. Many keep returning their nominal rate without a clock though,
+	// so getSampleRate is only trusted once it has been seen failing.
+	if (engine.handle->getSampleRate(&sampleRate) != ASIOError::OK || sampleRate <= 0.0)
+		engine.clockPollable = true;
+	else if (engine.clockPollable)
+		return SB_RecoverClock(engine, sampleRate, SBClock::now());
+
+	const double lostSeconds = std::chrono::duration<double>(SBClock::now() - engine.clockLostSince).count();
+	if (engine.setup.clockFallbackSeconds >= 0.0 && lostSeconds >= engine.setup.clockFallbackSeconds && !engine.clockFallbackTried)
+	{
+		engine.clockFallbackTried = true;
+		const long internal = engine.capabilities.internalClockSource();
+		if (internal >= 0 && internal != engine.capabilities.currentClockSource() && engine.handle->setClockSource(internal) == ASIOError::OK)
+		{
+			SB_RefreshCapabilities(engine);
+			sampleRate = 0.0;
+			if (engine.handle->getSampleRate(&sampleRate) == ASIOError::OK && sampleRate > 0.0)
+				return SB_RecoverClock(engine, sampleRate, engine.clockLostSince);
+		}
+	}
+	return false;
+}
+
+ASIOError SB_SetAudioEngineSampleRate(SBAudioEngine* engine, ASIOSampleRate sampleRate)
+{
+	if (!engine || !engine->handle)
+		return ASIOError::NotPresent;
+
+	const SBClock::time_point start = SBClock::now();
+	ASIOError result = engine->handle->canSampleRate(sampleRate);
+	if (result == ASIOError::OK)
+		result = engine->handle->setSampleRate(sampleRate);
+	if (result != ASIOError::OK)
+		return result;
+	SB_RefreshCapabilities(*engine);
+	SB_RecoverClock(*engine, sampleRate, start);
+	return ASIOError::OK;
+}
+
+ASIOError SB_SetAudioEngineClockSource(SBAudioEngine* engine, long clockSource)
+{
+	if (!engine || !engine->handle)
+		return ASIOError::NotPresent;
+
+	const SBClock::time_point start = SBClock::now();
+	const ASIOError result = engine->handle->setClockSource(clockSource);
+	if (result != ASIOError::OK)
+		return result;
+	SB_RefreshCapabilities(*engine);
+	ASIOSampleRate sampleRate = 0.0;
+	if (engine->handle->getSampleRate(&sampleRate) == ASIOError::OK && sampleRate > 0.0)
+		SB_RecoverClock(*engine, sampleRate, start);
+	else
+		SB_NotifyClockChange(*engine, 0.0);	// nothing to lock on yet, serviced as a loss
+	return ASIOError::OK;
+}
+
+bool SB_UpdateAudioEngine(SBAudioEngine* engine)
+{
+	if (!engine || !engine->handle)
+		return false;
+
+	if (engine->resetRequested.exchange(false))
+	{
+		// drivers usually request a reset after their buffer configuration changed from the control panel
+		long preferredSize = 0;
+		SB_QueryBufferSizes(*engine, preferredSize);
+		if (engine->bufferSizes.empty())
+			return false;
+		const long size = engine->setup.adaptiveBufferSize ? engine->bufferSizes.front() : engine->bufferSize;
+		return SB_SetAudioEngineBufferSize(engine, size) == ASIOError::OK;
+	}
+	if (SB_UpdateClock(*engine))
+		return true;
+	if (engine->clockDown)
+		return false;
+
+	const float peakLoad = engine->peakLoad.exchange(0) * 0.001f;
+	const long overloadCount = engine->overloadCount.load();
+	const bool overloaded = overloadCount != engine->checkedOverloadCount || (!engine->settling && peakLoad > engine->setup.adaptiveMaxLoad);
+	engine->checkedOverloadCount = overloadCount;
+	engine->lastPeakLoad = peakLoad;
+	engine->settling = false;	// the first window after a (re)start includes the driver warm-up
+	if (!engine->setup.adaptiveBufferSize || !engine->running)
+		return false;
+
+	const SBClock::time_point now = SBClock::now();
+	const size_t index = engine->bufferSizeIndex;
+	if (overloaded)
+	{
+		engine->stableSince = now;
+		if (index + 1 < engine->bufferSizes.size())
+		{
+			// back off from this size, twice as long every time it fails
+			double& backoff = engine->retryBackoff[index];
+			backoff = backoff > 0.0 ? std::min(backoff * 2.0, 3600.0) : 3.0 * engine->setup.adaptiveStableSeconds;
+			engine->retryAfter[index] = now + std::chrono::duration_cast<SBClock::duration>(std::chrono::duration<double>(backoff));
+			return SB_SetAudioEngineBufferSize(engine, engine->bufferSizes[index + 1]) == ASIOError::OK;
+		}
+		return false;
+	}
+
+	const double stableSeconds = std::chrono::duration<double>(now - engine->stableSince).count();
+	if (index > 0 && stableSeconds >= engine->setup.adaptiveStableSeconds && peakLoad < 0.5f * engine->setup.adaptiveMaxLoad && now >= engine->retryAfter[index - 1])
+	{
+		return SB_SetAudioEngineBufferSize(engine, engine->bufferSizes[index - 1]) == ASIOError::OK;
+	}
+	return false;
+}
+
+SBAudioEngineStats SB_GetAudioEngineStats(const SBAudioEngine* engine)
+{
+	SBAudioEngineStats stats;
+	if (engine)
+	{
+		stats.bufferSize = engine->bufferSize;
+		stats.inputLatency = engine->inputLatency;
+		stats.outputLatency = engine->outputLatency;
+		stats.dynamicsLatency = engine->setup.dynamics ? engine->setup.dynamics->latency() : 0;
+		stats.sampleRate = engine->sampleRate.load();
+		stats.peakLoad = engine->lastPeakLoad;
+		stats.overloadCount = engine->overloadCount.load();
+		stats.clockLost = engine->clockLost.load();
+		stats.clockChanges = engine->clockChanges;
+		stats.clockRecoverySeconds = engine->clockRecoverySeconds;
+	}
+	return stats;
+}
+
+bool SB_WaitAudioEngineEvent(SBAudioEngine* engine, double timeoutSeconds)
+{
+	return engine && engine->events.wait(timeoutSeconds);
+}
+
+SBAsioCapabilities SB_GetAudioEngineCapabilities(const SBAudioEngine* engine)
+{
+	return engine ? engine->capabilities : SBAsioCapabilities();
+}
+
+SBAudioScheduler* SB_GetAudioScheduler(SBAudioEngine* engine)
+{
+	return engine ? &engine->scheduler : nullptr;
+}
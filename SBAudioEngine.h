@@ -0,0 +1,92 @@
+#pragma once
+
+#include "SBAsioDevice.h"
+#include "SBAudioBlock.h"
+#include "SBDither.h"
+
+class SBAnalyzer;
+class SBCapture;
+class SBDynamics;
+class SBSessionRecorder;
+
+using SBAudioClockCallback = void (*)(double sampleRate, void* userData);
+
+struct SBAudioEngineSetup
+{
+	long                  	bufferSize = 0;    	// 0: driver preferred size
+	long                  	maxInputs = -1;    	// -1: every input channel
+	long                  	maxOutputs = -1;   	// -1: every output channel
+	size_t                	eventCapacity = 4096;
+	SBAudioProcessCallback	process = nullptr; 	// nullptr: outputs are silenced
+	void*                 	userData = nullptr;
+	SBParameterStore*     	parameters = nullptr;	// advanced every block, handed to process in SBAudioBlock; caps the buffer size at its maxFrames()
+	SBCapture*            	capture = nullptr;	// inputs pushed every block, right after conversion (start/stop it at will)
+	SBDynamics*           	dynamics = nullptr;	// outputs, after processing and before the analyzer (dynamics channel = output index); every block passes the same channels, min(numChannels(), outputs)
+	SBSessionRecorder*    	session = nullptr;	// driver inputs, timing, events and parameter changes of every block, for SB_ReplaySession (start/stop it at will)
+	SBAnalyzer*           	analyzer = nullptr;	// inputs then outputs pushed every block, after processing (analyzer channel = engine channel)
+	SBDitherSetup         	dither;            	// outputs narrower than 32 bits (Int16, Int24, Int32 LSB16 to LSB24)
+
+	// The driver's callback thread gets real-time priority and FTZ/DAZ on its first callback (see SBThread.h).
+	int                   	audioThreadCore = -1;	// -1: leave the affinity to the driver
+
+	// Low-latency mode: start at the smallest size the driver allows and step along its granularity,
+	// up on overloads or when the callback load gets too high, down again after a stable period.
+	bool                  	adaptiveBufferSize = false;
+	float                 	adaptiveMaxLoad = 0.75f;      	// callback duration / buffer period
+	double                	adaptiveStableSeconds = 10.0; 	// trouble-free time before trying a smaller size
+
+	// Clock changes (sampleRateDidChange, ASIOTime clock flags, SB_SetAudioEngineSampleRate/ClockSource) are renegotiated
+	// in place by SB_UpdateAudioEngine: the driver is stopped, clockChanged rebuilds what follows the rate (resamplers,
+	// filters, smoothing) and the driver restarts on the same buffers. Outputs are muted while the clock is lost;
+	// clockChanged is then called with 0, and again on a relock at the same rate, both times without stopping the driver.
+	SBAudioClockCallback  	clockChanged = nullptr;       	// control thread, with userData
+	double                	clockFallbackSeconds = 1.0;   	// without a clock for that long, switch to the internal one; < 0: wait
+};
+
+struct SBAudioEngineStats
+{
+	long  	bufferSize = 0;
+	long  	inputLatency = 0; 	// samples, as reported by getLatencies for the current buffers
+	long  	outputLatency = 0;
+	long  	dynamicsLatency = 0;	// samples setup.dynamics delays the outputs by, on top of outputLatency
+	double	sampleRate = 0.0;
+	float 	peakLoad = 0.0f;  	// worst callback duration / buffer period over the last update
+	long  	overloadCount = 0;	// overloads reported by the driver since creation
+	bool  	clockLost = false;
+	long  	clockChanges = 0; 	// renegotiations since creation
+	double	clockRecoverySeconds = 0.0;	// last one, from the driver report to the restarted driver
+};
+
+// Services the ASIOCallbacks of a single driver: converts the driver buffers to planar SBAudioSample,
+// anchors the timeline on ASIOTime and hands the due event slice to the processing callback.
+// ASIO callbacks carry no user pointer, hence only one engine can be running at a time.
+struct SBAudioEngine;
+
+SBAudioEngine* SB_CreateAudioEngine(const SBAsioDevice& device, const SBAudioEngineSetup& setup);
+SBAudioEngine* SB_CreateAudioEngine(IASIO* handle, const SBAudioEngineSetup& setup);	// e.g. software drivers, the engine adds its own reference
+void SB_DestroyAudioEngine(SBAudioEngine* engine);
+
+ASIOError SB_StartAudioEngine(SBAudioEngine* engine);
+ASIOError SB_StopAudioEngine(SBAudioEngine* engine);
+
+// Control thread: recreates the driver buffers (disposeBuffers/createBuffers) at a safe point,
+// restarting the driver if it was running.
+ASIOError SB_SetAudioEngineBufferSize(SBAudioEngine* engine, long bufferSize);
+
+// Control thread: the driver is switched, then the engine renegotiates as for a driver report.
+ASIOError SB_SetAudioEngineSampleRate(SBAudioEngine* engine, ASIOSampleRate sampleRate);
+ASIOError SB_SetAudioEngineClockSource(SBAudioEngine* engine, long clockSource);	// ASIOClockSource::index
+
+// Control thread, periodically (~100 ms): services driver reset requests, clock changes and the adaptive buffer size.
+// Returns true when the buffers were recreated or the clock renegotiated.
+bool SB_UpdateAudioEngine(SBAudioEngine* engine);
+
+// Control thread: waits up to timeoutSeconds for a driver notification (reset request, clock change), so that an
+// update loop built on it services them within a few buffer periods rather than its polling interval.
+bool SB_WaitAudioEngineEvent(SBAudioEngine* engine, double timeoutSeconds);
+
+SBAudioEngineStats SB_GetAudioEngineStats(const SBAudioEngine* engine);
+SBAsioCapabilities SB_GetAudioEngineCapabilities(const SBAudioEngine* engine);	// control thread, as of the last clock change
+
+// Thread-safe; events are delivered on the audio thread inside the block they fall in.
+SBAudioScheduler* SB_GetAudioScheduler(SBAudioEngine* engine);
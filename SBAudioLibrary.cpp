@@ -0,0 +1,412 @@
+#include "SBAudioLibrary.h"
+#include "SBTaskGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cwctype>
+
+namespace
+{
+	constexpr uint32_t SBAudioLibraryMagic = 0x494C4253;	// 'SBLI' in memory
+	constexpr size_t SBAudioLibraryRetryBytes = 64 * 1024;
+	constexpr size_t SBAudioLibraryListBatch = 16;         	// directories per listing task
+
+#ifdef _WIN32
+	constexpr wchar_t SBPathSeparator = L'\\';
+#else
+	constexpr wchar_t SBPathSeparator = L'/';
+#endif
+
+	bool SB_IsPathSeparator(wchar_t character)
+	{
+#ifdef _WIN32
+		return character == L'\\' || character == L'/';
+#else
+		return character == L'/';
+#endif
+	}
+
+	std::wstring SB_TrimSeparators(std::wstring path)
+	{
+		while (path.size() > 1 && SB_IsPathSeparator(path.back()))
+			path.pop_back();
+		return path;
+	}
+
+	bool SB_IsWavName(const std::wstring& name)
+	{
+		const size_t dot = name.rfind(L'.');
+		if (dot == std::wstring::npos)
+			return false;
+		std::wstring extension = name.substr(dot + 1);
+		for (wchar_t& character : extension)
+			character = static_cast<wchar_t>(std::towlower(character));
+		return extension == L"wav" || extension == L"wave" || extension == L"bwf";
+	}
+
+	// byte order, as std::string sorts
+	int SB_CompareUtf8(const char* left, size_t leftLength, const char* right, size_t rightLength)
+	{
+		const int result = memcmp(left, right, std::min(leftLength, rightLength));
+		if (result != 0)
+			return result;
+		return leftLength < rightLength ? -1 : leftLength > rightLength ? 1 : 0;
+	}
+
+	struct SBScannedDirectory
+	{
+		std::wstring                 	path;
+		std::string                  	utf8;
+		std::vector<SBDirectoryEntry>	files;	// WAV named, sorted by UTF-8 name once listed
+		std::vector<std::string>     	names;
+	};
+}
+
+bool SBAudioLibrary::open(const std::wstring& path)
+{
+	close();
+	indexPath = path;
+	if (!file.open(path) || file.size() < sizeof(SBAudioLibraryHeader))
+	{
+		file.close();
+		return false;
+	}
+
+	const SBAudioLibraryHeader* mapped = reinterpret_cast<const SBAudioLibraryHeader*>(file.data());
+	const uint64_t expected = sizeof(SBAudioLibraryHeader) + static_cast<uint64_t>(mapped->directoryCount) * sizeof(SBAudioLibraryDirectory)
+		+ static_cast<uint64_t>(mapped->entryCount) * sizeof(SBAudioLibraryEntry) + mapped->stringBytes;
+	if (mapped->magic != SBAudioLibraryMagic || mapped->version != SB_AUDIO_LIBRARY_FORMAT_VERSION || mapped->stringBytes > file.size() || expected != file.size())
+	{
+		file.close();
+		return false;
+	}
+
+	// a damaged index is treated like an outdated one: every table must stay inside the file, or scan() rebuilds it
+	const SBAudioLibraryDirectory* mappedDirectories = reinterpret_cast<const SBAudioLibraryDirectory*>(mapped + 1);
+	const SBAudioLibraryEntry* mappedEntries = reinterpret_cast<const SBAudioLibraryEntry*>(mappedDirectories + mapped->directoryCount);
+	const uint64_t stringBytes = mapped->stringBytes;
+	auto inStrings = [stringBytes](uint64_t offset, uint64_t length) { return offset <= stringBytes && length <= stringBytes - offset; };
+	bool valid = true;
+	for (uint32_t index = 0; index < mapped->directoryCount && valid; ++index)
+	{
+		const SBAudioLibraryDirectory& directory = mappedDirectories[index];
+		valid = inStrings(directory.pathOffset, directory.pathLength) &&
+			static_cast<uint64_t>(directory.firstEntry) + directory.entryCount <= mapped->entryCount;
+	}
+	for (uint32_t index = 0; index < mapped->entryCount && valid; ++index)
+	{
+		const SBAudioLibraryEntry& entry = mappedEntries[index];
+		valid = entry.directory < mapped->directoryCount && inStrings(entry.nameOffset, entry.nameLength);
+	}
+	if (!valid)
+	{
+		file.close();
+		return false;
+	}
+
+	header = mapped;
+	directories = mappedDirectories;
+	entries = mappedEntries;
+	strings = reinterpret_cast<const char*>(entries + header->entryCount);
+	return true;
+}
+
+void SBAudioLibrary::close()
+{
+	file.close();
+	header = nullptr;
+	directories = nullptr;
+	entries = nullptr;
+	strings = nullptr;
+}
+
+std::wstring SBAudioLibrary::path(size_t index) const
+{
+	const SBAudioLibraryEntry& found = entries[index];
+	const SBAudioLibraryDirectory& directory = directories[found.directory];
+	std::wstring result = SB_PathFromUtf8(string(directory.pathOffset), directory.pathLength);
+	if (result.empty() || !SB_IsPathSeparator(result.back()))
+		result += SBPathSeparator;
+	return result + SB_PathFromUtf8(string(found.nameOffset), found.nameLength);
+}
+
+size_t SBAudioLibrary::findDirectory(const std::string& path) const
+{
+	const size_t count = header ? header->directoryCount : 0;
+	const SBAudioLibraryDirectory* found = std::lower_bound(directories, directories + count, path,
+		[this](const SBAudioLibraryDirectory& directory, const std::string& key)
+		{
+			return SB_CompareUtf8(string(directory.pathOffset), directory.pathLength, key.data(), key.size()) < 0;
+		});
+	if (found == directories + count || SB_CompareUtf8(string(found->pathOffset), found->pathLength, path.data(), path.size()) != 0)
+		return count;
+	return static_cast<size_t>(found - directories);
+}
+
+const SBAudioLibraryEntry* SBAudioLibrary::find(const std::wstring& path) const
+{
+	if (!header)
+		return nullptr;
+	size_t separator = path.size();
+	while (separator > 0 && !SB_IsPathSeparator(path[separator - 1]))
+		--separator;
+	if (separator == 0)
+		return nullptr;
+
+	const size_t directoryIndex = findDirectory(SB_Utf8FromPath(SB_TrimSeparators(path.substr(0, separator))));
+	if (directoryIndex == header->directoryCount)
+		return nullptr;
+	const SBAudioLibraryDirectory& directory = directories[directoryIndex];
+	const std::string name = SB_Utf8FromPath(path.substr(separator));
+	const SBAudioLibraryEntry* first = entries + directory.firstEntry;
+	const SBAudioLibraryEntry* last = first + directory.entryCount;
+	const SBAudioLibraryEntry* found = std::lower_bound(first, last, name,
+		[this](const SBAudioLibraryEntry& entry, const std::string& key)
+		{
+			return SB_CompareUtf8(string(entry.nameOffset), entry.nameLength, key.data(), key.size()) < 0;
+		});
+	if (found == last || SB_CompareUtf8(string(found->nameOffset), found->nameLength, name.data(), name.size()) != 0)
+		return nullptr;
+	return found;
+}
+
+size_t SBAudioLibrary::query(const SBAudioLibraryQuery& query, std::vector<size_t>& results) const
+{
+	results.clear();
+	if (!header)
+		return 0;
+
+	// the directories under a prefix are contiguous in path order
+	std::string prefix;
+	size_t firstDirectory = 0;
+	if (!query.directory.empty())
+	{
+		prefix = SB_Utf8FromPath(SB_TrimSeparators(query.directory));
+		firstDirectory = std::lower_bound(directories, directories + header->directoryCount, prefix,
+			[this](const SBAudioLibraryDirectory& directory, const std::string& key)
+			{
+				return SB_CompareUtf8(string(directory.pathOffset), directory.pathLength, key.data(), key.size()) < 0;
+			}) - directories;
+	}
+	for (size_t index = firstDirectory; index < header->directoryCount; ++index)
+	{
+		const SBAudioLibraryDirectory& directory = directories[index];
+		if (!prefix.empty())
+		{
+			const char* path = string(directory.pathOffset);
+			if (directory.pathLength < prefix.size() || memcmp(path, prefix.data(), prefix.size()) != 0)
+				break;
+			// "/a/b" is under "/a", "/ab" is not
+			if (directory.pathLength > prefix.size() && !SB_IsPathSeparator(static_cast<wchar_t>(path[prefix.size()]))
+				&& !SB_IsPathSeparator(static_cast<wchar_t>(prefix.back())))
+				continue;
+		}
+		for (size_t entryIndex = directory.firstEntry; entryIndex < directory.firstEntry + directory.entryCount; ++entryIndex)
+		{
+			const SBAudioLibraryEntry& candidate = entries[entryIndex];
+			if (!(candidate.flags & SBAudioLibraryEntry::Valid) || (query.decodableOnly && !(candidate.flags & SBAudioLibraryEntry::Decodable)))
+				continue;
+			if (candidate.sampleRate < query.minSampleRate || candidate.sampleRate > query.maxSampleRate
+				|| candidate.numChannels < query.minChannels || candidate.numChannels > query.maxChannels
+				|| (query.codec != SBWavAudioCodec::WAVE_FORMAT_UNKNOWN && candidate.codec != query.codec))
+				continue;
+			const double duration = candidate.duration();
+			if (duration < query.minSeconds || duration > query.maxSeconds)
+				continue;
+			results.push_back(entryIndex);
+		}
+	}
+	return results.size();
+}
+
+bool SBAudioLibrary::scan(const SBAudioLibraryScanSetup& setup, SBAudioLibraryScanStats* stats)
+{
+	if (indexPath.empty())
+		return false;
+	const auto start = std::chrono::steady_clock::now();
+	SBAudioLibraryScanStats counts;
+
+	// walk the trees a level at a time, every level listed in parallel
+	std::vector<SBScannedDirectory> scanned;
+	std::vector<std::wstring> level;
+	for (const std::wstring& root : setup.roots)
+		level.push_back(SB_TrimSeparators(root));
+	while (!level.empty())
+	{
+		std::vector<SBScannedDirectory> listed(level.size());
+		std::vector<std::vector<std::wstring>> subdirectories(level.size());
+		SBTaskGraph listing;
+		for (size_t first = 0; first < level.size(); first += SBAudioLibraryListBatch)
+		{
+			listing.add("list", [&, first]()
+			{
+				std::vector<SBDirectoryEntry> found;
+				for (size_t index = first; index < std::min(first + SBAudioLibraryListBatch, level.size()); ++index)
+				{
+					SBScannedDirectory& directory = listed[index];
+					directory.path = level[index];
+					directory.utf8 = SB_Utf8FromPath(directory.path);
+					SB_ListDirectory(directory.path, found);
+					const bool separated = !directory.path.empty() && SB_IsPathSeparator(directory.path.back());
+					for (SBDirectoryEntry& entry : found)
+					{
+						if (entry.directory)
+							subdirectories[index].push_back(directory.path + (separated ? L"" : std::wstring(1, SBPathSeparator)) + entry.name);
+						else if (SB_IsWavName(entry.name))
+							directory.files.push_back(std::move(entry));
+					}
+					directory.names.reserve(directory.files.size());
+					for (const SBDirectoryEntry& entry : directory.files)
+						directory.names.push_back(SB_Utf8FromPath(entry.name));
+				}
+				return true;
+			});
+		}
+		listing.run(setup.threadCount);
+		level.clear();
+		for (size_t index = 0; index < listed.size(); ++index)
+		{
+			level.insert(level.end(), subdirectories[index].begin(), subdirectories[index].end());
+			scanned.push_back(std::move(listed[index]));
+		}
+	}
+	std::sort(scanned.begin(), scanned.end(), [](const SBScannedDirectory& left, const SBScannedDirectory& right) { return left.utf8 < right.utf8; });
+	scanned.erase(std::unique(scanned.begin(), scanned.end(), [](const SBScannedDirectory& left, const SBScannedDirectory& right) { return left.utf8 == right.utf8; }), scanned.end());	// overlapping roots
+	counts.directories = scanned.size();
+
+	// the new index, unchanged files copied from the current one
+	std::vector<SBAudioLibraryDirectory> newDirectories;
+	std::vector<SBAudioLibraryEntry> newEntries;
+	std::string newStrings;
+	std::vector<std::pair<size_t, std::wstring>> changed;	// entry, path
+	size_t kept = 0;
+	for (SBScannedDirectory& directory : scanned)
+	{
+		if (directory.files.empty())
+			continue;
+		std::vector<size_t> order(directory.files.size());
+		for (size_t index = 0; index < order.size(); ++index)
+			order[index] = index;
+		std::sort(order.begin(), order.end(), [&](size_t left, size_t right) { return directory.names[left] < directory.names[right]; });
+
+		SBAudioLibraryDirectory record = {};
+		record.pathOffset = newStrings.size();
+		record.pathLength = static_cast<uint32_t>(directory.utf8.size());
+		record.firstEntry = static_cast<uint32_t>(newEntries.size());
+		record.entryCount = static_cast<uint32_t>(order.size());
+		newStrings += directory.utf8;
+		const std::wstring prefix = directory.path + (SB_IsPathSeparator(directory.path.back()) ? L"" : std::wstring(1, SBPathSeparator));
+
+		// both sides sorted by name: the previous entries are walked along
+		const SBAudioLibraryEntry* previous = nullptr;
+		const SBAudioLibraryEntry* previousEnd = nullptr;
+		const size_t previousDirectory = findDirectory(directory.utf8);
+		if (header && previousDirectory < header->directoryCount)
+		{
+			previous = entries + directories[previousDirectory].firstEntry;
+			previousEnd = previous + directories[previousDirectory].entryCount;
+		}
+
+		for (size_t index : order)
+		{
+			const SBDirectoryEntry& file = directory.files[index];
+			const std::string& name = directory.names[index];
+			while (previous != previousEnd && SB_CompareUtf8(string(previous->nameOffset), previous->nameLength, name.data(), name.size()) < 0)
+				++previous;
+			const bool indexed = previous != previousEnd && SB_CompareUtf8(string(previous->nameOffset), previous->nameLength, name.data(), name.size()) == 0;
+			SBAudioLibraryEntry entry = {};
+			if (indexed)
+				++kept;
+			if (indexed && previous->size == file.info.size && previous->modifiedTime == file.info.modifiedTime)
+			{
+				entry = *previous;
+				++counts.reused;
+			}
+			else
+			{
+				entry.size = file.info.size;
+				entry.modifiedTime = file.info.modifiedTime;
+				changed.emplace_back(newEntries.size(), prefix + file.name);
+			}
+			entry.directory = static_cast<uint32_t>(newDirectories.size());
+			entry.nameOffset = newStrings.size();
+			entry.nameLength = static_cast<uint16_t>(directory.names[index].size());
+			newStrings += directory.names[index];
+			newEntries.push_back(entry);
+		}
+		newDirectories.push_back(record);
+	}
+	counts.files = newEntries.size();
+	counts.removed = size() - kept;
+	counts.read = changed.size();
+
+	// new and changed files: headers from the first bytes only, in batches sharing one read buffer
+	std::atomic<size_t> invalid = { 0 };
+	SBTaskGraph reading;
+	const size_t batchFiles = std::max<size_t>(setup.batchFiles, 1);
+	for (size_t first = 0; first < changed.size(); first += batchFiles)
+	{
+		reading.add("read", [&, first]()
+		{
+			std::vector<char> head(std::max<size_t>(setup.headBytes, 64));
+			for (size_t index = first; index < std::min(first + batchFiles, changed.size()); ++index)
+			{
+				SBAudioLibraryEntry& entry = newEntries[changed[index].first];
+				SBWavInfo info;
+				size_t count = SB_ReadFileHead(changed[index].second, head.data(), head.size());
+				bool parsed = SB_ReadWavHeader(head.data(), count, entry.size, info);
+				if (!parsed && count == head.size() && entry.size > count)
+				{
+					// large chunks ahead of the data (bext, iXML, pictures)
+					std::vector<char> larger(std::max(SBAudioLibraryRetryBytes, head.size()));
+					count = SB_ReadFileHead(changed[index].second, larger.data(), larger.size());
+					parsed = SB_ReadWavHeader(larger.data(), count, entry.size, info);
+				}
+				if (!parsed)
+				{
+					invalid.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+				entry.frameCount = info.frameCount;
+				entry.sampleRate = info.format.sampleRate;
+				entry.channelMask = info.channelMask;
+				entry.numChannels = info.format.numChannels;
+				entry.bitsPerSample = info.format.bitsPerSample;
+				entry.codec = info.sampleCodec;
+				entry.flags = SBAudioLibraryEntry::Valid | (info.decodable() ? SBAudioLibraryEntry::Decodable : 0);
+			}
+			return true;
+		});
+	}
+	reading.run(setup.threadCount);
+	counts.invalid = invalid.load();
+
+	SBAudioLibraryHeader newHeader = {};
+	newHeader.magic = SBAudioLibraryMagic;
+	newHeader.version = SB_AUDIO_LIBRARY_FORMAT_VERSION;
+	newHeader.directoryCount = static_cast<uint32_t>(newDirectories.size());
+	newHeader.entryCount = static_cast<uint32_t>(newEntries.size());
+	newHeader.stringBytes = newStrings.size();
+	std::vector<char> image(sizeof(newHeader) + newDirectories.size() * sizeof(SBAudioLibraryDirectory)
+		+ newEntries.size() * sizeof(SBAudioLibraryEntry) + newStrings.size());
+	char* output = image.data();
+	memcpy(output, &newHeader, sizeof(newHeader));
+	output += sizeof(newHeader);
+	memcpy(output, newDirectories.data(), newDirectories.size() * sizeof(SBAudioLibraryDirectory));
+	output += newDirectories.size() * sizeof(SBAudioLibraryDirectory);
+	memcpy(output, newEntries.data(), newEntries.size() * sizeof(SBAudioLibraryEntry));
+	output += newEntries.size() * sizeof(SBAudioLibraryEntry);
+	memcpy(output, newStrings.data(), newStrings.size());
+
+	// a mapped file cannot be replaced on Windows
+	const std::wstring path = indexPath;
+	close();
+	const bool written = SB_WriteFileAtomically(path, image.data(), image.size());
+	const bool opened = open(path);
+	counts.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (stats)
+		*stats = counts;
+	return written && opened;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "SBFile.h"
+#include "src/SBWav.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+static constexpr uint32_t SB_AUDIO_LIBRARY_FORMAT_VERSION = 1;
+
+// Index file layout: header, directories[directoryCount], entries[entryCount], then UTF-8 strings.
+// Directories are sorted by path, the entries of each one are contiguous and sorted by name.
+struct SBAudioLibraryHeader
+{
+	uint32_t	magic;         	// 'SBLI'
+	uint32_t	version;       	// SB_AUDIO_LIBRARY_FORMAT_VERSION
+	uint32_t	directoryCount;
+	uint32_t	entryCount;
+	uint64_t	stringBytes;
+};
+static_assert(sizeof(SBAudioLibraryHeader) == 24, "SBAudioLibraryHeader must stay packed for the binary format");
+
+struct SBAudioLibraryDirectory
+{
+	uint64_t	pathOffset;	// into the strings
+	uint32_t	pathLength;
+	uint32_t	firstEntry;
+	uint32_t	entryCount;
+	uint32_t	reserved;
+};
+static_assert(sizeof(SBAudioLibraryDirectory) == 24, "SBAudioLibraryDirectory must stay packed for the binary format");
+
+struct SBAudioLibraryEntry
+{
+	enum Flags : uint16_t
+	{
+		Valid = 1,    	// a WAV header was found; without it only the file identity is kept, so it is not read again
+		Decodable = 2,	// SBWavInfo::decodable()
+	};
+
+	uint64_t       	size;        	// SBFileInfo when indexed, a rescan only reads files where it changed
+	int64_t        	modifiedTime;
+	uint64_t       	frameCount;
+	uint64_t       	nameOffset;  	// into the strings
+	uint32_t       	directory;
+	uint32_t       	sampleRate;
+	uint32_t       	channelMask; 	// WAVE_FORMAT_EXTENSIBLE speaker positions, 0 when not given
+	uint16_t       	nameLength;
+	uint16_t       	numChannels;
+	uint16_t       	bitsPerSample;
+	SBWavAudioCodec	codec;       	// WAVE_FORMAT_EXTENSIBLE resolved
+	uint16_t       	flags;
+	uint16_t       	reserved;
+
+	double duration() const { return sampleRate ? static_cast<double>(frameCount) / sampleRate : 0.0; }
+};
+static_assert(sizeof(SBAudioLibraryEntry) == 56, "SBAudioLibraryEntry must stay packed for the binary format");
+
+struct SBAudioLibraryScanSetup
+{
+	std::vector<std::wstring>	roots;            	// directory trees to index
+	size_t                   	threadCount = 0;  	// 0: SBTaskGraph default, scans mostly wait on the disk
+	size_t                   	headBytes = 4096; 	// read per file, retried once with 64 KB when the headers run past it
+	size_t                   	batchFiles = 256; 	// files per task
+};
+
+struct SBAudioLibraryScanStats
+{
+	size_t	directories = 0;
+	size_t	files = 0;   	// WAV named files found
+	size_t	reused = 0;  	// unchanged since the previous index, not opened
+	size_t	read = 0;    	// new or changed, headers parsed
+	size_t	invalid = 0; 	// read but not a WAV
+	size_t	removed = 0; 	// in the previous index, gone now
+	double	seconds = 0.0;
+};
+
+struct SBAudioLibraryQuery
+{
+	std::wstring   	directory;                	// only files under it, empty: everywhere
+	uint32_t       	minSampleRate = 0;
+	uint32_t       	maxSampleRate = std::numeric_limits<uint32_t>::max();
+	uint16_t       	minChannels = 0;
+	uint16_t       	maxChannels = std::numeric_limits<uint16_t>::max();
+	SBWavAudioCodec	codec = SBWavAudioCodec::WAVE_FORMAT_UNKNOWN;	// unknown: any
+	double         	minSeconds = 0.0;
+	double         	maxSeconds = std::numeric_limits<double>::infinity();
+	bool           	decodableOnly = true;
+};
+
+// Catalogue of WAV files, memory-mapped from its index file.
+//
+// scan() walks the roots with a thread pool, stats every file through the directory listing and only opens the
+// new or changed ones, reading their first headBytes; the index is then rewritten next to the previous one and
+// mapped again. Lookups binary search the mapping: no parsing and no allocation but the path conversion.
+class SBAudioLibrary
+{
+public:
+	SBAudioLibrary() = default;
+	SBAudioLibrary(const SBAudioLibrary&) = delete;
+	SBAudioLibrary& operator=(const SBAudioLibrary&) = delete;
+
+	bool open(const std::wstring& indexPath);	// false when there is no valid index yet; scan() creates it
+	void close();
+	bool scan(const SBAudioLibraryScanSetup& setup, SBAudioLibraryScanStats* stats = nullptr);
+
+	size_t size() const { return header ? header->entryCount : 0; }
+	const SBAudioLibraryEntry& entry(size_t index) const { return entries[index]; }
+	std::wstring path(size_t index) const;
+
+	const SBAudioLibraryEntry* find(const std::wstring& path) const;	// nullptr when not indexed
+	size_t query(const SBAudioLibraryQuery& query, std::vector<size_t>& results) const;	// entry indices, in path order
+
+private:
+	const char* string(uint64_t offset) const { return strings + offset; }
+	size_t findDirectory(const std::string& path) const;	// directoryCount when not indexed
+
+	std::wstring                  	indexPath;
+	SBMappedFile                  	file;
+	const SBAudioLibraryHeader*   	header = nullptr;
+	const SBAudioLibraryDirectory*	directories = nullptr;
+	const SBAudioLibraryEntry*    	entries = nullptr;
+	const char*                   	strings = nullptr;
+};
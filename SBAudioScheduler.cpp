@@ -0,0 +1,98 @@
+#include "SBAudioScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+//
+// SBAudioTimeline
+//
+int64_t SBAudioTimeline::samplesFromSystemTime(int64_t nanoseconds) const
+{
+	const double elapsed = static_cast<double>(nanoseconds - systemTime) * 1e-9;
+	return samplePosition + std::llround(elapsed * sampleRate * speed);
+}
+
+int64_t SBAudioTimeline::samplesFromTicks(int64_t ticks) const
+{
+	const double samplesPerTick = 60.0 * sampleRate / (tempo * SB_AUDIO_TICKS_PER_BEAT);
+	return tempoOriginSample + std::llround(static_cast<double>(ticks - tempoOriginTicks) * samplesPerTick);
+}
+
+int64_t SBAudioTimeline::ticksFromSamples(int64_t samples) const
+{
+	const double ticksPerSample = tempo * SB_AUDIO_TICKS_PER_BEAT / (60.0 * sampleRate);
+	return tempoOriginTicks + std::llround(static_cast<double>(samples - tempoOriginSample) * ticksPerSample);
+}
+
+int64_t SBAudioTimeline::resolve(const SBAudioEvent& event) const
+{
+	switch (event.timebase)
+	{
+	case SBAudioTimebase::Samples:    return event.time;
+	case SBAudioTimebase::SystemTime: return samplesFromSystemTime(event.time);
+	case SBAudioTimebase::Ticks:      return samplesFromTicks(event.time);
+	case SBAudioTimebase::Immediate:
+	default:                          return samplePosition;
+	}
+}
+
+//
+// SBAudioScheduler
+//
+SBAudioScheduler::SBAudioScheduler(size_t capacity)
+	: incoming(capacity)
+{
+	pending.reserve(incoming.capacity());
+	blockEvents.reserve(incoming.capacity());
+}
+
+bool SBAudioScheduler::schedule(const SBAudioEvent& event)
+{
+	return incoming.push(event);
+}
+
+void SBAudioScheduler::beginBlock(const SBAudioTimeline& timeline, long frameCount)
+{
+	// Tempo is owned by the scheduler (changed through Tempo events), everything else follows the driver.
+	const double tempo = currentTimeline.tempo;
+	const int64_t tempoOriginSample = currentTimeline.tempoOriginSample;
+	const int64_t tempoOriginTicks = currentTimeline.tempoOriginTicks;
+	currentTimeline = timeline;
+	currentTimeline.tempo = tempo;
+	currentTimeline.tempoOriginSample = tempoOriginSample;
+	currentTimeline.tempoOriginTicks = tempoOriginTicks;
+
+	// Drain producers; stop when the heap is full, remaining events stay queued for the next block.
+	SBAudioEvent event;
+	while (pending.size() < pending.capacity() && incoming.pop(event))
+	{
+		pending.push_back({ currentTimeline.resolve(event), order++, event });
+		std::push_heap(pending.begin(), pending.end());
+	}
+
+	// Slice everything due before the end of this block; late events land on the first frame.
+	blockEvents.clear();
+	const int64_t blockEnd = currentTimeline.samplePosition + frameCount;
+	while (!pending.empty() && pending.front().samplePosition < blockEnd)
+	{
+		std::pop_heap(pending.begin(), pending.end());
+		const PendingEvent& due = pending.back();
+		const long offset = static_cast<long>(std::max<int64_t>(due.samplePosition - currentTimeline.samplePosition, 0));
+		blockEvents.push_back({ offset, due.event });
+		if (due.event.type == SBAudioEventType::Tempo && due.event.value > 0.0f)
+		{
+			const int64_t position = currentTimeline.samplePosition + offset;
+			currentTimeline.tempoOriginTicks = currentTimeline.ticksFromSamples(position);
+			currentTimeline.tempoOriginSample = position;
+			currentTimeline.tempo = due.event.value;
+		}
+		pending.pop_back();
+	}
+}
+
+void SBAudioScheduler::setTempo(const SBAudioTimeline& tempoMap)
+{
+	currentTimeline.tempo = tempoMap.tempo;
+	currentTimeline.tempoOriginSample = tempoMap.tempoOriginSample;
+	currentTimeline.tempoOriginTicks = tempoMap.tempoOriginTicks;
+}
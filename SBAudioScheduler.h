@@ -0,0 +1,109 @@
+#pragma once
+
+#include "SBLockFreeQueue.h"
+
+#include <vector>
+#include <cstdint>
+
+// Musical time resolution (960 PPQ, refined so slow tempos still resolve to single samples).
+static constexpr int64_t SB_AUDIO_TICKS_PER_BEAT = 960 * 1024;
+
+enum class SBAudioTimebase : uint32_t
+{
+	Immediate = 0,	// first frame of the next block
+	Samples,      	// absolute sample position (ASIOSamples)
+	SystemTime,   	// wall-clock, in nanoseconds (same clock as AsioTimeInfo::systemTime)
+	Ticks,        	// musical time, in SB_AUDIO_TICKS_PER_BEAT units
+};
+
+enum class SBAudioEventType : uint32_t
+{
+	Parameter = 0,	// target: parameter id, value: new value
+	Trigger,      	// target: voice/sample id, value: velocity
+	Tempo,        	// value: beats per minute; also applied to the timeline by the scheduler
+	User = 0x100, 	// first application defined type
+};
+
+struct SBAudioEvent
+{
+	int64_t         	time = 0;	// in timebase units
+	SBAudioTimebase 	timebase = SBAudioTimebase::Immediate;
+	SBAudioEventType	type = SBAudioEventType::Parameter;
+	uint32_t        	target = 0;
+	float           	value = 0.0f;
+	uint64_t        	payload = 0;
+};
+
+struct SBAudioBlockEvent
+{
+	long        	offset;	// frame offset inside the current block
+	SBAudioEvent	event;
+};
+
+struct SBAudioEventSlice
+{
+	const SBAudioBlockEvent*	events = nullptr;	// sorted by offset, then by scheduling order
+	size_t                  	count = 0;
+
+	const SBAudioBlockEvent* begin() const { return events; }
+	const SBAudioBlockEvent* end() const { return events + count; }
+};
+
+// Maps the different timebases to sample positions for the current block.
+// Anchored on every buffer switch from ASIOTime (samplePosition/systemTime pair).
+struct SBAudioTimeline
+{
+	int64_t	samplePosition = 0;	// first frame of the current block
+	int64_t	systemTime = 0;    	// nanoseconds, matching samplePosition
+	double 	sampleRate = 0.0;
+	double 	speed = 1.0;
+
+	double 	tempo = 120.0;        	// beats per minute
+	int64_t	tempoOriginSample = 0;	// sample position where tempoOriginTicks was reached
+	int64_t	tempoOriginTicks = 0;
+
+	int64_t samplesFromSystemTime(int64_t nanoseconds) const;
+	int64_t samplesFromTicks(int64_t ticks) const;
+	int64_t ticksFromSamples(int64_t samples) const;
+	int64_t resolve(const SBAudioEvent& event) const;
+};
+
+// Turns timestamped events posted from any thread into per-block, sample accurate slices.
+// Producers push into a bounded lock-free queue; the audio thread drains it into a
+// preallocated heap ordered by resolved sample position, so nothing allocates in the callback.
+// Musical (Ticks) timestamps are resolved with the tempo in effect when the event is drained.
+class SBAudioScheduler
+{
+public:
+	explicit SBAudioScheduler(size_t capacity = 4096);
+	SBAudioScheduler(const SBAudioScheduler&) = delete;
+	SBAudioScheduler& operator=(const SBAudioScheduler&) = delete;
+
+	// any thread; returns false when the queue is full
+	bool schedule(const SBAudioEvent& event);
+
+	// audio thread only
+	void beginBlock(const SBAudioTimeline& timeline, long frameCount);
+	SBAudioEventSlice dueEvents() const { return { blockEvents.data(), blockEvents.size() }; }
+	const SBAudioTimeline& timeline() const { return currentTimeline; }
+	void setTempo(const SBAudioTimeline& tempoMap);	// tempo and its origin from tempoMap, e.g. to resume a recorded session
+
+private:
+	struct PendingEvent
+	{
+		int64_t     	samplePosition;
+		uint64_t    	order;
+		SBAudioEvent	event;
+
+		bool operator <(const PendingEvent& other) const	// max-heap comparator, earliest first
+		{
+			return samplePosition != other.samplePosition ? samplePosition > other.samplePosition : order > other.order;
+		}
+	};
+
+	SBLockFreeQueue<SBAudioEvent>	incoming;
+	std::vector<PendingEvent>    	pending;
+	std::vector<SBAudioBlockEvent>	blockEvents;
+	SBAudioTimeline              	currentTimeline;
+	uint64_t                     	order = 0;
+};
@@ -0,0 +1,198 @@
+#include "SBCapture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+bool SBCapture::start(const SBCaptureSetup& captureSetup)
+{
+	stop();
+	if (captureSetup.numChannels == 0 || captureSetup.sampleRate == 0 || captureSetup.path.empty())
+		return false;
+	setup = captureSetup;
+
+	paths.clear();
+	if (setup.layout == SBCaptureLayout::PolyWav)
+		paths.push_back(setup.path);
+	else
+	{
+		for (uint16_t channel = 0; channel < setup.numChannels; ++channel)
+			paths.push_back(setup.path + L"_" + std::to_wstring(channel + 1) + L".wav");
+	}
+	const uint16_t channelsPerFile = setup.layout == SBCaptureLayout::PolyWav ? setup.numChannels : 1;
+	for (size_t index = 0; index < paths.size(); ++index)
+	{
+		writers.emplace_back(new SBWavWriter);
+		writers.back()->setDither(setup.dither, static_cast<uint32_t>(index));
+		if (!writers.back()->open(paths[index], channelsPerFile, setup.sampleRate, setup.sampleFormat, true))
+		{
+			discardFiles(index);
+			return false;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(overviewMutex);
+		overviews.assign(setup.overviews ? paths.size() : 0, SBOverview());
+		for (SBOverview& overview : overviews)
+			overview.reset(channelsPerFile, setup.sampleRate);
+	}
+
+	// allocated (and touched) up front, the audio thread never faults a page in
+	const size_t ringFrames = SB_RoundUpToPowerOfTwo(static_cast<size_t>(std::max(setup.bufferSeconds, 0.01) * setup.sampleRate));
+	rings.assign(setup.numChannels, std::vector<float>(ringFrames, 0.0f));
+	ringMask = ringFrames - 1;
+	writeFrames = std::min(std::max<size_t>(static_cast<size_t>(setup.writeSeconds * setup.sampleRate), 1), ringFrames / 2);
+	views.assign(setup.numChannels, nullptr);
+	failed = false;
+	writeIndex.store(0, std::memory_order_relaxed);
+	readIndex.store(0, std::memory_order_relaxed);
+	dropped.store(0, std::memory_order_relaxed);
+	peak.store(0, std::memory_order_relaxed);
+	stopping.store(false, std::memory_order_relaxed);
+
+	SBThreadSetup threadSetup;
+	threadSetup.name = "Capture";
+	threadSetup.priority = SBThreadPriority::High;
+	if (!writer.start(threadSetup, [this]() { run(); }))
+	{
+		discardFiles(paths.size());
+		rings.clear();
+		return false;
+	}
+	accepting.store(true, std::memory_order_seq_cst);
+	return true;
+}
+
+// A take that could not start leaves no files behind: the first openedCount were created empty by start().
+void SBCapture::discardFiles(size_t openedCount)
+{
+	writers.clear();
+	for (size_t index = 0; index < openedCount && index < paths.size(); ++index)
+		SB_DeleteFile(paths[index]);
+}
+
+bool SBCapture::stop()
+{
+	if (writers.empty())
+		return false;
+
+	// pushing/accepting pair up so that no push is in flight once accepting is seen false
+	accepting.store(false, std::memory_order_seq_cst);
+	while (pushing.load(std::memory_order_seq_cst))
+		std::this_thread::yield();
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+
+	bool succeeded = !failed;
+	for (size_t index = 0; index < writers.size(); ++index)
+	{
+		succeeded = writers[index]->close() && succeeded;
+		if (index < overviews.size())
+			succeeded = overviews[index].save(SB_OverviewPath(paths[index]), SB_GetFileInfo(paths[index])) && succeeded;
+	}
+	writers.clear();
+	rings.clear();
+	return succeeded;
+}
+
+bool SBCapture::push(const float* const* channels, long numChannels, long frameCount)
+{
+	pushing.store(true, std::memory_order_seq_cst);
+	if (!accepting.load(std::memory_order_seq_cst) || frameCount <= 0)
+	{
+		pushing.store(false, std::memory_order_release);
+		return false;
+	}
+
+	const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	const uint64_t fill = write + frameCount - readIndex.load(std::memory_order_acquire);
+	if (fill > ringMask + 1)
+	{
+		dropped.fetch_add(static_cast<uint64_t>(frameCount), std::memory_order_relaxed);
+		pushing.store(false, std::memory_order_release);
+		return false;
+	}
+
+	const size_t start = static_cast<size_t>(write) & ringMask;
+	const size_t first = std::min<size_t>(frameCount, ringMask + 1 - start);
+	for (size_t channel = 0; channel < rings.size(); ++channel)
+	{
+		float* ring = rings[channel].data();
+		if (static_cast<long>(channel) < numChannels && channels[channel])
+		{
+			memcpy(ring + start, channels[channel], first * sizeof(float));
+			memcpy(ring, channels[channel] + first, (frameCount - first) * sizeof(float));
+		}
+		else
+		{
+			std::fill_n(ring + start, first, 0.0f);
+			std::fill_n(ring, frameCount - first, 0.0f);
+		}
+	}
+	writeIndex.store(write + frameCount, std::memory_order_release);
+	if (fill > peak.load(std::memory_order_relaxed))
+		peak.store(fill, std::memory_order_relaxed);
+	pushing.store(false, std::memory_order_release);
+	return true;
+}
+
+size_t SBCapture::queryOverview(size_t file, uint16_t channel, uint64_t firstFrame, uint64_t lastFrame, size_t pixelCount, SBOverviewBin* pixels) const
+{
+	std::lock_guard<std::mutex> lock(overviewMutex);
+	if (file >= overviews.size())
+	{
+		std::fill_n(pixels, pixelCount, SBOverviewBin{ 0.0f, 0.0f, 0.0f });
+		return 0;
+	}
+	return overviews[file].query(channel, firstFrame, lastFrame, pixelCount, pixels);
+}
+
+double SBCapture::peakFill() const
+{
+	return static_cast<double>(peak.load(std::memory_order_relaxed)) / static_cast<double>(ringMask + 1);	// last take after stop()
+}
+
+void SBCapture::run()
+{
+	const auto interval = std::chrono::milliseconds(std::max(static_cast<long>(setup.writeSeconds * 250.0), 5l));
+	while (!stopping.load(std::memory_order_acquire))
+	{
+		drain(false);
+		std::this_thread::sleep_for(interval);
+	}
+	drain(true);	// no push can happen anymore
+}
+
+bool SBCapture::drain(bool all)
+{
+	for (;;)
+	{
+		const uint64_t read = readIndex.load(std::memory_order_relaxed);
+		const uint64_t available = writeIndex.load(std::memory_order_acquire) - read;
+		if (available == 0 || (!all && available < writeFrames))
+			break;
+
+		// up to the end of the ring; a wrapped batch takes two writes
+		const size_t start = static_cast<size_t>(read) & ringMask;
+		const size_t frameCount = static_cast<size_t>(std::min<uint64_t>(available, ringMask + 1 - start));
+		for (size_t channel = 0; channel < rings.size(); ++channel)
+			views[channel] = rings[channel].data() + start;
+		if (!failed)
+		{
+			const size_t channelsPerFile = rings.size() / writers.size();
+			for (size_t index = 0; index < writers.size() && !failed; ++index)
+				failed = !writers[index]->write(views.data() + index * channelsPerFile, frameCount);
+			if (!failed && !overviews.empty())
+			{
+				std::lock_guard<std::mutex> lock(overviewMutex);
+				for (size_t index = 0; index < overviews.size(); ++index)
+					overviews[index].append(views.data() + index * channelsPerFile, frameCount);
+			}
+		}
+		// consumed even after a failure, the audio thread must keep going
+		readIndex.store(read + frameCount, std::memory_order_release);
+	}
+	return !failed;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "SBLockFreeQueue.h"
+#include "SBOverview.h"
+#include "SBThread.h"
+#include "src/SBWav.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+enum class SBCaptureLayout
+{
+	PolyWav = 0, 	// one interleaved file with every channel
+	ChannelFiles,	// one mono file per channel
+};
+
+struct SBCaptureSetup
+{
+	std::wstring     	path;                	// PolyWav: the file; ChannelFiles: prefix of <path>_<channel, from 1>.wav
+	uint16_t         	numChannels = 0;
+	uint32_t         	sampleRate = 48000;
+	SBWavSampleFormat	sampleFormat = SBWavSampleFormat::Int24;
+	SBDitherSetup    	dither;              	// Int16 and Int24
+	SBCaptureLayout  	layout = SBCaptureLayout::PolyWav;
+	double           	bufferSeconds = 4.0; 	// ring length: the longest disk stall absorbed without losing input
+	double           	writeSeconds = 0.25; 	// audio gathered before each write
+	bool             	overviews = true;    	// peak file next to every WAV (SB_OverviewPath), updated as it is written
+};
+
+// Records audio thread blocks to disk.
+//
+// push() only copies planar blocks into per-channel rings sharing single-producer/single-consumer indices;
+// a writer thread wakes up periodically, converts whatever reached writeSeconds to the target format and writes
+// it in one call per file. Files are opened with RF64 room, so long multitrack takes are not cut at 4 GB.
+// When the rings are full, whole blocks are dropped and counted rather than blocking the audio thread.
+class SBCapture
+{
+public:
+	SBCapture() = default;
+	SBCapture(const SBCapture&) = delete;
+	SBCapture& operator=(const SBCapture&) = delete;
+	~SBCapture() { stop(); }
+
+	// control thread
+	bool start(const SBCaptureSetup& setup);	// opens the files and starts the writer
+	bool stop();                            	// writes what is left and closes; false if anything failed
+	bool recording() const { return accepting.load(std::memory_order_relaxed); }
+
+	// audio thread; channels beyond numChannels are ignored, missing ones recorded as silence
+	bool push(const float* const* channels, long numChannels, long frameCount);
+
+	uint64_t capturedFrames() const { return writeIndex.load(std::memory_order_relaxed); }
+	uint64_t writtenFrames() const { return readIndex.load(std::memory_order_relaxed); }
+	uint64_t droppedFrames() const { return dropped.load(std::memory_order_relaxed); }
+	double peakFill() const;	// highest ring occupancy seen, 0 to 1
+
+	// any thread, during or after the take: SBOverview::query on what was written to file (0 with PolyWav)
+	size_t queryOverview(size_t file, uint16_t channel, uint64_t firstFrame, uint64_t lastFrame, size_t pixelCount, SBOverviewBin* pixels) const;
+
+private:
+	void run();
+	bool drain(bool all);
+	void discardFiles(size_t openedCount);
+
+	SBCaptureSetup                          	setup;
+	std::vector<std::unique_ptr<SBWavWriter>>	writers;
+	std::vector<std::wstring>               	paths;
+	std::vector<SBOverview>                 	overviews; 	// one per file
+	mutable std::mutex                      	overviewMutex;
+	std::vector<std::vector<float>>         	rings;     	// one per channel, power of two frames
+	size_t                                  	ringMask = 0;
+	size_t                                  	writeFrames = 0;
+	std::vector<const float*>               	views;     	// writer thread scratch
+	SBThread                                	writer;
+	bool                                    	failed = false;	// writer thread, read after join
+
+	std::atomic<bool>                       	accepting = { false };
+	std::atomic<bool>                       	pushing = { false };
+	std::atomic<bool>                       	stopping = { false };
+	char                                    	padding0[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t>                   	writeIndex = { 0 };	// frames, audio thread
+	std::atomic<uint64_t>                   	dropped = { 0 };
+	std::atomic<uint64_t>                   	peak = { 0 };
+	char                                    	padding1[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t>                   	readIndex = { 0 };	// frames, writer thread
+};
@@ -0,0 +1,292 @@
+#include "SBConvolver.h"
+#include "SBFFT.h"
+#include "src/SBWav.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Taps [offset, offset + partitions * size) of the response, uniformly partitioned.
+// Block n of the stage output (before the offset delay) is computed from input blocks n and earlier,
+// and is heard from position n * size + offset.
+class SBConvolverStage
+{
+public:
+	SBConvolverStage(const float* response, size_t length, long partitionSize, int64_t stageOffset, long blockSize)
+		: size(partitionSize), offset(stageOffset), fft(2 * static_cast<size_t>(partitionSize)),
+		partitions(std::max<size_t>((length - static_cast<size_t>(stageOffset) + partitionSize - 1) / partitionSize, 1)),
+		spectrum(2 * static_cast<size_t>(partitionSize)), accumulator(partitionSize + 1),
+		input(SB_RoundUpToPowerOfTwo(static_cast<size_t>(stageOffset) + 3 * partitionSize + blockSize), 0.0f),
+		outputBlocks(static_cast<size_t>((stageOffset + blockSize) / partitionSize) + 3)
+	{
+		// length is where the stage ends in the response
+		const size_t bins = size + 1;
+		filter.resize(partitions * bins);
+		history.assign(partitions * bins, SBComplex());
+		results.assign(outputBlocks * size, 0.0f);
+		for (size_t partition = 0; partition < partitions; ++partition)
+		{
+			std::fill(spectrum.begin(), spectrum.end(), SBComplex());
+			const size_t first = static_cast<size_t>(offset) + partition * size;
+			const size_t count = std::min<size_t>(size, length > first ? length - first : 0);
+			for (size_t tap = 0; tap < count; ++tap)
+				spectrum[tap] = SBComplex(response[first + tap], 0.0f);
+			fft.forward(spectrum.data());
+			std::copy(spectrum.begin(), spectrum.begin() + bins, filter.begin() + partition * bins);
+		}
+		inputMask = input.size() - 1;
+	}
+
+	// audio thread
+	void write(const float* samples, long frameCount, int64_t position)
+	{
+		for (long frame = 0; frame < frameCount; ++frame)
+			input[static_cast<size_t>(position + frame) & inputMask] = samples[frame];
+	}
+
+	const float* output(int64_t blockIndex) const
+	{
+		return results.data() + static_cast<size_t>(blockIndex % static_cast<int64_t>(outputBlocks)) * size;
+	}
+
+	// only ever runs on one thread at a time, in block order
+	void runPending()
+	{
+		for (;;)
+		{
+			if (busy.exchange(true, std::memory_order_acquire))
+				return;	// whoever holds it picks up the new blocks
+			int64_t blockIndex = completed.load(std::memory_order_relaxed);
+			while (blockIndex < submitted.load(std::memory_order_acquire))
+			{
+				compute(blockIndex);
+				completed.store(++blockIndex, std::memory_order_release);
+			}
+			busy.store(false, std::memory_order_release);
+			// a block submitted between the last check and the release may have been dropped by another thread
+			if (completed.load(std::memory_order_relaxed) >= submitted.load(std::memory_order_acquire))
+				return;
+		}
+	}
+
+	void reset()
+	{
+		std::fill(input.begin(), input.end(), 0.0f);
+		std::fill(history.begin(), history.end(), SBComplex());
+		std::fill(results.begin(), results.end(), 0.0f);
+		submitted.store(0, std::memory_order_relaxed);
+		completed.store(0, std::memory_order_relaxed);
+	}
+
+	const long          	size;
+	const int64_t       	offset;
+	std::atomic<int64_t>	submitted = { 0 };	// blocks of input complete
+	std::atomic<int64_t>	completed = { 0 };	// blocks of output ready
+	std::atomic<bool>   	busy = { false };
+	std::atomic<int>    	queued = { 0 };   	// worker queue entries still pointing at the stage
+
+private:
+	void compute(int64_t blockIndex)
+	{
+		// overlap-save: the previous and the current input block, only the second half of the result is kept
+		const size_t bins = size + 1;
+		const uint64_t start = static_cast<uint64_t>(blockIndex - 1) * size;
+		for (size_t index = 0; index < spectrum.size(); ++index)
+			spectrum[index] = SBComplex(input[(start + index) & inputMask], 0.0f);
+		fft.forward(spectrum.data());
+
+		// real input: bins above size mirror the lower half and are never stored
+		const size_t slot = static_cast<size_t>(blockIndex % static_cast<int64_t>(partitions));
+		std::copy(spectrum.begin(), spectrum.begin() + bins, history.begin() + slot * bins);
+		std::fill(accumulator.begin(), accumulator.end(), SBComplex());
+		for (size_t partition = 0; partition < partitions; ++partition)
+		{
+			const size_t delayed = (slot + partitions - partition) % partitions;
+			SB_ComplexMultiplyAccumulate(accumulator.data(), history.data() + delayed * bins, filter.data() + partition * bins, bins);
+		}
+
+		std::copy(accumulator.begin(), accumulator.end(), spectrum.begin());
+		for (size_t bin = 1; bin < static_cast<size_t>(size); ++bin)
+			spectrum[2 * size - bin] = std::conj(accumulator[bin]);
+		fft.inverse(spectrum.data());
+		float* target = results.data() + static_cast<size_t>(blockIndex % static_cast<int64_t>(outputBlocks)) * size;
+		for (long frame = 0; frame < size; ++frame)
+			target[frame] = spectrum[size + frame].real();
+	}
+
+	SBFFT                 	fft;
+	const size_t          	partitions;
+	std::vector<SBComplex>	filter;     	// partitions * (size + 1) bins
+	std::vector<SBComplex>	history;    	// input spectra, same layout, indexed by block modulo partitions
+	std::vector<SBComplex>	spectrum;   	// 2 * size
+	std::vector<SBComplex>	accumulator;	// size + 1
+	std::vector<float>    	input;      	// ring; long enough for a late worker not to see it overwritten
+	size_t                	inputMask = 0;
+	const size_t          	outputBlocks;
+	std::vector<float>    	results;    	// outputBlocks blocks, kept until heard
+};
+
+//
+// SBConvolutionWorkers
+//
+SBConvolutionWorkers::SBConvolutionWorkers(size_t threadCount, SBThreadPriority priority, size_t queueCapacity)
+	: jobs(queueCapacity)
+{
+	if (threadCount == 0)
+		threadCount = std::max<size_t>(SB_GetCoreCount() - 1, 1);
+
+	SBThreadSetup setup;
+	setup.name = "Convolution";
+	setup.priority = priority;
+	setup.realTimePriority = 70;	// below the audio thread
+	setup.flushDenormals = true;	// same arithmetic as the audio thread
+	for (size_t index = 0; index < threadCount; ++index)
+	{
+		std::unique_ptr<SBThread> thread(new SBThread);
+		if (thread->start(setup, [this]() { run(); }))
+			threads.push_back(std::move(thread));
+	}
+}
+
+SBConvolutionWorkers::~SBConvolutionWorkers()
+{
+	stopping.store(true, std::memory_order_release);
+	for (size_t index = 0; index < threads.size(); ++index)
+		wakeUp.signal();
+	threads.clear();
+}
+
+bool SBConvolutionWorkers::submit(SBConvolverStage* stage)
+{
+	if (threads.empty())
+		return false;
+	stage->queued.fetch_add(1, std::memory_order_relaxed);
+	if (!jobs.push(stage))
+	{
+		stage->queued.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+	wakeUp.signal();
+	return true;
+}
+
+void SBConvolutionWorkers::run()
+{
+	for (;;)
+	{
+		wakeUp.wait();
+		if (stopping.load(std::memory_order_acquire))
+			return;
+		SBConvolverStage* stage = nullptr;
+		while (jobs.pop(stage))
+		{
+			stage->runPending();
+			stage->queued.fetch_sub(1, std::memory_order_release);
+		}
+	}
+}
+
+//
+// SBConvolver
+//
+SBConvolver::SBConvolver(const float* impulseResponse, size_t length, const SBConvolverSetup& setup, SBConvolutionWorkers* convolutionWorkers)
+	: block(static_cast<long>(SB_RoundUpToPowerOfTwo(static_cast<size_t>(std::max(setup.blockSize, 1l))))), taps(length), workers(convolutionWorkers),
+	scratch(block, 0.0f)
+{
+	const long maxSize = std::max(block, static_cast<long>(SB_RoundUpToPowerOfTwo(static_cast<size_t>(std::max(setup.maxPartitionSize, 1l)))));
+	const long growth = static_cast<long>(SB_RoundUpToPowerOfTwo(static_cast<size_t>(std::max(setup.partitionGrowth, 2l))));
+
+	// each stage lasts until the next one has a full partition period of slack: offset >= 2 * next size - block
+	long size = block;
+	int64_t offset = 0;
+	do
+	{
+		const long next = std::min(size * growth, maxSize);
+		const int64_t remaining = static_cast<int64_t>(length) - offset;
+		int64_t count = (remaining + size - 1) / size;
+		if (next > size)
+			count = std::min(count, std::max<int64_t>((2 * next - block - offset + size - 1) / size, 1));
+		const int64_t end = std::min<int64_t>(offset + count * size, length);
+		stages.emplace_back(new SBConvolverStage(impulseResponse, static_cast<size_t>(end), size, offset, block));
+		offset += count * size;
+		size = next;
+	} while (offset < static_cast<int64_t>(length));
+}
+
+SBConvolver::~SBConvolver()
+{
+	waitForWorkers();
+}
+
+void SBConvolver::waitForWorkers() const
+{
+	for (const std::unique_ptr<SBConvolverStage>& stage : stages)
+	{
+		while (stage->queued.load(std::memory_order_acquire) > 0 || stage->busy.load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+}
+
+void SBConvolver::reset()
+{
+	waitForWorkers();
+	for (std::unique_ptr<SBConvolverStage>& stage : stages)
+		stage->reset();
+	position = 0;
+}
+
+void SBConvolver::process(const float* input, float* output, long frameCount)
+{
+	for (long frame = 0; frame + block <= frameCount; frame += block)
+		processBlock(input + frame, output + frame);
+}
+
+void SBConvolver::processBlock(const float* input, float* output)
+{
+	memcpy(scratch.data(), input, block * sizeof(float));	// output may be the input
+	for (size_t index = 0; index < stages.size(); ++index)
+	{
+		SBConvolverStage& stage = *stages[index];
+		stage.write(scratch.data(), block, position);
+		if ((position + block) % stage.size == 0)
+		{
+			stage.submitted.store((position + block) / stage.size, std::memory_order_release);
+			// the first stage is due in this very block
+			if (index == 0 || !workers || !workers->submit(&stage))
+				stage.runPending();
+		}
+
+		const int64_t delayed = position - stage.offset;
+		if (delayed < 0)
+			continue;
+		const int64_t blockIndex = delayed / stage.size;
+		if (stage.completed.load(std::memory_order_acquire) <= blockIndex)
+		{
+			late.fetch_add(1, std::memory_order_relaxed);
+			while (stage.completed.load(std::memory_order_acquire) <= blockIndex)
+				std::this_thread::yield();
+		}
+		const float* result = stage.output(blockIndex) + delayed % stage.size;
+		if (index == 0)
+			memcpy(output, result, block * sizeof(float));
+		else
+		{
+			for (long frame = 0; frame < block; ++frame)
+				output[frame] += result[frame];
+		}
+	}
+	position += block;
+}
+
+std::vector<std::unique_ptr<SBConvolver>> SB_LoadConvolvers(const std::wstring& path, const SBConvolverSetup& setup, SBConvolutionWorkers* workers, uint32_t* sampleRate)
+{
+	std::vector<std::unique_ptr<SBConvolver>> convolvers;
+	SBWavAudio audio;
+	if (!SB_ReadWavFile(path, audio))
+		return convolvers;
+	for (const std::vector<float>& channel : audio.channels)
+		convolvers.emplace_back(new SBConvolver(channel.data(), channel.size(), setup, workers));
+	if (sampleRate)
+		*sampleRate = audio.sampleRate;
+	return convolvers;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "SBLockFreeQueue.h"
+#include "SBThread.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class SBConvolverStage;
+
+// Threads computing the late partitions of every convolver attached to them.
+class SBConvolutionWorkers
+{
+public:
+	// threadCount 0: one per core but one (left to the audio thread)
+	explicit SBConvolutionWorkers(size_t threadCount = 0, SBThreadPriority priority = SBThreadPriority::High, size_t queueCapacity = 1024);
+	SBConvolutionWorkers(const SBConvolutionWorkers&) = delete;
+	SBConvolutionWorkers& operator=(const SBConvolutionWorkers&) = delete;
+	~SBConvolutionWorkers();	// convolvers using the workers must be destroyed first
+
+	size_t size() const { return threads.size(); }
+
+private:
+	friend class SBConvolver;
+	bool submit(SBConvolverStage* stage);	// audio thread; false when the queue is full
+	void run();
+
+	SBLockFreeQueue<SBConvolverStage*>    	jobs;
+	SBSemaphore                           	wakeUp;
+	std::atomic<bool>                     	stopping = { false };
+	std::vector<std::unique_ptr<SBThread>>	threads;
+};
+
+struct SBConvolverSetup
+{
+	long	blockSize = 64;          	// frames per process() step and first partition size, power of two
+	long	maxPartitionSize = 32768;	// power of two
+	long	partitionGrowth = 8;     	// partition size ratio from one stage to the next, power of two
+};
+
+// Zero latency, non-uniformly partitioned overlap-save convolution of one channel.
+//
+// The head of the response is split in blockSize partitions computed on the audio thread, so the output of a
+// block already holds its own contribution. The tail uses partitions growing by partitionGrowth up to
+// maxPartitionSize; each larger stage starts late enough in the response (at least twice its partition size
+// minus a block) that a worker has a whole partition period to compute it before it is heard.
+// Every stage is a frequency domain delay line multiplied and accumulated with SB_ComplexMultiplyAccumulate.
+//
+// Without workers, or when a worker misses its deadline, the audio thread computes or waits for the late stages
+// itself: the output never depends on thread timing, so offline renders match real-time ones.
+class SBConvolver
+{
+public:
+	SBConvolver(const float* impulseResponse, size_t length, const SBConvolverSetup& setup = SBConvolverSetup(), SBConvolutionWorkers* workers = nullptr);
+	SBConvolver(const SBConvolver&) = delete;
+	SBConvolver& operator=(const SBConvolver&) = delete;
+	~SBConvolver();	// waits for the workers to let go of the stages
+
+	// audio thread; frameCount must be a multiple of blockSize. input and output may alias.
+	void process(const float* input, float* output, long frameCount);
+
+	void reset();	// clears the history, not while process() runs
+
+	long blockSize() const { return block; }
+	size_t length() const { return taps; }
+	size_t stageCount() const { return stages.size(); }
+	uint64_t lateBlocks() const { return late.load(std::memory_order_relaxed); }	// blocks that waited for a worker
+
+private:
+	void processBlock(const float* input, float* output);
+	void waitForWorkers() const;
+
+	const long                                    	block;
+	const size_t                                  	taps;
+	SBConvolutionWorkers*                         	workers;
+	std::vector<std::unique_ptr<SBConvolverStage>>	stages;	// [0] runs on the audio thread
+	std::vector<float>                            	scratch;
+	int64_t                                       	position = 0;
+	std::atomic<uint64_t>                         	late = { 0 };
+};
+
+// One convolver per channel of a WAV impulse response (SB_ReadWavFile); sampleRate receives the file's rate.
+std::vector<std::unique_ptr<SBConvolver>> SB_LoadConvolvers(const std::wstring& path, const SBConvolverSetup& setup, SBConvolutionWorkers* workers = nullptr, uint32_t* sampleRate = nullptr);
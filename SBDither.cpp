@@ -0,0 +1,46 @@
+#include "SBDither.h"
+
+#include <algorithm>
+
+struct SBNoiseShapingFilter
+{
+	int  	taps;
+	float	coefficients[SB_DITHER_MAX_TAPS];
+};
+
+static SBNoiseShapingFilter SB_NoiseShapingFilter(SBNoiseShaping shaping)
+{
+	switch (shaping)
+	{
+	case SBNoiseShaping::FirstOrder:  return { 1, { 1.0f } };
+	case SBNoiseShaping::SecondOrder: return { 2, { 2.0f, -1.0f } };
+	case SBNoiseShaping::EWeighted5:  return { 5, { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f } };
+	case SBNoiseShaping::FWeighted9:  return { 9, { 2.412f, -3.370f, 3.937f, -4.174f, 3.353f, -2.205f, 1.281f, -0.569f, 0.0847f } };
+	default:                          return { 0, {} };
+	}
+}
+
+void SBDither::prepare(const SBDitherSetup& ditherSetup, long count, int bits, uint32_t stream)
+{
+	setup = ditherSetup;
+	channelCount = std::max(count, 0l);
+	bitDepth = std::min(std::max(bits, 8), 24);
+
+	const SBNoiseShapingFilter filter = SB_NoiseShapingFilter(setup.shaping);
+	taps = filter.taps;
+	std::copy_n(filter.coefficients, SB_DITHER_MAX_TAPS, coefficients);
+
+	const size_t paddedCount = (static_cast<size_t>(channelCount) + 3) & ~size_t(3);
+	keys.resize(paddedCount);
+	const uint32_t streamKey = SB_DitherHash(setup.seed ^ SB_DitherHash(stream + 0x9e3779b9u));
+	for (size_t channel = 0; channel < paddedCount; ++channel)
+		keys[channel] = SB_DitherHash(streamKey + static_cast<uint32_t>(channel) * 0x9e3779b9u);
+	errors.resize(paddedCount * SB_DITHER_MAX_TAPS);
+	reset();
+}
+
+void SBDither::reset()
+{
+	std::fill(errors.begin(), errors.end(), 0.0f);
+	position = 0;
+}
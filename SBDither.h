@@ -0,0 +1,439 @@
+#pragma once
+
+#include "SBSampleKernels.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class SBDitherType
+{
+	None = 0,  	// rounding only, the codes SB_QuantizeSample gives
+	Triangular,	// TPDF, 2 LSB peak to peak: the error no longer depends on the signal
+};
+
+// Error feedback filters, the quantization noise spectrum becomes 1 - H(z). The first and second order ones
+// are rate independent; the weighted curves are psychoacoustic designs for 44.1 kHz (Lipshitz E-weighted 5 tap,
+// Wannamaker F-weighted 9 tap) that still push the noise out of the sensitive band at higher rates.
+enum class SBNoiseShaping
+{
+	None = 0,
+	FirstOrder,
+	SecondOrder,
+	EWeighted5,
+	FWeighted9,
+};
+
+struct SBDitherSetup
+{
+	SBDitherType  	type = SBDitherType::None;
+	SBNoiseShaping	shaping = SBNoiseShaping::None;
+	uint32_t      	seed = 0;	// same seed and block sequence, same output: renders stay reproducible
+};
+
+static constexpr int SB_DITHER_MAX_TAPS = 9;
+
+// Quantizes planar channels to integer codes with dither and noise shaping, for the outputs narrower than the
+// processing type (16/24 bits drivers and files).
+//
+// The noise comes from a counter based generator, an integer hash of the frame keyed per channel, so channels
+// are independent and any frame can be reproduced without running a sequence: the output does not depend on how
+// the signal is cut into blocks. Without shaping each channel is vectorized along time; the shaping feedback is
+// serial in time, so blocks of 4x4 samples are transposed and it runs across channels, one per SIMD lane, with
+// four groups of lanes interleaved. The scalar path gives the same codes.
+class SBDither
+{
+public:
+	// bits: 8 to 24; stream keys the noise of another set of channels sharing the seed (e.g. another output format)
+	void prepare(const SBDitherSetup& setup, long channelCount, int bits, uint32_t stream = 0);
+	void reset();	// error history and noise counter back to the start
+
+	bool active() const { return setup.type != SBDitherType::None || setup.shaping != SBNoiseShaping::None; }
+	long channels() const { return channelCount; }
+	int bits() const { return bitDepth; }
+
+	// channels() inputs to channels() outputs, LSB aligned codes (what SB_SamplesToInt32 would write)
+	template<typename T>
+	void quantize(const T* const* in, int32_t* const* out, long frameCount);
+
+private:
+	template<int Taps, bool Dithered, typename T>
+	void quantizeChannels(const T* const* in, int32_t* const* out, long frameCount);
+#if defined(SB_SIMD_SSE2)
+	template<int Taps, bool Dithered, int Groups, typename T>
+	void shapeGroups(const T* const* in, int32_t* const* out, long frameCount, long first, long lanes);
+#endif
+
+	SBDitherSetup     	setup;
+	long              	channelCount = 0;
+	int               	bitDepth = 16;
+	int               	taps = 0;
+	float             	coefficients[SB_DITHER_MAX_TAPS] = {};
+	std::vector<uint32_t>	keys;  	// per channel, padded to a multiple of 4
+	std::vector<float>	errors;	// per group of 4 channels: taps x 4 lanes, most recent first
+	uint32_t          	position = 0;	// frames since reset, the noise repeats after 2^32 of them
+};
+
+//
+// Noise
+//
+// lowbias32 (C. Wellons): two multiply rounds, single round hashes leave the noise correlated.
+inline uint32_t SB_DitherHash(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+// The key enters the input and again between the rounds: with counter + key every channel would be the same
+// sequence at another lag.
+inline uint32_t SB_DitherNoise(uint32_t key, uint32_t counter)
+{
+	uint32_t value = counter ^ key;
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= (value >> 15) ^ key;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+// Difference of the two 16 bit halves: triangular over (-1, 1) LSB.
+inline float SB_DitherTriangular(uint32_t noise)
+{
+	return static_cast<float>(static_cast<int32_t>(noise & 0xffffu) - static_cast<int32_t>(noise >> 16)) * (1.0f / 65536.0f);
+}
+
+//
+// Input split
+//
+// Each sample becomes the nearest code at full precision (rounded like SB_QuantizeSample) plus the fraction
+// left, so the feedback works on small floats even at 24 bits. Out of range samples are clamped to twice full
+// scale first, the codes are clipped after the feedback.
+template<typename T> struct SBDitherInput;
+
+template<> struct SBDitherInput<float>
+{
+	static void split(float sample, int bits, int32_t& code, float& fraction)
+	{
+		const float limit = static_cast<float>(1ll << (bits - 1));
+		const float value = std::min(std::max(sample * limit, -2.0f * limit), 2.0f * limit);
+		code = static_cast<int32_t>(std::lrint(value));
+		fraction = value - static_cast<float>(code);
+	}
+
+#if defined(SB_SIMD_SSE2)
+	static void split(const float* samples, int bits, __m128i& codes, __m128& fractions)
+	{
+		const float limit = static_cast<float>(1ll << (bits - 1));
+		const __m128 values = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(samples), _mm_set1_ps(limit)), _mm_set1_ps(-2.0f * limit)), _mm_set1_ps(2.0f * limit));
+		codes = _mm_cvtps_epi32(values);
+		fractions = _mm_sub_ps(values, _mm_cvtepi32_ps(codes));
+	}
+#endif
+};
+
+template<> struct SBDitherInput<double>
+{
+	static void split(double sample, int bits, int32_t& code, float& fraction)
+	{
+		const double limit = static_cast<double>(1ll << (bits - 1));
+		const double value = std::min(std::max(sample * limit, -2.0 * limit), 2.0 * limit);
+		code = static_cast<int32_t>(std::lrint(value));
+		fraction = static_cast<float>(value - static_cast<double>(code));
+	}
+
+#if defined(SB_SIMD_SSE2)
+	static void split(const double* samples, int bits, __m128i& codes, __m128& fractions)
+	{
+		const double limit = static_cast<double>(1ll << (bits - 1));
+		const __m128d scale = _mm_set1_pd(limit), low = _mm_set1_pd(-2.0 * limit), high = _mm_set1_pd(2.0 * limit);
+		const __m128d first = _mm_min_pd(_mm_max_pd(_mm_mul_pd(_mm_loadu_pd(samples), scale), low), high);
+		const __m128d second = _mm_min_pd(_mm_max_pd(_mm_mul_pd(_mm_loadu_pd(samples + 2), scale), low), high);
+		const __m128i firstCodes = _mm_cvtpd_epi32(first), secondCodes = _mm_cvtpd_epi32(second);
+		codes = _mm_unpacklo_epi64(firstCodes, secondCodes);
+		fractions = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(first, _mm_cvtepi32_pd(firstCodes))), _mm_cvtpd_ps(_mm_sub_pd(second, _mm_cvtepi32_pd(secondCodes))));
+	}
+#endif
+};
+
+// Q31 keeps its low bits exactly: the code is the floor, the fraction in [0, 1).
+template<> struct SBDitherInput<SBQ31>
+{
+	static void split(SBQ31 sample, int bits, int32_t& code, float& fraction)
+	{
+		const int shift = 32 - bits;
+		code = sample.value >> shift;
+		fraction = static_cast<float>(sample.value & ((1 << shift) - 1)) * (1.0f / static_cast<float>(1 << shift));
+	}
+
+#if defined(SB_SIMD_SSE2)
+	static void split(const SBQ31* samples, int bits, __m128i& codes, __m128& fractions)
+	{
+		const int shift = 32 - bits;
+		const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples));
+		codes = _mm_sra_epi32(values, _mm_cvtsi32_si128(shift));
+		fractions = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(values, _mm_set1_epi32((1 << shift) - 1))), _mm_set1_ps(1.0f / static_cast<float>(1 << shift)));
+	}
+#endif
+};
+
+//
+// Quantization
+//
+// Per sample, with e the errors of the previous codes: w = fraction - sum(c[k] * e[k]); step = round(w + dither);
+// e[0] = step - w; code += step, clipped. The error fed back is taken before clipping, so it stays within 1.5 LSB
+// and a clipped code cannot destabilize the filter. The older taps are summed first, off the path from one error
+// to the next.
+template<typename T>
+inline void SBDither::quantize(const T* const* in, int32_t* const* out, long frameCount)
+{
+	const bool dithered = setup.type == SBDitherType::Triangular;
+	switch (taps)
+	{
+	case 0: dithered ? quantizeChannels<0, true>(in, out, frameCount) : quantizeChannels<0, false>(in, out, frameCount); break;
+	case 1: dithered ? quantizeChannels<1, true>(in, out, frameCount) : quantizeChannels<1, false>(in, out, frameCount); break;
+	case 2: dithered ? quantizeChannels<2, true>(in, out, frameCount) : quantizeChannels<2, false>(in, out, frameCount); break;
+	case 5: dithered ? quantizeChannels<5, true>(in, out, frameCount) : quantizeChannels<5, false>(in, out, frameCount); break;
+	default: dithered ? quantizeChannels<9, true>(in, out, frameCount) : quantizeChannels<9, false>(in, out, frameCount); break;
+	}
+	position += static_cast<uint32_t>(frameCount);
+}
+
+#if defined(SB_SIMD_SSE2)
+// Low 32 bits of each lane product (_mm_mullo_epi32 is SSE4.1).
+inline __m128i SB_MultiplyLow32(__m128i a, __m128i b)
+{
+	const __m128i even = _mm_mul_epu32(a, b);
+	const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i SB_DitherNoise(__m128i keys, __m128i counters)
+{
+	__m128i value = _mm_xor_si128(counters, keys);
+	value = _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+	value = SB_MultiplyLow32(value, _mm_set1_epi32(0x7feb352d));
+	value = _mm_xor_si128(_mm_xor_si128(value, _mm_srli_epi32(value, 15)), keys);
+	value = SB_MultiplyLow32(value, _mm_set1_epi32(static_cast<int32_t>(0x846ca68bu)));
+	return _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+}
+
+inline __m128 SB_DitherTriangular(__m128i noise)
+{
+	const __m128i difference = _mm_sub_epi32(_mm_and_si128(noise, _mm_set1_epi32(0xffff)), _mm_srli_epi32(noise, 16));
+	return _mm_mul_ps(_mm_cvtepi32_ps(difference), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+inline __m128i SB_SelectInt32(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+inline void SB_TransposeInt32(__m128i& row0, __m128i& row1, __m128i& row2, __m128i& row3)
+{
+	const __m128i t0 = _mm_unpacklo_epi32(row0, row1), t1 = _mm_unpacklo_epi32(row2, row3);
+	const __m128i t2 = _mm_unpackhi_epi32(row0, row1), t3 = _mm_unpackhi_epi32(row2, row3);
+	row0 = _mm_unpacklo_epi64(t0, t1);
+	row1 = _mm_unpackhi_epi64(t0, t1);
+	row2 = _mm_unpacklo_epi64(t2, t3);
+	row3 = _mm_unpackhi_epi64(t2, t3);
+}
+#endif
+
+#if defined(SB_SIMD_SSE2)
+// Groups x 4 channels from first; a single group may have fewer lanes, the missing ones quantize silence.
+template<int Taps, bool Dithered, int Groups, typename T>
+inline void SBDither::shapeGroups(const T* const* in, int32_t* const* out, long frameCount, long first, long lanes)
+{
+	const int bits = bitDepth;	// locals: the stores to out could alias the members
+	const uint32_t start = position;
+	const __m128i highs = _mm_set1_epi32(static_cast<int32_t>((1ll << (bits - 1)) - 1)), lows = _mm_sub_epi32(_mm_setzero_si128(), _mm_add_epi32(highs, _mm_set1_epi32(1)));
+	__m128 weights[Taps > 0 ? Taps : 1];
+	for (int tap = 0; tap < Taps; ++tap)
+		weights[tap] = _mm_set1_ps(coefficients[tap]);
+	// the errors of each group oldest first, so that a frame appends one instead of moving them all; the newest
+	// also stays in a register, off the memory path. The line goes back to its start when full.
+	constexpr int Span = 64;
+	__m128 line[Groups][Span + (Taps > 0 ? Taps : 1)], latest[Groups];
+	__m128i channelKeys[Groups];
+	int top = Taps;
+	auto rewind = [&]()
+	{
+		for (int group = 0; group < Groups; ++group)
+			std::copy(line[group] + top - Taps, line[group] + top, line[group]);
+		top = Taps;
+	};
+	for (int group = 0; group < Groups; ++group)
+	{
+		const float* history = errors.data() + static_cast<size_t>(first + 4 * group) * SB_DITHER_MAX_TAPS;
+		for (int tap = 0; tap < Taps; ++tap)
+			line[group][Taps - 1 - tap] = _mm_loadu_ps(history + 4 * tap);
+		latest[group] = line[group][Taps > 0 ? Taps - 1 : 0];
+		channelKeys[group] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys.data() + first + 4 * group));
+	}
+
+	// one frame of four channels, top moves on once all the groups took theirs
+	auto step = [&](int group, __m128i codes, __m128 fractions, uint32_t counter) -> __m128i
+	{
+		__m128 early = fractions;
+		if (Taps > 1)
+		{
+			const __m128* recent = line[group] + top - 1;	// recent[-tap]: the error tap frames back
+			__m128 older = _mm_mul_ps(weights[1], recent[-1]);
+			for (int tap = 2; tap < Taps; ++tap)
+				older = _mm_add_ps(older, _mm_mul_ps(weights[tap], recent[-tap]));
+			early = _mm_sub_ps(fractions, older);
+		}
+		const __m128 shaped = _mm_sub_ps(early, _mm_mul_ps(weights[0], latest[group]));
+		__m128 target = shaped;
+		if (Dithered)
+			target = _mm_add_ps(shaped, SB_DitherTriangular(SB_DitherNoise(channelKeys[group], _mm_set1_epi32(static_cast<int32_t>(counter)))));
+		const __m128i steps = _mm_cvtps_epi32(target);
+		latest[group] = _mm_sub_ps(_mm_cvtepi32_ps(steps), shaped);
+		line[group][top] = latest[group];
+		__m128i result = _mm_add_epi32(codes, steps);
+		result = SB_SelectInt32(_mm_cmpgt_epi32(result, highs), highs, result);
+		return SB_SelectInt32(_mm_cmplt_epi32(result, lows), lows, result);
+	};
+
+	long frame = 0;
+	if (lanes == 4)
+	{
+		for (; frame + 4 <= frameCount; frame += 4)
+		{
+			if (top + 4 > Span + Taps)
+				rewind();
+			__m128i codes[Groups][4], results[Groups][4];
+			__m128 fractions[Groups][4];
+			for (int group = 0; group < Groups; ++group)
+			{
+				for (long lane = 0; lane < 4; ++lane)
+					SBDitherInput<T>::split(in[first + 4 * group + lane] + frame, bits, codes[group][lane], fractions[group][lane]);
+				SB_TransposeInt32(codes[group][0], codes[group][1], codes[group][2], codes[group][3]);
+				_MM_TRANSPOSE4_PS(fractions[group][0], fractions[group][1], fractions[group][2], fractions[group][3]);
+			}
+			for (long offset = 0; offset < 4; ++offset)
+			{
+				for (int group = 0; group < Groups; ++group)
+					results[group][offset] = step(group, codes[group][offset], fractions[group][offset], start + static_cast<uint32_t>(frame + offset));
+				++top;
+			}
+			for (int group = 0; group < Groups; ++group)
+			{
+				SB_TransposeInt32(results[group][0], results[group][1], results[group][2], results[group][3]);
+				for (long lane = 0; lane < 4; ++lane)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out[first + 4 * group + lane] + frame), results[group][lane]);
+			}
+		}
+	}
+	for (; frame < frameCount; ++frame)
+	{
+		if (top == Span + Taps)
+			rewind();
+		for (int group = 0; group < Groups; ++group)
+		{
+			const long channel = first + 4 * group;
+			int32_t codes[4] = {}, results[4];
+			float fractions[4] = {};
+			for (long lane = 0; lane < lanes; ++lane)
+				SBDitherInput<T>::split(in[channel + lane][frame], bits, codes[lane], fractions[lane]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(results), step(group, _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes)), _mm_loadu_ps(fractions), start + static_cast<uint32_t>(frame)));
+			for (long lane = 0; lane < lanes; ++lane)
+				out[channel + lane][frame] = results[lane];
+		}
+		++top;
+	}
+
+	for (int group = 0; group < Groups; ++group)
+	{
+		float* history = errors.data() + static_cast<size_t>(first + 4 * group) * SB_DITHER_MAX_TAPS;
+		for (int tap = 0; tap < Taps; ++tap)
+			_mm_storeu_ps(history + 4 * tap, line[group][top - 1 - tap]);
+	}
+}
+#endif
+
+template<int Taps, bool Dithered, typename T>
+inline void SBDither::quantizeChannels(const T* const* in, int32_t* const* out, long frameCount)
+{
+	const int bits = bitDepth;
+	const uint32_t start = position;
+	const int32_t high = static_cast<int32_t>((1ll << (bits - 1)) - 1), low = -high - 1;
+	long first = 0, firstFrame = 0;
+
+#if defined(SB_SIMD_SSE2)
+	const __m128i highs = _mm_set1_epi32(high), lows = _mm_set1_epi32(low);
+	if (Taps == 0)
+	{
+		// nothing serial: along time, four frames at a time, the scalar loop below finishes the tails
+		firstFrame = frameCount & ~3l;
+		const __m128i offsets = _mm_setr_epi32(0, 1, 2, 3);
+		for (long channel = 0; channel < channelCount; ++channel)
+		{
+			const T* samples = in[channel];
+			int32_t* codesOut = out[channel];
+			const __m128i key = _mm_set1_epi32(static_cast<int32_t>(keys[channel]));
+			__m128i counters = _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(start)), offsets);
+			for (long frame = 0; frame < firstFrame; frame += 4)
+			{
+				__m128i codes;
+				__m128 target;
+				SBDitherInput<T>::split(samples + frame, bits, codes, target);
+				if (Dithered)
+					target = _mm_add_ps(target, SB_DitherTriangular(SB_DitherNoise(key, counters)));
+				__m128i result = _mm_add_epi32(codes, _mm_cvtps_epi32(target));
+				result = SB_SelectInt32(_mm_cmpgt_epi32(result, highs), highs, result);
+				result = SB_SelectInt32(_mm_cmplt_epi32(result, lows), lows, result);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(codesOut + frame), result);
+				counters = _mm_add_epi32(counters, _mm_set1_epi32(4));
+			}
+		}
+	}
+	else
+	{
+		// the feedback is serial in time: across channels, several groups of four interleaved to hide its latency
+		for (; first + 16 <= channelCount; first += 16)
+			shapeGroups<Taps, Dithered, 4>(in, out, frameCount, first, 4);
+		for (; first < channelCount; first += 4)
+			shapeGroups<Taps, Dithered, 1>(in, out, frameCount, first, std::min(channelCount - first, 4l));
+	}
+#endif
+
+	// same arithmetic, one channel at a time
+	for (; first < channelCount; ++first)
+	{
+		float* history = errors.data() + static_cast<size_t>(first & ~3l) * SB_DITHER_MAX_TAPS + (first & 3);
+		const uint32_t key = keys[first];
+		for (long frame = firstFrame; frame < frameCount; ++frame)
+		{
+			int32_t code;
+			float fraction;
+			SBDitherInput<T>::split(in[first][frame], bits, code, fraction);
+			float shaped = fraction;
+			if (Taps > 0)
+			{
+				float early = fraction;
+				if (Taps > 1)
+				{
+					float older = coefficients[1] * history[4];
+					for (int tap = 2; tap < Taps; ++tap)
+						older = older + coefficients[tap] * history[4 * tap];
+					early = fraction - older;
+				}
+				shaped = early - coefficients[0] * history[0];
+			}
+			const float target = Dithered ? shaped + SB_DitherTriangular(SB_DitherNoise(key, start + static_cast<uint32_t>(frame))) : shaped;
+			const int32_t step = static_cast<int32_t>(std::lrint(target));
+			if (Taps > 0)
+			{
+				for (int tap = Taps - 1; tap > 0; --tap)
+					history[4 * tap] = history[4 * (tap - 1)];
+				history[0] = static_cast<float>(step) - shaped;
+			}
+			out[first][frame] = std::min(std::max(code + step, low), high);
+		}
+	}
+}
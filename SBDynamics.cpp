@@ -0,0 +1,424 @@
+#include "SBDynamics.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float SB_DB_TO_LOG2 = 0.166096405f;	// log2(10) / 20
+
+static long SB_DynamicsMeanLength(const SBDynamicsSetup& setup)
+{
+	// the latency, (meanLength + 1) periods less a frame, covers the lookahead
+	const long lookahead = static_cast<long>(std::lround(std::max(setup.lookaheadSeconds, 0.0f) * setup.sampleRate));
+	return std::max((lookahead + SB_DYNAMICS_PERIOD) / SB_DYNAMICS_PERIOD - 1, 1l);
+}
+
+static float SB_OnePole(float seconds, double sampleRate)
+{
+	return seconds > 0.0f && sampleRate > 0.0 ? static_cast<float>(std::exp(-SB_DYNAMICS_PERIOD / (seconds * sampleRate))) : 0.0f;
+}
+
+// Suffix maxima of a block of values, one lane of rows of 4.
+static void SB_SuffixMaxima(const float* values, float* maxima, long length)
+{
+	float maximum = 0.0f;
+	for (long row = length - 1; row >= 0; --row)
+	{
+		maximum = std::max(maximum, values[4 * row]);
+		maxima[4 * row] = maximum;
+	}
+}
+
+// Suffix sums in place, one lane of rows of 4.
+static void SB_SuffixSums(float* values, long length)
+{
+	float total = 0.0f;
+	for (long row = length - 1; row >= 0; --row)
+	{
+		total += values[4 * row];
+		values[4 * row] = total;
+	}
+}
+
+//
+// Kernels
+//
+#if defined(SB_SIMD_SSE2)
+static inline __m128 SB_Select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// As SB_PowerToDecibels: exponent bits and a polynomial on the mantissa, within 4e-5.
+static inline __m128 SB_Log2(__m128 x)
+{
+	const __m128i bits = _mm_castps_si128(x);
+	const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	const __m128 m = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000))), _mm_set1_ps(1.0f));
+	__m128 polynomial = _mm_add_ps(_mm_mul_ps(m, _mm_set1_ps(-0.08428509f)), _mm_set1_ps(0.3236304f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, m), _mm_set1_ps(-0.6780815f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, m), _mm_set1_ps(1.438547f));
+	return _mm_add_ps(exponent, _mm_mul_ps(polynomial, m));
+}
+
+// Nearest integer into the exponent bits, Taylor polynomial of the fraction left in [-0.5, 0.5], within 3e-7.
+static inline __m128 SB_Exp2(__m128 x)
+{
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(126.0f));
+	const __m128i whole = _mm_cvtps_epi32(x);
+	const __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(whole));
+	__m128 polynomial = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(1.33335581e-3f)), _mm_set1_ps(9.61812911e-3f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, f), _mm_set1_ps(5.55041087e-2f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, f), _mm_set1_ps(2.40226507e-1f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, f), _mm_set1_ps(6.93147181e-1f));
+	polynomial = _mm_add_ps(_mm_mul_ps(polynomial, f), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(polynomial, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(whole, _mm_set1_epi32(127)), 23)));
+}
+
+static void SB_SuffixMaxima4(const float* values, float* maxima, long length)
+{
+	__m128 maximum = _mm_setzero_ps();
+	for (long row = length - 1; row >= 0; --row)
+	{
+		maximum = _mm_max_ps(maximum, _mm_loadu_ps(values + 4 * row));
+		_mm_storeu_ps(maxima + 4 * row, maximum);
+	}
+}
+
+static void SB_SuffixSums4(float* values, long length)
+{
+	__m128 total = _mm_setzero_ps();
+	for (long row = length - 1; row >= 0; --row)
+	{
+		total = _mm_add_ps(total, _mm_loadu_ps(values + 4 * row));
+		_mm_storeu_ps(values + 4 * row, total);
+	}
+}
+
+// Four channels in registers for the length of a process() call.
+struct SBDynamicsLanes
+{
+	__m128	threshold, direction, slope, halfKnee, kneeScale, range, fall, rise, makeup;
+	__m128	periodPeak, holdPeak, meanSum, gain, ramp, rampStep;
+	float*	delay;
+	float*	peaks;
+	float*	maxima;
+	float*	gains;
+};
+#endif
+
+//
+// SBDynamics
+//
+SBDynamics::SBDynamics(const SBDynamicsSetup& setup)
+	: channels(std::max(setup.numChannels, 0l)), meanLength(SB_DynamicsMeanLength(setup)), holdLength(meanLength + 1),
+	delayLength(holdLength * SB_DYNAMICS_PERIOD), sampleRate(setup.sampleRate)
+{
+	const size_t groups = (static_cast<size_t>(channels) + 3) / 4;
+	delayLine.resize(groups * 4 * delayLength);
+	holdPeaks.resize(groups * 4 * holdLength);
+	holdMaxima.resize(groups * 4 * (holdLength + 1));
+	meanGains.resize(groups * 4 * (meanLength + 1));
+	for (std::vector<float>* lanes : { &periodPeak, &holdPeak, &meanSum, &gain, &ramp, &rampStep, &thresholds, &directions, &slopes, &halfKnees, &kneeScales, &ranges, &falls, &rises, &makeups })
+		lanes->resize(groups * 4);
+
+	// the padding lanes keep zero settings: no reduction, whatever they are fed
+	const SBDynamicsChannel defaults;
+	for (long channel = 0; channel < channels; ++channel)
+		setChannel(channel, defaults);
+	reset();
+}
+
+void SBDynamics::setChannel(long channel, const SBDynamicsChannel& settings)
+{
+	if (channel < 0 || channel >= channels)
+		return;
+	const bool limiter = settings.type == SBDynamicsType::Limiter;
+	const bool gate = settings.type == SBDynamicsType::Gate;
+	const float ratio = std::max(settings.ratio, 1.0f);
+	const float knee = std::max(settings.kneeDb, 0.0f) * SB_DB_TO_LOG2;
+	const float attack = SB_OnePole(settings.attackSeconds, sampleRate);
+	const float release = SB_OnePole(settings.releaseSeconds, sampleRate);
+
+	// limiters sit a hair under the ceiling, for the log2 and exp2 approximations
+	thresholds[channel] = settings.thresholdDb * SB_DB_TO_LOG2 - (limiter ? 0.0005f : 0.0f);
+	directions[channel] = gate ? -1.0f : 1.0f;
+	slopes[channel] = limiter ? 1.0f : gate ? ratio - 1.0f : 1.0f - 1.0f / ratio;
+	halfKnees[channel] = 0.5f * knee;
+	kneeScales[channel] = knee > 0.0f ? 0.5f / knee : 0.0f;
+	ranges[channel] = gate ? std::max(settings.rangeDb, 0.0f) * SB_DB_TO_LOG2 : 1000.0f;
+	falls[channel] = limiter ? 0.0f : gate ? release : attack;	// the mean is the limiter's attack
+	rises[channel] = gate ? attack : release;
+	makeups[channel] = limiter ? 0.0f : settings.makeupDb * SB_DB_TO_LOG2;
+}
+
+void SBDynamics::reset()
+{
+	for (std::vector<float>* values : { &delayLine, &holdPeaks, &holdMaxima, &meanGains, &periodPeak, &holdPeak, &meanSum, &gain, &rampStep })
+		std::fill(values->begin(), values->end(), 0.0f);
+	std::fill(ramp.begin(), ramp.end(), 1.0f);
+	delayCursor = holdCursor = meanCursor = 0;
+}
+
+float SBDynamics::gainDb(long channel) const
+{
+	return channel >= 0 && channel < channels ? gain[channel] / SB_DB_TO_LOG2 : 0.0f;
+}
+
+void SBDynamics::process(const float* const* in, float* const* out, long channelCount, long frameCount)
+{
+	const long count = std::min(std::max(channelCount, 0l), channels);
+	if (frameCount <= 0)
+		return;
+
+	long first = 0;
+#if defined(SB_SIMD_SSE2)
+	// the envelopes are serial in time: across channels, several groups of four interleaved to hide their latency
+	for (; first + 16 <= count; first += 16)
+		processGroups<4>(in, out, frameCount, first, 4);
+	for (; first < count; first += 4)
+		processGroups<1>(in, out, frameCount, first, std::min(count - first, 4l));
+#endif
+	for (; first < count; ++first)
+		processLane(in[first], out[first], frameCount, first);
+
+	const long periods = (delayCursor % SB_DYNAMICS_PERIOD + frameCount) / SB_DYNAMICS_PERIOD;
+	delayCursor = static_cast<long>((delayCursor + frameCount) % delayLength);
+	holdCursor = (holdCursor + periods) % holdLength;
+	meanCursor = (meanCursor + periods) % meanLength;
+}
+
+// Every frame goes into the delay line, which gives it back delayLength - 1 frames later, and raises the peak of
+// its period. At the end of a period, with p the position of the period in a block, the detector's window is the
+// previous block from p + 1 and the current one up to p: its maximum is max(suffix maximum [p + 1], running
+// maximum), and the mean of the gains (suffix sum [p + 1] + running sum) / meanLength. The gain ramps linearly
+// to that mean over the next period.
+void SBDynamics::processLane(const float* in, float* out, long frameCount, long channel)
+{
+	const size_t group = static_cast<size_t>(channel / 4), lane = static_cast<size_t>(channel % 4);
+	float* delay = delayLine.data() + group * 4 * delayLength + lane;
+	float* peaks = holdPeaks.data() + group * 4 * holdLength + lane;
+	float* maxima = holdMaxima.data() + group * 4 * (holdLength + 1) + lane;
+	float* gains = meanGains.data() + group * 4 * (meanLength + 1) + lane;
+	const float threshold = thresholds[channel], direction = directions[channel], slope = slopes[channel];
+	const float halfKnee = halfKnees[channel], kneeScale = kneeScales[channel], range = ranges[channel];
+	const float fall = falls[channel], rise = rises[channel], makeup = makeups[channel];
+	const float scale = 1.0f / static_cast<float>(meanLength);
+	float peak = periodPeak[channel], held = holdPeak[channel], sum = meanSum[channel];
+	float smoothed = gain[channel], current = ramp[channel], step = rampStep[channel];
+
+	long delayPosition = delayCursor, holdPosition = holdCursor, meanPosition = meanCursor;
+	for (long frame = 0; frame < frameCount; ++frame)
+	{
+		const float input = in[frame];
+		delay[4 * delayPosition] = input;
+		const float delayed = delay[delayPosition + 1 == delayLength ? 0 : 4 * (delayPosition + 1)];
+		peak = std::max(peak, std::abs(input));
+		if (delayPosition % SB_DYNAMICS_PERIOD == SB_DYNAMICS_PERIOD - 1)
+		{
+			peaks[4 * holdPosition] = peak;
+			held = std::max(held, peak);
+			peak = 0.0f;
+			const float level = std::log2(std::max(std::max(held, maxima[4 * (holdPosition + 1)]), 1e-20f));
+			const float over = direction * (level - threshold);
+			const float knee = std::min(std::max(over + halfKnee, 0.0f), 2.0f * halfKnee);
+			const float target = -std::min(slope * (knee * knee * kneeScale + std::max(over - halfKnee, 0.0f)), range);
+			smoothed = target + (target < smoothed ? fall : rise) * (smoothed - target);
+			gains[4 * meanPosition] = smoothed;
+			sum += smoothed;
+			step = (std::exp2((sum + gains[4 * (meanPosition + 1)]) * scale + makeup) - current) * (1.0f / SB_DYNAMICS_PERIOD);
+
+			if (++holdPosition == holdLength)
+			{
+				SB_SuffixMaxima(peaks, maxima, holdLength);
+				held = 0.0f;
+				holdPosition = 0;
+			}
+			if (++meanPosition == meanLength)
+			{
+				SB_SuffixSums(gains, meanLength);
+				sum = 0.0f;
+				meanPosition = 0;
+			}
+		}
+		current += step;
+		out[frame] = delayed * current;
+		if (++delayPosition == delayLength)
+			delayPosition = 0;
+	}
+	periodPeak[channel] = peak;
+	holdPeak[channel] = held;
+	meanSum[channel] = sum;
+	gain[channel] = smoothed;
+	ramp[channel] = current;
+	rampStep[channel] = step;
+}
+
+#if defined(SB_SIMD_SSE2)
+// Groups x 4 channels from first, the same arithmetic as processLane with approximated log2 and exp2; a single
+// group may have fewer lanes, the missing ones run on silence.
+template<int Groups>
+void SBDynamics::processGroups(const float* const* in, float* const* out, long frameCount, long first, long lanes)
+{
+	SBDynamicsLanes states[Groups];
+	for (int group = 0; group < Groups; ++group)
+	{
+		const size_t channel = static_cast<size_t>(first + 4 * group);
+		SBDynamicsLanes& state = states[group];
+		state.threshold = _mm_loadu_ps(thresholds.data() + channel);
+		state.direction = _mm_loadu_ps(directions.data() + channel);
+		state.slope = _mm_loadu_ps(slopes.data() + channel);
+		state.halfKnee = _mm_loadu_ps(halfKnees.data() + channel);
+		state.kneeScale = _mm_loadu_ps(kneeScales.data() + channel);
+		state.range = _mm_loadu_ps(ranges.data() + channel);
+		state.fall = _mm_loadu_ps(falls.data() + channel);
+		state.rise = _mm_loadu_ps(rises.data() + channel);
+		state.makeup = _mm_loadu_ps(makeups.data() + channel);
+		state.periodPeak = _mm_loadu_ps(periodPeak.data() + channel);
+		state.holdPeak = _mm_loadu_ps(holdPeak.data() + channel);
+		state.meanSum = _mm_loadu_ps(meanSum.data() + channel);
+		state.gain = _mm_loadu_ps(gain.data() + channel);
+		state.ramp = _mm_loadu_ps(ramp.data() + channel);
+		state.rampStep = _mm_loadu_ps(rampStep.data() + channel);
+		state.delay = delayLine.data() + channel * delayLength;
+		state.peaks = holdPeaks.data() + channel * holdLength;
+		state.maxima = holdMaxima.data() + channel * (holdLength + 1);
+		state.gains = meanGains.data() + channel * (meanLength + 1);
+	}
+
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 floor = _mm_set1_ps(1e-20f);
+	const __m128 scale = _mm_set1_ps(1.0f / static_cast<float>(meanLength));
+	const __m128 fraction = _mm_set1_ps(1.0f / SB_DYNAMICS_PERIOD);
+	long delayPosition = delayCursor, holdPosition = holdCursor, meanPosition = meanCursor;
+
+	// end of a period: detector, gain computer, smoothing, mean and the next ramp of four channels
+	auto control = [&](SBDynamicsLanes& state)
+	{
+		const size_t holdRow = 4 * static_cast<size_t>(holdPosition), meanRow = 4 * static_cast<size_t>(meanPosition);
+		_mm_storeu_ps(state.peaks + holdRow, state.periodPeak);
+		state.holdPeak = _mm_max_ps(state.holdPeak, state.periodPeak);
+		state.periodPeak = zero;
+		const __m128 level = SB_Log2(_mm_max_ps(_mm_max_ps(state.holdPeak, _mm_loadu_ps(state.maxima + holdRow + 4)), floor));
+		const __m128 over = _mm_mul_ps(state.direction, _mm_sub_ps(level, state.threshold));
+		const __m128 knee = _mm_min_ps(_mm_max_ps(_mm_add_ps(over, state.halfKnee), zero), _mm_add_ps(state.halfKnee, state.halfKnee));
+		const __m128 excess = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(knee, knee), state.kneeScale), _mm_max_ps(_mm_sub_ps(over, state.halfKnee), zero));
+		const __m128 target = _mm_xor_ps(_mm_min_ps(_mm_mul_ps(state.slope, excess), state.range), sign);
+		const __m128 coefficient = SB_Select(_mm_cmplt_ps(target, state.gain), state.fall, state.rise);
+		state.gain = _mm_add_ps(target, _mm_mul_ps(coefficient, _mm_sub_ps(state.gain, target)));
+		_mm_storeu_ps(state.gains + meanRow, state.gain);
+		state.meanSum = _mm_add_ps(state.meanSum, state.gain);
+		const __m128 mean = _mm_mul_ps(_mm_add_ps(state.meanSum, _mm_loadu_ps(state.gains + meanRow + 4)), scale);
+		state.rampStep = _mm_mul_ps(_mm_sub_ps(SB_Exp2(_mm_add_ps(mean, state.makeup)), state.ramp), fraction);
+	};
+
+	// one frame of four channels
+	auto step = [&](SBDynamicsLanes& state, __m128 input) -> __m128
+	{
+		const size_t row = 4 * static_cast<size_t>(delayPosition);
+		_mm_storeu_ps(state.delay + row, input);
+		const __m128 delayed = _mm_loadu_ps(state.delay + (delayPosition + 1 == delayLength ? 0 : row + 4));
+		state.periodPeak = _mm_max_ps(state.periodPeak, _mm_andnot_ps(sign, input));
+		if (delayPosition % SB_DYNAMICS_PERIOD == SB_DYNAMICS_PERIOD - 1)
+			control(state);
+		state.ramp = _mm_add_ps(state.ramp, state.rampStep);
+		return _mm_mul_ps(delayed, state.ramp);
+	};
+
+	// after every group took the frame: the blocks that completed become the previous ones
+	auto advance = [&]()
+	{
+		const bool periodEnd = delayPosition % SB_DYNAMICS_PERIOD == SB_DYNAMICS_PERIOD - 1;
+		if (++delayPosition == delayLength)
+			delayPosition = 0;
+		if (!periodEnd)
+			return;
+		if (++holdPosition == holdLength)
+		{
+			for (SBDynamicsLanes& state : states)
+			{
+				SB_SuffixMaxima4(state.peaks, state.maxima, holdLength);
+				state.holdPeak = zero;
+			}
+			holdPosition = 0;
+		}
+		if (++meanPosition == meanLength)
+		{
+			for (SBDynamicsLanes& state : states)
+			{
+				SB_SuffixSums4(state.gains, meanLength);
+				state.meanSum = zero;
+			}
+			meanPosition = 0;
+		}
+	};
+
+	// 4x4 tiles along the delay line (so along the periods), transposed to one frame of four channels per vector; ragged tiles (the ends
+	// of the block, missing lanes) are gathered lane by lane
+	for (long frame = 0; frame < frameCount;)
+	{
+		const long frames = std::min(frameCount - frame, 4 - delayPosition % 4);
+		const bool whole = lanes == 4 && frames == 4;
+		__m128 samples[Groups][4];
+		for (int group = 0; group < Groups; ++group)
+		{
+			const long channel = first + 4 * group;
+			if (whole)
+			{
+				for (long lane = 0; lane < 4; ++lane)
+					samples[group][lane] = _mm_loadu_ps(in[channel + lane] + frame);
+				_MM_TRANSPOSE4_PS(samples[group][0], samples[group][1], samples[group][2], samples[group][3]);
+				continue;
+			}
+			float tile[4][4] = {};
+			for (long lane = 0; lane < lanes; ++lane)
+			{
+				for (long offset = 0; offset < frames; ++offset)
+					tile[offset][lane] = in[channel + lane][frame + offset];
+			}
+			for (long offset = 0; offset < 4; ++offset)
+				samples[group][offset] = _mm_loadu_ps(tile[offset]);
+		}
+
+		for (long offset = 0; offset < frames; ++offset)
+		{
+			for (int group = 0; group < Groups; ++group)
+				samples[group][offset] = step(states[group], samples[group][offset]);
+			advance();
+		}
+
+		for (int group = 0; group < Groups; ++group)
+		{
+			const long channel = first + 4 * group;
+			if (whole)
+			{
+				_MM_TRANSPOSE4_PS(samples[group][0], samples[group][1], samples[group][2], samples[group][3]);
+				for (long lane = 0; lane < 4; ++lane)
+					_mm_storeu_ps(out[channel + lane] + frame, samples[group][lane]);
+				continue;
+			}
+			float tile[4][4];
+			for (long offset = 0; offset < 4; ++offset)
+				_mm_storeu_ps(tile[offset], samples[group][offset]);
+			for (long lane = 0; lane < lanes; ++lane)
+			{
+				for (long offset = 0; offset < frames; ++offset)
+					out[channel + lane][frame + offset] = tile[offset][lane];
+			}
+		}
+		frame += frames;
+	}
+
+	for (int group = 0; group < Groups; ++group)
+	{
+		const size_t channel = static_cast<size_t>(first + 4 * group);
+		const SBDynamicsLanes& state = states[group];
+		_mm_storeu_ps(periodPeak.data() + channel, state.periodPeak);
+		_mm_storeu_ps(holdPeak.data() + channel, state.holdPeak);
+		_mm_storeu_ps(meanSum.data() + channel, state.meanSum);
+		_mm_storeu_ps(gain.data() + channel, state.gain);
+		_mm_storeu_ps(ramp.data() + channel, state.ramp);
+		_mm_storeu_ps(rampStep.data() + channel, state.rampStep);
+	}
+}
+#endif
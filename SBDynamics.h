@@ -0,0 +1,125 @@
+#pragma once
+
+#include "SBSampleKernels.h"
+
+#include <vector>
+
+enum class SBDynamicsType
+{
+	Limiter = 0,	// brickwall: no sample past the threshold (the ceiling), attack set by the lookahead
+	Compressor,
+	Gate,       	// downward expander below the threshold; ratios of 10 and more act as a gate
+};
+
+struct SBDynamicsChannel
+{
+	SBDynamicsType	type = SBDynamicsType::Limiter;
+	float         	thresholdDb = -0.3f;  	// dBFS sample peak
+	float         	ratio = 4.0f;         	// compressor above the threshold, gate below; the limiter is infinite
+	float         	kneeDb = 0.0f;        	// soft knee width, centred on the threshold
+	float         	rangeDb = 80.0f;      	// gate: attenuation when closed
+	float         	attackSeconds = 0.005f;	// compressor: gain going down, gate: opening; not for the limiter
+	float         	releaseSeconds = 0.1f;
+	float         	makeupDb = 0.0f;      	// compressor and gate
+};
+
+struct SBDynamicsSetup
+{
+	long  	numChannels = 0;
+	double	sampleRate = 48000.0;
+	float 	lookaheadSeconds = 0.002f;	// rounded up to whole periods, two at least: every channel is delayed by latency()
+};
+
+static constexpr long SB_DYNAMICS_PERIOD = 8;	// frames per gain computation, a multiple of 4
+
+// Limiters, compressors and gates on many channels, one SIMD lane per channel.
+//
+// Channel state lives in groups of four lanes (structure of arrays); blocks of 4x4 samples are transposed so the
+// envelopes run across channels, serial in time as they have to be. Per frame a lane only tracks its peak and
+// ramps its gain; once per period of 8 frames the peak enters the detector, a sliding maximum over the lookahead
+// in O(1) (van Herk / Gil-Werman: suffix maxima of the previous block of the window's length against the running
+// maximum of the current one), then the gain computer and the smoothing run in log2 units and the gain is
+// averaged over the lookahead with the same block scheme. The mean window is one period shorter than the
+// detector's, so both ends of every ramp are below the gain a peak needs by the time it leaves the delay:
+// limiters are brickwall with no branch per sample. Every channel shares the lookahead, so the bank adds one
+// latency.
+class SBDynamics
+{
+public:
+	explicit SBDynamics(const SBDynamicsSetup& setup);	// channels start as limiters with the default settings
+	SBDynamics(const SBDynamics&) = delete;
+	SBDynamics& operator=(const SBDynamics&) = delete;
+
+	// audio thread, between blocks (or before the first)
+	void setChannel(long channel, const SBDynamicsChannel& settings);
+	void reset();	// history and gains cleared
+
+	// audio thread; in and out may alias. channelCount up to numChannels() and the same on every call: the delay
+	// and detector cursors are shared, so channels left out fall out of step and need a reset() before joining.
+	void process(const float* const* in, float* const* out, long channelCount, long frameCount);
+
+	long numChannels() const { return channels; }
+	long latency() const { return delayLength - 1; }	// frames, the same for every channel
+	float gainDb(long channel) const;               	// smoothed gain of the last period, before makeup; audio thread
+
+private:
+	void processLane(const float* in, float* out, long frameCount, long channel);
+#if defined(SB_SIMD_SSE2)
+	template<int Groups>
+	void processGroups(const float* const* in, float* const* out, long frameCount, long first, long lanes);
+#endif
+
+	const long        	channels;
+	const long        	meanLength;  	// periods averaged, at least 1
+	const long        	holdLength;  	// periods in the detector's maximum, meanLength + 1
+	const long        	delayLength; 	// frames, holdLength periods
+	const double      	sampleRate;
+	long              	delayCursor = 0;	// next frame in the delay line, its position in the period in the low bits
+	long              	holdCursor = 0;
+	long              	meanCursor = 0;
+
+	// per group of 4 channels, rows of 4 lanes
+	std::vector<float>	delayLine;   	// delayLength rows
+	std::vector<float>	holdPeaks;   	// holdLength rows: peaks of the periods of the current block
+	std::vector<float>	holdMaxima;  	// holdLength + 1 rows: suffix maxima of the previous block, the last row stays 0
+	std::vector<float>	meanGains;   	// meanLength + 1 rows: suffix sums of the previous block, overwritten by the current gains
+
+	// per channel, padded to a multiple of 4
+	std::vector<float>	periodPeak;  	// of |input| in the current period
+	std::vector<float>	holdPeak;    	// running maximum of the current detector block
+	std::vector<float>	meanSum;     	// running sum of the current mean block
+	std::vector<float>	gain;        	// smoothed, log2
+	std::vector<float>	ramp;        	// linear gain of the last frame
+	std::vector<float>	rampStep;
+	std::vector<float>	thresholds;  	// log2
+	std::vector<float>	directions;  	// +1 above the threshold (limiter, compressor), -1 below (gate)
+	std::vector<float>	slopes;      	// log2 reduction per log2 past the threshold
+	std::vector<float>	halfKnees;
+	std::vector<float>	kneeScales;  	// 1 / (2 knee), 0 for a hard knee
+	std::vector<float>	ranges;
+	std::vector<float>	falls;       	// one pole coefficients per period, gain going down and up
+	std::vector<float>	rises;
+	std::vector<float>	makeups;
+};
+
+// The bank on the outputs of a block, as the engine, offline renders and session replays run it: in place in float
+// builds, otherwise on float copies in scratch (count * frameCount) through views (count pointers).
+inline void SB_ApplyDynamics(SBDynamics& dynamics, float* const* channels, long count, long frameCount, float* /*scratch*/, float** /*views*/)
+{
+	dynamics.process(channels, channels, count, frameCount);
+}
+
+template<typename T>
+inline void SB_ApplyDynamics(SBDynamics& dynamics, T* const* channels, long count, long frameCount, float* scratch, float** views)
+{
+	for (long channel = 0; channel < count; ++channel)
+	{
+		views[channel] = scratch + static_cast<size_t>(channel) * frameCount;
+		SB_ConvertSamples(channels[channel], views[channel], frameCount);
+	}
+	dynamics.process(views, views, count, frameCount);
+	for (long channel = 0; channel < count; ++channel)
+	{
+		SB_ConvertSamples(views[channel], channels[channel], frameCount);
+	}
+}
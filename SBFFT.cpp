@@ -0,0 +1,197 @@
+#include "SBFFT.h"
+#include "SBSimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#if defined(SB_SIMD_SSE2)
+// Two complex products per register, (re0, im0, re1, im1): (xr*yr - xi*yi, xi*yr + xr*yi).
+static inline __m128 SB_ComplexMultiply2(__m128 x, __m128 y)
+{
+	const __m128 negateReal = _mm_castsi128_ps(_mm_setr_epi32(static_cast<int>(0x80000000u), 0, static_cast<int>(0x80000000u), 0));
+	const __m128 yReal = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0));
+	const __m128 yImag = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 1, 1));
+	const __m128 xSwapped = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_add_ps(_mm_mul_ps(x, yReal), _mm_xor_ps(_mm_mul_ps(xSwapped, yImag), negateReal));
+}
+#endif
+
+SBFFT::SBFFT(size_t size)
+	: n(size), twiddles(size >= 4 ? size - 2 : 0), bitReverse(size)
+{
+	// contiguous per stage, so the butterflies load their twiddles in pairs
+	const double pi = 3.14159265358979323846;
+	for (size_t half = 2; half < n; half <<= 1)
+	{
+		for (size_t k = 0; k < half; ++k)
+		{
+			const double angle = -pi * static_cast<double>(k) / static_cast<double>(half);
+			twiddles[half - 2 + k] = SBComplex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+		}
+	}
+
+	unsigned bits = 0;
+	while ((size_t(1) << bits) < n)
+		++bits;
+	for (size_t index = 0; index < n; ++index)
+	{
+		uint32_t reversed = 0;
+		for (unsigned bit = 0; bit < bits; ++bit)
+			reversed |= ((index >> bit) & 1u) << (bits - 1 - bit);
+		bitReverse[index] = reversed;
+	}
+}
+
+void SBFFT::forward(SBComplex* data) const
+{
+	transform(data, false);
+}
+
+void SBFFT::inverse(SBComplex* data) const
+{
+	transform(data, true);
+	const float scale = 1.0f / static_cast<float>(n);
+	for (size_t index = 0; index < n; ++index)
+		data[index] *= scale;
+}
+
+void SBFFT::transform(SBComplex* data, bool inverse) const
+{
+	for (size_t index = 0; index < n; ++index)
+	{
+		if (index < bitReverse[index])
+			std::swap(data[index], data[bitReverse[index]]);
+	}
+
+	// span 2: the twiddle is 1
+	for (size_t start = 0; start + 1 < n; start += 2)
+	{
+		const SBComplex even = data[start];
+		data[start] = even + data[start + 1];
+		data[start + 1] = even - data[start + 1];
+	}
+
+#if defined(SB_SIMD_SSE2)
+	const __m128 conjugate = _mm_castsi128_ps(_mm_setr_epi32(0, static_cast<int>(0x80000000u), 0, static_cast<int>(0x80000000u)));
+	const __m128 sign = inverse ? conjugate : _mm_setzero_ps();
+#endif
+	for (size_t half = 2; half < n; half <<= 1)
+	{
+		const SBComplex* stage = twiddles.data() + half - 2;
+		for (size_t start = 0; start < n; start += 2 * half)
+		{
+			SBComplex* even = data + start;
+			SBComplex* odd = even + half;
+			size_t k = 0;
+#if defined(SB_SIMD_SSE2)
+			for (; k + 2 <= half; k += 2)
+			{
+				const __m128 twiddle = _mm_xor_ps(_mm_loadu_ps(reinterpret_cast<const float*>(stage + k)), sign);
+				const __m128 product = SB_ComplexMultiply2(_mm_loadu_ps(reinterpret_cast<const float*>(odd + k)), twiddle);
+				const __m128 value = _mm_loadu_ps(reinterpret_cast<const float*>(even + k));
+				_mm_storeu_ps(reinterpret_cast<float*>(odd + k), _mm_sub_ps(value, product));
+				_mm_storeu_ps(reinterpret_cast<float*>(even + k), _mm_add_ps(value, product));
+			}
+#endif
+			for (; k < half; ++k)
+			{
+				const SBComplex twiddle = inverse ? std::conj(stage[k]) : stage[k];
+				const SBComplex product = SB_ComplexMultiply(odd[k], twiddle);
+				odd[k] = even[k] - product;
+				even[k] += product;
+			}
+		}
+	}
+}
+
+//
+// SBRealFFT
+//
+
+SBRealFFT::SBRealFFT(size_t size)
+	: n(size), half(size / 2), twiddles(size / 4 + 1)
+{
+	const double pi = 3.14159265358979323846;
+	for (size_t k = 0; k < twiddles.size(); ++k)
+	{
+		const double angle = -2.0 * pi * static_cast<double>(k) / static_cast<double>(n);
+		twiddles[k] = SBComplex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+	}
+}
+
+void SBRealFFT::forward(const float* input, SBComplex* spectrum) const
+{
+	// z[k] = x[2k] + i*x[2k+1], transformed in place in the first n/2 bins
+	const size_t m = n / 2;
+	std::copy_n(input, n, reinterpret_cast<float*>(spectrum));
+	half.forward(spectrum);
+
+	// X[k] = E[k] + w^k O[k] with E[k] = (Z[k] + Z*[m-k]) / 2 and O[k] = -i (Z[k] - Z*[m-k]) / 2;
+	// E and O of m-k are the conjugates of those of k and w^(m-k) = -conj(w^k), so each pair is solved at once
+	const SBComplex z0 = spectrum[0];
+	spectrum[0] = SBComplex(z0.real() + z0.imag(), 0.0f);
+	spectrum[m] = SBComplex(z0.real() - z0.imag(), 0.0f);
+	for (size_t k = 1; k <= m / 2; ++k)
+	{
+		const SBComplex a = spectrum[k];
+		const SBComplex b = std::conj(spectrum[m - k]);
+		const SBComplex even = 0.5f * (a + b);
+		const SBComplex difference = 0.5f * (a - b);
+		const SBComplex odd = SB_ComplexMultiply(SBComplex(difference.imag(), -difference.real()), twiddles[k]);
+		spectrum[k] = even + odd;
+		spectrum[m - k] = std::conj(even - odd);
+	}
+}
+
+void SBRealFFT::inverse(SBComplex* spectrum, float* output) const
+{
+	// Z[k] = E[k] + i*O[k], with E[k] = (X[k] + X*[m-k]) / 2 and O[k] = (X[k] - X*[m-k]) conj(w^k) / 2
+	const size_t m = n / 2;
+	const float dc = spectrum[0].real();
+	const float nyquist = spectrum[m].real();
+	spectrum[0] = SBComplex(0.5f * (dc + nyquist), 0.5f * (dc - nyquist));
+	for (size_t k = 1; k <= m / 2; ++k)
+	{
+		const SBComplex a = spectrum[k];
+		const SBComplex b = std::conj(spectrum[m - k]);
+		const SBComplex even = 0.5f * (a + b);
+		const SBComplex odd = SB_ComplexMultiply(0.5f * (a - b), std::conj(twiddles[k]));
+		spectrum[k] = SBComplex(even.real() - odd.imag(), even.imag() + odd.real());
+		spectrum[m - k] = SBComplex(even.real() + odd.imag(), odd.real() - even.imag());
+	}
+	half.inverse(spectrum);
+	const float* values = reinterpret_cast<const float*>(spectrum);
+	std::copy_n(values, n, output);
+}
+
+void SB_ComplexMultiplyAccumulate(SBComplex* accumulator, const SBComplex* a, const SBComplex* b, size_t count)
+{
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	// std::complex<float> is laid out as float[2]: (re0, im0, re1, im1) per register
+	float* out = reinterpret_cast<float*>(accumulator);
+	const float* left = reinterpret_cast<const float*>(a);
+	const float* right = reinterpret_cast<const float*>(b);
+	for (; index + 2 <= count; index += 2)
+	{
+		const __m128 product = SB_ComplexMultiply2(_mm_loadu_ps(left + 2 * index), _mm_loadu_ps(right + 2 * index));
+		_mm_storeu_ps(out + 2 * index, _mm_add_ps(_mm_loadu_ps(out + 2 * index), product));
+	}
+#endif
+	for (; index < count; ++index)
+		accumulator[index] += SB_ComplexMultiply(a[index], b[index]);
+}
+
+void SB_ComplexMultiplyInPlace(SBComplex* values, const SBComplex* factors, size_t count)
+{
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	float* out = reinterpret_cast<float*>(values);
+	const float* right = reinterpret_cast<const float*>(factors);
+	for (; index + 2 <= count; index += 2)
+		_mm_storeu_ps(out + 2 * index, SB_ComplexMultiply2(_mm_loadu_ps(out + 2 * index), _mm_loadu_ps(right + 2 * index)));
+#endif
+	for (; index < count; ++index)
+		values[index] = SB_ComplexMultiply(values[index], factors[index]);
+}
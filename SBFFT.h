@@ -0,0 +1,59 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <cstdint>
+
+using SBComplex = std::complex<float>;
+
+// std::complex operator* carries the C99 NaN/inf recovery path, too slow for inner loops.
+inline SBComplex SB_ComplexMultiply(const SBComplex& a, const SBComplex& b)
+{
+	return SBComplex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// accumulator[k] += a[k] * b[k]; SSE2, two bins per step.
+void SB_ComplexMultiplyAccumulate(SBComplex* accumulator, const SBComplex* a, const SBComplex* b, size_t count);
+
+// values[k] *= factors[k]; SSE2, two bins per step.
+void SB_ComplexMultiplyInPlace(SBComplex* values, const SBComplex* factors, size_t count);
+
+// In-place radix-2 complex FFT with precomputed twiddles and bit reversal table.
+// Tables are built once at construction; transforms never allocate. Butterflies run two at a time with SSE2.
+class SBFFT
+{
+public:
+	explicit SBFFT(size_t size);	// size: power of two
+
+	size_t size() const { return n; }
+
+	void forward(SBComplex* data) const;
+	void inverse(SBComplex* data) const;	// scaled by 1/size
+
+private:
+	void transform(SBComplex* data, bool inverse) const;
+
+	size_t                	n;
+	std::vector<SBComplex>	twiddles;	// per stage of span 2h (h >= 2), e^(-2*pi*i*k/2h) for k < h, from offset h - 2
+	std::vector<uint32_t> 	bitReverse;
+};
+
+// FFT of real samples: the even and odd samples are packed into one complex FFT of half the size, then split
+// into the bins 0 to size/2 (DC and Nyquist have no imaginary part). About half the work of a complex transform;
+// the inverse merges the bins back the same way.
+class SBRealFFT
+{
+public:
+	explicit SBRealFFT(size_t size);	// size: power of two, at least 4
+
+	size_t size() const { return n; }
+	size_t bins() const { return n / 2 + 1; }
+
+	void forward(const float* input, SBComplex* spectrum) const;	// spectrum: bins() values, not overlapping input
+	void inverse(SBComplex* spectrum, float* output) const;     	// scaled by 1/size; spectrum is used as scratch
+
+private:
+	size_t                	n;
+	SBFFT                 	half;
+	std::vector<SBComplex>	twiddles;	// e^(-2*pi*i*k/n), k <= n/4
+};
@@ -0,0 +1,367 @@
+#include "SBFile.h"
+#include "SBTrace.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::string SB_Utf8FromPath(const std::wstring& path)
+{
+	std::string narrow;
+	narrow.reserve(path.size());
+	for (size_t index = 0; index < path.size(); ++index)
+	{
+		uint32_t code = static_cast<uint32_t>(path[index]);
+		// UTF-16 surrogate pair where wchar_t is 16 bits (Windows)
+		if (sizeof(wchar_t) == 2 && code >= 0xD800 && code < 0xDC00 && index + 1 < path.size())
+		{
+			const uint32_t low = static_cast<uint32_t>(path[index + 1]);
+			if (low >= 0xDC00 && low < 0xE000)
+			{
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				++index;
+			}
+		}
+		if (code < 0x80)
+		{
+			narrow += static_cast<char>(code);
+		}
+		else if (code < 0x800)
+		{
+			narrow += static_cast<char>(0xC0 | (code >> 6));
+			narrow += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			narrow += static_cast<char>(0xE0 | (code >> 12));
+			narrow += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			narrow += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			narrow += static_cast<char>(0xF0 | (code >> 18));
+			narrow += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+			narrow += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			narrow += static_cast<char>(0x80 | (code & 0x3F));
+		}
+	}
+	return narrow;
+}
+
+std::wstring SB_PathFromUtf8(const char* text, size_t length)
+{
+	std::wstring path;
+	path.reserve(length);
+	for (size_t index = 0; index < length;)
+	{
+		const unsigned char lead = static_cast<unsigned char>(text[index]);
+		const size_t count = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+		uint32_t code = count == 1 ? lead : count == 2 ? (lead & 0x1F) : count == 3 ? (lead & 0x0F) : (lead & 0x07);
+		for (size_t next = 1; next < count && index + next < length; ++next)
+			code = (code << 6) | (static_cast<unsigned char>(text[index + next]) & 0x3F);
+		index += count;
+		if (sizeof(wchar_t) == 2 && code >= 0x10000)
+		{
+			path += static_cast<wchar_t>(0xD800 + ((code - 0x10000) >> 10));
+			path += static_cast<wchar_t>(0xDC00 + ((code - 0x10000) & 0x3FF));
+		}
+		else
+			path += static_cast<wchar_t>(code);
+	}
+	return path;
+}
+
+#ifndef _WIN32
+static std::string SB_NarrowPath(const std::wstring& path)
+{
+	return SB_Utf8FromPath(path);
+}
+#endif
+
+SBFileInfo SB_GetFileInfo(const std::wstring& path)
+{
+	SBFileInfo info;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+	{
+		info.exists = true;
+		info.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		info.modifiedTime = static_cast<int64_t>((static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+	}
+#else
+	struct stat status = {};
+	if (stat(SB_NarrowPath(path).c_str(), &status) == 0)
+	{
+		info.exists = true;
+		info.size = static_cast<uint64_t>(status.st_size);
+		info.modifiedTime = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+	}
+#endif
+	return info;
+}
+
+std::FILE* SB_OpenFile(const std::wstring& path, const char* mode)
+{
+#ifdef _WIN32
+	const std::wstring wideMode(mode, mode + strlen(mode));
+	return _wfopen(path.c_str(), wideMode.c_str());
+#else
+	return fopen(SB_NarrowPath(path).c_str(), mode);
+#endif
+}
+
+bool SB_DeleteFile(const std::wstring& path)
+{
+#ifdef _WIN32
+	return DeleteFileW(path.c_str()) != 0;
+#else
+	return ::unlink(SB_NarrowPath(path).c_str()) == 0;
+#endif
+}
+
+bool SB_ReadFile(const std::wstring& path, std::vector<char>& data)
+{
+	SBTraceScope trace("SB_ReadFile");
+	data.clear();
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size = {};
+	bool success = GetFileSizeEx(file, &size) != FALSE;
+	if (success)
+	{
+		data.resize(static_cast<size_t>(size.QuadPart));
+		size_t offset = 0;
+		while (success && offset < data.size())
+		{
+			DWORD read = 0;
+			success = ReadFile(file, data.data() + offset, static_cast<DWORD>(std::min<size_t>(data.size() - offset, 1u << 30)), &read, NULL) && read > 0;
+			offset += read;
+		}
+	}
+	CloseHandle(file);
+	return success;
+#else
+	const int file = ::open(SB_NarrowPath(path).c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status = {};
+	bool success = fstat(file, &status) == 0;
+	if (success)
+	{
+		data.resize(static_cast<size_t>(status.st_size));
+		size_t offset = 0;
+		while (success && offset < data.size())
+		{
+			const ssize_t count = ::read(file, data.data() + offset, data.size() - offset);
+			success = count > 0;
+			offset += success ? static_cast<size_t>(count) : 0;
+		}
+	}
+	::close(file);
+	return success;
+#endif
+}
+
+size_t SB_ReadFileHead(const std::wstring& path, void* data, size_t size)
+{
+	SBTraceScope trace("SB_ReadFileHead");
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 0;
+	DWORD read = 0;
+	if (!ReadFile(file, data, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &read, NULL))
+		read = 0;
+	CloseHandle(file);
+	return read;
+#else
+	const int file = ::open(SB_NarrowPath(path).c_str(), O_RDONLY);
+	if (file < 0)
+		return 0;
+	size_t offset = 0;
+	while (offset < size)
+	{
+		const ssize_t count = ::read(file, static_cast<char*>(data) + offset, size - offset);
+		if (count <= 0)
+			break;
+		offset += static_cast<size_t>(count);
+	}
+	::close(file);
+	return offset;
+#endif
+}
+
+bool SB_ListDirectory(const std::wstring& path, std::vector<SBDirectoryEntry>& entries)
+{
+	SBTraceScope trace("SB_ListDirectory");
+	entries.clear();
+#ifdef _WIN32
+	// sizes and times come with the listing, nothing is opened per file
+	WIN32_FIND_DATAW found = {};
+	HANDLE search = FindFirstFileExW((path + L"\\*").c_str(), FindExInfoBasic, &found, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (search == INVALID_HANDLE_VALUE)
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	do
+	{
+		if (wcscmp(found.cFileName, L".") == 0 || wcscmp(found.cFileName, L"..") == 0)
+			continue;
+		// junctions and links are not followed, they can loop
+		if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+			continue;
+		SBDirectoryEntry entry;
+		entry.name = found.cFileName;
+		entry.directory = (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if (!entry.directory)
+		{
+			entry.info.exists = true;
+			entry.info.size = (static_cast<uint64_t>(found.nFileSizeHigh) << 32) | found.nFileSizeLow;
+			entry.info.modifiedTime = static_cast<int64_t>((static_cast<uint64_t>(found.ftLastWriteTime.dwHighDateTime) << 32) | found.ftLastWriteTime.dwLowDateTime);
+		}
+		entries.push_back(std::move(entry));
+	} while (FindNextFileW(search, &found));
+	FindClose(search);
+	return true;
+#else
+	DIR* directory = opendir(SB_NarrowPath(path).c_str());
+	if (!directory)
+		return false;
+	const int descriptor = dirfd(directory);
+	while (const dirent* found = readdir(directory))
+	{
+		if (strcmp(found->d_name, ".") == 0 || strcmp(found->d_name, "..") == 0)
+			continue;
+		// links to files count as files, links to directories are not followed, they can loop
+		struct stat status = {};
+		if (fstatat(descriptor, found->d_name, &status, AT_SYMLINK_NOFOLLOW) != 0)
+			continue;
+		if (S_ISLNK(status.st_mode) && (fstatat(descriptor, found->d_name, &status, 0) != 0 || !S_ISREG(status.st_mode)))
+			continue;
+		if (!S_ISREG(status.st_mode) && !S_ISDIR(status.st_mode))
+			continue;
+		SBDirectoryEntry entry;
+		entry.name = SB_PathFromUtf8(found->d_name, strlen(found->d_name));
+		entry.directory = S_ISDIR(status.st_mode);
+		if (!entry.directory)
+		{
+			entry.info.exists = true;
+			entry.info.size = static_cast<uint64_t>(status.st_size);
+			entry.info.modifiedTime = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+		}
+		entries.push_back(std::move(entry));
+	}
+	closedir(directory);
+	return true;
+#endif
+}
+
+bool SB_WriteFileAtomically(const std::wstring& path, const void* data, size_t size)
+{
+	SBTraceScope trace("SB_WriteFileAtomically");
+	const std::wstring temporaryPath = path + L".tmp";
+#ifdef _WIN32
+	HANDLE file = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	bool success = true;
+	size_t offset = 0;
+	while (success && offset < size)
+	{
+		DWORD written = 0;
+		success = WriteFile(file, static_cast<const char*>(data) + offset, static_cast<DWORD>(std::min<size_t>(size - offset, 1u << 30)), &written, NULL) && written > 0;
+		offset += written;
+	}
+	CloseHandle(file);
+	return success && MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	const std::string narrowPath = SB_NarrowPath(temporaryPath);
+	const int file = ::open(narrowPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+		return false;
+	bool success = true;
+	size_t offset = 0;
+	while (success && offset < size)
+	{
+		const ssize_t count = ::write(file, static_cast<const char*>(data) + offset, size - offset);
+		success = count > 0;
+		offset += success ? static_cast<size_t>(count) : 0;
+	}
+	success = ::close(file) == 0 && success;
+	return success && ::rename(narrowPath.c_str(), SB_NarrowPath(path).c_str()) == 0;
+#endif
+}
+
+//
+// SBMappedFile
+//
+bool SBMappedFile::open(const std::wstring& path)
+{
+	SBTraceScope trace("SBMappedFile::open");
+	close();
+#ifdef _WIN32
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER size = {};
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			length = view ? static_cast<size_t>(size.QuadPart) : 0;
+		}
+	}
+#else
+	const int file = ::open(SB_NarrowPath(path).c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status = {};
+	if (fstat(file, &status) == 0 && status.st_size > 0)
+	{
+		void* address = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+		if (address != MAP_FAILED)
+		{
+			view = static_cast<const char*>(address);
+			length = static_cast<size_t>(status.st_size);
+		}
+	}
+	::close(file);	// the mapping keeps its own reference
+#endif
+	if (!view)
+		close();
+	return view != nullptr;
+}
+
+void SBMappedFile::close()
+{
+#ifdef _WIN32
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (view)
+		munmap(const_cast<char*>(view), length);
+#endif
+	view = nullptr;
+	length = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+// Paths are wide strings, as everywhere else in the application; converted to UTF-8 on POSIX.
+struct SBFileInfo
+{
+	bool    	exists = false;
+	uint64_t	size = 0;
+	int64_t 	modifiedTime = 0;	// platform ticks, only meant for equality checks
+
+	bool operator ==(const SBFileInfo& other) const { return exists == other.exists && size == other.size && modifiedTime == other.modifiedTime; }
+	bool operator !=(const SBFileInfo& other) const { return !(*this == other); }
+};
+
+struct SBDirectoryEntry
+{
+	std::wstring	name;
+	bool        	directory = false;
+	SBFileInfo  	info;	// files only, same values as SB_GetFileInfo
+};
+
+std::string SB_Utf8FromPath(const std::wstring& path);
+std::wstring SB_PathFromUtf8(const char* text, size_t length);
+
+SBFileInfo SB_GetFileInfo(const std::wstring& path);
+std::FILE* SB_OpenFile(const std::wstring& path, const char* mode);	// fopen modes
+bool SB_DeleteFile(const std::wstring& path);
+bool SB_ReadFile(const std::wstring& path, std::vector<char>& data);
+size_t SB_ReadFileHead(const std::wstring& path, void* data, size_t size);	// first size bytes at most, returns the count read
+
+// Files and subdirectories of path, without "." and "..". Links to directories are skipped.
+bool SB_ListDirectory(const std::wstring& path, std::vector<SBDirectoryEntry>& entries);
+
+// Writes next to the target then renames over it, so readers never see a partial file.
+bool SB_WriteFileAtomically(const std::wstring& path, const void* data, size_t size);
+
+// Read-only view of a whole file.
+class SBMappedFile
+{
+public:
+	SBMappedFile() = default;
+	SBMappedFile(const SBMappedFile&) = delete;
+	SBMappedFile& operator=(const SBMappedFile&) = delete;
+	~SBMappedFile() { close(); }
+
+	bool open(const std::wstring& path);
+	void close();
+
+	const char* data() const { return view; }
+	size_t size() const { return length; }
+	operator bool() const { return view != nullptr; }
+
+private:
+	const char*	view = nullptr;
+	size_t     	length = 0;
+#ifdef _WIN32
+	void*      	file = nullptr;
+	void*      	mapping = nullptr;
+#endif
+};
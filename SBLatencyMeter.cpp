@@ -0,0 +1,210 @@
+#include "SBLatencyMeter.h"
+#include "SBAudioEngine.h"
+#include "SBFFT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+//
+// Sequence & correlation
+//
+std::vector<float> SB_GenerateMLS(int order)
+{
+	// Fibonacci LFSR feedback taps (primitive polynomials), bit 0 being the output
+	static const uint32_t taps[][4] = {
+		{ 10, 7, 0, 0 },
+		{ 11, 9, 0, 0 },
+		{ 12, 11, 10, 4 },
+		{ 13, 12, 11, 8 },
+		{ 14, 13, 12, 2 },
+		{ 15, 14, 0, 0 },
+		{ 16, 15, 13, 4 },
+		{ 17, 14, 0, 0 },
+		{ 18, 11, 0, 0 },
+	};
+	if (order < 10 || order > 18)
+		return {};
+
+	uint32_t mask = 0;
+	for (uint32_t tap : taps[order - 10])
+	{
+		if (tap)
+			mask |= 1u << (order - tap);
+	}
+
+	const size_t length = (size_t(1) << order) - 1;
+	std::vector<float> sequence(length);
+	uint32_t state = 1;
+	for (size_t index = 0; index < length; ++index)
+	{
+		sequence[index] = (state & 1u) ? 1.0f : -1.0f;
+		uint32_t feedback = state & mask;
+		feedback ^= feedback >> 16;
+		feedback ^= feedback >> 8;
+		feedback ^= feedback >> 4;
+		feedback ^= feedback >> 2;
+		feedback ^= feedback >> 1;
+		state = (state >> 1) | ((feedback & 1u) << (order - 1));
+	}
+	return sequence;
+}
+
+long SB_FindCorrelationLag(const float* reference, size_t referenceLength, const float* captured, size_t capturedLength, float* confidence)
+{
+	if (referenceLength == 0 || capturedLength == 0)
+		return -1;
+
+	// zero padded so the circular correlation equals the linear one for every lag in the capture
+	const SBFFT fft(SB_RoundUpToPowerOfTwo(referenceLength + capturedLength));
+	std::vector<SBComplex> capturedSpectrum(fft.size()), referenceSpectrum(fft.size());
+	std::copy_n(captured, capturedLength, capturedSpectrum.begin());
+	std::copy_n(reference, referenceLength, referenceSpectrum.begin());
+	fft.forward(capturedSpectrum.data());
+	fft.forward(referenceSpectrum.data());
+	for (size_t bin = 0; bin < fft.size(); ++bin)
+	{
+		capturedSpectrum[bin] = SB_ComplexMultiply(capturedSpectrum[bin], std::conj(referenceSpectrum[bin]));
+	}
+	fft.inverse(capturedSpectrum.data());
+
+	size_t peakLag = 0;
+	float peak = 0.0f;
+	for (size_t lag = 0; lag < capturedLength; ++lag)
+	{
+		const float value = std::abs(capturedSpectrum[lag].real());
+		if (value > peak)
+		{
+			peak = value;
+			peakLag = lag;
+		}
+	}
+
+	// strongest correlation away from the peak (a few samples excluded for band-limited converters)
+	static constexpr size_t guard = 8;
+	float sideLobe = 0.0f;
+	for (size_t lag = 0; lag < capturedLength; ++lag)
+	{
+		if (lag + guard < peakLag || lag > peakLag + guard)
+			sideLobe = std::max(sideLobe, std::abs(capturedSpectrum[lag].real()));
+	}
+	const float ratio = sideLobe > 0.0f ? peak / sideLobe : (peak > 0.0f ? INFINITY : 0.0f);
+	if (confidence)
+		*confidence = ratio;
+	return peak > 0.0f ? static_cast<long>(peakLag) : -1;
+}
+
+//
+// Probe
+//
+struct SBLatencyProbe
+{
+	long              	outputChannel = 0;
+	long              	inputChannel = 0;
+	float             	level = 0.0f;
+	std::vector<float>	sequence;
+	std::vector<float>	captured;
+	size_t            	position = 0;   	// frames emitted (and captured) so far
+	long              	settleBlocks = 8;	// let the driver reach its steady state first
+	std::atomic<bool> 	done = { false };
+};
+
+static void SB_LatencyProbeProcess(const SBAudioBlock& block, void* userData)
+{
+	SBLatencyProbe& probe = *static_cast<SBLatencyProbe*>(userData);
+	for (long channel = 0; channel < block.numOutputs; ++channel)
+		std::fill_n(block.outputs[channel], block.frameCount, SBAudioSample());
+
+	if (probe.done.load(std::memory_order_relaxed) || probe.settleBlocks-- > 0)
+		return;
+	if (probe.outputChannel >= block.numOutputs || probe.inputChannel >= block.numInputs)
+	{
+		probe.done.store(true, std::memory_order_release);	// captured stays silent, no lag will be found
+		return;
+	}
+
+	// emission and capture share the same frame counter, so the lag is the host round trip
+	SBAudioSample* output = block.outputs[probe.outputChannel];
+	const SBAudioSample* input = block.inputs[probe.inputChannel];
+	for (long frame = 0; frame < block.frameCount; ++frame)
+	{
+		const size_t position = probe.position + frame;
+		if (position < probe.sequence.size())
+			output[frame] = SBSampleTraits<SBAudioSample>::fromDouble(probe.sequence[position] * probe.level);
+		if (position < probe.captured.size())
+			probe.captured[position] = static_cast<float>(SBSampleTraits<SBAudioSample>::toDouble(input[frame]));
+	}
+	probe.position += block.frameCount;
+	if (probe.position >= probe.captured.size())
+		probe.done.store(true, std::memory_order_release);
+}
+
+SBLatencyMeasurement SB_MeasureRoundTripLatency(IASIO* handle, const SBLatencyMeterSetup& setup)
+{
+	SBLatencyMeasurement measurement;
+
+	SBLatencyProbe probe;
+	probe.outputChannel = setup.outputChannel;
+	probe.inputChannel = setup.inputChannel;
+	probe.level = setup.level;
+	probe.sequence = setup.sequenceOrder > 0 ? SB_GenerateMLS(setup.sequenceOrder) : std::vector<float>(1, 1.0f);
+	if (probe.sequence.empty())
+		return measurement;
+
+	SBAudioEngineSetup engineSetup;
+	engineSetup.bufferSize = setup.bufferSize;
+	engineSetup.maxInputs = setup.inputChannel + 1;
+	engineSetup.maxOutputs = setup.outputChannel + 1;
+	engineSetup.process = &SB_LatencyProbeProcess;
+	engineSetup.userData = &probe;
+	SBAudioEngine* engine = SB_CreateAudioEngine(handle, engineSetup);
+	if (!engine)
+		return measurement;
+
+	const SBAudioEngineStats stats = SB_GetAudioEngineStats(engine);
+	measurement.bufferSize = stats.bufferSize;
+	measurement.sampleRate = stats.sampleRate;
+	measurement.reportedInputLatency = stats.inputLatency;
+	measurement.reportedOutputLatency = stats.outputLatency;
+
+	ASIOInternalBufferInfo internalBuffers = {};
+	const ASIOError internalResult = handle->future(ASIOFuture::GetInternalBufferSamples, &internalBuffers);
+	if (internalResult == ASIOError::SuccessFuture || internalResult == ASIOError::OK)
+	{
+		measurement.internalInputSamples = internalBuffers.inputSamples;
+		measurement.internalOutputSamples = internalBuffers.outputSamples;
+	}
+
+	const size_t window = static_cast<size_t>(setup.maxLatencySeconds * stats.sampleRate);
+	probe.captured.assign(probe.sequence.size() + window, 0.0f);
+	const bool started = SB_StartAudioEngine(engine) == ASIOError::OK;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(setup.timeoutSeconds));
+	while (started && !probe.done.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	SB_StopAudioEngine(engine);
+	SB_DestroyAudioEngine(engine);
+
+	if (probe.done.load(std::memory_order_acquire))
+	{
+		const long lag = SB_FindCorrelationLag(probe.sequence.data(), probe.sequence.size(), probe.captured.data(), probe.captured.size(), &measurement.confidence);
+		measurement.measuredSamples = lag;
+		// an MLS correlation peak stands far above its side lobes; a lone impulse only needs to be the maximum
+		measurement.valid = lag >= 0 && measurement.confidence > (setup.sequenceOrder > 0 ? 4.0f : 1.0f);
+	}
+	return measurement;
+}
+
+SBLatencyMeasurement SB_MeasureRoundTripLatency(const SBAsioDevice& device, const SBLatencyMeterSetup& setup)
+{
+	SBLatencyMeasurement measurement;
+	if (IASIO* handle = SB_QueryInterface(device))
+	{
+		measurement = SB_MeasureRoundTripLatency(handle, setup);
+		handle->Release();
+	}
+	return measurement;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SBAsioDevice.h"
+
+#include <vector>
+
+struct SBLatencyMeterSetup
+{
+	long  	outputChannel = 0;
+	long  	inputChannel = 0;       	// physically (or virtually) looped back to outputChannel
+	int   	sequenceOrder = 14;     	// MLS of 2^order - 1 samples (10 to 18); 0 for a single impulse
+	float 	level = 0.25f;          	// -12 dBFS
+	long  	bufferSize = 0;         	// 0: driver preferred size
+	double	maxLatencySeconds = 1.0;	// capture window beyond the end of the sequence
+	double	timeoutSeconds = 5.0;
+};
+
+struct SBLatencyMeasurement
+{
+	bool  	valid = false;
+	long  	measuredSamples = 0;      	// from output write to input read, as seen by the host
+	long  	reportedInputLatency = 0; 	// getLatencies
+	long  	reportedOutputLatency = 0;
+	long  	internalInputSamples = 0; 	// ASIOFuture::GetInternalBufferSamples, included in the reported latencies
+	long  	internalOutputSamples = 0;
+	long  	bufferSize = 0;
+	double	sampleRate = 0.0;
+	float 	confidence = 0.0f;        	// correlation peak over the strongest side lobe
+
+	long reportedSamples() const { return reportedInputLatency + reportedOutputLatency; }
+	long errorSamples() const { return measuredSamples - reportedSamples(); }
+};
+
+// Maximum length sequence of +/-1, 2^order - 1 samples long (order 10 to 18).
+std::vector<float> SB_GenerateMLS(int order);
+
+// Position of reference inside captured using FFT cross-correlation; -1 when it cannot be found.
+long SB_FindCorrelationLag(const float* reference, size_t referenceLength, const float* captured, size_t capturedLength, float* confidence = nullptr);
+
+// Runs an audio engine on the driver, plays the sequence on the output channel, captures the input
+// channel and correlates both. Blocks until the capture is complete or the timeout expires.
+SBLatencyMeasurement SB_MeasureRoundTripLatency(IASIO* handle, const SBLatencyMeterSetup& setup);
+SBLatencyMeasurement SB_MeasureRoundTripLatency(const SBAsioDevice& device, const SBLatencyMeterSetup& setup);
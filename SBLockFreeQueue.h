@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+static constexpr size_t SB_CACHE_LINE_SIZE = 64;
+
+inline size_t SB_RoundUpToPowerOfTwo(size_t value)
+{
+	size_t result = 2;
+	while (result < value)
+		result <<= 1;
+	return result;
+}
+
+// Bounded multi-producer/multi-consumer queue (D. Vyukov).
+// Every slot carries a sequence number so producers and consumers only contend on their own index.
+// Never allocates after construction; push fails (returns false) when the queue is full.
+template<typename T>
+class SBLockFreeQueue
+{
+public:
+	explicit SBLockFreeQueue(size_t capacity)
+		: mask(SB_RoundUpToPowerOfTwo(capacity) - 1), slots(new Slot[mask + 1])
+	{
+		for (size_t index = 0; index <= mask; ++index)
+		{
+			slots[index].sequence.store(index, std::memory_order_relaxed);
+		}
+	}
+	SBLockFreeQueue(const SBLockFreeQueue&) = delete;
+	SBLockFreeQueue& operator=(const SBLockFreeQueue&) = delete;
+
+	size_t capacity() const { return mask + 1; }
+
+	bool push(const T& value)
+	{
+		size_t position = pushIndex.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Slot& slot = slots[position & mask];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t delta = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (delta == 0)
+			{
+				if (pushIndex.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					slot.value = value;
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (delta < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = pushIndex.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool pop(T& value)
+	{
+		size_t position = popIndex.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Slot& slot = slots[position & mask];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t delta = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+			if (delta == 0)
+			{
+				if (popIndex.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value = slot.value;
+					slot.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (delta < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = popIndex.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	// padding rather than alignas: over-aligned new is not guaranteed before C++17
+	const size_t mask;
+	std::unique_ptr<Slot[]> slots;
+	char padding0[SB_CACHE_LINE_SIZE];
+	std::atomic<size_t> pushIndex = { 0 };
+	char padding1[SB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> popIndex = { 0 };
+	char padding2[SB_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
@@ -0,0 +1,335 @@
+#include "SBLoopbackAsio.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+class SBLoopbackAsio final : public IASIO
+{
+public:
+	explicit SBLoopbackAsio(const SBLoopbackAsioSetup& setup)
+		: setup(setup), sampleRate(setup.sampleRate)
+	{
+	}
+	~SBLoopbackAsio()
+	{
+		stop();
+	}
+
+	// IUnknown
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void**) override { return static_cast<HRESULT>(0x80004002L); } // E_NOINTERFACE
+	ULONG STDMETHODCALLTYPE AddRef() override { return ++refcount; }
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		const ULONG count = --refcount;
+		if (count == 0)
+			delete this;
+		return count;
+	}
+
+	// IASIO
+	ASIOBool init(void*) override { return ASIOBool::True; }
+	void getDriverName(char* name) override { strcpy(name, "SBAudio Loopback"); }
+	long getDriverVersion() override { return 1; }
+	void getErrorMessage(char* string) override { strcpy(string, ""); }
+
+	ASIOError start() override
+	{
+		if (channels.empty())
+			return ASIOError::InvalidMode;
+		if (!running.exchange(true))
+			clock = std::thread([this] { run(); });
+		return ASIOError::OK;
+	}
+	ASIOError stop() override
+	{
+		if (running.exchange(false))
+			clock.join();
+		return ASIOError::OK;
+	}
+
+	ASIOError getChannels(long* numInputChannels, long* numOutputChannels) override
+	{
+		*numInputChannels = *numOutputChannels = setup.numChannels;
+		return ASIOError::OK;
+	}
+	ASIOError getLatencies(long* inputLatency, long* outputLatency) override
+	{
+		if (channels.empty())
+			return ASIOError::NotPresent;
+		*inputLatency = bufferSize + setup.inputDelay + setup.internalInputSamples;
+		*outputLatency = bufferSize + setup.outputDelay + setup.internalOutputSamples + setup.latencyReportError;
+		return ASIOError::OK;
+	}
+	ASIOError getBufferSize(long* minSize, long* maxSize, long* preferredSize, long* granularity) override
+	{
+		*minSize = setup.minBufferSize;
+		*maxSize = setup.maxBufferSize;
+		*preferredSize = setup.preferredBufferSize;
+		*granularity = -1;
+		return ASIOError::OK;
+	}
+
+	// the external clock imposes its rate
+	ASIOError canSampleRate(ASIOSampleRate rate) override
+	{
+		if (rate <= 0.0)
+			return ASIOError::NoClock;
+		return !externalSelected() || rate == setup.externalClockRate ? ASIOError::OK : ASIOError::NoClock;
+	}
+	ASIOError getSampleRate(ASIOSampleRate* rate) override
+	{
+		if (clockLost())
+		{
+			*rate = 0.0;
+			return ASIOError::NoClock;
+		}
+		*rate = sampleRate;
+		return ASIOError::OK;
+	}
+	ASIOError setSampleRate(ASIOSampleRate rate) override
+	{
+		if (canSampleRate(rate) != ASIOError::OK)
+			return ASIOError::NoClock;
+		sampleRate = rate;
+		return ASIOError::OK;
+	}
+	ASIOError getClockSources(ASIOClockSource* clocks, long* numSources) override
+	{
+		const long count = setup.externalClockRate > 0.0 ? 2 : 1;
+		if (*numSources < count)
+			return ASIOError::InvalidParameter;
+		for (long index = 0; index < count; ++index)
+		{
+			clocks[index] = {};
+			clocks[index].index = index;
+			clocks[index].associatedChannel = index == 0 ? -1 : 0;
+			clocks[index].isCurrentSource = index == clockSource ? ASIOBool::True : ASIOBool::False;
+			strcpy(clocks[index].name, index == 0 ? "Internal" : "External");
+		}
+		*numSources = count;
+		return ASIOError::OK;
+	}
+	ASIOError setClockSource(long reference) override
+	{
+		if (reference < 0 || reference > (setup.externalClockRate > 0.0 ? 1 : 0))
+			return ASIOError::InvalidParameter;
+		clockSource = reference;
+		if (reference == 1)
+			sampleRate = setup.externalClockRate;
+		return ASIOError::OK;
+	}
+
+	void setExternalClock(bool locked)
+	{
+		if (externalLocked.exchange(locked) == locked || !externalSelected())
+			return;
+		if (ASIOCallbacks* current = callbacks)
+			current->sampleRateDidChange(locked ? setup.externalClockRate : 0.0);
+	}
+
+	ASIOError getSamplePosition(ASIOSamples* sPos, ASIOTimeStamp* tStamp) override
+	{
+		if (!running)
+			return ASIOError::SPNotAdvancing;
+		*sPos = samplePosition.load();
+		*tStamp = systemTime.load();
+		return ASIOError::OK;
+	}
+	ASIOError getChannelInfo(ASIOChannelInfo* info) override
+	{
+		if (info->channel < 0 || info->channel >= setup.numChannels)
+			return ASIOError::InvalidParameter;
+		info->isActive = ASIOBool::False;
+		for (const Channel& channel : channels)
+		{
+			if (channel.isInput == (info->isInput == ASIOBool::True) && channel.index == info->channel)
+				info->isActive = ASIOBool::True;
+		}
+		info->channelGroup = 0;
+		info->type = ASIOSampleType::Float32_LSB;
+		snprintf(info->name, sizeof(info->name), "Loopback %s %d", info->isInput == ASIOBool::True ? "In" : "Out", static_cast<int>(info->channel + 1));
+		return ASIOError::OK;
+	}
+
+	ASIOError createBuffers(ASIOBufferInfo* bufferInfos, long numChannels, long size, ASIOCallbacks* asioCallbacks) override
+	{
+		if (running || !asioCallbacks || size < setup.minBufferSize || size > setup.maxBufferSize)
+			return ASIOError::InvalidMode;
+
+		bufferSize = size;
+		callbacks = asioCallbacks;
+		useTimeInfo = callbacks->asioMessage &&
+			callbacks->asioMessage(static_cast<long>(ASIOMessageSelector::SupportsTimeInfo), 0, nullptr, nullptr) == 1;
+
+		const long delay = setup.inputDelay + setup.outputDelay + setup.internalInputSamples + setup.internalOutputSamples;
+		delayLineSize = nextPowerOfTwo(delay + bufferSize);
+		channels.assign(numChannels, Channel());
+		for (long index = 0; index < numChannels; ++index)
+		{
+			Channel& channel = channels[index];
+			channel.isInput = bufferInfos[index].isInput == ASIOBool::True;
+			channel.index = bufferInfos[index].channelNum;
+			if (channel.index < 0 || channel.index >= setup.numChannels)
+			{
+				channels.clear();
+				return ASIOError::InvalidParameter;
+			}
+			channel.buffers.assign(2 * bufferSize, 0.0f);
+			if (!channel.isInput)
+			{
+				channel.delayLine.assign(delayLineSize, 0.0f);
+				channel.captured.assign(bufferSize, 0.0f);
+			}
+			bufferInfos[index].buffers[0] = channel.buffers.data();
+			bufferInfos[index].buffers[1] = channel.buffers.data() + bufferSize;
+		}
+		return ASIOError::OK;
+	}
+	ASIOError disposeBuffers() override
+	{
+		stop();
+		channels.clear();
+		callbacks = nullptr;
+		return ASIOError::OK;
+	}
+
+	ASIOError controlPanel() override { return ASIOError::NotPresent; }
+	ASIOError future(ASIOFuture selector, void* opt) override
+	{
+		switch (selector)
+		{
+		case ASIOFuture::CanTimeInfo:
+			return ASIOError::SuccessFuture;
+		case ASIOFuture::GetInternalBufferSamples:
+		{
+			ASIOInternalBufferInfo* info = static_cast<ASIOInternalBufferInfo*>(opt);
+			if (!info)
+				return ASIOError::InvalidParameter;
+			info->inputSamples = setup.internalInputSamples;
+			info->outputSamples = setup.internalOutputSamples;
+			return ASIOError::SuccessFuture;
+		}
+		default:
+			return ASIOError::InvalidParameter;
+		}
+	}
+	ASIOError outputReady() override { return ASIOError::OK; }
+
+private:
+	struct Channel
+	{
+		bool              	isInput = false;
+		long              	index = 0;
+		std::vector<float>	buffers;  	// double buffer, 2 x bufferSize
+		std::vector<float>	delayLine;	// outputs only
+		std::vector<float>	captured; 	// outputs only, captured during the last period
+	};
+
+	static long nextPowerOfTwo(long value)
+	{
+		long result = 1;
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+
+	// One hardware period: play what the host wrote last time, deliver what was captured the period
+	// before, then let the host process the current half.
+	void tick(long index)
+	{
+		const long delay = setup.inputDelay + setup.outputDelay + setup.internalInputSamples + setup.internalOutputSamples;
+		const int64_t mask = delayLineSize - 1;
+		for (Channel& input : channels)
+		{
+			if (!input.isInput)
+				continue;
+			float* target = input.buffers.data() + index * bufferSize;
+			std::fill_n(target, bufferSize, 0.0f);
+			for (const Channel& output : channels)
+			{
+				if (!output.isInput && output.index == input.index)
+					std::copy_n(output.captured.data(), bufferSize, target);
+			}
+		}
+		for (Channel& output : channels)
+		{
+			if (output.isInput)
+				continue;
+			const float* played = output.buffers.data() + (index ^ 1) * bufferSize;
+			for (long frame = 0; frame < bufferSize; ++frame)
+			{
+				const int64_t position = writePosition + frame;
+				output.delayLine[position & mask] = played[frame];
+				output.captured[frame] = output.delayLine[(position - delay) & mask];
+			}
+		}
+		writePosition += bufferSize;
+
+		ASIOTime time = {};
+		time.timeInfo.speed = 1.0;
+		time.timeInfo.samplePosition = samplePosition.load();
+		time.timeInfo.systemTime = systemTime.load();
+		time.timeInfo.sampleRate = sampleRate;
+		time.timeInfo.flags = static_cast<unsigned long>(ASIOTimeInfoFlags::SystemTimeValid) | static_cast<unsigned long>(ASIOTimeInfoFlags::SamplePositionValid) | static_cast<unsigned long>(ASIOTimeInfoFlags::SampleRateValid);
+		if (useTimeInfo)
+			callbacks->bufferSwitchTimeInfo(&time, index, ASIOBool::True);
+		else
+			callbacks->bufferSwitch(index, ASIOBool::True);
+	}
+
+	bool externalSelected() const { return clockSource == 1; }
+	bool clockLost() const { return externalSelected() && !externalLocked; }
+
+	// without a clock the hardware stops: no periods, the position stands still
+	void run()
+	{
+		using clock_t = std::chrono::steady_clock;
+		auto next = clock_t::now();
+		long index = 0;
+		while (running)
+		{
+			if (!clockLost())
+			{
+				systemTime = std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count();
+				tick(index);
+				samplePosition += bufferSize;
+				index ^= 1;
+			}
+			next += std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double>(bufferSize / sampleRate));
+			std::this_thread::sleep_until(next);
+		}
+	}
+
+	const SBLoopbackAsioSetup	setup;
+	std::atomic<ULONG>       	refcount = { 1 };
+	std::atomic<ASIOSampleRate>	sampleRate;
+	std::atomic<long>        	clockSource = { 0 };
+	std::atomic<bool>        	externalLocked = { true };
+	long                     	bufferSize = 0;
+	long                     	delayLineSize = 0;
+	int64_t                  	writePosition = 0;
+	std::vector<Channel>     	channels;
+	ASIOCallbacks*           	callbacks = nullptr;
+	bool                     	useTimeInfo = false;
+
+	std::thread              	clock;
+	std::atomic<bool>        	running = { false };
+	std::atomic<ASIOSamples> 	samplePosition = { 0 };
+	std::atomic<ASIOTimeStamp>	systemTime = { 0 };
+};
+
+IASIO* SB_CreateLoopbackAsio(const SBLoopbackAsioSetup& setup)
+{
+	return new SBLoopbackAsio(setup);
+}
+
+void SB_SetLoopbackExternalClock(IASIO* loopback, bool locked)
+{
+	if (loopback)
+		static_cast<SBLoopbackAsio*>(loopback)->setExternalClock(locked);
+}
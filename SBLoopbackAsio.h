@@ -0,0 +1,30 @@
+#pragma once
+
+#include "SBAsioDevice.h"
+
+// Software IASIO that feeds every output channel back into the input channel with the same index.
+// Clocked by its own thread; the round trip seen by the host is two buffer periods (one to play,
+// one to capture) plus the simulated converter and internal buffering delays.
+struct SBLoopbackAsioSetup
+{
+	long          	numChannels = 2;
+	long          	minBufferSize = 32;
+	long          	maxBufferSize = 2048;
+	long          	preferredBufferSize = 256;
+	ASIOSampleRate	sampleRate = 48000.0;
+
+	long          	inputDelay = 0;            	// converter latency, in samples
+	long          	outputDelay = 0;
+	long          	internalInputSamples = 0;  	// reported through ASIOFuture::GetInternalBufferSamples
+	long          	internalOutputSamples = 0;
+	long          	latencyReportError = 0;    	// added to the reported output latency only, to simulate a lying driver
+
+	ASIOSampleRate	externalClockRate = 0.0;   	// > 0: second clock source "External" (index 1), locked at that rate
+};
+
+// Returned with a reference count of 1; samples are Float32_LSB.
+IASIO* SB_CreateLoopbackAsio(const SBLoopbackAsioSetup& setup);
+
+// Plugs or unplugs the simulated external clock of a loopback driver. While it is the current source and unplugged,
+// the driver stops calling back and reports no clock; both transitions go through sampleRateDidChange, like hardware.
+void SB_SetLoopbackExternalClock(IASIO* loopback, bool locked);
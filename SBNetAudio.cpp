@@ -0,0 +1,747 @@
+#include "SBNetAudio.h"
+#include "SBSampleKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define SB_NET_MMSG	// sendmmsg/recvmmsg: one system call per batch
+#endif
+
+namespace
+{
+	constexpr uint32_t SBNetAudioMagic = 0x414E4253;	// 'SBNA' in memory
+	constexpr size_t SBNetBatchSize = 32;           	// datagrams per receive call
+	constexpr double SBNetReceiveTimeout = 0.05;     	// how fast the receive thread notices close()
+
+#ifdef _WIN32
+	using SBSocketHandle = SOCKET;
+	const SBSocketHandle SBInvalidSocket = INVALID_SOCKET;
+	using SBNetBuffer = WSABUF;
+
+	inline void SB_SetNetBuffer(WSABUF& buffer, const void* data, size_t size)
+	{
+		buffer.buf = static_cast<char*>(const_cast<void*>(data));
+		buffer.len = static_cast<ULONG>(size);
+	}
+
+	inline bool SB_NetWouldBlock()
+	{
+		const int error = WSAGetLastError();
+		return error == WSAEWOULDBLOCK || error == WSAENOBUFS;
+	}
+#else
+	using SBSocketHandle = int;
+	const SBSocketHandle SBInvalidSocket = -1;
+	using SBNetBuffer = iovec;
+
+	inline void SB_SetNetBuffer(iovec& buffer, const void* data, size_t size)
+	{
+		buffer.iov_base = const_cast<void*>(data);
+		buffer.iov_len = size;
+	}
+
+	inline bool SB_NetWouldBlock()
+	{
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+	}
+#endif
+
+	int64_t SB_SteadyNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	long SB_NetSampleBytes(SBNetSampleFormat format)
+	{
+		return format == SBNetSampleFormat::Int24 ? 3 : 4;
+	}
+
+	// How a block of frameCount frames is cut into datagrams; the count never decreases as frameCount grows,
+	// so the layout of maxBlockFrames bounds every other.
+	struct SBNetLayout
+	{
+		long	framesPerDatagram;
+		long	channelsPerDatagram;
+		long	datagramCount;
+	};
+
+	SBNetLayout SB_NetLayout(const SBNetAudioSetup& setup, long frameCount)
+	{
+		const long payloadSamples = std::max(static_cast<long>((setup.maxDatagramBytes - sizeof(SBNetAudioHeader)) / SB_NetSampleBytes(setup.sampleFormat)), 1l);
+		SBNetLayout layout;
+		layout.framesPerDatagram = std::min(std::min(frameCount, payloadSamples), 65535l);
+		layout.channelsPerDatagram = std::min(std::max(payloadSamples / layout.framesPerDatagram, 1l), static_cast<long>(setup.numChannels));
+		layout.datagramCount = ((frameCount + layout.framesPerDatagram - 1) / layout.framesPerDatagram)
+			* ((setup.numChannels + layout.channelsPerDatagram - 1) / layout.channelsPerDatagram);
+		return layout;
+	}
+
+	// UDP socket with the Winsock reference it needs
+	class SBNetSocket
+	{
+	public:
+		SBNetSocket()
+		{
+#ifdef _WIN32
+			WSADATA data;
+			started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#endif
+		}
+		SBNetSocket(const SBNetSocket&) = delete;
+		SBNetSocket& operator=(const SBNetSocket&) = delete;
+		~SBNetSocket()
+		{
+			if (handle != SBInvalidSocket)
+			{
+#ifdef _WIN32
+				closesocket(handle);
+#else
+				::close(handle);
+#endif
+			}
+#ifdef _WIN32
+			if (started)
+				WSACleanup();
+#endif
+		}
+
+		// sender: connected to the destination, non-blocking; receiver: bound, blocking with a timeout
+		bool open(const SBNetAudioSetup& setup, bool receive)
+		{
+			addrinfo hints = {};
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_DGRAM;
+			hints.ai_protocol = IPPROTO_UDP;
+			hints.ai_flags = AI_NUMERICSERV | (receive ? AI_PASSIVE : 0);
+			char port[8];
+			snprintf(port, sizeof(port), "%u", static_cast<unsigned>(setup.port));
+			addrinfo* addresses = nullptr;
+			if (getaddrinfo(setup.address.empty() ? nullptr : setup.address.c_str(), port, &hints, &addresses) != 0)
+				return false;
+
+			for (addrinfo* address = addresses; address && handle == SBInvalidSocket; address = address->ai_next)
+			{
+				handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+				if (handle == SBInvalidSocket)
+					continue;
+				bool succeeded;
+				if (receive)
+				{
+					const int reuse = 1;
+					setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+					succeeded = bind(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0;
+				}
+				else
+					succeeded = connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0;
+				if (!succeeded)
+				{
+#ifdef _WIN32
+					closesocket(handle);
+#else
+					::close(handle);
+#endif
+					handle = SBInvalidSocket;
+				}
+			}
+			freeaddrinfo(addresses);
+			if (handle == SBInvalidSocket)
+				return false;
+
+			// room for bursts: a whole block leaves at once, and the receive thread may be preempted
+			const int bufferBytes = receive ? 4 << 20 : 1 << 20;
+			setsockopt(handle, SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF, reinterpret_cast<const char*>(&bufferBytes), sizeof(bufferBytes));
+			if (receive)
+			{
+#ifdef _WIN32
+				const DWORD timeout = static_cast<DWORD>(SBNetReceiveTimeout * 1000.0);
+#else
+				timeval timeout = {};
+				timeout.tv_usec = static_cast<long>(SBNetReceiveTimeout * 1000000.0);
+#endif
+				setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+			}
+			else
+			{
+#ifdef _WIN32
+				u_long nonBlocking = 1;
+				ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+				fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+			}
+			return true;
+		}
+
+		SBSocketHandle	handle = SBInvalidSocket;
+#ifdef _WIN32
+		bool          	started = false;
+#endif
+	};
+}
+
+//
+// SBNetAudioSender
+//
+
+struct SBNetAudioSender::Batch
+{
+	SBNetSocket                  	socket;
+	size_t                       	buffersPerDatagram = 0;	// header, then one run per channel
+	std::vector<SBNetAudioHeader>	headers;
+	std::vector<SBNetBuffer>     	buffers;
+	std::vector<unsigned char>   	staging;	// Int24, numChannels runs of maxBlockFrames
+	std::vector<unsigned char>   	silence;	// for missing channels
+#ifdef SB_NET_MMSG
+	std::vector<mmsghdr>         	messages;
+#endif
+};
+
+SBNetAudioSender::SBNetAudioSender() = default;
+
+SBNetAudioSender::~SBNetAudioSender()
+{
+	close();
+}
+
+bool SBNetAudioSender::open(const SBNetAudioSetup& senderSetup)
+{
+	close();
+	const long sampleBytes = SB_NetSampleBytes(senderSetup.sampleFormat);
+	if (senderSetup.numChannels == 0 || senderSetup.maxBlockFrames <= 0 || senderSetup.maxDatagramBytes > 65507
+		|| senderSetup.maxDatagramBytes < sizeof(SBNetAudioHeader) + sampleBytes)
+		return false;
+	setup = senderSetup;
+
+	std::unique_ptr<Batch> opened(new Batch);
+	if (!opened->socket.open(setup, false))
+		return false;
+
+	// everything send() touches is sized here: the datagram count for the largest block, the channels per datagram
+	// for the smallest
+	const SBNetLayout layout = SB_NetLayout(setup, setup.maxBlockFrames);
+	opened->buffersPerDatagram = 1 + SB_NetLayout(setup, 1).channelsPerDatagram;
+	opened->headers.resize(layout.datagramCount);
+	opened->buffers.resize(layout.datagramCount * opened->buffersPerDatagram);
+	if (setup.sampleFormat == SBNetSampleFormat::Int24)
+		opened->staging.resize(static_cast<size_t>(setup.numChannels) * setup.maxBlockFrames * sampleBytes);
+	opened->silence.assign(static_cast<size_t>(setup.maxBlockFrames) * sampleBytes, 0);
+#ifdef SB_NET_MMSG
+	opened->messages.assign(layout.datagramCount, mmsghdr());
+#endif
+	batch = std::move(opened);
+	sequence = 0;
+	sent.store(0, std::memory_order_relaxed);
+	dropped.store(0, std::memory_order_relaxed);
+	return true;
+}
+
+void SBNetAudioSender::close()
+{
+	batch.reset();
+}
+
+bool SBNetAudioSender::isOpen() const
+{
+	return batch != nullptr;
+}
+
+bool SBNetAudioSender::send(const SBAudioTimeline& timeline, const float* const* channels, long frameCount)
+{
+	if (!batch || frameCount <= 0 || frameCount > setup.maxBlockFrames)
+		return false;
+
+	const long sampleBytes = SB_NetSampleBytes(setup.sampleFormat);
+	if (setup.sampleFormat == SBNetSampleFormat::Int24)
+	{
+		for (long channel = 0; channel < setup.numChannels; ++channel)
+		{
+			if (channels[channel])
+				SB_SamplesToInt24(channels[channel], batch->staging.data() + channel * setup.maxBlockFrames * sampleBytes, frameCount);
+		}
+	}
+
+	const SBNetLayout layout = SB_NetLayout(setup, frameCount);
+	size_t datagram = 0;
+	for (long frame = 0; frame < frameCount; frame += layout.framesPerDatagram)
+	{
+		const long frames = std::min(layout.framesPerDatagram, frameCount - frame);
+		const int64_t systemTime = timeline.systemTime > 0 && timeline.sampleRate > 0.0
+			? timeline.systemTime + static_cast<int64_t>(std::llround(frame * 1e9 / timeline.sampleRate)) : timeline.systemTime;
+		for (long firstChannel = 0; firstChannel < setup.numChannels; firstChannel += layout.channelsPerDatagram)
+		{
+			const long channelCount = std::min(layout.channelsPerDatagram, setup.numChannels - firstChannel);
+			SBNetAudioHeader& header = batch->headers[datagram];
+			header = SBNetAudioHeader();
+			header.magic = SBNetAudioMagic;
+			header.version = SB_NET_AUDIO_PROTOCOL_VERSION;
+			header.sampleFormat = static_cast<uint8_t>(setup.sampleFormat);
+			header.streamId = setup.streamId;
+			header.sequence = sequence++;
+			header.samplePosition = timeline.samplePosition + frame;
+			header.systemTime = systemTime;
+			header.sampleRate = static_cast<uint32_t>(std::lround(timeline.sampleRate));
+			header.numChannels = setup.numChannels;
+			header.firstChannel = static_cast<uint16_t>(firstChannel);
+			header.channelCount = static_cast<uint16_t>(channelCount);
+			header.frameCount = static_cast<uint16_t>(frames);
+
+			// the payload is gathered from the channel buffers by the system call
+			SBNetBuffer* buffers = batch->buffers.data() + datagram * batch->buffersPerDatagram;
+			SB_SetNetBuffer(buffers[0], &header, sizeof(header));
+			for (long index = 0; index < channelCount; ++index)
+			{
+				const long channel = firstChannel + index;
+				const void* samples;
+				if (!channels[channel])
+					samples = batch->silence.data();
+				else if (setup.sampleFormat == SBNetSampleFormat::Int24)
+					samples = batch->staging.data() + (channel * setup.maxBlockFrames + frame) * sampleBytes;
+				else
+					samples = channels[channel] + frame;
+				SB_SetNetBuffer(buffers[1 + index], samples, frames * sampleBytes);
+			}
+#ifdef SB_NET_MMSG
+			msghdr& message = batch->messages[datagram].msg_hdr;
+			message = msghdr();
+			message.msg_iov = buffers;
+			message.msg_iovlen = 1 + channelCount;
+#endif
+			++datagram;
+		}
+	}
+
+	// datagrams the socket buffer has no room for are dropped, never waited for
+	size_t next = 0;
+	while (next < datagram)
+	{
+#ifdef SB_NET_MMSG
+		const int result = sendmmsg(batch->socket.handle, batch->messages.data() + next, static_cast<unsigned>(datagram - next), 0);
+		if (result > 0)
+		{
+			next += result;
+			sent.fetch_add(result, std::memory_order_relaxed);
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+#else
+		const SBNetAudioHeader& header = batch->headers[next];
+		SBNetBuffer* buffers = batch->buffers.data() + next * batch->buffersPerDatagram;
+#ifdef _WIN32
+		DWORD bytes = 0;
+		const bool succeeded = WSASend(batch->socket.handle, buffers, 1 + header.channelCount, &bytes, 0, nullptr, nullptr) == 0;
+#else
+		msghdr message = {};
+		message.msg_iov = buffers;
+		message.msg_iovlen = 1 + header.channelCount;
+		const bool succeeded = sendmsg(batch->socket.handle, &message, 0) >= 0;
+#endif
+		if (succeeded)
+		{
+			++next;
+			sent.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+#endif
+		if (SB_NetWouldBlock())
+		{
+			dropped.fetch_add(datagram - next, std::memory_order_relaxed);
+			break;
+		}
+		// e.g. refused by a receiver that is not listening yet: skip that one
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		++next;
+	}
+	return next == datagram;
+}
+
+//
+// SBNetAudioReceiver
+//
+
+struct SBNetAudioReceiver::Socket
+{
+	SBNetSocket	socket;
+#ifdef SB_NET_MMSG
+	mmsghdr    	messages[SBNetBatchSize];
+	iovec      	buffers[SBNetBatchSize];
+#endif
+
+	// blocks up to the receive timeout for the first datagram, then takes what is already there;
+	// sizes are 0 for truncated or failed ones
+	size_t receive(unsigned char* const* slots, size_t* sizes, size_t count, size_t capacity)
+	{
+#ifdef SB_NET_MMSG
+		for (size_t index = 0; index < count; ++index)
+		{
+			SB_SetNetBuffer(buffers[index], slots[index], capacity);
+			messages[index] = mmsghdr();
+			messages[index].msg_hdr.msg_iov = &buffers[index];
+			messages[index].msg_hdr.msg_iovlen = 1;
+		}
+		const int received = recvmmsg(socket.handle, messages, static_cast<unsigned>(count), MSG_WAITFORONE, nullptr);
+		if (received <= 0)
+			return 0;
+		for (int index = 0; index < received; ++index)
+			sizes[index] = (messages[index].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : messages[index].msg_len;
+		return received;
+#else
+		size_t received = 0;
+		while (received < count)
+		{
+			if (received > 0)
+			{
+#ifdef _WIN32
+				u_long pending = 0;
+				if (ioctlsocket(socket.handle, FIONREAD, &pending) != 0 || pending == 0)
+					break;
+#endif
+			}
+#ifdef _WIN32
+			const int result = recv(socket.handle, reinterpret_cast<char*>(slots[received]), static_cast<int>(capacity), 0);
+			if (result < 0 && WSAGetLastError() != WSAEMSGSIZE)
+				break;
+#else
+			const ssize_t result = recv(socket.handle, slots[received], capacity, received > 0 ? MSG_DONTWAIT : 0);
+			if (result < 0)
+				break;
+#endif
+			sizes[received++] = result > 0 && static_cast<size_t>(result) <= capacity ? static_cast<size_t>(result) : 0;
+		}
+		return received;
+#endif
+	}
+};
+
+SBNetAudioReceiver::SBNetAudioReceiver() = default;
+
+SBNetAudioReceiver::~SBNetAudioReceiver()
+{
+	close();
+}
+
+bool SBNetAudioReceiver::open(const SBNetAudioSetup& receiverSetup)
+{
+	close();
+	if (receiverSetup.numChannels == 0 || receiverSetup.maxDatagramBytes <= sizeof(SBNetAudioHeader) || receiverSetup.maxDatagramBytes > 65507
+		|| receiverSetup.bufferFrames <= 0 || receiverSetup.maxDelayFrames <= 0)
+		return false;
+	setup = receiverSetup;
+
+	std::unique_ptr<Socket> opened(new Socket);
+	if (!opened->socket.open(setup, true))
+		return false;
+
+	// one extra slot past the queued ones takes what arrives while every slot waits for the audio thread
+	const size_t slotCount = SB_RoundUpToPowerOfTwo(std::max(setup.queueDatagrams, 2 * SBNetBatchSize));
+	datagrams.assign((slotCount + 1) * setup.maxDatagramBytes, 0);
+	sizes.assign(slotCount + 1, 0);
+	arrivals.assign(slotCount + 1, 0);
+	filled.reset(new SBLockFreeQueue<uint32_t>(slotCount));
+	empty.reset(new SBLockFreeQueue<uint32_t>(slotCount));
+	for (uint32_t slot = 0; slot < slotCount; ++slot)
+		empty->push(slot);
+
+	// deep enough for the skip threshold of the largest delay
+	const size_t ringFrames = SB_RoundUpToPowerOfTwo(std::max(static_cast<size_t>(setup.bufferFrames), static_cast<size_t>(setup.maxDelayFrames) * 4));
+	ring.assign(setup.numChannels, std::vector<float>(ringFrames, 0.0f));
+	ringMask = static_cast<int64_t>(ringFrames) - 1;
+	readPosition = 0;
+	newestPosition = 0;
+	playing = false;
+	synchronized = false;
+	nextSequence = 0;
+	lastTransit = 0;
+	jitter = 0.0;
+	datagramFrames = 0;
+	pullFrames = 0;
+	margin = 0;
+	for (std::atomic<uint64_t>* counter : { &accepted, &lost, &reordered, &late, &invalid, &overflows, &underrunFrames, &skippedFrames })
+		counter->store(0, std::memory_order_relaxed);
+	jitterSeconds.store(0.0, std::memory_order_relaxed);
+	delayFrames.store(0, std::memory_order_relaxed);
+	sampleRate.store(0, std::memory_order_relaxed);
+
+	socket = std::move(opened);
+	running.store(true, std::memory_order_release);
+	SBThreadSetup threadSetup;
+	threadSetup.name = "NetAudio";
+	threadSetup.priority = SBThreadPriority::High;
+	if (!receiver.start(threadSetup, [this]() { run(); }))
+	{
+		running.store(false, std::memory_order_relaxed);
+		socket.reset();
+		return false;
+	}
+	return true;
+}
+
+void SBNetAudioReceiver::close()
+{
+	running.store(false, std::memory_order_release);
+	receiver.join();	// within the receive timeout
+	socket.reset();
+}
+
+void SBNetAudioReceiver::run()
+{
+	const uint32_t spare = static_cast<uint32_t>(sizes.size() - 1);
+	uint32_t slots[SBNetBatchSize];
+	unsigned char* buffers[SBNetBatchSize];
+	size_t received[SBNetBatchSize];
+	while (running.load(std::memory_order_acquire))
+	{
+		size_t count = 0;
+		while (count < SBNetBatchSize && empty->pop(slots[count]))
+			++count;
+		const bool overflow = count == 0;	// the audio thread is not pulling: drain the socket all the same
+		if (overflow)
+			slots[count++] = spare;
+		for (size_t index = 0; index < count; ++index)
+			buffers[index] = datagrams.data() + slots[index] * setup.maxDatagramBytes;
+
+		const size_t receivedCount = socket->receive(buffers, received, count, setup.maxDatagramBytes);
+		const int64_t arrival = SB_SteadyNanoseconds();
+		if (overflow)
+		{
+			overflows.fetch_add(receivedCount, std::memory_order_relaxed);
+			continue;
+		}
+		for (size_t index = 0; index < count; ++index)
+		{
+			if (index < receivedCount)
+			{
+				sizes[slots[index]] = received[index];
+				arrivals[slots[index]] = arrival;
+				filled->push(slots[index]);	// never full, both queues hold every slot
+			}
+			else
+				empty->push(slots[index]);
+		}
+	}
+}
+
+long SBNetAudioReceiver::pull(float* const* channels, long numChannels, long frameCount)
+{
+	if (frameCount <= 0)
+		return 0;
+	if (ring.empty())
+	{
+		for (long channel = 0; channel < numChannels; ++channel)
+			std::fill_n(channels[channel], frameCount, 0.0f);
+		return 0;
+	}
+
+	pullFrames = frameCount;
+	uint32_t slot;
+	while (filled->pop(slot))
+	{
+		place(datagrams.data() + slot * setup.maxDatagramBytes, sizes[slot], arrivals[slot]);
+		empty->push(slot);
+	}
+
+	// (re)buffering until the target delay is reached, then playing until the newest frame is passed
+	const long target = targetDelay();
+	if (!playing && synchronized && newestPosition - readPosition >= target)
+	{
+		playing = true;
+		discard(newestPosition - target);
+	}
+	else if (playing && newestPosition - readPosition > 2 * target + frameCount)
+	{
+		skippedFrames.fetch_add(static_cast<uint64_t>(newestPosition - target - readPosition), std::memory_order_relaxed);
+		discard(newestPosition - target);
+	}
+
+	long available = 0;
+	if (playing)
+	{
+		available = static_cast<long>(std::min<int64_t>(std::max<int64_t>(newestPosition - readPosition, 0), frameCount));
+		const long start = static_cast<long>(readPosition & ringMask);
+		const long first = std::min(available, static_cast<long>(ringMask + 1) - start);
+		for (size_t channel = 0; channel < ring.size(); ++channel)
+		{
+			float* samples = ring[channel].data();
+			if (static_cast<long>(channel) < numChannels)
+			{
+				std::copy_n(samples + start, first, channels[channel]);
+				std::copy_n(samples, available - first, channels[channel] + first);
+			}
+			// cleared as consumed: frames of lost datagrams play as silence the next time around
+			std::fill_n(samples + start, first, 0.0f);
+			std::fill_n(samples, available - first, 0.0f);
+		}
+		readPosition += available;
+		if (available < frameCount)
+		{
+			// rebuffer with a deeper target; it decays again while pulls are served in full
+			underrunFrames.fetch_add(static_cast<uint64_t>(frameCount - available), std::memory_order_relaxed);
+			margin = std::min(margin + frameCount, static_cast<long>(setup.maxDelayFrames));
+			playing = false;
+		}
+		else if (margin > 0)
+			--margin;
+	}
+	for (long channel = 0; channel < numChannels; ++channel)
+	{
+		const long silent = channel < static_cast<long>(ring.size()) ? available : 0;
+		std::fill_n(channels[channel] + silent, frameCount - silent, 0.0f);
+	}
+
+	delayFrames.store(synchronized ? static_cast<long>(newestPosition - readPosition) : 0, std::memory_order_relaxed);
+	jitterSeconds.store(jitter * 1e-9, std::memory_order_relaxed);
+	return available;
+}
+
+SBNetAudioStats SBNetAudioReceiver::stats() const
+{
+	SBNetAudioStats result;
+	result.datagrams = accepted.load(std::memory_order_relaxed);
+	result.lost = lost.load(std::memory_order_relaxed);
+	result.reordered = reordered.load(std::memory_order_relaxed);
+	result.late = late.load(std::memory_order_relaxed);
+	result.invalid = invalid.load(std::memory_order_relaxed);
+	result.overflows = overflows.load(std::memory_order_relaxed);
+	result.underrunFrames = underrunFrames.load(std::memory_order_relaxed);
+	result.skippedFrames = skippedFrames.load(std::memory_order_relaxed);
+	result.jitterSeconds = jitterSeconds.load(std::memory_order_relaxed);
+	result.delayFrames = delayFrames.load(std::memory_order_relaxed);
+	result.sampleRate = sampleRate.load(std::memory_order_relaxed);
+	return result;
+}
+
+void SBNetAudioReceiver::place(const unsigned char* datagram, size_t size, int64_t arrival)
+{
+	SBNetAudioHeader header;
+	if (size < sizeof(header))
+	{
+		invalid.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	memcpy(&header, datagram, sizeof(header));
+	const SBNetSampleFormat format = static_cast<SBNetSampleFormat>(header.sampleFormat);
+	const long sampleBytes = SB_NetSampleBytes(format);
+	if (header.magic != SBNetAudioMagic || header.version != SB_NET_AUDIO_PROTOCOL_VERSION || header.streamId != setup.streamId
+		|| header.sampleFormat > static_cast<uint8_t>(SBNetSampleFormat::Int24) || header.channelCount == 0 || header.frameCount == 0
+		|| header.firstChannel + header.channelCount > header.numChannels
+		|| size != sizeof(header) + static_cast<size_t>(header.channelCount) * header.frameCount * sampleBytes)
+	{
+		invalid.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	sampleRate.store(header.sampleRate, std::memory_order_relaxed);
+
+	// a position outside the ring around playout means the sender restarted or jumped: start over from it
+	const int64_t start = header.samplePosition;
+	const int64_t end = start + header.frameCount;
+	const int64_t ringFrames = ringMask + 1;
+	if (!synchronized || start >= readPosition + ringFrames || end <= readPosition - ringFrames)
+	{
+		if (synchronized)
+		{
+			for (std::vector<float>& samples : ring)
+				std::fill(samples.begin(), samples.end(), 0.0f);
+		}
+		synchronized = true;
+		playing = false;
+		readPosition = start;
+		newestPosition = end;
+		nextSequence = header.sequence;
+		lastTransit = 0;
+	}
+
+	const int32_t gap = static_cast<int32_t>(header.sequence - nextSequence);
+	if (gap >= 0)
+	{
+		lost.fetch_add(static_cast<uint64_t>(gap), std::memory_order_relaxed);
+		nextSequence = header.sequence + 1;
+	}
+	else
+	{
+		reordered.fetch_add(1, std::memory_order_relaxed);
+		if (lost.load(std::memory_order_relaxed) > 0)
+			lost.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// RFC 3550 interarrival jitter: the clocks differ, their offset cancels out between datagrams
+	if (header.systemTime != 0)
+	{
+		const int64_t transit = arrival - header.systemTime;
+		if (lastTransit != 0)
+			jitter += (std::fabs(static_cast<double>(transit - lastTransit)) - jitter) / 16.0;
+		lastTransit = transit;
+	}
+	datagramFrames = header.frameCount;
+
+	if (end <= readPosition)
+	{
+		late.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	const int64_t from = std::max(start, readPosition);
+	const int64_t to = std::min(end, readPosition + ringFrames);
+	const unsigned char* payload = datagram + sizeof(header);
+	for (long index = 0; index < header.channelCount; ++index)
+	{
+		const size_t channel = header.firstChannel + index;
+		if (channel >= ring.size())
+			break;
+		const unsigned char* samples = payload + (index * header.frameCount + (from - start)) * sampleBytes;
+		float* target = ring[channel].data();
+		for (int64_t position = from; position < to;)
+		{
+			const int64_t offset = position & ringMask;
+			const long count = static_cast<long>(std::min(to - position, ringFrames - offset));
+			if (format == SBNetSampleFormat::Int24)
+				SB_SamplesFromInt24(samples, target + offset, count);
+			else
+				memcpy(target + offset, samples, count * sizeof(float));
+			samples += count * sampleBytes;
+			position += count;
+		}
+	}
+	// the sender closes every run of frames with its last channels: only then are all of them there
+	if (header.firstChannel + header.channelCount == header.numChannels)
+		newestPosition = std::max(newestPosition, to);
+	accepted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SBNetAudioReceiver::discard(int64_t position)
+{
+	const int64_t ringFrames = ringMask + 1;
+	for (int64_t cleared = std::max(readPosition, position - ringFrames); cleared < position;)
+	{
+		const int64_t offset = cleared & ringMask;
+		const long count = static_cast<long>(std::min(position - cleared, ringFrames - offset));
+		for (std::vector<float>& samples : ring)
+			std::fill_n(samples.data() + offset, count, 0.0f);
+		cleared += count;
+	}
+	readPosition = std::max(readPosition, position);
+}
+
+long SBNetAudioReceiver::targetDelay() const
+{
+	// one datagram and one pull of granularity, plus three mean deviations of jitter
+	const double jitterFrames = jitter * 1e-9 * sampleRate.load(std::memory_order_relaxed);
+	const long target = datagramFrames + pullFrames + static_cast<long>(std::ceil(3.0 * jitterFrames)) + margin + setup.minDelayFrames;
+	return std::min(target, std::min(setup.maxDelayFrames, static_cast<long>(ringMask + 1) / 4));
+}
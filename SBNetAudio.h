@@ -0,0 +1,176 @@
+#pragma once
+
+#include "SBAudioScheduler.h"
+#include "SBLockFreeQueue.h"
+#include "SBThread.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+static constexpr uint16_t SB_NET_AUDIO_PROTOCOL_VERSION = 1;
+
+enum class SBNetSampleFormat : uint8_t
+{
+	Float32 = 0,
+	Int24,	// quantized like the driver conversions, a quarter less bandwidth
+};
+
+// Datagram layout: this header, then channelCount planar runs of frameCount samples, little endian.
+// Blocks are cut into rectangles of channels x frames that fit one datagram, so a lost datagram only
+// silences its own rectangle.
+struct SBNetAudioHeader
+{
+	uint32_t	magic;         	// 'SBNA'
+	uint16_t	version;       	// SB_NET_AUDIO_PROTOCOL_VERSION
+	uint8_t 	sampleFormat;  	// SBNetSampleFormat
+	uint8_t 	reserved0;
+	uint32_t	streamId;
+	uint32_t	sequence;      	// per datagram
+	int64_t 	samplePosition;	// stream frame of the first sample, from the sender's ASIOTime
+	int64_t 	systemTime;    	// sender nanoseconds matching samplePosition
+	uint32_t	sampleRate;
+	uint16_t	numChannels;   	// of the whole stream
+	uint16_t	firstChannel;
+	uint16_t	channelCount;
+	uint16_t	frameCount;
+	uint32_t	reserved1;
+};
+static_assert(sizeof(SBNetAudioHeader) == 48, "SBNetAudioHeader is the wire format");
+
+struct SBNetAudioSetup
+{
+	std::string      	address = "127.0.0.1";	// sender: destination; receiver: local interface to bind ("0.0.0.0": any)
+	uint16_t         	port = 47800;
+	uint32_t         	streamId = 0;          	// receivers drop the datagrams of other streams
+	uint16_t         	numChannels = 2;
+	SBNetSampleFormat	sampleFormat = SBNetSampleFormat::Float32;	// sender only, receivers follow the datagrams
+	size_t           	maxDatagramBytes = 1472;	// 1500 byte Ethernet MTU minus the IPv4 and UDP headers
+	long             	maxBlockFrames = 4096;  	// sender: largest block, sizes the batches at open
+
+	// receiver
+	long             	bufferFrames = 32768;   	// jitter ring, bounds the deepest delay
+	long             	minDelayFrames = 0;     	// on top of one sender block and one pull
+	long             	maxDelayFrames = 8192;
+	size_t           	queueDatagrams = 1024;  	// received, waiting for the next pull
+};
+
+// Streams planar float blocks to one destination.
+//
+// send() never blocks: datagrams the socket cannot take right away are dropped and counted. Float32 leaves
+// straight from the channel buffers (one scatter/gather entry per channel run), Int24 through a staging buffer
+// sized at open, and a block goes out in a single sendmmsg where the system has it. Safe on the audio thread.
+class SBNetAudioSender
+{
+public:
+	SBNetAudioSender();
+	SBNetAudioSender(const SBNetAudioSender&) = delete;
+	SBNetAudioSender& operator=(const SBNetAudioSender&) = delete;
+	~SBNetAudioSender();
+
+	bool open(const SBNetAudioSetup& setup);
+	void close();
+	bool isOpen() const;
+
+	// timeline: the block's (SBAudioBlock::timeline), channels: setup.numChannels buffers of frameCount samples
+	bool send(const SBAudioTimeline& timeline, const float* const* channels, long frameCount);
+
+	uint64_t sentDatagrams() const { return sent.load(std::memory_order_relaxed); }
+	uint64_t droppedDatagrams() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Batch;
+
+	SBNetAudioSetup       	setup;
+	std::unique_ptr<Batch>	batch;
+	uint32_t              	sequence = 0;
+	std::atomic<uint64_t> 	sent = { 0 };
+	std::atomic<uint64_t> 	dropped = { 0 };
+};
+
+struct SBNetAudioStats
+{
+	uint64_t	datagrams = 0;  	// accepted
+	uint64_t	lost = 0;       	// sequence gaps not filled later
+	uint64_t	reordered = 0;
+	uint64_t	late = 0;       	// arrived after their frames were played
+	uint64_t	invalid = 0;    	// malformed or from another stream
+	uint64_t	overflows = 0;  	// dropped because the queue to the audio thread was full
+	uint64_t	underrunFrames = 0;	// silence inserted because nothing had arrived yet
+	uint64_t	skippedFrames = 0;	// dropped to bring the delay back down
+	double  	jitterSeconds = 0.0;	// RFC 3550 interarrival jitter
+	long    	delayFrames = 0;	// current playout delay behind the newest frame received
+	uint32_t	sampleRate = 0; 	// of the sender
+};
+
+// Receives one stream into an adaptive jitter buffer.
+//
+// A thread pulls datagrams in batches (recvmmsg where available) and queues them for the audio thread, which
+// places them in a private ring at its next pull(): no lock and no shared buffer between the two.
+// Playout runs a target delay behind the newest frame, sized from the measured jitter: missing frames are played
+// as silence and push playout back (the delay grows), a delay far above the target is skipped forward.
+// Streams are expected at the receiver's rate, clock drift is absorbed the same way.
+class SBNetAudioReceiver
+{
+public:
+	SBNetAudioReceiver();
+	SBNetAudioReceiver(const SBNetAudioReceiver&) = delete;
+	SBNetAudioReceiver& operator=(const SBNetAudioReceiver&) = delete;
+	~SBNetAudioReceiver();
+
+	bool open(const SBNetAudioSetup& setup);	// binds, then starts the receive thread
+	void close();
+
+	// audio thread: frameCount frames of the first numChannels channels; returns how many held received audio
+	long pull(float* const* channels, long numChannels, long frameCount);
+
+	SBNetAudioStats stats() const;	// any thread
+
+private:
+	struct Socket;
+
+	void run();
+	void place(const unsigned char* datagram, size_t size, int64_t arrival);
+	void discard(int64_t position);	// moves playout forward, clearing what it skips
+	long targetDelay() const;
+
+	SBNetAudioSetup              	setup;
+	std::unique_ptr<Socket>      	socket;
+	SBThread                     	receiver;
+	std::atomic<bool>            	running = { false };
+
+	// receive thread -> audio thread
+	std::vector<unsigned char>   	datagrams;	// queueDatagrams slots of maxDatagramBytes
+	std::vector<size_t>          	sizes;
+	std::vector<int64_t>         	arrivals; 	// steady clock nanoseconds
+	std::unique_ptr<SBLockFreeQueue<uint32_t>>	filled;
+	std::unique_ptr<SBLockFreeQueue<uint32_t>>	empty;
+
+	// audio thread
+	std::vector<std::vector<float>>	ring;   	// per channel, indexed by stream frame & ringMask
+	int64_t                      	ringMask = 0;
+	int64_t                      	readPosition = 0;
+	int64_t                      	newestPosition = 0;	// end of the newest frames received on every channel
+	bool                         	playing = false;
+	bool                         	synchronized = false;	// a datagram was placed since the last reset
+	uint32_t                     	nextSequence = 0;
+	int64_t                      	lastTransit = 0;
+	double                       	jitter = 0.0;	// nanoseconds
+	long                         	datagramFrames = 0;	// of the last one, the arrival granularity
+	long                         	pullFrames = 0;
+	long                         	margin = 0;  	// grown by underruns, decays as pulls succeed
+
+	std::atomic<uint64_t>        	accepted = { 0 };
+	std::atomic<uint64_t>        	lost = { 0 };
+	std::atomic<uint64_t>        	reordered = { 0 };
+	std::atomic<uint64_t>        	late = { 0 };
+	std::atomic<uint64_t>        	invalid = { 0 };
+	std::atomic<uint64_t>        	overflows = { 0 };
+	std::atomic<uint64_t>        	underrunFrames = { 0 };
+	std::atomic<uint64_t>        	skippedFrames = { 0 };
+	std::atomic<double>          	jitterSeconds = { 0.0 };
+	std::atomic<long>            	delayFrames = { 0 };
+	std::atomic<uint32_t>        	sampleRate = { 0 };
+};
@@ -0,0 +1,92 @@
+#include "SBOfflineRender.h"
+#include "SBDynamics.h"
+#include "SBTaskGraph.h"
+#include "SBThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <type_traits>
+
+using SBClock = std::chrono::steady_clock;
+
+SBOfflineRenderResult SB_RenderOffline(const SBOfflineRenderSetup& setup)
+{
+	SBOfflineRenderResult result;
+	result.sampleRate = setup.sampleRate;
+	if (setup.sampleRate <= 0.0 || setup.bufferSize <= 0 || setup.numInputs < 0 || setup.numOutputs <= 0 || setup.numOutputs > UINT16_MAX || setup.lengthFrames < 0)
+		return result;
+	if (setup.parameters && setup.bufferSize > setup.parameters->maxFrames())
+		return result;
+
+	SBWavWriter writer;
+	writer.setDither(setup.dither);
+	if (!setup.outputPath.empty() && !writer.open(setup.outputPath, static_cast<uint16_t>(setup.numOutputs), static_cast<uint32_t>(std::llround(setup.sampleRate)), setup.sampleFormat))
+		return result;
+
+	const long numChannels = setup.numInputs + setup.numOutputs;
+	std::vector<SBAudioSample> scratch(static_cast<size_t>(numChannels) * setup.bufferSize, SBAudioSample());
+	std::vector<SBAudioSample*> channels(numChannels);
+	for (long channel = 0; channel < numChannels; ++channel)
+		channels[channel] = scratch.data() + static_cast<size_t>(channel) * setup.bufferSize;
+	std::vector<float> writerScratch(std::is_same<SBAudioSample, float>::value ? 0 : static_cast<size_t>(setup.numOutputs) * setup.bufferSize);
+	std::vector<const float*> writerChannels(setup.numOutputs);
+	const long dynamicsCount = setup.dynamics ? std::min(setup.numOutputs, setup.dynamics->numChannels()) : 0;
+	std::vector<float> dynamicsScratch(std::is_same<SBAudioSample, float>::value ? 0 : static_cast<size_t>(dynamicsCount) * setup.bufferSize);
+	std::vector<float*> dynamicsChannels(dynamicsCount);
+
+	SBAudioScheduler scheduler(setup.eventCapacity);
+	SBAudioTimeline timeline;
+	timeline.sampleRate = setup.sampleRate;
+	size_t nextEvent = 0;
+
+	// same floating point environment as the real-time audio thread, or denormals would round differently
+	const bool flushedDenormals = SB_FlushDenormals(true);
+	const SBClock::time_point start = SBClock::now();
+	bool succeeded = true;
+	while (succeeded && timeline.samplePosition < setup.lengthFrames)
+	{
+		while (nextEvent < setup.events.size() && scheduler.schedule(setup.events[nextEvent]))
+			++nextEvent;
+		// the callback is free to use its inputs as scratch
+		std::fill(scratch.begin(), scratch.begin() + static_cast<size_t>(setup.numInputs) * setup.bufferSize, SBAudioSample());
+
+		// always full blocks, like a driver would; the tail of the last one is dropped
+		SB_ProcessAudioBlock(scheduler, setup.parameters, timeline, setup.bufferSize, setup.numInputs, setup.numOutputs, channels.data(), setup.process, setup.userData);
+		if (setup.dynamics)
+			SB_ApplyDynamics(*setup.dynamics, channels.data() + setup.numInputs, dynamicsCount, setup.bufferSize, dynamicsScratch.data(), dynamicsChannels.data());
+		const int64_t frameCount = std::min<int64_t>(setup.bufferSize, setup.lengthFrames - timeline.samplePosition);
+		if (writer)
+		{
+			const float* const* outputs = SB_FloatChannels(channels.data() + setup.numInputs, setup.numOutputs, setup.bufferSize, writerScratch.data(), writerChannels.data());
+			succeeded = writer.write(outputs, static_cast<size_t>(frameCount));
+		}
+
+		result.frames += frameCount;
+		timeline.samplePosition += setup.bufferSize;
+		timeline.systemTime = std::llround(static_cast<double>(timeline.samplePosition) * 1e9 / setup.sampleRate);
+	}
+	if (writer)
+		succeeded = writer.close() && succeeded;
+	result.seconds = std::chrono::duration<double>(SBClock::now() - start).count();
+	SB_FlushDenormals(flushedDenormals);
+	result.succeeded = succeeded;
+	return result;
+}
+
+std::vector<SBOfflineRenderResult> SB_RenderOffline(const std::vector<SBOfflineRenderSetup>& setups, size_t threadCount)
+{
+	std::vector<SBOfflineRenderResult> results(setups.size());
+	SBTaskGraph renders;
+	for (size_t index = 0; index < setups.size(); ++index)
+	{
+		renders.add("render", [&setups, &results, index]()
+		{
+			results[index] = SB_RenderOffline(setups[index]);
+			return results[index].succeeded;
+		});
+	}
+	renders.run(threadCount ? threadCount : std::max<size_t>(std::thread::hardware_concurrency(), 1));
+	return results;
+}
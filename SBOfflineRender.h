@@ -0,0 +1,48 @@
+#pragma once
+
+#include "SBAudioBlock.h"
+#include "src/SBWav.h"
+
+#include <string>
+#include <vector>
+
+class SBDynamics;
+
+// Drives the processing callback without a device, as fast as the CPU allows.
+// The timeline is synthesized from the frame count (starting at sample 0, systemTime following the nominal rate)
+// and each block goes through SB_ProcessAudioBlock and the dynamics like in the ASIO engine: with the same block
+// size, events and dynamics settings, the output is bit-identical to a real-time run (FTZ/DAZ included). SystemTime stamped events are the exception,
+// since they depend on the wall clock of the run.
+struct SBOfflineRenderSetup
+{
+	double                   	sampleRate = 48000.0;
+	long                     	bufferSize = 256;
+	long                     	numInputs = 0;      	// fed silence
+	long                     	numOutputs = 2;
+	int64_t                  	lengthFrames = 0;
+	size_t                   	eventCapacity = 4096;
+	SBAudioProcessCallback   	process = nullptr;
+	void*                    	userData = nullptr;	// must not be shared by renders running in parallel
+	SBParameterStore*        	parameters = nullptr;	// same; bufferSize up to its maxFrames()
+	std::vector<SBAudioEvent>	events;             	// fed to the scheduler in order, as its queue allows
+	SBDynamics*              	dynamics = nullptr; 	// outputs after processing, as SBAudioEngineSetup::dynamics; not shared either
+
+	std::wstring             	outputPath;         	// empty: rendered but not written
+	SBWavSampleFormat        	sampleFormat = SBWavSampleFormat::Float32;
+	SBDitherSetup            	dither;             	// Int16 and Int24; with a fixed seed renders stay bit identical
+};
+
+struct SBOfflineRenderResult
+{
+	bool   	succeeded = false;
+	int64_t	frames = 0;
+	double 	sampleRate = 0.0;
+	double 	seconds = 0.0;	// wall clock
+
+	double realtimeFactor() const { return seconds > 0.0 ? frames / sampleRate / seconds : 0.0; }
+};
+
+SBOfflineRenderResult SB_RenderOffline(const SBOfflineRenderSetup& setup);
+
+// Independent renders spread over threadCount threads (0: one per core).
+std::vector<SBOfflineRenderResult> SB_RenderOffline(const std::vector<SBOfflineRenderSetup>& setups, size_t threadCount = 0);
@@ -0,0 +1,337 @@
+#include "SBOverview.h"
+#include "SBSimd.h"
+#include "SBTaskGraph.h"
+#include "src/SBWav.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+static constexpr uint32_t SB_OVERVIEW_MAGIC = 0x4B504253u;	// "SBPK"
+
+void SBOverview::Accumulator::merge(const Accumulator& other)
+{
+	if (other.frames == 0)
+		return;
+	minimum = frames ? std::min(minimum, other.minimum) : other.minimum;
+	maximum = frames ? std::max(maximum, other.maximum) : other.maximum;
+	sumSquares += other.sumSquares;
+	frames += other.frames;
+}
+
+//
+// Building
+//
+void SBOverview::reset(uint16_t channelCount, uint32_t sampleRate)
+{
+	numChannels = channelCount;
+	rate = sampleRate;
+	frames = 0;
+	levels.assign(1, Level());
+	levels[0].open.resize(numChannels);
+}
+
+void SBOverview::append(const float* const* channels, size_t frameCount)
+{
+	if (numChannels == 0)
+		return;
+	size_t done = 0;
+	while (done < frameCount)
+	{
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(frameCount - done, BaseFramesPerBin - levels[0].open[0].frames));
+		for (uint16_t channel = 0; channel < numChannels; ++channel)
+		{
+			Accumulator& accumulator = levels[0].open[channel];
+			if (accumulator.frames == 0)
+				accumulator.minimum = accumulator.maximum = channels[channel][done];
+			SB_AccumulatePeaks(channels[channel] + done, static_cast<long>(count), accumulator.minimum, accumulator.maximum, accumulator.sumSquares);
+			accumulator.frames += count;
+		}
+		done += count;
+		frames += count;
+		if (levels[0].open[0].frames == BaseFramesPerBin)
+			closeBin(0);
+	}
+}
+
+void SBOverview::pushBaseBins(const Accumulator* bins, size_t binCount)
+{
+	for (size_t index = 0; index < binCount; ++index)
+	{
+		std::copy(bins + index * numChannels, bins + (index + 1) * numChannels, levels[0].open.begin());
+		frames += bins[index * numChannels].frames;
+		if (levels[0].open[0].frames == BaseFramesPerBin)
+			closeBin(0);
+	}
+}
+
+void SBOverview::closeBin(size_t level)
+{
+	if (level + 1 == levels.size())
+	{
+		levels.emplace_back();
+		levels.back().open.resize(numChannels);
+	}
+	Level& current = levels[level];
+	Level& above = levels[level + 1];
+	for (uint16_t channel = 0; channel < numChannels; ++channel)
+	{
+		Accumulator& accumulator = current.open[channel];
+		current.bins.push_back({ accumulator.minimum, accumulator.maximum, static_cast<float>(std::sqrt(accumulator.sumSquares / static_cast<double>(accumulator.frames))) });
+		above.open[channel].merge(accumulator);
+		accumulator = Accumulator();
+	}
+	if (above.open[0].frames == framesPerBin(level + 1))
+		closeBin(level + 1);
+}
+
+uint64_t SBOverview::framesPerBin(size_t level) const
+{
+	uint64_t size = BaseFramesPerBin;
+	for (size_t index = 0; index < level; ++index)
+		size *= LevelFactor;
+	return size;
+}
+
+uint64_t SBOverview::binCount(size_t level) const
+{
+	const uint64_t size = framesPerBin(level);
+	return (frames + size - 1) / size;
+}
+
+SBOverview::Accumulator SBOverview::bin(size_t level, uint64_t index, uint16_t channel) const
+{
+	Accumulator result;
+	const Level& source = levels[level];
+	if (index < source.bins.size() / numChannels)
+	{
+		const SBOverviewBin& stored = source.bins[static_cast<size_t>(index) * numChannels + channel];
+		result.minimum = stored.minimum;
+		result.maximum = stored.maximum;
+		result.frames = framesPerBin(level);
+		result.sumSquares = static_cast<double>(stored.rms) * stored.rms * static_cast<double>(result.frames);
+		return result;
+	}
+	// the open bin: its content is spread over the open accumulators of this level and every level below
+	for (size_t below = 0; below <= level; ++below)
+		result.merge(levels[below].open[channel]);
+	return result;
+}
+
+//
+// Queries
+//
+size_t SBOverview::query(uint16_t channel, uint64_t firstFrame, uint64_t lastFrame, size_t pixelCount, SBOverviewBin* pixels) const
+{
+	std::fill_n(pixels, pixelCount, SBOverviewBin{ 0.0f, 0.0f, 0.0f });
+	if (channel >= numChannels || pixelCount == 0 || lastFrame <= firstFrame || levels.empty())
+		return 0;
+
+	const double framesPerPixel = static_cast<double>(lastFrame - firstFrame) / static_cast<double>(pixelCount);
+	size_t level = 0;
+	while (level + 1 < levels.size() && static_cast<double>(framesPerBin(level + 1)) <= framesPerPixel)
+		++level;
+	const uint64_t size = framesPerBin(level);
+	const uint64_t count = binCount(level);
+
+	size_t filled = 0;
+	for (size_t pixel = 0; pixel < pixelCount; ++pixel)
+	{
+		const uint64_t start = firstFrame + static_cast<uint64_t>(pixel * framesPerPixel);
+		const uint64_t end = std::max(firstFrame + static_cast<uint64_t>((pixel + 1) * framesPerPixel), start + 1);
+		if (start >= frames)
+			break;
+		// at most LevelFactor + 1 bins per pixel
+		const uint64_t firstBin = start / size;
+		const uint64_t lastBin = std::max(std::min((end + size - 1) / size, count), firstBin + 1);
+		Accumulator accumulator;
+		for (uint64_t index = firstBin; index < lastBin; ++index)
+			accumulator.merge(bin(level, index, channel));
+		if (accumulator.frames)
+			pixels[pixel] = { accumulator.minimum, accumulator.maximum, static_cast<float>(std::sqrt(accumulator.sumSquares / static_cast<double>(accumulator.frames))) };
+		++filled;
+	}
+	return filled;
+}
+
+//
+// Peak files
+//
+bool SBOverview::save(const std::wstring& path, const SBFileInfo& source) const
+{
+	SBOverviewHeader header = {};
+	header.magic = SB_OVERVIEW_MAGIC;
+	header.version = SB_OVERVIEW_FORMAT_VERSION;
+	header.sourceSize = source.size;
+	header.sourceTime = source.modifiedTime;
+	header.frameCount = frames;
+	header.sampleRate = rate;
+	header.numChannels = numChannels;
+	header.levelCount = static_cast<uint16_t>(levels.size());
+	header.baseFramesPerBin = BaseFramesPerBin;
+	header.levelFactor = LevelFactor;
+
+	std::vector<uint64_t> binCounts(levels.size());
+	size_t totalBins = 0;
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		binCounts[level] = binCount(level);
+		totalBins += static_cast<size_t>(binCounts[level]);
+	}
+
+	std::vector<char> binary(sizeof(header) + binCounts.size() * sizeof(uint64_t) + totalBins * numChannels * sizeof(SBOverviewBin));
+	char* cursor = binary.data();
+	memcpy(cursor, &header, sizeof(header));
+	cursor += sizeof(header);
+	memcpy(cursor, binCounts.data(), binCounts.size() * sizeof(uint64_t));
+	cursor += binCounts.size() * sizeof(uint64_t);
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		for (uint64_t index = 0; index < binCounts[level]; ++index)
+		{
+			for (uint16_t channel = 0; channel < numChannels; ++channel)
+			{
+				const Accumulator accumulator = bin(level, index, channel);
+				const SBOverviewBin stored = { accumulator.minimum, accumulator.maximum, static_cast<float>(std::sqrt(accumulator.sumSquares / static_cast<double>(accumulator.frames))) };
+				memcpy(cursor, &stored, sizeof(stored));
+				cursor += sizeof(stored);
+			}
+		}
+	}
+	return SB_WriteFileAtomically(path, binary.data(), binary.size());
+}
+
+bool SBOverview::load(const std::wstring& path, const SBFileInfo& source)
+{
+	std::vector<char> binary;
+	if (!SB_ReadFile(path, binary) || binary.size() < sizeof(SBOverviewHeader))
+		return false;
+	SBOverviewHeader header;
+	memcpy(&header, binary.data(), sizeof(header));
+	if (header.magic != SB_OVERVIEW_MAGIC || header.version != SB_OVERVIEW_FORMAT_VERSION ||
+		header.baseFramesPerBin != BaseFramesPerBin || header.levelFactor != LevelFactor ||
+		header.sourceSize != source.size || header.sourceTime != source.modifiedTime ||
+		header.numChannels == 0 || header.levelCount == 0)
+	{
+		return false;
+	}
+
+	reset(header.numChannels, header.sampleRate);
+	frames = header.frameCount;
+	std::vector<uint64_t> binCounts(header.levelCount);
+	size_t expectedSize = sizeof(header) + binCounts.size() * sizeof(uint64_t);
+	if (binary.size() < expectedSize)
+		return false;
+	memcpy(binCounts.data(), binary.data() + sizeof(header), binCounts.size() * sizeof(uint64_t));
+	for (size_t level = 0; level < binCounts.size(); ++level)
+	{
+		if (binCounts[level] != binCount(level))
+			return false;
+		expectedSize += static_cast<size_t>(binCounts[level]) * numChannels * sizeof(SBOverviewBin);
+	}
+	if (binary.size() != expectedSize)
+		return false;
+
+	// complete bins are taken as is; open accumulators are rebuilt from what the level below has not merged up
+	const char* cursor = binary.data() + sizeof(header) + binCounts.size() * sizeof(uint64_t);
+	levels.assign(binCounts.size(), Level());
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		Level& current = levels[level];
+		current.open.resize(numChannels);
+		const size_t complete = static_cast<size_t>(frames / framesPerBin(level));
+		current.bins.resize(complete * numChannels);
+		if (!current.bins.empty())
+			memcpy(current.bins.data(), cursor, current.bins.size() * sizeof(SBOverviewBin));	// data() may be null
+		if (level == 0 && complete < binCounts[0])
+		{
+			for (uint16_t channel = 0; channel < numChannels; ++channel)
+			{
+				SBOverviewBin stored;
+				memcpy(&stored, cursor + (complete * numChannels + channel) * sizeof(SBOverviewBin), sizeof(stored));
+				Accumulator& accumulator = current.open[channel];
+				accumulator.minimum = stored.minimum;
+				accumulator.maximum = stored.maximum;
+				accumulator.frames = frames - complete * BaseFramesPerBin;
+				accumulator.sumSquares = static_cast<double>(stored.rms) * stored.rms * static_cast<double>(accumulator.frames);
+			}
+		}
+		else if (level > 0)
+		{
+			const uint64_t lowerComplete = levels[level - 1].bins.size() / numChannels;
+			for (uint64_t index = complete * LevelFactor; index < lowerComplete; ++index)
+			{
+				for (uint16_t channel = 0; channel < numChannels; ++channel)
+					current.open[channel].merge(bin(level - 1, index, channel));
+			}
+		}
+		cursor += static_cast<size_t>(binCounts[level]) * numChannels * sizeof(SBOverviewBin);
+	}
+	return true;
+}
+
+std::wstring SB_OverviewPath(const std::wstring& wavPath)
+{
+	return wavPath + L".sbpk";
+}
+
+bool SB_BuildOverview(const std::wstring& wavPath, SBOverview& overview, size_t threadCount)
+{
+	SBMappedFile file;
+	SBWavInfo info;
+	if (!file.open(wavPath) || !SB_ReadWavInfo(file.data(), file.size(), info) || !info.decodable())
+		return false;
+
+	const uint16_t numChannels = info.format.numChannels;
+	const uint64_t binSize = SBOverview::BaseFramesPerBin;
+	const size_t binCount = static_cast<size_t>((info.frameCount + binSize - 1) / binSize);
+	overview.reset(numChannels, info.format.sampleRate);
+	std::vector<SBOverview::Accumulator> bins(binCount * numChannels);
+
+	// level 0 in chunks of about a million samples, each decoded and reduced by its own task
+	const size_t chunkBins = std::max<size_t>((1u << 20) / (binSize * numChannels), 1);
+	SBTaskGraph chunks;
+	for (size_t firstBin = 0; firstBin < binCount; firstBin += chunkBins)
+	{
+		chunks.add("overview", [&, firstBin]()
+		{
+			const uint64_t firstFrame = firstBin * binSize;
+			const size_t frameCount = static_cast<size_t>(std::min<uint64_t>(chunkBins * binSize, info.frameCount - firstFrame));
+			std::vector<float> scratch(frameCount * numChannels);
+			std::vector<float*> planes(numChannels);
+			for (uint16_t channel = 0; channel < numChannels; ++channel)
+				planes[channel] = scratch.data() + channel * frameCount;
+			SB_DecodeWavFrames(file.data(), info, firstFrame, frameCount, planes.data());
+
+			for (size_t frame = 0, index = firstBin; frame < frameCount; frame += static_cast<size_t>(binSize), ++index)
+			{
+				const long count = static_cast<long>(std::min<size_t>(static_cast<size_t>(binSize), frameCount - frame));
+				for (uint16_t channel = 0; channel < numChannels; ++channel)
+				{
+					SBOverview::Accumulator& accumulator = bins[index * numChannels + channel];
+					accumulator.minimum = accumulator.maximum = planes[channel][frame];
+					SB_AccumulatePeaks(planes[channel] + frame, count, accumulator.minimum, accumulator.maximum, accumulator.sumSquares);
+					accumulator.frames = static_cast<uint64_t>(count);
+				}
+			}
+			return true;
+		});
+	}
+	chunks.run(threadCount ? threadCount : std::max<size_t>(std::thread::hardware_concurrency(), 1));
+	overview.pushBaseBins(bins.data(), binCount);
+	return true;
+}
+
+bool SB_GetOverview(const std::wstring& wavPath, SBOverview& overview, size_t threadCount)
+{
+	const SBFileInfo source = SB_GetFileInfo(wavPath);
+	if (!source.exists)
+		return false;
+	if (overview.load(SB_OverviewPath(wavPath), source))
+		return true;
+	if (!SB_BuildOverview(wavPath, overview, threadCount))
+		return false;
+	overview.save(SB_OverviewPath(wavPath), source);	// best effort, the folder may be read-only
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "SBFile.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+static constexpr uint32_t SB_OVERVIEW_FORMAT_VERSION = 1;
+
+struct SBOverviewBin
+{
+	float	minimum;
+	float	maximum;
+	float	rms;
+};
+
+// Peak file layout: header, binCounts[levelCount] (uint64), then every level's bins as [bin][channel].
+// The last bin of a level may cover fewer frames than the others (frameCount tells how many).
+struct SBOverviewHeader
+{
+	uint32_t	magic;          	// 'SBPK'
+	uint32_t	version;        	// SB_OVERVIEW_FORMAT_VERSION
+	uint64_t	sourceSize;     	// SBFileInfo of the WAV it was built from
+	int64_t 	sourceTime;
+	uint64_t	frameCount;
+	uint32_t	sampleRate;
+	uint16_t	numChannels;
+	uint16_t	levelCount;
+	uint32_t	baseFramesPerBin;
+	uint32_t	levelFactor;
+};
+static_assert(sizeof(SBOverviewHeader) == 48, "SBOverviewHeader must stay packed for the binary format");
+
+// Multiresolution min/max/RMS summary of a multichannel signal.
+//
+// Level 0 holds one bin per BaseFramesPerBin frames, each level above merges LevelFactor bins of the one below.
+// append() is incremental (a finished bin is folded into the next level right away, the open tails are merged
+// on demand), so an overview can follow a recording and be queried at any time.
+class SBOverview
+{
+public:
+	static constexpr uint32_t BaseFramesPerBin = 256;
+	static constexpr uint32_t LevelFactor = 4;
+
+	void reset(uint16_t numChannels, uint32_t sampleRate);
+	void append(const float* const* channels, size_t frameCount);
+
+	uint16_t channelCount() const { return numChannels; }
+	uint32_t sampleRate() const { return rate; }
+	uint64_t frameCount() const { return frames; }
+	size_t levelCount() const { return levels.size(); }
+
+	// pixelCount bins evenly covering [firstFrame, lastFrame), from the coarsest level still finer than a pixel;
+	// the cost follows pixelCount, not the range. Pixels past the end are zeroed. Returns the pixels with data.
+	size_t query(uint16_t channel, uint64_t firstFrame, uint64_t lastFrame, size_t pixelCount, SBOverviewBin* pixels) const;
+
+	// source: the WAV the overview describes, a cached file only loads back for the same one
+	bool save(const std::wstring& path, const SBFileInfo& source) const;
+	bool load(const std::wstring& path, const SBFileInfo& source);
+
+private:
+	struct Accumulator
+	{
+		float   	minimum = 0.0f;
+		float   	maximum = 0.0f;
+		double  	sumSquares = 0.0;
+		uint64_t	frames = 0;
+
+		void merge(const Accumulator& other);
+	};
+
+	struct Level
+	{
+		std::vector<SBOverviewBin>	bins;	// complete bins, [bin][channel]
+		std::vector<Accumulator>  	open;	// per channel: complete bins of the level below not merged up yet
+	};
+
+	friend bool SB_BuildOverview(const std::wstring& wavPath, SBOverview& overview, size_t threadCount);
+	void pushBaseBins(const Accumulator* bins, size_t binCount);	// [bin][channel], only the last one may be partial
+	void closeBin(size_t level);
+	uint64_t framesPerBin(size_t level) const;
+	uint64_t binCount(size_t level) const;	// including the open one
+	Accumulator bin(size_t level, uint64_t index, uint16_t channel) const;
+
+	uint16_t          	numChannels = 0;
+	uint32_t          	rate = 0;
+	uint64_t          	frames = 0;
+	std::vector<Level>	levels;
+};
+
+std::wstring SB_OverviewPath(const std::wstring& wavPath);	// next to the WAV
+
+// Scans the WAV data in parallel chunks (threadCount 0: one per core).
+bool SB_BuildOverview(const std::wstring& wavPath, SBOverview& overview, size_t threadCount = 0);
+
+// Cached peak file when it matches the WAV, otherwise built and cached.
+bool SB_GetOverview(const std::wstring& wavPath, SBOverview& overview, size_t threadCount = 0);
@@ -0,0 +1,253 @@
+#include "SBParameters.h"
+#include "SBAudioScheduler.h"
+#include "SBSimd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+static uint32_t SB_FloatBits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float SB_BitsFloat(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+//
+// SBAutomationCurve
+//
+SBAutomationCurve::SBAutomationCurve(std::vector<SBAutomationPoint> curvePoints)
+	: points(std::move(curvePoints))
+{
+	std::stable_sort(points.begin(), points.end(), [](const SBAutomationPoint& a, const SBAutomationPoint& b) { return a.samplePosition < b.samplePosition; });
+}
+
+float SBAutomationCurve::valueAt(int64_t samplePosition) const
+{
+	if (points.empty())
+		return 0.0f;
+	auto next = std::upper_bound(points.begin(), points.end(), samplePosition, [](int64_t position, const SBAutomationPoint& point) { return position < point.samplePosition; });
+	if (next == points.begin())
+		return next->value;
+	if (next == points.end())
+		return points.back().value;
+	const SBAutomationPoint& previous = *(next - 1);
+	const double t = static_cast<double>(samplePosition - previous.samplePosition) / static_cast<double>(next->samplePosition - previous.samplePosition);
+	return previous.value + static_cast<float>(t) * (next->value - previous.value);
+}
+
+void SBAutomationCurve::render(int64_t blockStart, long frameCount, float* values, size_t& cursor) const
+{
+	if (points.empty())
+	{
+		SB_FillValue(values, frameCount, 0.0f);
+		return;
+	}
+
+	// cursor: first point after the current position; only searched again on seeks
+	const bool cursorValid = cursor <= points.size() &&
+		(cursor == 0 || points[cursor - 1].samplePosition <= blockStart) &&
+		(cursor == points.size() || points[cursor].samplePosition > blockStart);
+	if (!cursorValid)
+	{
+		cursor = static_cast<size_t>(std::upper_bound(points.begin(), points.end(), blockStart, [](int64_t position, const SBAutomationPoint& point) { return position < point.samplePosition; }) - points.begin());
+	}
+
+	long frame = 0;
+	while (frame < frameCount)
+	{
+		const int64_t position = blockStart + frame;
+		if (cursor == points.size())
+		{
+			SB_FillValue(values + frame, frameCount - frame, points.back().value);
+			break;
+		}
+
+		const SBAutomationPoint& next = points[cursor];
+		const long segmentEnd = static_cast<long>(std::min<int64_t>(next.samplePosition - blockStart, frameCount));
+		if (cursor == 0)
+		{
+			SB_FillValue(values + frame, segmentEnd - frame, next.value);
+		}
+		else
+		{
+			const SBAutomationPoint& previous = points[cursor - 1];
+			const float slope = (next.value - previous.value) / static_cast<float>(next.samplePosition - previous.samplePosition);
+			const float start = previous.value + slope * static_cast<float>(position - 1 - previous.samplePosition);
+			SB_FillRamp(values + frame, segmentEnd - frame, start, slope);
+		}
+		frame = segmentEnd;
+		if (blockStart + frame >= next.samplePosition)
+			++cursor;
+	}
+}
+
+//
+// SBParameterStore
+//
+SBParameterStore::SBParameterStore(uint32_t parameterCount, long blockSize, float smoothingSeconds)
+	: count(parameterCount), maxBlockSize(std::max(blockSize, 1l)),
+	automation(new std::atomic<const SBAutomationCurve*>[parameterCount]),
+	current(parameterCount, 0.0f), goal(parameterCount, 0.0f), step(parameterCount, 0.0f), remaining(parameterCount, 0),
+	smoothing(parameterCount, smoothingSeconds), ramps(static_cast<size_t>(parameterCount) * maxBlockSize, 0.0f),
+	cursors(parameterCount, 0), evaluatedBlock(parameterCount, 0)
+{
+	// padding rather than alignas: over-aligned new is not guaranteed before C++17
+	const size_t groupCount = (count + ParametersPerGroup - 1) / ParametersPerGroup;
+	storage.reset(new char[(groupCount + 1) * sizeof(Group)]);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(storage.get());
+	groups = reinterpret_cast<Group*>((address + SB_CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(SB_CACHE_LINE_SIZE - 1));
+	for (size_t index = 0; index < groupCount; ++index)
+	{
+		Group* group = new (groups + index) Group;
+		for (std::atomic<uint32_t>& target : group->targets)
+			target.store(SB_FloatBits(0.0f), std::memory_order_relaxed);
+		group->changed.store(0, std::memory_order_relaxed);
+	}
+	for (uint32_t id = 0; id < count; ++id)
+		automation[id].store(nullptr, std::memory_order_relaxed);
+	active.reserve(count);
+	taken.reserve(count);
+}
+
+void SBParameterStore::setSmoothing(uint32_t id, float seconds)
+{
+	smoothing[id] = std::max(seconds, 0.0f);
+}
+
+void SBParameterStore::reset(uint32_t id, float value)
+{
+	groups[id / ParametersPerGroup].targets[id % ParametersPerGroup].store(SB_FloatBits(value), std::memory_order_relaxed);
+	current[id] = goal[id] = value;
+	step[id] = 0.0f;
+	remaining[id] = 0;
+}
+
+void SBParameterStore::set(uint32_t id, float value)
+{
+	Group& group = groups[id / ParametersPerGroup];
+	group.targets[id % ParametersPerGroup].store(SB_FloatBits(value), std::memory_order_relaxed);
+	group.changed.fetch_or(1u << (id % ParametersPerGroup), std::memory_order_release);
+	dirty.store(true, std::memory_order_release);
+}
+
+float SBParameterStore::target(uint32_t id) const
+{
+	return SB_BitsFloat(groups[id / ParametersPerGroup].targets[id % ParametersPerGroup].load(std::memory_order_relaxed));
+}
+
+void SBParameterStore::setAutomation(uint32_t id, const SBAutomationCurve* curve)
+{
+	automation[id].store(curve, std::memory_order_release);
+}
+
+void SBParameterStore::beginBlock(const SBAudioTimeline& timeline, long frameCount)
+{
+	// move the ramps past the previous block
+	size_t kept = 0;
+	for (uint32_t id : active)
+	{
+		if (remaining[id] <= blockFrames)
+		{
+			current[id] = goal[id];
+			remaining[id] = 0;
+		}
+		else
+		{
+			current[id] += step[id] * static_cast<float>(blockFrames);
+			remaining[id] -= blockFrames;
+			active[kept++] = id;
+		}
+	}
+	active.resize(kept);
+
+	++blockIndex;
+	blockStart = timeline.samplePosition;
+	assert(frameCount <= maxBlockSize);	// ramps would be read past their maxBlockSize values
+	blockFrames = frameCount;
+
+	// new targets; only the groups flagged by a writer are visited
+	taken.clear();
+	if (dirty.load(std::memory_order_relaxed) && dirty.exchange(false, std::memory_order_acquire))
+	{
+		const uint32_t groupCount = (count + ParametersPerGroup - 1) / ParametersPerGroup;
+		for (uint32_t groupIndex = 0; groupIndex < groupCount; ++groupIndex)
+		{
+			Group& group = groups[groupIndex];
+			if (group.changed.load(std::memory_order_relaxed) == 0)
+				continue;
+			for (uint32_t mask = group.changed.exchange(0, std::memory_order_acquire); mask != 0; mask &= mask - 1)
+			{
+				uint32_t slot = 0;
+				while (!(mask & (1u << slot)))
+					++slot;
+				const uint32_t id = groupIndex * ParametersPerGroup + slot;
+				const float value = SB_BitsFloat(group.targets[slot].load(std::memory_order_relaxed));
+				if (value == goal[id])
+					continue;
+
+				goal[id] = value;
+				taken.push_back({ id, value });
+				const long samples = static_cast<long>(std::lround(smoothing[id] * timeline.sampleRate));
+				if (samples <= 0)
+				{
+					current[id] = value;
+					remaining[id] = 0;	// dropped from active on the next block
+					continue;
+				}
+				if (remaining[id] == 0)
+					active.push_back(id);
+				step[id] = (value - current[id]) / static_cast<float>(samples);
+				remaining[id] = samples;
+			}
+		}
+	}
+
+	for (uint32_t id : active)
+	{
+		if (remaining[id] == 0)
+			continue;
+		float* values = ramps.data() + static_cast<size_t>(id) * maxBlockSize;
+		const long rampFrames = std::min(remaining[id], blockFrames);
+		SB_FillRamp(values, rampFrames, current[id], step[id]);
+		if (rampFrames < blockFrames)
+		{
+			values[rampFrames - 1] = goal[id];	// exact landing
+			SB_FillValue(values + rampFrames, blockFrames - rampFrames, goal[id]);
+		}
+	}
+}
+
+void SBParameterStore::evaluateAutomation(uint32_t id)
+{
+	if (evaluatedBlock[id] == blockIndex)
+		return;
+	const SBAutomationCurve* curve = automation[id].load(std::memory_order_acquire);
+	curve->render(blockStart, blockFrames, ramps.data() + static_cast<size_t>(id) * maxBlockSize, cursors[id]);
+	evaluatedBlock[id] = blockIndex;
+}
+
+float SBParameterStore::value(uint32_t id)
+{
+	const float* values = ramp(id);
+	return values ? values[0] : current[id];
+}
+
+const float* SBParameterStore::ramp(uint32_t id)
+{
+	if (automation[id].load(std::memory_order_relaxed))
+	{
+		evaluateAutomation(id);
+		return ramps.data() + static_cast<size_t>(id) * maxBlockSize;
+	}
+	return remaining[id] > 0 ? ramps.data() + static_cast<size_t>(id) * maxBlockSize : nullptr;
+}
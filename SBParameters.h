@@ -0,0 +1,108 @@
+#pragma once
+
+#include "SBLockFreeQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+struct SBAudioTimeline;
+
+struct SBParameterChange
+{
+	uint32_t	id;
+	float   	value;
+};
+
+struct SBAutomationPoint
+{
+	int64_t	samplePosition;
+	float  	value;	// linear interpolation up to the next point, held after the last one
+};
+
+// Immutable breakpoint curve, evaluated one block at a time on the audio thread.
+class SBAutomationCurve
+{
+public:
+	explicit SBAutomationCurve(std::vector<SBAutomationPoint> points);	// sorted by position on construction
+
+	bool empty() const { return points.empty(); }
+	float valueAt(int64_t samplePosition) const;
+
+	// Fills frameCount values from blockStart; cursor caches the segment between calls (start at 0).
+	void render(int64_t blockStart, long frameCount, float* values, size_t& cursor) const;
+
+private:
+	std::vector<SBAutomationPoint>	points;
+};
+
+// Parameters written from any thread (UI, network) and read every block by the audio thread.
+//
+// Targets live in cache-line sized groups of 15 atomics plus a change mask, so a writer touches a single line
+// and the audio thread only visits the groups whose mask is set. beginBlock() turns new targets into linear
+// ramps over the parameter's smoothing time; unchanged parameters cost nothing. Automation curves override
+// targets and are only evaluated when the parameter is read in the block.
+class SBParameterStore
+{
+public:
+	static constexpr uint32_t ParametersPerGroup = 15;
+
+	SBParameterStore(uint32_t count, long maxBlockSize = 2048, float smoothingSeconds = 0.02f);	// ramps take maxBlockSize floats per parameter
+	SBParameterStore(const SBParameterStore&) = delete;
+	SBParameterStore& operator=(const SBParameterStore&) = delete;
+
+	uint32_t size() const { return count; }
+	long maxFrames() const { return maxBlockSize; }	// largest block beginBlock() takes: the engine and the renderers refuse bigger ones
+
+	// setup, before the audio thread runs
+	void setSmoothing(uint32_t id, float seconds);
+	void reset(uint32_t id, float value);	// no ramp
+
+	// any thread
+	void set(uint32_t id, float value);
+	float target(uint32_t id) const;
+	// curve must stay alive until replaced and one more block was processed
+	void setAutomation(uint32_t id, const SBAutomationCurve* curve);
+
+	// audio thread
+	void beginBlock(const SBAudioTimeline& timeline, long frameCount);	// frameCount up to maxFrames()
+	bool isConstant(uint32_t id) const { return remaining[id] == 0 && !automation[id].load(std::memory_order_relaxed); }
+	float value(uint32_t id);        	// at the first frame of the block
+	const float* ramp(uint32_t id);  	// frameCount values, nullptr when isConstant()
+	const std::vector<SBParameterChange>& changes() const { return taken; }	// new targets taken by the last beginBlock(), by id
+
+private:
+	struct Group
+	{
+		std::atomic<uint32_t>	targets[ParametersPerGroup];	// float bits
+		std::atomic<uint32_t>	changed;
+	};
+	static_assert(sizeof(Group) == SB_CACHE_LINE_SIZE, "Group must fill a cache line");
+
+	void evaluateAutomation(uint32_t id);
+
+	const uint32_t                  	count;
+	const long                      	maxBlockSize;
+	std::unique_ptr<char[]>         	storage;
+	Group*                          	groups = nullptr;	// cache line aligned in storage
+	char                            	padding0[SB_CACHE_LINE_SIZE];
+	std::atomic<bool>               	dirty = { false };	// some group changed since the last block
+	char                            	padding1[SB_CACHE_LINE_SIZE - sizeof(std::atomic<bool>)];
+	std::unique_ptr<std::atomic<const SBAutomationCurve*>[]>	automation;
+
+	// audio thread state, structure of arrays
+	std::vector<float>   	current;      	// value at the first frame of the block
+	std::vector<float>   	goal;         	// target being ramped to
+	std::vector<float>   	step;
+	std::vector<long>    	remaining;    	// ramp samples left from the first frame of the block
+	std::vector<float>   	smoothing;    	// seconds
+	std::vector<float>   	ramps;        	// maxBlockSize values per parameter
+	std::vector<uint32_t>	active;       	// parameters ramping in this block
+	std::vector<SBParameterChange>	taken;	// reserved for every parameter
+	std::vector<size_t>  	cursors;      	// automation segment caches
+	std::vector<uint64_t>	evaluatedBlock;	// block the automation ramp was last rendered for
+	uint64_t             	blockIndex = 0;
+	int64_t              	blockStart = 0;
+	long                 	blockFrames = 0;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Integer sample helpers shared by the driver conversions and the file writers,
+// so a file holds exactly what the driver would have been handed.
+inline int32_t SB_ReadInt24(const unsigned char* bytes)
+{
+	return static_cast<int32_t>((static_cast<uint32_t>(bytes[0]) << 8) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 24)) >> 8;
+}
+
+inline void SB_WriteInt24(unsigned char* bytes, int32_t sample)
+{
+	bytes[0] = static_cast<unsigned char>(sample);
+	bytes[1] = static_cast<unsigned char>(sample >> 8);
+	bytes[2] = static_cast<unsigned char>(sample >> 16);
+}
+
+// Full scale is [-1, 1), clipped; rounds to nearest.
+inline int32_t SB_QuantizeSample(double sample, int bits)
+{
+	const double scale = static_cast<double>(1ll << (bits - 1));
+	const double value = std::min(std::max(sample * scale, -scale), scale - 1.0);
+	return static_cast<int32_t>(std::lrint(value));
+}
+
+inline int32_t SB_QuantizeSample(float sample, int bits)
+{
+	return SB_QuantizeSample(static_cast<double>(sample), bits);
+}
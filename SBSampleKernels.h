@@ -0,0 +1,553 @@
+#pragma once
+
+#include "SBSample.h"
+#include "SBSimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Q31 fixed point: full scale [-1, 1) over the signed 32 bit range, every operation saturates.
+// A type of its own rather than int32_t, so that driver words and processing samples never mix up.
+struct SBQ31
+{
+	int32_t	value;
+};
+
+// Q31 gain, multiplier * 2^(shift - 31): the multiplier keeps 31 significant bits up to the +-65536 limit.
+struct SBQ31Gain
+{
+	int32_t	multiplier;
+	int    	shift;
+};
+
+// Meter readings, full scale is 1 whatever the sample type. Accumulates over as many blocks as wanted.
+struct SBSampleLevels
+{
+	double  	peak = 0.0;
+	double  	sumSquares = 0.0;
+	uint64_t	count = 0;
+
+	double rms() const { return count ? std::sqrt(sumSquares / static_cast<double>(count)) : 0.0; }
+};
+
+//
+// Sample traits
+//
+// The scalar arithmetic of each processing type; the kernels below only go through these and SBSampleSimd,
+// so the type is fixed at compile time and inner loops never branch on it.
+template<typename T> struct SBSampleTraits;
+
+template<> struct SBSampleTraits<float>
+{
+	using Gain = float;
+	static const char* name() { return "float32"; }
+	static Gain gain(double value) { return static_cast<float>(value); }
+	static float fromDouble(double value) { return static_cast<float>(value); }
+	static double toDouble(float sample) { return sample; }
+	static float fromInt(int32_t sample, int bits) { return static_cast<float>(sample) * (1.0f / static_cast<float>(1ll << (bits - 1))); }
+	static int32_t toInt(float sample, int bits) { return SB_QuantizeSample(sample, bits); }
+	static float add(float a, float b) { return a + b; }
+	static float scale(float sample, Gain gain) { return sample * gain; }
+};
+
+template<> struct SBSampleTraits<double>
+{
+	using Gain = double;
+	static const char* name() { return "float64"; }
+	static Gain gain(double value) { return value; }
+	static double fromDouble(double value) { return value; }
+	static double toDouble(double sample) { return sample; }
+	static double fromInt(int32_t sample, int bits) { return static_cast<double>(sample) * (1.0 / static_cast<double>(1ll << (bits - 1))); }
+	static int32_t toInt(double sample, int bits) { return SB_QuantizeSample(sample, bits); }
+	static double add(double a, double b) { return a + b; }
+	static double scale(double sample, Gain gain) { return sample * gain; }
+};
+
+template<> struct SBSampleTraits<SBQ31>
+{
+	using Gain = SBQ31Gain;
+	static const char* name() { return "q31"; }
+
+	static Gain gain(double value)
+	{
+		value = std::min(std::max(value, -65536.0), 65536.0);
+		int exponent = 0;
+		const double mantissa = std::frexp(value, &exponent);	// [0.5, 1)
+		int64_t multiplier = std::llround(mantissa * 2147483648.0);
+		if (multiplier == 2147483648ll || multiplier == -2147483648ll)
+		{
+			multiplier /= 2;
+			++exponent;
+		}
+		if (multiplier == 0 || exponent < -31)
+			return { 0, 0 };
+		return { static_cast<int32_t>(multiplier), exponent };
+	}
+
+	static SBQ31 fromDouble(double value) { return { static_cast<int32_t>(std::lrint(std::min(std::max(value * 2147483648.0, -2147483648.0), 2147483647.0))) }; }
+	static double toDouble(SBQ31 sample) { return static_cast<double>(sample.value) * (1.0 / 2147483648.0); }
+
+	static SBQ31 fromInt(int32_t sample, int bits)
+	{
+		if (bits == 32)
+			return { sample };
+		const int32_t limit = static_cast<int32_t>(1ll << (bits - 1));
+		sample = std::min(std::max(sample, -limit), limit - 1);
+		return { static_cast<int32_t>(static_cast<uint32_t>(sample) << (32 - bits)) };
+	}
+
+	static int32_t toInt(SBQ31 sample, int bits)
+	{
+		if (bits == 32)
+			return sample.value;
+		const int shift = 32 - bits;
+		const int64_t rounded = (static_cast<int64_t>(sample.value) + (1ll << (shift - 1))) >> shift;
+		return static_cast<int32_t>(std::min<int64_t>(rounded, (1ll << (bits - 1)) - 1));
+	}
+
+	static SBQ31 add(SBQ31 a, SBQ31 b) { return saturate(static_cast<int64_t>(a.value) + b.value); }
+
+	static SBQ31 scale(SBQ31 sample, Gain gain)
+	{
+		const int shift = 31 - gain.shift;	// >= 14
+		const int64_t product = static_cast<int64_t>(sample.value) * gain.multiplier;
+		return saturate((product + (1ll << (shift - 1))) >> shift);
+	}
+
+	static SBQ31 saturate(int64_t value) { return { static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(value, INT32_MIN), INT32_MAX)) }; }
+};
+
+//
+// Vector paths
+//
+// Each returns how many leading samples it handled, the scalar loop of the kernel finishes the rest.
+template<typename T> struct SBSampleScalar
+{
+	using Gain = typename SBSampleTraits<T>::Gain;
+	static long fromInt32(const int32_t*, T*, long, int) { return 0; }
+	static long toInt32(const T*, int32_t*, long, int) { return 0; }
+	static long mix(T*, const T*, long) { return 0; }
+	static long mixScaled(T*, const T*, Gain, long) { return 0; }
+	static long applyGain(T*, Gain, long) { return 0; }
+	static long measure(const T*, long, SBSampleLevels&) { return 0; }
+};
+
+template<typename T> struct SBSampleSimd : SBSampleScalar<T> {};
+
+#if defined(SB_SIMD_SSE2)
+template<> struct SBSampleSimd<double> : SBSampleScalar<double>
+{
+	static long fromInt32(const int32_t* in, double* out, long count, int bits)
+	{
+		const __m128d scale = _mm_set1_pd(1.0 / static_cast<double>(1ll << (bits - 1)));
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			_mm_storeu_pd(out + index, _mm_mul_pd(_mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + index))), scale));
+		return index;
+	}
+
+	// two lanes quantized like SB_QuantizeSample, in the low half of the result
+	static __m128i quantize(__m128d samples, __m128d scale, __m128d low, __m128d high)
+	{
+		return _mm_cvtpd_epi32(_mm_min_pd(_mm_max_pd(_mm_mul_pd(samples, scale), low), high));
+	}
+
+	static long toInt32(const double* in, int32_t* out, long count, int bits)
+	{
+		const double limit = static_cast<double>(1ll << (bits - 1));
+		const __m128d scale = _mm_set1_pd(limit), low = _mm_set1_pd(-limit), high = _mm_set1_pd(limit - 1.0);
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + index), quantize(_mm_loadu_pd(in + index), scale, low, high));
+		return index;
+	}
+
+	static long mix(double* out, const double* in, long count)
+	{
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			_mm_storeu_pd(out + index, _mm_add_pd(_mm_loadu_pd(out + index), _mm_loadu_pd(in + index)));
+		return index;
+	}
+
+	static long mixScaled(double* out, const double* in, double gain, long count)
+	{
+		const __m128d gains = _mm_set1_pd(gain);
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			_mm_storeu_pd(out + index, _mm_add_pd(_mm_loadu_pd(out + index), _mm_mul_pd(_mm_loadu_pd(in + index), gains)));
+		return index;
+	}
+
+	static long applyGain(double* data, double gain, long count)
+	{
+		const __m128d gains = _mm_set1_pd(gain);
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			_mm_storeu_pd(data + index, _mm_mul_pd(_mm_loadu_pd(data + index), gains));
+		return index;
+	}
+
+	static void accumulate(__m128d values, __m128d& peaks, __m128d& sums)
+	{
+		peaks = _mm_max_pd(peaks, _mm_andnot_pd(_mm_set1_pd(-0.0), values));
+		sums = _mm_add_pd(sums, _mm_mul_pd(values, values));
+	}
+
+	static void store(__m128d peaks, __m128d sums, SBSampleLevels& levels)
+	{
+		double lanes[2];
+		_mm_storeu_pd(lanes, peaks);
+		levels.peak = std::max(levels.peak, std::max(lanes[0], lanes[1]));
+		_mm_storeu_pd(lanes, sums);
+		levels.sumSquares += lanes[0] + lanes[1];
+	}
+
+	static long measure(const double* in, long count, SBSampleLevels& levels)
+	{
+		__m128d peaks = _mm_setzero_pd(), sums = _mm_setzero_pd();
+		long index = 0;
+		for (; index + 2 <= count; index += 2)
+			accumulate(_mm_loadu_pd(in + index), peaks, sums);
+		store(peaks, sums, levels);
+		return index;
+	}
+};
+
+template<> struct SBSampleSimd<float> : SBSampleScalar<float>
+{
+	static long fromInt32(const int32_t* in, float* out, long count, int bits)
+	{
+		const __m128 scale = _mm_set1_ps(1.0f / static_cast<float>(1ll << (bits - 1)));
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+			_mm_storeu_ps(out + index, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index))), scale));
+		return index;
+	}
+
+	// quantized in double precision, as SB_QuantizeSample does
+	static long toInt32(const float* in, int32_t* out, long count, int bits)
+	{
+		const double limit = static_cast<double>(1ll << (bits - 1));
+		const __m128d scale = _mm_set1_pd(limit), low = _mm_set1_pd(-limit), high = _mm_set1_pd(limit - 1.0);
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			const __m128 samples = _mm_loadu_ps(in + index);
+			const __m128i first = SBSampleSimd<double>::quantize(_mm_cvtps_pd(samples), scale, low, high);
+			const __m128i second = SBSampleSimd<double>::quantize(_mm_cvtps_pd(_mm_movehl_ps(samples, samples)), scale, low, high);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + index), _mm_unpacklo_epi64(first, second));
+		}
+		return index;
+	}
+
+	static long mix(float* out, const float* in, long count)
+	{
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+			_mm_storeu_ps(out + index, _mm_add_ps(_mm_loadu_ps(out + index), _mm_loadu_ps(in + index)));
+		return index;
+	}
+
+	static long mixScaled(float* out, const float* in, float gain, long count)
+	{
+		const __m128 gains = _mm_set1_ps(gain);
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+			_mm_storeu_ps(out + index, _mm_add_ps(_mm_loadu_ps(out + index), _mm_mul_ps(_mm_loadu_ps(in + index), gains)));
+		return index;
+	}
+
+	static long applyGain(float* data, float gain, long count)
+	{
+		const __m128 gains = _mm_set1_ps(gain);
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+			_mm_storeu_ps(data + index, _mm_mul_ps(_mm_loadu_ps(data + index), gains));
+		return index;
+	}
+
+	// squares summed in double lanes, so long blocks meter like the scalar path
+	static long measure(const float* in, long count, SBSampleLevels& levels)
+	{
+		__m128d peaks = _mm_setzero_pd(), sums = _mm_setzero_pd();
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			const __m128 samples = _mm_loadu_ps(in + index);
+			SBSampleSimd<double>::accumulate(_mm_cvtps_pd(samples), peaks, sums);
+			SBSampleSimd<double>::accumulate(_mm_cvtps_pd(_mm_movehl_ps(samples, samples)), peaks, sums);
+		}
+		SBSampleSimd<double>::store(peaks, sums, levels);
+		return index;
+	}
+};
+
+// SSE2 has no signed 32x32->64 multiply, Q31 gains stay scalar (int64 products).
+template<> struct SBSampleSimd<SBQ31> : SBSampleScalar<SBQ31>
+{
+	static __m128i select(__m128i mask, __m128i a, __m128i b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+	static __m128i addSaturated(__m128i a, __m128i b)
+	{
+		const __m128i sum = _mm_add_epi32(a, b);
+		const __m128i overflow = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(sum, a), _mm_xor_si128(sum, b)), 31);
+		const __m128i limit = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(INT32_MAX));
+		return select(overflow, limit, sum);
+	}
+
+	static long fromInt32(const int32_t* in, SBQ31* out, long count, int bits)
+	{
+		if (bits == 32)
+		{
+			std::memcpy(out, in, static_cast<size_t>(count) * sizeof(int32_t));
+			return count;
+		}
+		const __m128i high = _mm_set1_epi32(static_cast<int32_t>((1ll << (bits - 1)) - 1));
+		const __m128i low = _mm_set1_epi32(static_cast<int32_t>(-(1ll << (bits - 1))));
+		const __m128i shift = _mm_cvtsi32_si128(32 - bits);
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+			samples = select(_mm_cmpgt_epi32(samples, high), high, samples);
+			samples = select(_mm_cmplt_epi32(samples, low), low, samples);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + index), _mm_sll_epi32(samples, shift));
+		}
+		return index;
+	}
+
+	// rounding bias added with saturation, so full scale lands on the largest code like the scalar clip
+	static long toInt32(const SBQ31* in, int32_t* out, long count, int bits)
+	{
+		if (bits == 32)
+		{
+			std::memcpy(out, in, static_cast<size_t>(count) * sizeof(int32_t));
+			return count;
+		}
+		const __m128i half = _mm_set1_epi32(1 << (31 - bits));
+		const __m128i shift = _mm_cvtsi32_si128(32 - bits);
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + index), _mm_sra_epi32(addSaturated(samples, half), shift));
+		}
+		return index;
+	}
+
+	static long mix(SBQ31* out, const SBQ31* in, long count)
+	{
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			__m128i* target = reinterpret_cast<__m128i*>(out + index);
+			_mm_storeu_si128(target, addSaturated(_mm_loadu_si128(target), _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index))));
+		}
+		return index;
+	}
+
+	static long measure(const SBQ31* in, long count, SBSampleLevels& levels)
+	{
+		const __m128d scale = _mm_set1_pd(1.0 / 2147483648.0);
+		__m128d peaks = _mm_setzero_pd(), sums = _mm_setzero_pd();
+		long index = 0;
+		for (; index + 4 <= count; index += 4)
+		{
+			const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+			SBSampleSimd<double>::accumulate(_mm_mul_pd(_mm_cvtepi32_pd(samples), scale), peaks, sums);
+			SBSampleSimd<double>::accumulate(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(samples, _MM_SHUFFLE(1, 0, 3, 2))), scale), peaks, sums);
+		}
+		SBSampleSimd<double>::store(peaks, sums, levels);
+		return index;
+	}
+};
+#endif
+
+//
+// Conversion
+//
+// Driver words to samples and back. Integer formats follow SB_QuantizeSample, so that every processing type
+// hands the driver (and the file writers) the same codes for the same signal.
+template<typename T>
+inline void SB_SamplesFromInt32(const int32_t* in, T* out, long count, int bits)	// bits: 16 to 32, LSB aligned
+{
+	for (long index = SBSampleSimd<T>::fromInt32(in, out, count, bits); index < count; ++index)
+		out[index] = SBSampleTraits<T>::fromInt(in[index], bits);
+}
+
+template<typename T>
+inline void SB_SamplesFromInt16(const int16_t* in, T* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		out[index] = SBSampleTraits<T>::fromInt(in[index], 16);
+}
+
+template<typename T>
+inline void SB_SamplesFromInt24(const unsigned char* in, T* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		out[index] = SBSampleTraits<T>::fromInt(SB_ReadInt24(in + 3 * index), 24);
+}
+
+template<typename T>
+inline void SB_SamplesToInt32(const T* in, int32_t* out, long count, int bits)
+{
+	for (long index = SBSampleSimd<T>::toInt32(in, out, count, bits); index < count; ++index)
+		out[index] = SBSampleTraits<T>::toInt(in[index], bits);
+}
+
+template<typename T>
+inline void SB_SamplesToInt16(const T* in, int16_t* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		out[index] = static_cast<int16_t>(SBSampleTraits<T>::toInt(in[index], 16));
+}
+
+template<typename T>
+inline void SB_SamplesToInt24(const T* in, unsigned char* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		SB_WriteInt24(out + 3 * index, SBSampleTraits<T>::toInt(in[index], 24));
+}
+
+// Codes from SB_SamplesToInt32 or SBDither into the packed formats.
+inline void SB_PackInt16(const int32_t* in, int16_t* out, long count)
+{
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	for (; index + 8 <= count; index += 8)
+	{
+		const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index));
+		const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + index + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + index), _mm_packs_epi32(first, second));
+	}
+#endif
+	for (; index < count; ++index)
+		out[index] = static_cast<int16_t>(std::min(std::max(in[index], -32768), 32767));	// saturated like _mm_packs_epi32
+}
+
+inline void SB_PackInt24(const int32_t* in, unsigned char* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		SB_WriteInt24(out + 3 * index, in[index]);
+}
+
+// Between processing types (float, double, SBQ31), through double; a plain copy for the same type.
+template<typename Target, typename Source>
+inline void SB_ConvertSamples(const Source* in, Target* out, long count)
+{
+	for (long index = 0; index < count; ++index)
+		out[index] = SBSampleTraits<Target>::fromDouble(SBSampleTraits<Source>::toDouble(in[index]));
+}
+
+template<typename T>
+inline void SB_ConvertSamples(const T* in, T* out, long count)
+{
+	std::copy_n(in, count, out);
+}
+
+// A driver buffer to samples, by its ASIOSampleType value (recorded sessions replay without the driver headers).
+// Big endian and DSD formats are not supported and come out silent.
+template<typename T>
+inline void SB_SamplesFromDriver(long asioType, const void* in, T* out, long count)
+{
+	const int32_t* words = static_cast<const int32_t*>(in);
+	switch (asioType)
+	{
+	case 16: SB_SamplesFromInt16(static_cast<const int16_t*>(in), out, count); break;      	// Int16_LSB
+	case 17: SB_SamplesFromInt24(static_cast<const unsigned char*>(in), out, count); break;	// Int24_LSB
+	case 18: SB_SamplesFromInt32(words, out, count, 32); break;                            	// Int32_LSB
+	case 19: SB_ConvertSamples(static_cast<const float*>(in), out, count); break;          	// Float32_LSB
+	case 20: SB_ConvertSamples(static_cast<const double*>(in), out, count); break;         	// Float64_LSB
+	case 24: SB_SamplesFromInt32(words, out, count, 16); break;                            	// Int32_LSB16
+	case 25: SB_SamplesFromInt32(words, out, count, 18); break;                            	// Int32_LSB18
+	case 26: SB_SamplesFromInt32(words, out, count, 20); break;                            	// Int32_LSB20
+	case 27: SB_SamplesFromInt32(words, out, count, 24); break;                            	// Int32_LSB24
+	default: std::fill_n(out, count, T()); break;
+	}
+}
+
+//
+// Processing
+//
+template<typename T>
+inline typename SBSampleTraits<T>::Gain SB_MakeGain(double gain)
+{
+	return SBSampleTraits<T>::gain(gain);
+}
+
+// out += in
+template<typename T>
+inline void SB_MixSamples(T* out, const T* in, long count)
+{
+	for (long index = SBSampleSimd<T>::mix(out, in, count); index < count; ++index)
+		out[index] = SBSampleTraits<T>::add(out[index], in[index]);
+}
+
+// out += in * gain
+template<typename T>
+inline void SB_MixSamples(T* out, const T* in, typename SBSampleTraits<T>::Gain gain, long count)
+{
+	for (long index = SBSampleSimd<T>::mixScaled(out, in, gain, count); index < count; ++index)
+		out[index] = SBSampleTraits<T>::add(out[index], SBSampleTraits<T>::scale(in[index], gain));
+}
+
+template<typename T>
+inline void SB_ApplyGain(T* data, typename SBSampleTraits<T>::Gain gain, long count)
+{
+	for (long index = SBSampleSimd<T>::applyGain(data, gain, count); index < count; ++index)
+		data[index] = SBSampleTraits<T>::scale(data[index], gain);
+}
+
+// Peak and sum of squares, added to levels.
+template<typename T>
+inline void SB_MeasureLevels(const T* in, long count, SBSampleLevels& levels)
+{
+	double peak = levels.peak, sumSquares = 0.0;
+	for (long index = SBSampleSimd<T>::measure(in, count, levels); index < count; ++index)
+	{
+		const double value = SBSampleTraits<T>::toDouble(in[index]);
+		peak = std::max(peak, std::abs(value));
+		sumSquares += value * value;
+	}
+	levels.peak = std::max(levels.peak, peak);
+	levels.sumSquares += sumSquares;
+	levels.count += static_cast<uint64_t>(count);
+}
+
+//
+// Processing type
+//
+// The engine precision is a build choice, SB_SAMPLE_FLOAT64 or SB_SAMPLE_Q31 (float32 otherwise), usually picked
+// to match the driver format of the deployment so the conversions become copies.
+#if defined(SB_SAMPLE_FLOAT64) && defined(SB_SAMPLE_Q31)
+#error "SB_SAMPLE_FLOAT64 and SB_SAMPLE_Q31 are exclusive"
+#elif defined(SB_SAMPLE_FLOAT64)
+using SBAudioSample = double;
+#elif defined(SB_SAMPLE_Q31)
+using SBAudioSample = SBQ31;
+#else
+using SBAudioSample = float;
+#endif
+
+// Planar float views of channels for the consumers that only take float (capture, file writers): the channels
+// themselves in float builds, otherwise converted into scratch (channelCount * frameCount, owned by the caller).
+inline const float* const* SB_FloatChannels(const float* const* channels, long /*channelCount*/, long /*frameCount*/, float* /*scratch*/, const float** /*views*/)
+{
+	return channels;
+}
+
+template<typename T>
+inline const float* const* SB_FloatChannels(const T* const* channels, long channelCount, long frameCount, float* scratch, const float** views)
+{
+	for (long channel = 0; channel < channelCount; ++channel)
+	{
+		float* target = scratch + static_cast<size_t>(channel) * frameCount;
+		SB_ConvertSamples(channels[channel], target, frameCount);
+		views[channel] = target;
+	}
+	return views;
+}
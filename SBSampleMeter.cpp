@@ -0,0 +1,127 @@
+#include "SBSampleMeter.h"
+#include "SBDither.h"
+#include "SBSampleKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using SBClock = std::chrono::steady_clock;
+
+static volatile double s_sink = 0.0;
+
+static double SB_ErrorDb(double error)
+{
+	return error > 0.0 ? 20.0 * std::log10(error) : -400.0;
+}
+
+// Samples per second of run(), called setup.repeats times on count samples each.
+template<typename Run>
+static double SB_MeasureRate(const SBSampleMeterSetup& setup, long count, Run run)
+{
+	run();	// warm the caches
+	const auto start = SBClock::now();
+	for (int repeat = 0; repeat < setup.repeats; ++repeat)
+		run();
+	const double seconds = std::chrono::duration<double>(SBClock::now() - start).count();
+	return seconds > 0.0 ? static_cast<double>(count) * setup.repeats / seconds : 0.0;
+}
+
+template<typename T>
+static SBSampleMeasurement SB_MeasureSampleKernels(const SBSampleMeterSetup& setup)
+{
+	using Traits = SBSampleTraits<T>;
+	SBSampleMeasurement measurement;
+	measurement.type = Traits::name();
+	const long frames = std::max(setup.frameCount, 1l), sources = std::max(setup.sources, 1l);
+	const size_t size = static_cast<size_t>(frames);
+
+	std::vector<T> samples(size), mix(size);
+	std::vector<int32_t> codes(size), roundTrip(size);
+
+	// codes: every 24 bit code, 32 bit ones strided over the range with both ends
+	for (int bits : { 24, 32 })
+	{
+		long& errors = bits == 24 ? measurement.codeErrors24 : measurement.codeErrors32;
+		const int64_t first = -(1ll << (bits - 1)), last = (1ll << (bits - 1)) - 1;
+		const int64_t stride = bits == 24 ? 1 : 4093;
+		for (int64_t code = first; code <= last;)
+		{
+			long count = 0;
+			for (; count < frames && code <= last; ++count)
+			{
+				codes[count] = static_cast<int32_t>(code);
+				code = code == last ? last + 1 : std::min(code + stride, last);
+			}
+			SB_SamplesFromInt32(codes.data(), samples.data(), count, bits);
+			SB_SamplesToInt32(samples.data(), roundTrip.data(), count, bits);
+			for (long index = 0; index < count; ++index)
+				errors += roundTrip[index] != codes[index];
+		}
+	}
+
+	// mix and gain: sources at -12 dBFS summed with gains of 1 / sources, against the same sums in double
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> signal(-0.25, 0.25), gains(0.5, 1.0);
+	std::vector<double> reference(size, 0.0), source(size);
+	std::fill(mix.begin(), mix.end(), Traits::fromDouble(0.0));
+	for (long channel = 0; channel < sources; ++channel)
+	{
+		const auto gain = SB_MakeGain<T>(gains(random) / static_cast<double>(sources));
+		const double exactGain = Traits::toDouble(Traits::scale(Traits::fromDouble(0.5), gain)) * 2.0;	// as the type holds it
+		for (size_t index = 0; index < size; ++index)
+		{
+			samples[index] = Traits::fromDouble(signal(random));
+			source[index] = Traits::toDouble(samples[index]);
+			reference[index] += source[index] * exactGain;
+		}
+		SB_MixSamples(mix.data(), samples.data(), gain, frames);
+	}
+	double mixError = 0.0, gainError = 0.0;
+	for (size_t index = 0; index < size; ++index)
+		mixError = std::max(mixError, std::abs(Traits::toDouble(mix[index]) - reference[index]));
+	const auto gain = SB_MakeGain<T>(0.7071);
+	const double exactGain = Traits::toDouble(Traits::scale(Traits::fromDouble(0.5), gain)) * 2.0;
+	SB_ApplyGain(samples.data(), gain, frames);
+	for (size_t index = 0; index < size; ++index)
+		gainError = std::max(gainError, std::abs(Traits::toDouble(samples[index]) - source[index] * exactGain));
+	measurement.mixErrorDb = SB_ErrorDb(mixError);
+	measurement.gainErrorDb = SB_ErrorDb(gainError);
+
+	// throughput: gains of 1/2 and 2 alternate and the mix adds then removes, so the data stays in range
+	for (size_t index = 0; index < size; ++index)
+		codes[index] = static_cast<int32_t>(std::lrint(signal(random) * 8388608.0));
+	SBSampleLevels levels;
+	const auto half = SB_MakeGain<T>(0.5), twice = SB_MakeGain<T>(2.0), plus = SB_MakeGain<T>(0.5), minus = SB_MakeGain<T>(-0.5);
+	bool flip = false;
+	measurement.fromInt32Rate = SB_MeasureRate(setup, frames, [&]() { SB_SamplesFromInt32(codes.data(), samples.data(), frames, 24); });
+	measurement.toInt32Rate = SB_MeasureRate(setup, frames, [&]() { SB_SamplesToInt32(samples.data(), roundTrip.data(), frames, 24); });
+	measurement.mixRate = SB_MeasureRate(setup, frames, [&]() { SB_MixSamples(mix.data(), samples.data(), (flip = !flip) ? plus : minus, frames); });
+	measurement.gainRate = SB_MeasureRate(setup, frames, [&]() { SB_ApplyGain(samples.data(), (flip = !flip) ? half : twice, frames); });
+	measurement.levelsRate = SB_MeasureRate(setup, frames, [&]() { SB_MeasureLevels(samples.data(), frames, levels); });
+
+	// dither: the sources as the channels of an output, each a copy of the samples
+	std::vector<const T*> ditherIn(static_cast<size_t>(sources), samples.data());
+	std::vector<std::vector<int32_t>> ditherCodes(static_cast<size_t>(sources), std::vector<int32_t>(size));
+	std::vector<int32_t*> ditherOut;
+	for (auto& channel : ditherCodes)
+		ditherOut.push_back(channel.data());
+	SBDither dither;
+	for (SBNoiseShaping shaping : { SBNoiseShaping::None, SBNoiseShaping::FWeighted9 })
+	{
+		SBDitherSetup ditherSetup;
+		ditherSetup.type = SBDitherType::Triangular;
+		ditherSetup.shaping = shaping;
+		dither.prepare(ditherSetup, sources, 24);
+		(shaping == SBNoiseShaping::None ? measurement.ditherRate : measurement.shapedDitherRate) =
+			SB_MeasureRate(setup, frames * sources, [&]() { dither.quantize(ditherIn.data(), ditherOut.data(), frames); });
+	}
+	s_sink = s_sink + levels.sumSquares + Traits::toDouble(mix[0]) + roundTrip[0] + ditherCodes[0][0];	// keeps the timed loops
+	return measurement;
+}
+
+std::vector<SBSampleMeasurement> SB_MeasureSampleKernels(const SBSampleMeterSetup& setup)
+{
+	return { SB_MeasureSampleKernels<float>(setup), SB_MeasureSampleKernels<double>(setup), SB_MeasureSampleKernels<SBQ31>(setup) };
+}
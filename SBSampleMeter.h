@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+struct SBSampleMeterSetup
+{
+	long	frameCount = 512;	// per kernel call, an engine block
+	long	sources = 16;    	// channels mixed into one for the precision of the mix, and dithered
+	int 	repeats = 4000;  	// kernel calls timed per measure
+};
+
+// Precision and throughput of the sample kernels for one processing type, whatever the build's SBAudioSample.
+struct SBSampleMeasurement
+{
+	const char*	type = "";
+	long       	codeErrors24 = 0;      	// 24 bit codes that do not come back from a round trip through the type
+	long       	codeErrors32 = 0;      	// the same for 32 bit codes (strided over the range)
+	double     	mixErrorDb = -400.0;   	// worst error of a scaled mix of sources against double arithmetic, dBFS
+	double     	gainErrorDb = -400.0;  	// the same for a gain
+	double     	fromInt32Rate = 0.0;   	// samples per second, 24 bit words in
+	double     	toInt32Rate = 0.0;     	// 24 bit words out
+	double     	mixRate = 0.0;         	// scaled mix, per source sample
+	double     	gainRate = 0.0;
+	double     	levelsRate = 0.0;
+	double     	ditherRate = 0.0;      	// SBDither to 24 bit words, TPDF over setup.sources channels
+	double     	shapedDitherRate = 0.0;	// the same with the 9 tap noise shaping, the slowest filter
+};
+
+// float32, float64 and q31, in that order. Runs on the calling thread, a fraction of a second with the default setup.
+std::vector<SBSampleMeasurement> SB_MeasureSampleKernels(const SBSampleMeterSetup& setup);
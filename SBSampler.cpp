@@ -0,0 +1,359 @@
+#include "SBSampler.h"
+#include "SBFile.h"
+#include "SBSimd.h"
+#include "src/SBWav.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const double SB_PI = 3.14159265358979323846;
+
+static inline float SB_InterpolateCubic(const float* frames, float t)
+{
+	const float previous = frames[-1], current = frames[0], next = frames[1], after = frames[2];
+	return current + 0.5f * t * (next - previous + t * (2.0f * previous - 5.0f * current + 4.0f * next - after + t * (3.0f * (current - next) + after - previous)));
+}
+
+SBSampler::SBSampler(double sampleRate, size_t maxVoices, long maxBlockSize)
+	: rate(sampleRate), capacity((std::max<size_t>(maxVoices, 1) + 3) & ~size_t(3)), maxFrames(std::max(maxBlockSize, 1l)),
+	silence(2 * GuardFrames, 0.0f), sincTable((SincPhases + 1) * SincTaps),
+	data(capacity), position(capacity), fraction(capacity), increment(capacity), end(capacity),
+	amplitude(capacity), amplitudeStep(capacity), gainLeft(capacity), gainRight(capacity), ids(capacity),
+	mixLeft(4 * static_cast<size_t>(maxFrames)), mixRight(4 * static_cast<size_t>(maxFrames))
+{
+	for (size_t voice = 0; voice < capacity; ++voice)
+		clearVoice(voice);
+
+	// taps cover frames -3..4 around the position; rows are normalized so DC passes unchanged
+	for (long phase = 0; phase <= SincPhases; ++phase)
+	{
+		const double t = static_cast<double>(phase) / SincPhases;
+		float* row = sincTable.data() + phase * SincTaps;
+		double sum = 0.0;
+		for (long tap = 0; tap < SincTaps; ++tap)
+		{
+			const double x = static_cast<double>(tap - SincTaps / 2 + 1) - t;
+			const double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(SB_PI * x) / (SB_PI * x);
+			const double window = 0.42 + 0.5 * std::cos(SB_PI * x / (SincTaps / 2)) + 0.08 * std::cos(2.0 * SB_PI * x / (SincTaps / 2));
+			row[tap] = static_cast<float>(sinc * window);
+			sum += row[tap];
+		}
+		for (long tap = 0; tap < SincTaps; ++tap)
+			row[tap] = static_cast<float>(row[tap] / sum);
+	}
+}
+
+//
+// Samples
+//
+uint32_t SBSampler::addSample(const float* frames, size_t frameCount, double sampleRate)
+{
+	if (sampleRate <= 0.0 || frameCount > static_cast<size_t>(std::numeric_limits<int32_t>::max() - 2 * GuardFrames))
+		return InvalidSample;
+	Sample sample;
+	sample.frames.assign(frameCount + 2 * GuardFrames, 0.0f);
+	std::copy(frames, frames + frameCount, sample.frames.begin() + GuardFrames);
+	sample.length = static_cast<int32_t>(frameCount);
+	sample.sampleRate = sampleRate;
+	samples.push_back(std::move(sample));
+	return static_cast<uint32_t>(samples.size() - 1);
+}
+
+uint32_t SBSampler::addSample(const void* wavData, const SBWavInfo& info, uint16_t channel)
+{
+	if (!info.decodable() || channel >= info.format.numChannels || info.frameCount > static_cast<uint64_t>(std::numeric_limits<int32_t>::max() - 2 * GuardFrames))
+		return InvalidSample;
+	Sample sample;
+	sample.frames.assign(static_cast<size_t>(info.frameCount) + 2 * GuardFrames, 0.0f);
+	std::vector<float*> channels(info.format.numChannels, nullptr);
+	channels[channel] = sample.frames.data() + GuardFrames;
+	sample.length = static_cast<int32_t>(SB_DecodeWavFrames(wavData, info, 0, static_cast<size_t>(info.frameCount), channels.data()));
+	sample.sampleRate = info.format.sampleRate;
+	samples.push_back(std::move(sample));
+	return static_cast<uint32_t>(samples.size() - 1);
+}
+
+bool SBSampler::loadSamples(const std::wstring& path, std::vector<uint32_t>& sampleIds)
+{
+	SBMappedFile file;
+	SBWavInfo info;
+	if (!file.open(path) || !SB_ReadWavInfo(file.data(), file.size(), info) || !info.decodable() || info.format.sampleRate == 0)
+		return false;
+	const size_t firstSample = samples.size();
+	std::vector<uint32_t> loaded;
+	for (uint16_t channel = 0; channel < info.format.numChannels; ++channel)
+	{
+		const uint32_t sampleId = addSample(file.data(), info, channel);
+		if (sampleId == InvalidSample)
+		{
+			samples.erase(samples.begin() + firstSample, samples.end());
+			return false;
+		}
+		loaded.push_back(sampleId);
+	}
+	sampleIds.insert(sampleIds.end(), loaded.begin(), loaded.end());
+	return true;
+}
+
+void SBSampler::setReleaseTime(float seconds)
+{
+	releaseSeconds = std::max(seconds, 0.0f);
+}
+
+//
+// Voices
+//
+uint32_t SBSampler::start(uint32_t sampleId, float pitch, float gain, float pan)
+{
+	if (count == capacity || sampleId >= samples.size() || !(pitch > 0.0f))
+		return 0;
+
+	const Sample& sample = samples[sampleId];
+	const size_t voice = count++;
+	const double angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0) * SB_PI / 4.0;	// constant power
+	data[voice] = sample.frames.data() + GuardFrames;
+	position[voice] = 0;
+	fraction[voice] = 0.0f;
+	increment[voice] = static_cast<float>(pitch * sample.sampleRate / rate);
+	end[voice] = sample.length;
+	amplitude[voice] = gain;
+	amplitudeStep[voice] = 0.0f;
+	gainLeft[voice] = static_cast<float>(std::cos(angle));
+	gainRight[voice] = static_cast<float>(std::sin(angle));
+	ids[voice] = nextId;
+	nextId = nextId == std::numeric_limits<uint32_t>::max() ? 1 : nextId + 1;
+	return ids[voice];
+}
+
+void SBSampler::stop(uint32_t voiceId)
+{
+	for (size_t voice = 0; voice < count; ++voice)
+	{
+		if (ids[voice] != voiceId)
+			continue;
+		releaseVoice(voice, releaseFrames());
+		return;
+	}
+}
+
+void SBSampler::stopAll()
+{
+	const long frames = releaseFrames();
+	for (size_t voice = 0; voice < count; ++voice)
+		releaseVoice(voice, frames);
+}
+
+long SBSampler::releaseFrames() const
+{
+	return std::max(static_cast<long>(std::lround(releaseSeconds * rate)), 1l);
+}
+
+void SBSampler::releaseVoice(size_t voice, long frames)
+{
+	// a voice already releasing keeps its slope
+	if (amplitudeStep[voice] >= 0.0f)
+		amplitudeStep[voice] = -std::max(std::fabs(amplitude[voice]), 1e-6f) / static_cast<float>(frames);
+}
+
+void SBSampler::clearVoice(size_t voice)
+{
+	// silent lanes read the guard frames of an empty sample
+	data[voice] = silence.data() + GuardFrames;
+	position[voice] = 0;
+	fraction[voice] = 0.0f;
+	increment[voice] = 0.0f;
+	end[voice] = 0;
+	amplitude[voice] = 0.0f;
+	amplitudeStep[voice] = 0.0f;
+	gainLeft[voice] = 0.0f;
+	gainRight[voice] = 0.0f;
+	ids[voice] = 0;
+}
+
+void SBSampler::removeFinishedVoices()
+{
+	for (size_t voice = 0; voice < count;)
+	{
+		const bool finished = position[voice] >= end[voice] || (amplitudeStep[voice] < 0.0f && amplitude[voice] <= 0.0f);
+		if (!finished)
+		{
+			++voice;
+			continue;
+		}
+		const size_t last = --count;
+		if (voice != last)
+		{
+			data[voice] = data[last];
+			position[voice] = position[last];
+			fraction[voice] = fraction[last];
+			increment[voice] = increment[last];
+			end[voice] = end[last];
+			amplitude[voice] = amplitude[last];
+			amplitudeStep[voice] = amplitudeStep[last];
+			gainLeft[voice] = gainLeft[last];
+			gainRight[voice] = gainRight[last];
+			ids[voice] = ids[last];
+		}
+		clearVoice(last);
+	}
+}
+
+//
+// Rendering
+//
+void SBSampler::render(float* left, float* right, long frameCount)
+{
+	for (long first = 0; first < frameCount; first += maxFrames)
+	{
+		const long frames = std::min(frameCount - first, maxFrames);
+		std::fill_n(mixLeft.begin(), 4 * frames, 0.0f);
+		std::fill_n(mixRight.begin(), 4 * frames, 0.0f);
+#if defined(SB_SIMD_SSE2)
+		switch (interpolation)
+		{
+		case SBInterpolation::Linear: renderGroups<SBInterpolation::Linear>(frames); break;
+		case SBInterpolation::Cubic:  renderGroups<SBInterpolation::Cubic>(frames); break;
+		case SBInterpolation::Sinc:   renderGroups<SBInterpolation::Sinc>(frames); break;
+		}
+#else
+		renderScalar(frames);
+#endif
+		for (long frame = 0; frame < frames; ++frame)
+		{
+			const float* lanes = mixLeft.data() + 4 * frame;
+			left[first + frame] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			lanes = mixRight.data() + 4 * frame;
+			right[first + frame] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+		}
+		removeFinishedVoices();
+	}
+}
+
+#if defined(SB_SIMD_SSE2)
+template<SBInterpolation Mode>
+void SBSampler::renderGroups(long frameCount)
+{
+	const float* table = sincTable.data();
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 phases = _mm_set1_ps(static_cast<float>(SincPhases));
+	for (size_t first = 0; first < count; first += 4)
+	{
+		const float* const* lanes = data.data() + first;
+		__m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position.data() + first));
+		__m128 t = _mm_loadu_ps(fraction.data() + first);
+		__m128 level = _mm_loadu_ps(amplitude.data() + first);
+		const __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(end.data() + first));
+		const __m128 step = _mm_loadu_ps(increment.data() + first);
+		const __m128 levelStep = _mm_loadu_ps(amplitudeStep.data() + first);
+		const __m128 left = _mm_loadu_ps(gainLeft.data() + first);
+		const __m128 right = _mm_loadu_ps(gainRight.data() + first);
+
+		int32_t frame4[4];
+		for (long frame = 0; frame < frameCount; ++frame)
+		{
+			// lanes past their end read (and are masked at) the last frame, inside the guard frames
+			const __m128i playing = _mm_cmplt_epi32(index, last);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(frame4), _mm_or_si128(_mm_and_si128(playing, index), _mm_andnot_si128(playing, last)));
+			const float* p0 = lanes[0] + frame4[0];
+			const float* p1 = lanes[1] + frame4[1];
+			const float* p2 = lanes[2] + frame4[2];
+			const float* p3 = lanes[3] + frame4[3];
+
+			__m128 value;
+			if (Mode == SBInterpolation::Linear)
+			{
+				const __m128 current = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+				const __m128 next = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+				value = _mm_add_ps(current, _mm_mul_ps(t, _mm_sub_ps(next, current)));
+			}
+			else if (Mode == SBInterpolation::Cubic)
+			{
+				const __m128 previous = _mm_setr_ps(p0[-1], p1[-1], p2[-1], p3[-1]);
+				const __m128 current = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+				const __m128 next = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+				const __m128 after = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+				// same Horner form as SB_InterpolateCubic
+				__m128 poly = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_sub_ps(current, next)), after), previous);
+				poly = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), previous), _mm_mul_ps(_mm_set1_ps(5.0f), current)), _mm_mul_ps(_mm_set1_ps(4.0f), next)), after), _mm_mul_ps(t, poly));
+				poly = _mm_add_ps(_mm_sub_ps(next, previous), _mm_mul_ps(t, poly));
+				value = _mm_add_ps(current, _mm_mul_ps(_mm_mul_ps(half, t), poly));
+			}
+			else
+			{
+				int32_t phase4[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(phase4), _mm_cvtps_epi32(_mm_mul_ps(t, phases)));
+				const float* c0 = table + phase4[0] * SincTaps;
+				const float* c1 = table + phase4[1] * SincTaps;
+				const float* c2 = table + phase4[2] * SincTaps;
+				const float* c3 = table + phase4[3] * SincTaps;
+				value = zero;
+				for (long tap = 0; tap < SincTaps; ++tap)
+				{
+					const long offset = tap - SincTaps / 2 + 1;
+					const __m128 frames = _mm_setr_ps(p0[offset], p1[offset], p2[offset], p3[offset]);
+					value = _mm_add_ps(value, _mm_mul_ps(frames, _mm_setr_ps(c0[tap], c1[tap], c2[tap], c3[tap])));
+				}
+			}
+
+			value = _mm_and_ps(_mm_mul_ps(value, level), _mm_castsi128_ps(playing));
+			float* mixL = mixLeft.data() + 4 * frame;
+			float* mixR = mixRight.data() + 4 * frame;
+			_mm_storeu_ps(mixL, _mm_add_ps(_mm_loadu_ps(mixL), _mm_mul_ps(value, left)));
+			_mm_storeu_ps(mixR, _mm_add_ps(_mm_loadu_ps(mixR), _mm_mul_ps(value, right)));
+
+			level = _mm_max_ps(_mm_add_ps(level, levelStep), zero);
+			t = _mm_add_ps(t, step);
+			const __m128i whole = _mm_cvttps_epi32(t);
+			index = _mm_add_epi32(index, whole);
+			t = _mm_sub_ps(t, _mm_cvtepi32_ps(whole));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(position.data() + first), index);
+		_mm_storeu_ps(fraction.data() + first, t);
+		_mm_storeu_ps(amplitude.data() + first, level);
+	}
+}
+#endif
+
+void SBSampler::renderScalar(long frameCount)
+{
+	for (size_t voice = 0; voice < count; ++voice)
+	{
+		float* mixL = mixLeft.data() + (voice & 3);
+		float* mixR = mixRight.data() + (voice & 3);
+		for (long frame = 0; frame < frameCount; ++frame)
+		{
+			const bool playing = position[voice] < end[voice];
+			const float* p = data[voice] + (playing ? position[voice] : end[voice]);
+			const float t = fraction[voice];
+			float value = 0.0f;
+			switch (interpolation)
+			{
+			case SBInterpolation::Linear:
+				value = p[0] + t * (p[1] - p[0]);
+				break;
+			case SBInterpolation::Cubic:
+				value = SB_InterpolateCubic(p, t);
+				break;
+			case SBInterpolation::Sinc:
+			{
+				const float* row = sincTable.data() + std::lrint(t * SincPhases) * SincTaps;
+				for (long tap = 0; tap < SincTaps; ++tap)
+					value += p[tap - SincTaps / 2 + 1] * row[tap];
+				break;
+			}
+			}
+			value = playing ? value * amplitude[voice] : 0.0f;
+			mixL[4 * frame] += value * gainLeft[voice];
+			mixR[4 * frame] += value * gainRight[voice];
+
+			amplitude[voice] = std::max(amplitude[voice] + amplitudeStep[voice], 0.0f);
+			fraction[voice] += increment[voice];
+			const int32_t whole = static_cast<int32_t>(fraction[voice]);
+			position[voice] += whole;
+			fraction[voice] -= static_cast<float>(whole);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct SBWavInfo;
+
+enum class SBInterpolation
+{
+	Linear = 0,
+	Cubic,	// 4 point Catmull-Rom
+	Sinc, 	// 8 point Blackman windowed sinc, fixed cutoff: pitching up aliases
+};
+
+// Polyphonic one-shot sample player.
+//
+// Voices are kept in structure-of-arrays form and rendered four at a time (one SSE2 lane each), mixing into
+// per-lane accumulators that are only summed once per frame. Finished voices are swapped out with the last
+// one, so the arrays never have holes and render cost follows the active voice count.
+// For sample accurate starts, render the segments between events (SB_ForEachEventSegment) and start voices in between.
+class SBSampler
+{
+public:
+	static constexpr long GuardFrames = 8;	// silence around every sample, covers the interpolation taps
+	static constexpr long SincTaps = 8;
+	static constexpr long SincPhases = 256;
+	static constexpr uint32_t InvalidSample = UINT32_MAX;
+
+	SBSampler(double sampleRate, size_t maxVoices = 4096, long maxBlockSize = 2048);
+	SBSampler(const SBSampler&) = delete;
+	SBSampler& operator=(const SBSampler&) = delete;
+
+	// setup, before the audio thread runs; sample ids start at 0, InvalidSample on failure
+	uint32_t addSample(const float* frames, size_t frameCount, double sampleRate);
+	uint32_t addSample(const void* wavData, const SBWavInfo& info, uint16_t channel);	// decoded straight from the file image
+	bool loadSamples(const std::wstring& path, std::vector<uint32_t>& sampleIds);	// one sample per channel, none if any fails
+	void setInterpolation(SBInterpolation mode) { interpolation = mode; }
+	void setReleaseTime(float seconds);
+	size_t sampleCount() const { return samples.size(); }
+
+	// audio thread
+	uint32_t start(uint32_t sampleId, float pitch = 1.0f, float gain = 1.0f, float pan = 0.0f);	// voice id, 0 when every voice is busy
+	void stop(uint32_t voiceId);	// fades out over the release time
+	void stopAll();
+	void render(float* left, float* right, long frameCount);	// adds to the outputs, frameCount <= maxBlockSize
+	size_t activeVoices() const { return count; }
+
+private:
+	struct Sample
+	{
+		std::vector<float>	frames;	// GuardFrames of silence on both sides
+		int32_t           	length = 0;
+		double            	sampleRate = 0.0;
+	};
+
+	template<SBInterpolation Mode> void renderGroups(long frameCount);
+	void renderScalar(long frameCount);
+	long releaseFrames() const;
+	void releaseVoice(size_t voice, long frames);
+	void clearVoice(size_t voice);
+	void removeFinishedVoices();
+
+	const double                	rate;
+	const size_t                	capacity;    	// multiple of 4
+	const long                  	maxFrames;
+	std::vector<Sample>         	samples;
+	std::vector<float>          	silence;
+	std::vector<float>          	sincTable;   	// (SincPhases + 1) rows of SincTaps
+	SBInterpolation             	interpolation = SBInterpolation::Linear;
+	float                       	releaseSeconds = 0.005f;
+
+	// voices [0, count) are playing, the others are silent and never move
+	std::vector<const float*>   	data;        	// first frame of the sample
+	std::vector<int32_t>        	position;    	// integer frame
+	std::vector<float>          	fraction;    	// [0, 1)
+	std::vector<float>          	increment;   	// frames per output frame
+	std::vector<int32_t>        	end;         	// sample length
+	std::vector<float>          	amplitude;
+	std::vector<float>          	amplitudeStep;	// negative while releasing
+	std::vector<float>          	gainLeft;
+	std::vector<float>          	gainRight;
+	std::vector<uint32_t>       	ids;
+	size_t                      	count = 0;
+	uint32_t                    	nextId = 1;
+	std::vector<float>          	mixLeft;     	// 4 lanes per frame
+	std::vector<float>          	mixRight;
+};
@@ -0,0 +1,707 @@
+#include "SBSession.h"
+#include "SBDynamics.h"
+#include "SBFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+using SBClock = std::chrono::steady_clock;
+
+static constexpr uint32_t SB_SESSION_MAGIC = 0x4E534253u;	// "SBSN"
+
+//
+// Sample coding
+//
+static size_t SB_SessionSampleBytes(SBSessionSampleType type)
+{
+	switch (type)
+	{
+	case SBSessionSampleType::Int16:      return 2;
+	case SBSessionSampleType::Int24:      return 3;
+	case SBSessionSampleType::Int32:
+	case SBSessionSampleType::Int32LSB16:
+	case SBSessionSampleType::Int32LSB18:
+	case SBSessionSampleType::Int32LSB20:
+	case SBSessionSampleType::Int32LSB24:
+	case SBSessionSampleType::Float32:    return 4;
+	case SBSessionSampleType::Float64:    return 8;
+	default:                              return 0;
+	}
+}
+
+static bool SB_IsFloatSample(SBSessionSampleType type)
+{
+	return type == SBSessionSampleType::Float32 || type == SBSessionSampleType::Float64;
+}
+
+static constexpr long SB_SESSION_PARTITION = 32;	// frames sharing a Rice parameter
+static constexpr int SB_SESSION_ESCAPE = 32;     	// unary quotients this long are followed by the whole residual
+
+enum class SBSessionCoding : uint8_t
+{
+	Raw = 0,	// the driver bytes as they are
+	Order0,  	// Rice-coded residuals of a fixed predictor of that order (FLAC's fixed predictors)
+	Order1,
+	Order2,
+};
+
+// Samples as integers: integer formats sign extended, floats mapped so that the order of the values is kept
+// (negative numbers are the complement of their magnitude, -0 stays apart from +0).
+static uint64_t SB_SampleToInteger(SBSessionSampleType type, const unsigned char* raw)
+{
+	const size_t width = SB_SessionSampleBytes(type);
+	uint64_t word = 0;
+	memcpy(&word, raw, width);
+	const int bits = static_cast<int>(8 * width);
+	if (!SB_IsFloatSample(type))
+		return bits == 64 ? word : static_cast<uint64_t>(static_cast<int64_t>(word << (64 - bits)) >> (64 - bits));
+	const uint64_t sign = uint64_t(1) << (bits - 1);
+	return word & sign ? ~(word & ~sign) : word;	// -magnitude - 1
+}
+
+static void SB_IntegerToSample(SBSessionSampleType type, uint64_t value, unsigned char* raw)
+{
+	const size_t width = SB_SessionSampleBytes(type);
+	if (SB_IsFloatSample(type) && static_cast<int64_t>(value) < 0)
+		value = ~value | (uint64_t(1) << (8 * width - 1));
+	memcpy(raw, &value, width);
+}
+
+// Fixed predictor of the given order, modulo 2^64 so that residuals reverse exactly whatever the range.
+static uint64_t SB_PredictSample(int order, uint64_t previous, uint64_t beforePrevious)
+{
+	switch (order)
+	{
+	case 0:  return 0;
+	case 1:  return previous;
+	default: return 2 * previous - beforePrevious;
+	}
+}
+
+static int SB_RiceBits(uint64_t value, int parameter)
+{
+	const uint64_t quotient = value >> parameter;
+	return quotient < SB_SESSION_ESCAPE ? static_cast<int>(quotient) + 1 + parameter : SB_SESSION_ESCAPE + 64;
+}
+
+// LSB first, whole bytes appended to out.
+struct SBSessionBitWriter
+{
+	std::vector<char>&	out;
+	uint64_t          	pending = 0;
+	int               	pendingBits = 0;
+
+	void put(uint64_t value, int bits)
+	{
+		while (bits > 0)
+		{
+			const int chunk = std::min(bits, 32);
+			pending |= (value & ((uint64_t(1) << chunk) - 1)) << pendingBits;
+			pendingBits += chunk;
+			value = chunk < 64 ? value >> chunk : 0;
+			bits -= chunk;
+			for (; pendingBits >= 8; pendingBits -= 8, pending >>= 8)
+				out.push_back(static_cast<char>(pending & 0xff));
+		}
+	}
+	void flush()
+	{
+		if (pendingBits > 0)
+			out.push_back(static_cast<char>(pending & 0xff));
+		pending = 0;
+		pendingBits = 0;
+	}
+};
+
+struct SBSessionBitReader
+{
+	const unsigned char*	data;
+	size_t              	size;
+	size_t              	position = 0;	// bits
+
+	bool get(uint64_t& value, int bits)
+	{
+		if (bits > 64 || position + bits > 8 * size)
+			return false;
+		value = 0;
+		for (int bit = 0; bit < bits;)
+		{
+			const size_t byte = position / 8;
+			const int offset = static_cast<int>(position % 8);
+			const int chunk = std::min(8 - offset, bits - bit);
+			value |= static_cast<uint64_t>((data[byte] >> offset) & ((1u << chunk) - 1)) << bit;
+			bit += chunk;
+			position += chunk;
+		}
+		return true;
+	}
+};
+
+// Appends frameCount samples of raw (little endian, width bytes each) as a coding byte and its data. The residuals
+// of the fixed predictor that fits the block best are Rice coded, a parameter (6 bits) per partition of
+// SB_SESSION_PARTITION frames; the raw bytes are kept whenever that is not smaller (noise, full scale material).
+static void SB_EncodeSamples(SBSessionSampleType type, const unsigned char* raw, long frameCount, std::vector<char>& out, std::vector<uint64_t>& residuals)
+{
+	const size_t width = SB_SessionSampleBytes(type);
+	const size_t start = out.size();
+	const size_t rawSize = width * frameCount;
+	if (width == 0 || frameCount <= 0)
+	{
+		out.push_back(static_cast<char>(SBSessionCoding::Raw));
+		out.insert(out.end(), raw, raw + rawSize);
+		return;
+	}
+
+	// the order with the smallest residuals overall
+	residuals.resize(static_cast<size_t>(frameCount));
+	double magnitudes[3] = {};
+	uint64_t previous = 0, beforePrevious = 0;
+	for (long frame = 0; frame < frameCount; ++frame)
+	{
+		const uint64_t value = SB_SampleToInteger(type, raw + frame * width);
+		for (int order = 0; order < 3; ++order)
+			magnitudes[order] += std::abs(static_cast<double>(static_cast<int64_t>(value - SB_PredictSample(order, previous, beforePrevious))));
+		residuals[frame] = value;
+		beforePrevious = previous;
+		previous = value;
+	}
+	const int order = static_cast<int>(std::min_element(magnitudes, magnitudes + 3) - magnitudes);
+	previous = beforePrevious = 0;
+	for (long frame = 0; frame < frameCount; ++frame)
+	{
+		const uint64_t value = residuals[frame];
+		const int64_t residual = static_cast<int64_t>(value - SB_PredictSample(order, previous, beforePrevious));
+		residuals[frame] = (static_cast<uint64_t>(residual) << 1) ^ static_cast<uint64_t>(residual >> 63);	// zigzag
+		beforePrevious = previous;
+		previous = value;
+	}
+
+	out.push_back(static_cast<char>(static_cast<int>(SBSessionCoding::Order0) + order));
+	SBSessionBitWriter writer = { out };
+	for (long first = 0; first < frameCount; first += SB_SESSION_PARTITION)
+	{
+		const long last = std::min(first + SB_SESSION_PARTITION, frameCount);
+		// the parameter around log2 of the mean, the cheapest of its neighbours
+		double sum = 0.0;
+		for (long frame = first; frame < last; ++frame)
+			sum += static_cast<double>(residuals[frame]);
+		const double mean = sum / static_cast<double>(last - first);
+		const int estimate = mean >= 1.0 ? std::min(static_cast<int>(std::log2(mean)), 63) : 0;
+		int parameter = estimate;
+		int64_t bestBits = INT64_MAX;
+		for (int candidate = std::max(estimate - 1, 0); candidate <= std::min(estimate + 1, 63); ++candidate)
+		{
+			int64_t bits = 0;
+			for (long frame = first; frame < last; ++frame)
+				bits += SB_RiceBits(residuals[frame], candidate);
+			if (bits < bestBits)
+			{
+				bestBits = bits;
+				parameter = candidate;
+			}
+		}
+
+		writer.put(static_cast<uint64_t>(parameter), 6);
+		for (long frame = first; frame < last; ++frame)
+		{
+			const uint64_t quotient = residuals[frame] >> parameter;
+			if (quotient < SB_SESSION_ESCAPE)
+			{
+				writer.put((uint64_t(1) << quotient) - 1, static_cast<int>(quotient) + 1);	// ones, then a zero
+				writer.put(residuals[frame], parameter);
+			}
+			else
+			{
+				writer.put(~uint64_t(0), SB_SESSION_ESCAPE);
+				writer.put(residuals[frame], 64);
+			}
+		}
+		if (out.size() - start > rawSize)
+			break;	// already larger than raw
+	}
+	writer.flush();
+
+	if (out.size() - start > rawSize)
+	{
+		out.resize(start);
+		out.push_back(static_cast<char>(SBSessionCoding::Raw));
+		out.insert(out.end(), raw, raw + rawSize);
+	}
+}
+
+// Inverse of SB_EncodeSamples; false when the data is not a valid coding of frameCount samples.
+static bool SB_DecodeSamples(SBSessionSampleType type, const unsigned char* data, size_t size, long frameCount, unsigned char* raw)
+{
+	const size_t width = SB_SessionSampleBytes(type);
+	if (size < 1)
+		return false;
+	const int coding = data[0];
+	++data;
+	--size;
+	if (coding == static_cast<int>(SBSessionCoding::Raw))
+	{
+		if (size != width * frameCount)
+			return false;
+		memcpy(raw, data, size);
+		return true;
+	}
+	const int order = coding - static_cast<int>(SBSessionCoding::Order0);
+	if (width == 0 || order < 0 || order > 2)
+		return false;
+
+	SBSessionBitReader reader = { data, size };
+	uint64_t previous = 0, beforePrevious = 0, parameter = 0;
+	for (long frame = 0; frame < frameCount; ++frame)
+	{
+		if (frame % SB_SESSION_PARTITION == 0 && !reader.get(parameter, 6))
+			return false;
+		uint64_t quotient = 0, bit = 1, residual = 0;
+		while (quotient < SB_SESSION_ESCAPE && reader.get(bit, 1) && bit)
+			++quotient;
+		if (quotient == SB_SESSION_ESCAPE)
+		{
+			if (!reader.get(residual, 64))
+				return false;
+		}
+		else
+		{
+			uint64_t remainder = 0;
+			if (bit || !reader.get(remainder, static_cast<int>(parameter)))
+				return false;	// out of data
+			residual = (quotient << parameter) | remainder;
+		}
+
+		const uint64_t delta = static_cast<uint64_t>(static_cast<int64_t>(residual >> 1) ^ -static_cast<int64_t>(residual & 1));
+		const uint64_t value = delta + SB_PredictSample(order, previous, beforePrevious);
+		SB_IntegerToSample(type, value, raw + frame * width);
+		beforePrevious = previous;
+		previous = value;
+	}
+	return (reader.position + 7) / 8 == size;
+}
+
+//
+// SBSessionRecorder
+//
+bool SBSessionRecorder::start(const SBSessionSetup& sessionSetup)
+{
+	stop();
+	if (sessionSetup.path.empty() || sessionSetup.bufferBytes == 0)
+		return false;
+	setup = sessionSetup;
+
+	SBSessionFileHeader header = {};
+	header.magic = SB_SESSION_MAGIC;
+	header.version = SB_SESSION_FORMAT_VERSION;
+	header.parameterCount = setup.parameters ? setup.parameters->size() : 0;
+	std::vector<float> targets(header.parameterCount);
+	for (uint32_t id = 0; id < header.parameterCount; ++id)
+		targets[id] = setup.parameters->target(id);
+
+	file = SB_OpenFile(setup.path, "wb");
+	if (!file)
+		return false;
+	if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(targets.data(), sizeof(float), targets.size(), file) != targets.size())
+	{
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+
+	// allocated (and touched) up front, the audio thread never faults a page in
+	ring.assign(SB_RoundUpToPowerOfTwo(setup.bufferBytes), 0);
+	ringMask = ring.size() - 1;
+	failed = false;
+	blockOpen = false;
+	writeIndex.store(0, std::memory_order_relaxed);
+	readIndex.store(0, std::memory_order_relaxed);
+	published.store(0, std::memory_order_relaxed);
+	dropped.store(0, std::memory_order_relaxed);
+	written.store(sizeof(header) + targets.size() * sizeof(float), std::memory_order_relaxed);
+	stopping.store(false, std::memory_order_relaxed);
+
+	SBThreadSetup threadSetup;
+	threadSetup.name = "Session";
+	threadSetup.priority = SBThreadPriority::High;
+	if (!writer.start(threadSetup, [this]() { run(); }))
+	{
+		fclose(file);
+		file = nullptr;
+		ring.clear();
+		return false;
+	}
+	accepting.store(true, std::memory_order_seq_cst);
+	return true;
+}
+
+bool SBSessionRecorder::stop()
+{
+	if (!file)
+		return false;
+
+	// pushing stays set from beginBlock to endBlock, so no block is half written once accepting is seen false
+	accepting.store(false, std::memory_order_seq_cst);
+	while (pushing.load(std::memory_order_seq_cst))
+		std::this_thread::yield();
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+
+	const bool succeeded = fclose(file) == 0 && !failed;
+	file = nullptr;
+	ring.clear();
+	return succeeded;
+}
+
+void SBSessionRecorder::beginBlock(const SBAudioScheduler& scheduler, const SBAudioTimeline& timeline, const SBSessionStamp& stamp,
+	const SBSessionSampleType* types, const void* const* inputs, long numInputs, long frameCount)
+{
+	blockOpen = false;
+	pushing.store(true, std::memory_order_seq_cst);
+	if (!accepting.load(std::memory_order_seq_cst) || frameCount <= 0 || frameCount > SB_SESSION_MAX_FRAMES)
+	{
+		pushing.store(false, std::memory_order_release);
+		return;
+	}
+	blockStart = SBClock::now();
+
+	size_t size = sizeof(SBSessionBlockHeader) + numInputs * sizeof(SBSessionSampleType);
+	for (long channel = 0; channel < numInputs; ++channel)
+		size += SB_SessionSampleBytes(types[channel]) * frameCount;
+	const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	if (write + size - readIndex.load(std::memory_order_acquire) > ringMask + 1)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		pushing.store(false, std::memory_order_release);
+		return;
+	}
+
+	const SBAudioTimeline& tempo = scheduler.timeline();
+	block = {};
+	block.frameCount = static_cast<uint32_t>(frameCount);
+	block.numInputs = static_cast<uint32_t>(numInputs);
+	block.stampFlags = stamp.flags;
+	block.stampPosition = stamp.samplePosition;
+	block.stampSystemTime = stamp.systemTime;
+	block.stampSampleRate = stamp.sampleRate;
+	block.stampSpeed = stamp.speed;
+	block.samplePosition = timeline.samplePosition;
+	block.systemTime = timeline.systemTime;
+	block.sampleRate = timeline.sampleRate;
+	block.speed = timeline.speed;
+	block.tempo = tempo.tempo;
+	block.tempoOriginSample = tempo.tempoOriginSample;
+	block.tempoOriginTicks = tempo.tempoOriginTicks;
+
+	blockEnd = write + sizeof(SBSessionBlockHeader);
+	put(blockEnd, types, numInputs * sizeof(SBSessionSampleType));
+	blockEnd += numInputs * sizeof(SBSessionSampleType);
+	for (long channel = 0; channel < numInputs; ++channel)
+	{
+		const size_t bytes = SB_SessionSampleBytes(types[channel]) * frameCount;
+		put(blockEnd, inputs[channel], bytes);
+		blockEnd += bytes;
+	}
+	blockOpen = true;
+}
+
+void SBSessionRecorder::endBlock(const SBAudioScheduler& scheduler, const SBParameterStore* parameters)
+{
+	if (!blockOpen)
+		return;
+	blockOpen = false;
+
+	const SBAudioEventSlice events = scheduler.dueEvents();
+	const size_t changeCount = parameters ? parameters->changes().size() : 0;
+	const uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	if (blockEnd + events.count * sizeof(SBSessionEvent) + changeCount * sizeof(SBParameterChange) - readIndex.load(std::memory_order_acquire) > ringMask + 1)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		pushing.store(false, std::memory_order_release);
+		return;
+	}
+
+	for (const SBAudioBlockEvent& blockEvent : events)
+	{
+		SBSessionEvent record = {};
+		record.time = blockEvent.event.time;
+		record.payload = blockEvent.event.payload;
+		record.offset = static_cast<uint32_t>(blockEvent.offset);
+		record.timebase = static_cast<uint32_t>(blockEvent.event.timebase);
+		record.type = static_cast<uint32_t>(blockEvent.event.type);
+		record.target = blockEvent.event.target;
+		record.value = blockEvent.event.value;
+		put(blockEnd, &record, sizeof(record));
+		blockEnd += sizeof(record);
+	}
+	if (changeCount)
+	{
+		put(blockEnd, parameters->changes().data(), changeCount * sizeof(SBParameterChange));
+		blockEnd += changeCount * sizeof(SBParameterChange);
+	}
+
+	block.eventCount = static_cast<uint32_t>(events.count);
+	block.changeCount = static_cast<uint32_t>(changeCount);
+	block.size = static_cast<uint32_t>(blockEnd - write - sizeof(SBSessionBlockHeader));
+	block.liveNanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(SBClock::now() - blockStart).count());
+	put(write, &block, sizeof(block));
+	writeIndex.store(blockEnd, std::memory_order_release);
+	published.fetch_add(1, std::memory_order_relaxed);
+	pushing.store(false, std::memory_order_release);
+}
+
+void SBSessionRecorder::put(uint64_t position, const void* data, size_t size)
+{
+	const size_t start = static_cast<size_t>(position) & ringMask;
+	const size_t first = std::min(size, ringMask + 1 - start);
+	memcpy(ring.data() + start, data, first);
+	memcpy(ring.data(), static_cast<const char*>(data) + first, size - first);
+}
+
+void SBSessionRecorder::get(uint64_t position, void* data, size_t size) const
+{
+	const size_t start = static_cast<size_t>(position) & ringMask;
+	const size_t first = std::min(size, ringMask + 1 - start);
+	memcpy(data, ring.data() + start, first);
+	memcpy(static_cast<char*>(data) + first, ring.data(), size - first);
+}
+
+void SBSessionRecorder::run()
+{
+	const auto interval = std::chrono::milliseconds(std::max(static_cast<long>(setup.writeSeconds * 1000.0), 5l));
+	while (!stopping.load(std::memory_order_acquire))
+	{
+		drain();
+		std::this_thread::sleep_for(interval);
+	}
+	drain();	// no block can be published anymore
+}
+
+bool SBSessionRecorder::drain()
+{
+	bool wrote = false;
+	for (;;)
+	{
+		const uint64_t read = readIndex.load(std::memory_order_relaxed);
+		if (writeIndex.load(std::memory_order_acquire) == read)
+			break;
+
+		SBSessionBlockHeader header;
+		get(read, &header, sizeof(header));
+		record.resize(header.size);
+		get(read + sizeof(header), record.data(), header.size);
+		if (!failed)
+		{
+			// inputs encoded, the types, events and changes around them copied as they are
+			const char* cursor = record.data();
+			const size_t typeBytes = header.numInputs * sizeof(SBSessionSampleType);
+			encoded.assign(cursor, cursor + typeBytes);
+			cursor += typeBytes;
+			for (uint32_t channel = 0; channel < header.numInputs; ++channel)
+			{
+				SBSessionSampleType type;
+				memcpy(&type, record.data() + channel * sizeof(type), sizeof(type));
+				const size_t sizeAt = encoded.size();
+				encoded.resize(sizeAt + sizeof(uint32_t));
+				SB_EncodeSamples(type, reinterpret_cast<const unsigned char*>(cursor), header.frameCount, encoded, residuals);
+				const uint32_t channelSize = static_cast<uint32_t>(encoded.size() - sizeAt - sizeof(uint32_t));
+				memcpy(encoded.data() + sizeAt, &channelSize, sizeof(channelSize));
+				cursor += SB_SessionSampleBytes(type) * header.frameCount;
+			}
+			encoded.insert(encoded.end(), cursor, static_cast<const char*>(record.data() + record.size()));
+
+			header.size = static_cast<uint32_t>(encoded.size());
+			failed = fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size();
+			written.fetch_add(sizeof(header) + encoded.size(), std::memory_order_relaxed);
+			wrote = true;
+		}
+		// consumed even after a failure, the audio thread must keep going
+		readIndex.store(read + sizeof(header) + record.size(), std::memory_order_release);
+	}
+	// what is written survives a crash of the session, the replay stops at a cut block
+	if (wrote && !failed)
+		failed = fflush(file) != 0;
+	return !failed;
+}
+
+//
+// Replay
+//
+SBSessionReplayResult SB_ReplaySession(const SBSessionReplaySetup& setup)
+{
+	SBSessionReplayResult result;
+	if (setup.numOutputs <= 0 || setup.numOutputs > UINT16_MAX)
+		return result;
+
+	SBMappedFile file;
+	SBSessionFileHeader header;
+	if (!file.open(setup.path) || file.size() < sizeof(header))
+		return result;
+	memcpy(&header, file.data(), sizeof(header));
+	size_t cursor = sizeof(header) + static_cast<size_t>(header.parameterCount) * sizeof(float);
+	if (header.magic != SB_SESSION_MAGIC || header.version != SB_SESSION_FORMAT_VERSION || file.size() < cursor)
+		return result;
+	if (setup.parameters && setup.parameters->size() == header.parameterCount)
+	{
+		for (uint32_t id = 0; id < header.parameterCount; ++id)
+		{
+			float value;
+			memcpy(&value, file.data() + sizeof(header) + id * sizeof(float), sizeof(value));
+			setup.parameters->reset(id, value);
+		}
+	}
+
+	SBAudioScheduler scheduler(setup.eventCapacity);
+	SBWavWriter writer;
+	writer.setDither(setup.dither);
+	std::vector<SBSessionSampleType> types;
+	std::vector<uint64_t> raw;	// driver format, 8 bytes per sample keep every channel aligned
+	std::vector<SBAudioSample> scratch;
+	std::vector<SBAudioSample*> channels;
+	std::vector<float> writerScratch;
+	std::vector<const float*> writerChannels(setup.numOutputs);
+	const long dynamicsCount = setup.dynamics ? std::min(setup.numOutputs, setup.dynamics->numChannels()) : 0;
+	std::vector<float*> dynamicsChannels(dynamicsCount);
+
+	// same floating point environment as the real-time audio thread, or denormals would round differently
+	const bool flushedDenormals = SB_FlushDenormals(true);
+	const auto start = SBClock::now();
+	bool succeeded = true;
+	while (succeeded && file.size() - cursor >= sizeof(SBSessionBlockHeader))
+	{
+		SBSessionBlockHeader block;
+		memcpy(&block, file.data() + cursor, sizeof(block));
+		const char* body = file.data() + cursor + sizeof(block);
+		if (file.size() - cursor - sizeof(block) < block.size)
+			break;	// cut short, the session did not end cleanly
+		const char* end = body + block.size;
+		cursor += sizeof(block) + block.size;
+
+		// bounded before anything is sized from them: every input takes its type, its size, its coding and a bit per frame
+		const uint64_t leastBytes = block.numInputs * (sizeof(SBSessionSampleType) + sizeof(uint32_t) + 1 + static_cast<uint64_t>(block.frameCount) / 8);
+		if (block.frameCount == 0 || block.frameCount > SB_SESSION_MAX_FRAMES || leastBytes > block.size)
+		{
+			succeeded = false;
+			break;
+		}
+		const long frameCount = static_cast<long>(block.frameCount);
+		const long numInputs = static_cast<long>(block.numInputs);
+		const size_t typeBytes = numInputs * sizeof(SBSessionSampleType);
+		if (setup.parameters && frameCount > setup.parameters->maxFrames())
+		{
+			succeeded = false;
+			break;
+		}
+		types.resize(numInputs);
+		memcpy(types.data(), body, typeBytes);
+		body += typeBytes;
+
+		const long numChannels = numInputs + setup.numOutputs;
+		const size_t samples = static_cast<size_t>(numChannels) * frameCount;
+		if (scratch.size() < samples)
+			scratch.resize(samples);
+		if (raw.size() < static_cast<size_t>(numInputs) * frameCount)
+			raw.resize(static_cast<size_t>(numInputs) * frameCount);
+		channels.resize(numChannels);
+		for (long channel = 0; channel < numChannels; ++channel)
+			channels[channel] = scratch.data() + static_cast<size_t>(channel) * frameCount;
+		if (!std::is_same<SBAudioSample, float>::value)
+			writerScratch.resize(static_cast<size_t>(setup.numOutputs) * frameCount);	// also the dynamics' float copies
+
+		for (long channel = 0; channel < numInputs && succeeded; ++channel)
+		{
+			uint32_t channelSize;
+			if (static_cast<size_t>(end - body) < sizeof(channelSize))
+			{
+				succeeded = false;
+				break;
+			}
+			memcpy(&channelSize, body, sizeof(channelSize));
+			body += sizeof(channelSize);
+			succeeded = static_cast<size_t>(end - body) >= channelSize &&
+				SB_DecodeSamples(types[channel], reinterpret_cast<const unsigned char*>(body), channelSize, frameCount, reinterpret_cast<unsigned char*>(raw.data() + static_cast<size_t>(channel) * frameCount));
+			body += channelSize;
+		}
+		if (!succeeded || static_cast<size_t>(end - body) != block.eventCount * sizeof(SBSessionEvent) + block.changeCount * sizeof(SBParameterChange))
+		{
+			succeeded = false;
+			break;
+		}
+
+		SBAudioTimeline timeline;
+		timeline.samplePosition = block.samplePosition;
+		timeline.systemTime = block.systemTime;
+		timeline.sampleRate = block.sampleRate;
+		timeline.speed = block.speed;
+		timeline.tempo = block.tempo;
+		timeline.tempoOriginSample = block.tempoOriginSample;
+		timeline.tempoOriginTicks = block.tempoOriginTicks;
+		if (result.blocks == 0)
+		{
+			result.sampleRate = block.sampleRate;
+			scheduler.setTempo(timeline);
+			if (!setup.outputPath.empty() && !writer.open(setup.outputPath, static_cast<uint16_t>(setup.numOutputs), static_cast<uint32_t>(std::llround(block.sampleRate)), setup.sampleFormat))
+			{
+				succeeded = false;
+				break;
+			}
+		}
+
+		// events come back on the frame they took effect, in the order they were sliced
+		for (uint32_t index = 0; index < block.eventCount; ++index)
+		{
+			SBSessionEvent record;
+			memcpy(&record, body, sizeof(record));
+			body += sizeof(record);
+			SBAudioEvent event;
+			event.time = block.samplePosition + record.offset;
+			event.timebase = SBAudioTimebase::Samples;
+			event.type = static_cast<SBAudioEventType>(record.type);
+			event.target = record.target;
+			event.value = record.value;
+			event.payload = record.payload;
+			succeeded = scheduler.schedule(event) && succeeded;	// fails when eventCapacity is too small
+		}
+		for (uint32_t index = 0; index < block.changeCount; ++index)
+		{
+			SBParameterChange change;
+			memcpy(&change, body, sizeof(change));
+			body += sizeof(change);
+			if (setup.parameters && change.id < setup.parameters->size())
+				setup.parameters->set(change.id, change.value);
+		}
+
+		const auto processStart = SBClock::now();
+		for (long channel = 0; channel < numInputs; ++channel)
+			SB_SamplesFromDriver(static_cast<long>(types[channel]), raw.data() + static_cast<size_t>(channel) * frameCount, channels[channel], frameCount);
+		SB_ProcessAudioBlock(scheduler, setup.parameters, timeline, frameCount, numInputs, setup.numOutputs, channels.data(), setup.process, setup.userData);
+		if (setup.dynamics)
+			SB_ApplyDynamics(*setup.dynamics, channels.data() + numInputs, dynamicsCount, frameCount, writerScratch.data(), dynamicsChannels.data());
+		const double elapsed = std::chrono::duration<double>(SBClock::now() - processStart).count();
+
+		const double live = static_cast<double>(block.liveNanoseconds) * 1e-9;
+		const double period = block.sampleRate > 0.0 ? frameCount / block.sampleRate : 0.0;
+		result.processSeconds += elapsed;
+		result.liveSeconds += live;
+		if (period > 0.0)
+		{
+			result.peakLoad = std::max(result.peakLoad, static_cast<float>(elapsed / period));
+			result.livePeakLoad = std::max(result.livePeakLoad, static_cast<float>(live / period));
+		}
+		if (writer)
+		{
+			const float* const* outputs = SB_FloatChannels(channels.data() + numInputs, setup.numOutputs, frameCount, writerScratch.data(), writerChannels.data());
+			succeeded = writer.write(outputs, static_cast<size_t>(frameCount));
+		}
+		++result.blocks;
+		result.frames += frameCount;
+	}
+	if (writer)
+		succeeded = writer.close() && succeeded;
+	result.seconds = std::chrono::duration<double>(SBClock::now() - start).count();
+	SB_FlushDenormals(flushedDenormals);
+	result.succeeded = succeeded;
+	return result;
+}
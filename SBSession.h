@@ -0,0 +1,204 @@
+#pragma once
+
+#include "SBAudioBlock.h"
+#include "SBLockFreeQueue.h"
+#include "SBThread.h"
+#include "src/SBWav.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+class SBDynamics;
+
+static constexpr uint32_t SB_SESSION_FORMAT_VERSION = 2;
+static constexpr long SB_SESSION_MAX_FRAMES = 65536;	// per block, above any ASIO buffer size: bigger blocks are not recorded
+
+// Driver sample formats a session records, with their ASIOSampleType values; the others are recorded as silence.
+enum class SBSessionSampleType : uint32_t
+{
+	Int16 = 16,
+	Int24 = 17,
+	Int32 = 18,
+	Float32 = 19,
+	Float64 = 20,
+	Int32LSB16 = 24,
+	Int32LSB18 = 25,
+	Int32LSB20 = 26,
+	Int32LSB24 = 27,
+};
+
+// AsioTimeInfo as the driver delivered it to bufferSwitchTimeInfo.
+struct SBSessionStamp
+{
+	int64_t 	samplePosition = 0;
+	int64_t 	systemTime = 0;
+	double  	sampleRate = 0.0;
+	double  	speed = 0.0;
+	uint32_t	flags = 0;	// ASIOTimeInfoFlags
+};
+
+// Session file layout: header, parameterCount floats (targets when recording started), then blocks.
+// A block is SBSessionBlockHeader, numInputs sample types (uint32), every input channel as an encoded size (uint32)
+// and its bytes, eventCount SBSessionEvent and changeCount SBParameterChange. A channel is a coding byte, then
+// either its driver bytes or, as in FLAC, the residuals of a fixed predictor (order 0 to 2; floats as ordered
+// integers) zigzagged and Rice coded with a parameter per partition of 32 frames, whichever is smaller.
+struct SBSessionFileHeader
+{
+	uint32_t	magic;         	// 'SBSN'
+	uint32_t	version;       	// SB_SESSION_FORMAT_VERSION
+	uint32_t	parameterCount;
+	uint32_t	reserved;
+};
+static_assert(sizeof(SBSessionFileHeader) == 16, "SBSessionFileHeader must stay packed for the binary format");
+
+struct SBSessionBlockHeader
+{
+	uint32_t	size;           	// bytes of the block after this header
+	uint32_t	frameCount;
+	uint32_t	numInputs;
+	uint32_t	eventCount;
+	uint32_t	changeCount;
+	uint32_t	stampFlags;
+	int64_t 	stampPosition;  	// SBSessionStamp
+	int64_t 	stampSystemTime;
+	double  	stampSampleRate;
+	double  	stampSpeed;
+	int64_t 	samplePosition; 	// timeline handed to SB_ProcessAudioBlock, with the tempo in effect before the block's events
+	int64_t 	systemTime;
+	double  	sampleRate;
+	double  	speed;
+	double  	tempo;
+	int64_t 	tempoOriginSample;
+	int64_t 	tempoOriginTicks;
+	uint64_t	liveNanoseconds;	// between beginBlock and endBlock on the audio thread
+};
+static_assert(sizeof(SBSessionBlockHeader) == 120, "SBSessionBlockHeader must stay packed for the binary format");
+
+struct SBSessionEvent
+{
+	int64_t 	time;     	// SBAudioEvent as scheduled
+	uint64_t	payload;
+	uint32_t	offset;   	// where it took effect in the block
+	uint32_t	timebase;
+	uint32_t	type;
+	uint32_t	target;
+	float   	value;
+	uint32_t	reserved;
+};
+static_assert(sizeof(SBSessionEvent) == 40, "SBSessionEvent must stay packed for the binary format");
+
+struct SBSessionSetup
+{
+	std::wstring           	path;
+	const SBParameterStore*	parameters = nullptr;	// targets saved when recording starts
+	size_t                 	bufferBytes = 32 << 20;	// ring of raw blocks: 32 float inputs at 48 kHz take 6 MB a second
+	double                 	writeSeconds = 0.25;   	// writer thread period
+};
+
+// Records what the audio thread received, block by block, for deterministic replays (SB_ReplaySession).
+//
+// beginBlock() copies the raw driver inputs and the timing into a single-producer/single-consumer byte ring;
+// endBlock() appends the events the scheduler sliced and the parameter targets the store took, then publishes
+// the block. A writer thread compresses the inputs and writes them out. When the ring is full whole blocks are
+// dropped and counted rather than blocking the audio thread. Automation curves are not recorded: they depend
+// on the sample position only, so a replay with the same curves reproduces them.
+class SBSessionRecorder
+{
+public:
+	SBSessionRecorder() = default;
+	SBSessionRecorder(const SBSessionRecorder&) = delete;
+	SBSessionRecorder& operator=(const SBSessionRecorder&) = delete;
+	~SBSessionRecorder() { stop(); }
+
+	// control thread
+	bool start(const SBSessionSetup& setup);	// creates the file and starts the writer
+	bool stop();                            	// writes what is left and closes; false if anything failed
+	bool recording() const { return accepting.load(std::memory_order_relaxed); }
+
+	// audio thread, around the processing of every block. beginBlock runs before SB_ProcessAudioBlock, while the
+	// scheduler still holds the tempo of the previous block; inputs are the driver buffers, in the formats of types.
+	void beginBlock(const SBAudioScheduler& scheduler, const SBAudioTimeline& timeline, const SBSessionStamp& stamp,
+		const SBSessionSampleType* types, const void* const* inputs, long numInputs, long frameCount);
+	void endBlock(const SBAudioScheduler& scheduler, const SBParameterStore* parameters);
+
+	uint64_t recordedBlocks() const { return published.load(std::memory_order_relaxed); }
+	uint64_t droppedBlocks() const { return dropped.load(std::memory_order_relaxed); }
+	uint64_t rawBytes() const { return writeIndex.load(std::memory_order_relaxed); }	// ring traffic
+	uint64_t writtenBytes() const { return written.load(std::memory_order_relaxed); }	// file size so far
+
+private:
+	void run();
+	bool drain();
+	void put(uint64_t position, const void* data, size_t size);
+	void get(uint64_t position, void* data, size_t size) const;
+
+	SBSessionSetup       	setup;
+	std::FILE*           	file = nullptr;
+	std::vector<char>    	ring;       	// power of two bytes
+	size_t               	ringMask = 0;
+	std::vector<char>    	record;     	// writer thread scratch: one raw block
+	std::vector<char>    	encoded;    	// writer thread scratch: the same block as written
+	std::vector<uint64_t>	residuals;  	// writer thread scratch: one channel
+	SBThread             	writer;
+	bool                 	failed = false;	// writer thread, read after join
+
+	// audio thread
+	SBSessionBlockHeader 	block = {};
+	uint64_t             	blockEnd = 0;	// ring position past what the open block wrote so far
+	bool                 	blockOpen = false;
+	std::chrono::steady_clock::time_point	blockStart;
+
+	std::atomic<bool>    	accepting = { false };
+	std::atomic<bool>    	pushing = { false };
+	std::atomic<bool>    	stopping = { false };
+	char                 	padding0[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t>	writeIndex = { 0 };	// bytes, audio thread
+	std::atomic<uint64_t>	published = { 0 };
+	std::atomic<uint64_t>	dropped = { 0 };
+	char                 	padding1[SB_CACHE_LINE_SIZE];
+	std::atomic<uint64_t>	readIndex = { 0 };	// bytes, writer thread
+	std::atomic<uint64_t>	written = { 0 };
+};
+
+// Feeds a recorded session to the processing callback, as fast as the CPU allows.
+// Every block goes through SB_ProcessAudioBlock with its recorded size and timeline, after its inputs were
+// converted from the driver format like the engine does, then through the dynamics; events are rescheduled on
+// the frames they took effect, parameter targets are set before the block that took them. With the store, the
+// callback and the dynamics in the state they had when recording started (parameter targets are restored from the
+// file, ramps then running land at once), the outputs are those of the session (FTZ/DAZ included), so workloads captured on a device can be profiled and
+// optimizations compared on any machine. Event payloads are replayed as they were, pointers in them are meaningless.
+struct SBSessionReplaySetup
+{
+	std::wstring          	path;
+	long                  	numOutputs = 2;
+	size_t                	eventCapacity = 4096;  	// at least the most events in a recorded block
+	SBAudioProcessCallback	process = nullptr;
+	void*                 	userData = nullptr;
+	SBParameterStore*     	parameters = nullptr;  	// same size as when recording, or targets are not restored; maxFrames() must cover the blocks
+	SBDynamics*           	dynamics = nullptr;    	// the engine's bank settings, for its outputs and its cost
+
+	std::wstring          	outputPath;            	// empty: rendered but not written
+	SBWavSampleFormat     	sampleFormat = SBWavSampleFormat::Float32;
+	SBDitherSetup         	dither;
+};
+
+struct SBSessionReplayResult
+{
+	bool    	succeeded = false;
+	uint64_t	blocks = 0;
+	int64_t 	frames = 0;
+	double  	sampleRate = 0.0;    	// of the first block
+	double  	seconds = 0.0;       	// wall clock, decoding and writing included
+	double  	processSeconds = 0.0;	// input conversion, SB_ProcessAudioBlock and the dynamics, what liveSeconds measured
+	double  	liveSeconds = 0.0;   	// the same work during the session
+	float   	peakLoad = 0.0f;     	// worst block: processing time / block period
+	float   	livePeakLoad = 0.0f;
+
+	double realtimeFactor() const { return processSeconds > 0.0 ? frames / sampleRate / processSeconds : 0.0; }
+};
+
+SBSessionReplayResult SB_ReplaySession(const SBSessionReplaySetup& setup);
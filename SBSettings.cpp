@@ -0,0 +1,308 @@
+#include "SBSettings.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+static constexpr uint32_t SB_SETTINGS_MAGIC = 0x54534253u;	// "SBST"
+
+SBSettingKey SB_SettingKey(const std::string& name)
+{
+	return SB_SettingKey(name.c_str());
+}
+
+static uint64_t SB_HashBytes(const char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t index = 0; index < size; ++index)
+		hash = (hash ^ static_cast<unsigned char>(data[index])) * 1099511628211ull;
+	return hash;
+}
+
+//
+// Compilation
+//
+static SBSettingType SB_ParseSettingValue(const std::string& text, SBSettingsEntry& entry)
+{
+	if (text == "true" || text == "false")
+	{
+		entry.value.integer = text == "true" ? 1 : 0;
+		return SBSettingType::Bool;
+	}
+	if (!text.empty() && text.find_first_of("xX") == std::string::npos)	// decimal only: strtod would take hex floats
+	{
+		char* end = nullptr;
+		const long long integer = std::strtoll(text.c_str(), &end, 10);
+		if (end == text.c_str() + text.size())
+		{
+			entry.value.integer = integer;
+			return SBSettingType::Int;
+		}
+		const double number = std::strtod(text.c_str(), &end);
+		if (end == text.c_str() + text.size())
+		{
+			entry.value.number = number;
+			return SBSettingType::Float;
+		}
+	}
+	return SBSettingType::String;
+}
+
+bool SB_CompileSettings(const char* text, size_t size, const SBFileInfo& source, uint32_t generation, std::vector<char>& binary)
+{
+	std::vector<SBSettingsEntry> entries;
+	std::string strings(1, '\0');	// offset 0 is the empty string
+	std::unordered_map<std::string, uint32_t> interned;
+	const auto intern = [&](const std::string& value) -> uint32_t
+	{
+		auto it = interned.find(value);
+		if (it != interned.end())
+			return it->second;
+		const uint32_t offset = static_cast<uint32_t>(strings.size());
+		strings.append(value);
+		strings.push_back('\0');
+		interned.insert({ value, offset });
+		return offset;
+	};
+	const auto readLine = [&](size_t& position, std::string& line) -> bool
+	{
+		if (position >= size)
+			return false;
+		const char* begin = text + position;
+		const char* end = static_cast<const char*>(memchr(begin, '\n', size - position));
+		const size_t length = end ? static_cast<size_t>(end - begin) : size - position;
+		line.assign(begin, length);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		position += length + 1;
+		return true;
+	};
+
+	std::unordered_map<SBSettingKey, size_t> indices;
+	std::string key, value;
+	size_t position = 0;
+	while (readLine(position, key))
+	{
+		value.clear();
+		readLine(position, value);
+		if (key.empty())
+			continue;	// invalid key, skipped like the text parser used to
+
+		SBSettingsEntry entry = {};
+		entry.key = SB_SettingKey(key);
+		entry.name = intern(key);
+		entry.type = SB_ParseSettingValue(value, entry);
+		if (entry.type == SBSettingType::String)
+		{
+			entry.value.string.offset = intern(value);
+			entry.value.string.length = static_cast<uint32_t>(value.size());
+		}
+
+		auto it = indices.find(entry.key);
+		if (it == indices.end())
+		{
+			indices.insert({ entry.key, entries.size() });
+			entries.push_back(entry);
+		}
+		else if (strcmp(strings.c_str() + entries[it->second].name, key.c_str()) == 0)
+		{
+			entries[it->second] = entry;	// last definition wins
+		}
+		else
+		{
+			return false;	// two different names hashing to the same key
+		}
+	}
+
+	uint32_t slotCount = 16;
+	while (slotCount < 2 * entries.size())
+		slotCount <<= 1;
+
+	SBSettingsHeader header = {};
+	header.magic = SB_SETTINGS_MAGIC;
+	header.version = SB_SETTINGS_FORMAT_VERSION;
+	header.sourceHash = SB_HashBytes(text, size);
+	header.sourceSize = source.size;
+	header.sourceTime = source.modifiedTime;
+	header.generation = generation;
+	header.count = static_cast<uint32_t>(entries.size());
+	header.slotCount = slotCount;
+	header.stringsSize = static_cast<uint32_t>(strings.size());
+
+	binary.assign(sizeof(header) + slotCount * sizeof(SBSettingsEntry) + strings.size(), 0);
+	memcpy(binary.data(), &header, sizeof(header));
+	SBSettingsEntry* slots = reinterpret_cast<SBSettingsEntry*>(binary.data() + sizeof(header));
+	for (const SBSettingsEntry& entry : entries)
+	{
+		uint32_t slot = static_cast<uint32_t>(entry.key) & (slotCount - 1);
+		while (slots[slot].key != 0)
+			slot = (slot + 1) & (slotCount - 1);
+		slots[slot] = entry;
+	}
+	memcpy(binary.data() + sizeof(header) + slotCount * sizeof(SBSettingsEntry), strings.data(), strings.size());
+	return true;
+}
+
+//
+// SBSettingsSnapshot
+//
+std::shared_ptr<const SBSettingsSnapshot> SBSettingsSnapshot::Map(const std::wstring& binaryPath)
+{
+	std::shared_ptr<SBSettingsSnapshot> snapshot(new SBSettingsSnapshot());
+	if (!snapshot->mapping.open(binaryPath) || !snapshot->bind(snapshot->mapping.data(), snapshot->mapping.size()))
+		return nullptr;
+	return snapshot;
+}
+
+std::shared_ptr<const SBSettingsSnapshot> SBSettingsSnapshot::Adopt(std::vector<char>&& binary)
+{
+	std::shared_ptr<SBSettingsSnapshot> snapshot(new SBSettingsSnapshot());
+	snapshot->storage = std::move(binary);
+	if (!snapshot->bind(snapshot->storage.data(), snapshot->storage.size()))
+		return nullptr;
+	return snapshot;
+}
+
+bool SBSettingsSnapshot::bind(const char* binary, size_t size)
+{
+	if (size < sizeof(SBSettingsHeader))
+		return false;
+	const SBSettingsHeader* fileHeader = reinterpret_cast<const SBSettingsHeader*>(binary);
+	if (fileHeader->magic != SB_SETTINGS_MAGIC || fileHeader->version != SB_SETTINGS_FORMAT_VERSION ||
+		fileHeader->slotCount == 0 || (fileHeader->slotCount & (fileHeader->slotCount - 1)) != 0 ||
+		size != sizeof(SBSettingsHeader) + static_cast<size_t>(fileHeader->slotCount) * sizeof(SBSettingsEntry) + fileHeader->stringsSize)
+	{
+		return false;
+	}
+	// the cache is a file that may be stale or damaged: every name and string must lie, terminated, in the pool,
+	// and an empty slot must end every probe of find()
+	const SBSettingsEntry* table = reinterpret_cast<const SBSettingsEntry*>(binary + sizeof(SBSettingsHeader));
+	const char* pool = binary + sizeof(SBSettingsHeader) + fileHeader->slotCount * sizeof(SBSettingsEntry);
+	const uint32_t poolSize = fileHeader->stringsSize;
+	auto terminated = [pool, poolSize](uint32_t offset) { return offset < poolSize && memchr(pool + offset, 0, poolSize - offset) != nullptr; };
+	uint32_t used = 0;
+	for (uint32_t slot = 0; slot < fileHeader->slotCount; ++slot)
+	{
+		const SBSettingsEntry& entry = table[slot];
+		if (entry.key == 0)
+			continue;
+		++used;
+		if (!terminated(entry.name) || entry.type < SBSettingType::Bool || entry.type > SBSettingType::String)
+			return false;
+		if (entry.type == SBSettingType::String &&
+			(entry.value.string.length >= poolSize - std::min(entry.value.string.offset, poolSize) || pool[entry.value.string.offset + entry.value.string.length] != '\0'))
+		{
+			return false;
+		}
+	}
+	if (used != fileHeader->count || used >= fileHeader->slotCount)
+		return false;
+
+	data = binary;
+	slots = table;
+	strings = pool;
+	mask = fileHeader->slotCount - 1;
+	return true;
+}
+
+const SBSettingsEntry* SBSettingsSnapshot::find(SBSettingKey key) const
+{
+	for (uint32_t slot = static_cast<uint32_t>(key) & mask;; slot = (slot + 1) & mask)
+	{
+		if (slots[slot].key == key)
+			return &slots[slot];
+		if (slots[slot].key == 0)
+			return nullptr;
+	}
+}
+
+bool SBSettingsSnapshot::getBool(SBSettingKey key, bool fallback) const
+{
+	const SBSettingsEntry* entry = find(key);
+	return entry && (entry->type == SBSettingType::Bool || entry->type == SBSettingType::Int) ? entry->value.integer != 0 : fallback;
+}
+
+int64_t SBSettingsSnapshot::getInt(SBSettingKey key, int64_t fallback) const
+{
+	const SBSettingsEntry* entry = find(key);
+	if (!entry)
+		return fallback;
+	switch (entry->type)
+	{
+	case SBSettingType::Bool:
+	case SBSettingType::Int:   return entry->value.integer;
+	case SBSettingType::Float: return static_cast<int64_t>(entry->value.number);
+	default:                   return fallback;
+	}
+}
+
+double SBSettingsSnapshot::getFloat(SBSettingKey key, double fallback) const
+{
+	const SBSettingsEntry* entry = find(key);
+	if (!entry)
+		return fallback;
+	switch (entry->type)
+	{
+	case SBSettingType::Int:   return static_cast<double>(entry->value.integer);
+	case SBSettingType::Float: return entry->value.number;
+	default:                   return fallback;
+	}
+}
+
+const char* SBSettingsSnapshot::getString(SBSettingKey key, const char* fallback) const
+{
+	const SBSettingsEntry* entry = find(key);
+	return entry && entry->type == SBSettingType::String ? strings + entry->value.string.offset : fallback;
+}
+
+//
+// SBSettings
+//
+bool SBSettings::load(const std::wstring& text, const std::wstring& binary)
+{
+	textPath = text;
+	binaryPath = binary;
+	std::atomic_store(&current, std::shared_ptr<const SBSettingsSnapshot>());
+	return reload() || snapshot() != nullptr;
+}
+
+bool SBSettings::reload()
+{
+	const SBFileInfo source = SB_GetFileInfo(textPath);
+	std::shared_ptr<const SBSettingsSnapshot> previous = snapshot();
+	const uint32_t generation = previous ? previous->generation() : 0;
+	if (previous && source == checkedSource)
+		return false;
+	checkedSource = source;
+
+	// Startup path: the cached binary still matches the text, map it as is.
+	if (!previous)
+	{
+		std::shared_ptr<const SBSettingsSnapshot> cached = SBSettingsSnapshot::Map(binaryPath);
+		if (cached && (!source.exists || (cached->header().sourceSize == source.size && cached->header().sourceTime == source.modifiedTime)))
+		{
+			std::atomic_store(&current, cached);
+			return true;
+		}
+	}
+
+	std::vector<char> text;
+	if (!source.exists || !SB_ReadFile(textPath, text))
+		return false;
+	if (previous && previous->header().sourceHash == SB_HashBytes(text.data(), text.size()))
+		return false;	// touched but unchanged
+
+	std::vector<char> binary;
+	if (!SB_CompileSettings(text.data(), text.size(), source, generation + 1, binary))
+		return false;
+
+	// The cache may be mapped by live snapshots (and locked on Windows); failing to refresh it only costs
+	// a recompilation on next startup, so publish the in-memory snapshot regardless.
+	SB_WriteFileAtomically(binaryPath, binary.data(), binary.size());
+	std::shared_ptr<const SBSettingsSnapshot> compiled = SBSettingsSnapshot::Adopt(std::move(binary));
+	if (!compiled)
+		return false;
+	std::atomic_store(&current, compiled);
+	return true;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "SBFile.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Setting keys are FNV-1a hashes of their name, computed at compile time for known keys:
+//	static constexpr SBSettingKey SB_SETTING_BUFFER_SIZE = SB_SettingKey("audio.bufferSize");
+using SBSettingKey = uint64_t;
+
+constexpr SBSettingKey SB_SettingKey(const char* name)
+{
+	uint64_t hash = 14695981039346656037ull;
+	while (*name)
+	{
+		hash = (hash ^ static_cast<unsigned char>(*name++)) * 1099511628211ull;
+	}
+	return hash != 0 ? hash : 1;	// 0 marks empty slots
+}
+SBSettingKey SB_SettingKey(const std::string& name);
+
+static constexpr uint32_t SB_SETTINGS_FORMAT_VERSION = 1;
+
+enum class SBSettingType : uint32_t
+{
+	None = 0,
+	Bool,
+	Int,
+	Float,
+	String,
+};
+
+// Binary snapshot layout: header, open addressing table of entries, interned string pool.
+struct SBSettingsHeader
+{
+	uint32_t	magic;         	// 'SBST'
+	uint32_t	version;       	// SB_SETTINGS_FORMAT_VERSION
+	uint64_t	sourceHash;    	// FNV-1a of the text it was compiled from
+	uint64_t	sourceSize;
+	int64_t 	sourceTime;
+	uint32_t	generation;    	// incremented on every compilation
+	uint32_t	count;
+	uint32_t	slotCount;     	// power of two, at least twice count
+	uint32_t	stringsSize;
+};
+
+struct SBSettingsEntry
+{
+	SBSettingKey	key;   	// 0: empty slot
+	SBSettingType	type;
+	uint32_t     	name;  	// interned key name, offset in the string pool
+	union
+	{
+		int64_t 	integer;
+		double  	number;
+		struct
+		{
+			uint32_t	offset;
+			uint32_t	length;
+		}       	string;
+	}            	value;
+};
+static_assert(sizeof(SBSettingsEntry) == 24, "SBSettingsEntry must stay packed for the binary format");
+
+// Immutable view over a compiled snapshot, either memory mapped or freshly compiled in memory.
+class SBSettingsSnapshot
+{
+public:
+	static std::shared_ptr<const SBSettingsSnapshot> Map(const std::wstring& binaryPath);
+	static std::shared_ptr<const SBSettingsSnapshot> Adopt(std::vector<char>&& binary);
+
+	const SBSettingsHeader& header() const { return *reinterpret_cast<const SBSettingsHeader*>(data); }
+	uint32_t generation() const { return header().generation; }
+	size_t size() const { return header().count; }
+
+	const SBSettingsEntry* find(SBSettingKey key) const;
+	const char* name(const SBSettingsEntry& entry) const { return strings + entry.name; }
+
+	bool getBool(SBSettingKey key, bool fallback = false) const;
+	int64_t getInt(SBSettingKey key, int64_t fallback = 0) const;
+	double getFloat(SBSettingKey key, double fallback = 0.0) const;
+	const char* getString(SBSettingKey key, const char* fallback = "") const;
+
+private:
+	SBSettingsSnapshot() = default;
+	bool bind(const char* binary, size_t size);
+
+	SBMappedFile          	mapping;
+	std::vector<char>     	storage;
+	const char*           	data = nullptr;
+	const SBSettingsEntry*	slots = nullptr;
+	const char*           	strings = nullptr;
+	uint32_t              	mask = 0;
+};
+
+// Line pairs (key line, value line) into a binary snapshot. Values are typed on the way:
+// true/false, decimal integers ("010" is 10), floating point, anything else (hex included) is kept as a string.
+bool SB_CompileSettings(const char* text, size_t size, const SBFileInfo& source, uint32_t generation, std::vector<char>& binary);
+
+// Owns the current snapshot. Readers take a reference with snapshot() and keep a consistent view
+// for as long as they hold it; reload() recompiles when the text changed and swaps atomically.
+class SBSettings
+{
+public:
+	bool load(const std::wstring& textPath, const std::wstring& binaryPath);
+	bool reload();	// returns true when a new snapshot was published
+
+	std::shared_ptr<const SBSettingsSnapshot> snapshot() const { return std::atomic_load(&current); }
+	operator bool() const { return snapshot() != nullptr; }
+
+	bool getBool(SBSettingKey key, bool fallback = false) const { auto s = snapshot(); return s ? s->getBool(key, fallback) : fallback; }
+	int64_t getInt(SBSettingKey key, int64_t fallback = 0) const { auto s = snapshot(); return s ? s->getInt(key, fallback) : fallback; }
+	double getFloat(SBSettingKey key, double fallback = 0.0) const { auto s = snapshot(); return s ? s->getFloat(key, fallback) : fallback; }
+	std::string getString(SBSettingKey key, const char* fallback = "") const { auto s = snapshot(); return s ? s->getString(key, fallback) : fallback; }
+
+private:
+	std::wstring                             	textPath;
+	std::wstring                             	binaryPath;
+	SBFileInfo                               	checkedSource;
+	std::shared_ptr<const SBSettingsSnapshot>	current;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+
+// SSE2 is the x86/x64 baseline (and the MSVC default), every kernel keeps a scalar path for other targets.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SB_SIMD_SSE2 1
+#endif
+
+// out[i] = start + step * (i + 1): the first sample already moved one step away from start.
+// Multiplied rather than accumulated so long ramps land exactly where a scalar evaluation would.
+inline void SB_FillRamp(float* out, long count, float start, float step)
+{
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	const __m128 base = _mm_set1_ps(start);
+	const __m128 steps = _mm_set1_ps(step);
+	const __m128 four = _mm_set1_ps(4.0f);
+	__m128 position = _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f);
+	for (; index + 4 <= count; index += 4)
+	{
+		_mm_storeu_ps(out + index, _mm_add_ps(base, _mm_mul_ps(steps, position)));
+		position = _mm_add_ps(position, four);
+	}
+#endif
+	for (; index < count; ++index)
+		out[index] = start + step * static_cast<float>(index + 1);
+}
+
+inline void SB_FillValue(float* out, long count, float value)
+{
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	const __m128 values = _mm_set1_ps(value);
+	for (; index + 4 <= count; index += 4)
+		_mm_storeu_ps(out + index, values);
+#endif
+	for (; index < count; ++index)
+		out[index] = value;
+}
+
+// Running minimum, maximum and sum of squares of count samples (waveform overviews).
+inline void SB_AccumulatePeaks(const float* in, long count, float& minimum, float& maximum, double& sumSquares)
+{
+	long index = 0;
+	float low = minimum, high = maximum, squares = 0.0f;
+#if defined(SB_SIMD_SSE2)
+	if (count >= 4)
+	{
+		__m128 lows = _mm_set1_ps(low), highs = _mm_set1_ps(high), sums = _mm_setzero_ps();
+		for (; index + 4 <= count; index += 4)
+		{
+			const __m128 samples = _mm_loadu_ps(in + index);
+			lows = _mm_min_ps(lows, samples);
+			highs = _mm_max_ps(highs, samples);
+			sums = _mm_add_ps(sums, _mm_mul_ps(samples, samples));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, lows);
+		low = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, highs);
+		high = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, sums);
+		squares = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+#endif
+	for (; index < count; ++index)
+	{
+		low = std::min(low, in[index]);
+		high = std::max(high, in[index]);
+		squares += in[index] * in[index];
+	}
+	minimum = low;
+	maximum = high;
+	sumSquares += squares;
+}
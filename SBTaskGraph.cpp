@@ -0,0 +1,110 @@
+#include "SBTaskGraph.h"
+#include "SBTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using SBClock = std::chrono::steady_clock;
+
+SBTaskGraph::TaskId SBTaskGraph::add(const char* name, Task task, std::initializer_list<TaskId> dependencies)
+{
+	// dependencies can only name tasks added before, so the graph can't have cycles
+	const TaskId id = nodes.size();
+	Node node;
+	node.name = name;
+	node.traceName = SB_InternTraceName(name);
+	node.task = std::move(task);
+	for (TaskId dependency : dependencies)
+	{
+		if (dependency < id)
+		{
+			nodes[dependency].dependents.push_back(id);
+			++node.dependencyCount;
+		}
+	}
+	nodes.push_back(std::move(node));
+	return id;
+}
+
+bool SBTaskGraph::run(size_t threadCount)
+{
+	results.assign(nodes.size(), SBTaskTiming());
+	if (nodes.empty())
+		return true;
+
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::deque<TaskId> ready;
+	std::vector<size_t> pending(nodes.size());
+	std::vector<bool> cancelled(nodes.size(), false);
+	size_t remaining = nodes.size();
+	for (TaskId id = 0; id < nodes.size(); ++id)
+	{
+		results[id].name = nodes[id].name;
+		pending[id] = nodes[id].dependencyCount;
+		if (pending[id] == 0)
+			ready.push_back(id);
+	}
+
+	const SBClock::time_point origin = SBClock::now();
+	const auto seconds = [origin](SBClock::time_point time) { return std::chrono::duration<double>(time - origin).count(); };
+	const auto worker = [&](size_t thread)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			wakeUp.wait(lock, [&] { return !ready.empty() || remaining == 0; });
+			if (ready.empty())
+				return;
+			const TaskId id = ready.front();
+			ready.pop_front();
+
+			SBTaskTiming& timing = results[id];
+			timing.thread = thread;
+			timing.skipped = cancelled[id];
+			if (!timing.skipped)
+			{
+				lock.unlock();
+				const SBClock::time_point start = SBClock::now();
+				bool succeeded;
+				{
+					SBTraceScope trace(nodes[id].traceName);
+					succeeded = nodes[id].task ? nodes[id].task() : true;
+				}
+				const SBClock::time_point end = SBClock::now();
+				lock.lock();
+				timing.start = seconds(start);
+				timing.duration = seconds(end) - timing.start;
+				timing.succeeded = succeeded;
+			}
+
+			for (TaskId dependent : nodes[id].dependents)
+			{
+				if (!timing.succeeded)
+					cancelled[dependent] = true;
+				if (--pending[dependent] == 0)
+					ready.push_back(dependent);
+			}
+			--remaining;
+			wakeUp.notify_all();
+		}
+	};
+
+	if (threadCount == 0)
+		threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 4);
+	threadCount = std::min(threadCount, nodes.size());
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (size_t thread = 1; thread < threadCount; ++thread)
+		threads.emplace_back(worker, thread);
+	worker(0);
+	for (std::thread& thread : threads)
+		thread.join();
+	totalDuration = seconds(SBClock::now());
+
+	return std::all_of(results.begin(), results.end(), [](const SBTaskTiming& timing) { return timing.succeeded; });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Per step timings, in seconds from the start of SBTaskGraph::run().
+struct SBTaskTiming
+{
+	std::string	name;
+	double     	start = 0.0;
+	double     	duration = 0.0;
+	size_t     	thread = 0;        	// 0 is the thread that called run()
+	bool       	succeeded = false;
+	bool       	skipped = false;   	// a dependency failed, the task never ran
+};
+
+// Dependency ordered set of one-shot tasks, run in parallel on a transient pool.
+// Meant for startup/shutdown sequences, not for the audio thread: scheduling takes a lock.
+class SBTaskGraph
+{
+public:
+	using TaskId = size_t;
+	using Task = std::function<bool()>;	// returns false to cancel the tasks depending on it
+
+	TaskId add(const char* name, Task task, std::initializer_list<TaskId> dependencies = {});
+
+	// Runs every task once; threadCount 0 uses the hardware concurrency, but at least 4 threads since startup
+	// tasks mostly block on the system (never more threads than tasks).
+	// Returns true when every task succeeded.
+	bool run(size_t threadCount = 0);
+
+	const std::vector<SBTaskTiming>& timings() const { return results; }
+	double elapsed() const { return totalDuration; }
+
+private:
+	struct Node
+	{
+		std::string        	name;
+		const char*        	traceName = nullptr;	// interned for SBTrace
+		Task               	task;
+		std::vector<TaskId>	dependents;
+		size_t             	dependencyCount = 0;
+	};
+
+	std::vector<Node>        	nodes;
+	std::vector<SBTaskTiming>	results;
+	double                   	totalDuration = 0.0;
+};
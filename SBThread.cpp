@@ -0,0 +1,382 @@
+#include "SBThread.h"
+#include "SBTrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <mutex>
+#include <system_error>
+
+#ifdef _WIN32
+#include "Windows.h"
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define SB_HAS_MXCSR 1
+#endif
+
+using SBClock = std::chrono::steady_clock;
+
+struct SBThreadRecord
+{
+	std::thread::id    	id;
+	std::string        	name;
+	bool               	realTime = false;
+	int                	core = -1;
+	SBClock::time_point	start;
+	double             	cpuStart = 0.0;
+#ifdef _WIN32
+	HANDLE             	handle = nullptr;	// duplicated, GetCurrentThread() is only a pseudo handle
+	HANDLE             	mmcss = nullptr;
+#else
+	clockid_t          	clock = 0;
+	bool               	hasClock = false;
+#endif
+};
+
+static std::mutex s_threadsMutex;
+static std::vector<SBThreadRecord> s_threads;
+
+static void SB_CloseThreadRecord(SBThreadRecord& record, bool currentThread)
+{
+#ifdef _WIN32
+	if (record.mmcss && currentThread)
+		AvRevertMmThreadCharacteristics(record.mmcss);
+	if (record.handle)
+		CloseHandle(record.handle);
+	record.mmcss = nullptr;
+	record.handle = nullptr;
+#else
+	(void)record;
+	(void)currentThread;
+#endif
+}
+
+static bool SB_ReleaseThreadRecord(std::thread::id thread, bool currentThread)
+{
+	std::lock_guard<std::mutex> lock(s_threadsMutex);
+	auto it = std::find_if(s_threads.begin(), s_threads.end(), [thread](const SBThreadRecord& record) { return record.id == thread; });
+	if (it == s_threads.end())
+		return false;
+	SB_CloseThreadRecord(*it, currentThread);
+	s_threads.erase(it);
+	return true;
+}
+
+//
+// Configuration
+//
+bool SB_ConfigureCurrentThread(const SBThreadSetup& setup)
+{
+	SB_ReleaseThreadRecord(std::this_thread::get_id(), true);
+
+	SBThreadRecord record;
+	record.id = std::this_thread::get_id();
+	record.name = setup.name;
+	SB_SetTraceThreadName(setup.name.c_str());
+	record.start = SBClock::now();
+	bool succeeded = true;
+
+#ifdef _WIN32
+	if (!setup.name.empty())
+	{
+		const std::wstring wideName(setup.name.begin(), setup.name.end());
+		SetThreadDescription(GetCurrentThread(), wideName.c_str());
+	}
+	DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &record.handle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+
+	switch (setup.priority)
+	{
+	case SBThreadPriority::RealTime:
+	{
+		// MMCSS boosts the thread into the real-time class without requiring elevation
+		DWORD taskIndex = 0;
+		record.mmcss = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+		if (record.mmcss)
+			AvSetMmThreadPriority(record.mmcss, AVRT_PRIORITY_CRITICAL);
+		record.realTime = record.mmcss != nullptr;
+		succeeded = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) && record.realTime;
+		break;
+	}
+	case SBThreadPriority::High:
+		succeeded = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST) != FALSE;
+		break;
+	default:
+		break;
+	}
+
+	if (setup.core >= 0)
+	{
+		const bool pinned = setup.core < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << setup.core) != 0;
+		record.core = pinned ? setup.core : -1;
+		succeeded = succeeded && pinned;
+	}
+#else
+	if (!setup.name.empty())
+		pthread_setname_np(pthread_self(), setup.name.substr(0, 15).c_str());	// 16 bytes with the terminator
+	record.hasClock = pthread_getcpuclockid(pthread_self(), &record.clock) == 0;
+
+	switch (setup.priority)
+	{
+	case SBThreadPriority::RealTime:
+	{
+		sched_param parameters = {};
+		parameters.sched_priority = std::min(std::max(setup.realTimePriority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+		record.realTime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;	// EPERM without CAP_SYS_NICE/rtprio limits
+		succeeded = record.realTime;
+		break;
+	}
+	case SBThreadPriority::High:
+	{
+#ifdef __linux__
+		// stays SCHED_OTHER with a lower nice value; nice is per thread on Linux. EACCES without CAP_SYS_NICE/nice
+		// limits leaves the thread at normal priority
+		succeeded = setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), -5) == 0;
+#else
+		succeeded = false;	// nice applies to the whole process elsewhere
+#endif
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (setup.core >= 0)
+	{
+#ifdef __linux__
+		cpu_set_t cores;
+		CPU_ZERO(&cores);
+		bool pinned = setup.core < CPU_SETSIZE;
+		if (pinned)
+		{
+			CPU_SET(setup.core, &cores);
+			pinned = pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) == 0;
+		}
+#else
+		const bool pinned = false;	// affinity is only a hint elsewhere (e.g. macOS affinity tags)
+#endif
+		record.core = pinned ? setup.core : -1;
+		succeeded = succeeded && pinned;
+	}
+#endif
+
+	if (setup.flushDenormals)
+		SB_FlushDenormals(true);
+	record.cpuStart = SB_GetCurrentThreadCpuTime();
+
+	std::lock_guard<std::mutex> lock(s_threadsMutex);
+	s_threads.push_back(record);
+	return succeeded;
+}
+
+void SB_ReleaseCurrentThread()
+{
+	SB_ReleaseThreadRecord(std::this_thread::get_id(), true);
+}
+
+void SB_ReleaseThread(std::thread::id thread)
+{
+	SB_ReleaseThreadRecord(thread, thread == std::this_thread::get_id());
+}
+
+bool SB_FlushDenormals(bool enable)
+{
+#if defined(SB_HAS_MXCSR)
+	static constexpr unsigned int flushToZero = 0x8000u;    	// FTZ: denormal results become 0
+	static constexpr unsigned int denormalsAreZero = 0x0040u;	// DAZ: denormal inputs read as 0
+	const unsigned int state = _mm_getcsr();
+	const bool previous = (state & (flushToZero | denormalsAreZero)) == (flushToZero | denormalsAreZero);
+	_mm_setcsr(enable ? state | flushToZero | denormalsAreZero : state & ~(flushToZero | denormalsAreZero));
+	return previous;
+#elif defined(__aarch64__)
+	static constexpr uint64_t flushToZero = uint64_t(1) << 24;	// FPCR.FZ, covers both inputs and results
+	uint64_t state = 0;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(state));
+	const bool previous = (state & flushToZero) != 0;
+	state = enable ? state | flushToZero : state & ~flushToZero;
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(state));
+	return previous;
+#else
+	(void)enable;
+	return false;
+#endif
+}
+
+//
+// Accounting
+//
+#ifdef _WIN32
+static double SB_GetThreadCpuTime(HANDLE thread)
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(thread, &creation, &exit, &kernel, &user))
+		return 0.0;
+	const auto ticks = [](const FILETIME& time) { return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+	return static_cast<double>(ticks(kernel) + ticks(user)) * 1e-7;	// 100 ns units
+}
+#else
+static double SB_GetThreadCpuTime(clockid_t clock)
+{
+	timespec time = {};
+	if (clock_gettime(clock, &time) != 0)
+		return 0.0;
+	return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1e-9;
+}
+#endif
+
+double SB_GetCurrentThreadCpuTime()
+{
+#ifdef _WIN32
+	return SB_GetThreadCpuTime(GetCurrentThread());
+#else
+	return SB_GetThreadCpuTime(CLOCK_THREAD_CPUTIME_ID);
+#endif
+}
+
+std::vector<SBThreadStats> SB_GetThreadStats()
+{
+	std::vector<SBThreadStats> stats;
+	const SBClock::time_point now = SBClock::now();
+	std::lock_guard<std::mutex> lock(s_threadsMutex);
+	stats.reserve(s_threads.size());
+	for (const SBThreadRecord& record : s_threads)
+	{
+		SBThreadStats threadStats;
+		threadStats.name = record.name;
+		threadStats.wallSeconds = std::chrono::duration<double>(now - record.start).count();
+		threadStats.realTime = record.realTime;
+		threadStats.core = record.core;
+#ifdef _WIN32
+		threadStats.cpuSeconds = record.handle ? SB_GetThreadCpuTime(record.handle) - record.cpuStart : 0.0;
+#else
+		threadStats.cpuSeconds = record.hasClock ? SB_GetThreadCpuTime(record.clock) - record.cpuStart : 0.0;
+#endif
+		stats.push_back(threadStats);
+	}
+	return stats;
+}
+
+size_t SB_GetCoreCount()
+{
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+//
+// SBThread
+//
+bool SBThread::start(const SBThreadSetup& setup, std::function<void()> body)
+{
+	join();
+	try
+	{
+		thread = std::thread([setup, body]()
+		{
+			SB_ConfigureCurrentThread(setup);
+			if (body)
+				body();
+			SB_ReleaseCurrentThread();
+		});
+	}
+	catch (const std::system_error&)
+	{
+		return false;
+	}
+	return true;
+}
+
+void SBThread::join()
+{
+	if (thread.joinable())
+		thread.join();
+}
+
+//
+// SBSemaphore
+//
+SBSemaphore::SBSemaphore()
+{
+#if defined(_WIN32)
+	handle = CreateSemaphoreW(NULL, 0, LONG_MAX, NULL);
+#elif defined(__APPLE__)
+	handle = dispatch_semaphore_create(0);
+#else
+	sem_t* semaphore = new sem_t;
+	sem_init(semaphore, 0, 0);
+	handle = semaphore;
+#endif
+}
+
+SBSemaphore::~SBSemaphore()
+{
+#if defined(_WIN32)
+	CloseHandle(handle);
+#elif defined(__APPLE__)
+	dispatch_release(static_cast<dispatch_semaphore_t>(handle));
+#else
+	sem_destroy(static_cast<sem_t*>(handle));
+	delete static_cast<sem_t*>(handle);
+#endif
+}
+
+void SBSemaphore::signal()
+{
+#if defined(_WIN32)
+	ReleaseSemaphore(handle, 1, NULL);
+#elif defined(__APPLE__)
+	dispatch_semaphore_signal(static_cast<dispatch_semaphore_t>(handle));
+#else
+	sem_post(static_cast<sem_t*>(handle));
+#endif
+}
+
+void SBSemaphore::wait()
+{
+#if defined(_WIN32)
+	WaitForSingleObject(handle, INFINITE);
+#elif defined(__APPLE__)
+	dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(handle), DISPATCH_TIME_FOREVER);
+#else
+	while (sem_wait(static_cast<sem_t*>(handle)) != 0)
+		;	// EINTR
+#endif
+}
+
+bool SBSemaphore::wait(double timeoutSeconds)
+{
+	timeoutSeconds = std::max(timeoutSeconds, 0.0);
+#if defined(_WIN32)
+	return WaitForSingleObject(handle, static_cast<DWORD>(std::min(timeoutSeconds * 1000.0, 4294967294.0))) == WAIT_OBJECT_0;
+#elif defined(__APPLE__)
+	return dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(handle), dispatch_time(DISPATCH_TIME_NOW, static_cast<int64_t>(timeoutSeconds * 1e9))) == 0;
+#else
+	// sem_timedwait only takes a CLOCK_REALTIME deadline
+	timespec deadline = {};
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	const long long nanoseconds = deadline.tv_nsec + static_cast<long long>(timeoutSeconds * 1e9);
+	deadline.tv_sec += static_cast<time_t>(nanoseconds / 1000000000);
+	deadline.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+	while (sem_timedwait(static_cast<sem_t*>(handle), &deadline) != 0)
+	{
+		if (errno != EINTR)
+			return false;
+	}
+	return true;
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class SBThreadPriority
+{
+	Normal = 0,
+	High,    	// above normal threads, not real-time (disk/network workers)
+	RealTime,	// audio: MMCSS "Pro Audio" + time critical on Windows, SCHED_FIFO elsewhere
+};
+
+struct SBThreadSetup
+{
+	std::string     	name;
+	SBThreadPriority	priority = SBThreadPriority::Normal;
+	int             	realTimePriority = 80;	// SCHED_FIFO priority (1-99), unused on Windows
+	int             	core = -1;           	// logical core to pin the thread to, -1: any
+	bool            	flushDenormals = false;	// FTZ/DAZ, for every thread running DSP
+};
+
+struct SBThreadStats
+{
+	std::string	name;
+	double     	cpuSeconds = 0.0;	// time actually spent on a core since registration
+	double     	wallSeconds = 0.0;	// since registration
+	bool       	realTime = false;	// real-time scheduling was granted
+	int        	core = -1;
+};
+
+// Applies the setup to the calling thread (including threads we don't own, e.g. the driver's callback thread)
+// and registers it for CPU accounting until released. Returns false when part of it was refused,
+// typically real-time scheduling without the privilege for it; everything else is still applied.
+bool SB_ConfigureCurrentThread(const SBThreadSetup& setup);
+void SB_ReleaseCurrentThread();
+void SB_ReleaseThread(std::thread::id thread);	// from another thread, once the thread is gone or idle
+
+// Flush-to-zero and denormals-are-zero for the calling thread; returns the previous state.
+bool SB_FlushDenormals(bool enable);
+
+double SB_GetCurrentThreadCpuTime();
+std::vector<SBThreadStats> SB_GetThreadStats();	// every registered thread
+size_t SB_GetCoreCount();
+
+// std::thread configured with SB_ConfigureCurrentThread before running its body, and released after.
+class SBThread
+{
+public:
+	SBThread() = default;
+	SBThread(const SBThread&) = delete;
+	SBThread& operator=(const SBThread&) = delete;
+	~SBThread() { join(); }
+
+	bool start(const SBThreadSetup& setup, std::function<void()> body);
+	void join();
+
+	bool joinable() const { return thread.joinable(); }
+	std::thread::id id() const { return thread.get_id(); }
+
+private:
+	std::thread	thread;
+};
+
+// Counting semaphore; signal() takes no lock and never allocates, so the audio thread can wake workers.
+class SBSemaphore
+{
+public:
+	SBSemaphore();
+	SBSemaphore(const SBSemaphore&) = delete;
+	SBSemaphore& operator=(const SBSemaphore&) = delete;
+	~SBSemaphore();
+
+	void signal();
+	void wait();
+	bool wait(double timeoutSeconds);	// false on timeout
+
+private:
+	void*	handle = nullptr;	// HANDLE, dispatch_semaphore_t or sem_t*
+};
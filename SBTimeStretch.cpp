@@ -0,0 +1,613 @@
+#include "SBTimeStretch.h"
+#include "SBSimd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float SB_TWO_PI = 6.28318530717958647692f;
+
+static long SB_StretchFrameSize(const SBStretchSetup& setup)
+{
+	if (setup.mode == SBStretchMode::PhaseVocoder)
+	{
+		long size = 256;
+		while (size < setup.fftSize && size < 16384)
+			size <<= 1;
+		return size;
+	}
+	// a multiple of 4, so that the hop and the search tolerance are whole
+	const long frames = setup.wsolaFrame > 0 ? setup.wsolaFrame : static_cast<long>(setup.sampleRate * 0.02);
+	return std::max((frames + 2) / 4 * 4, 64l);
+}
+
+// as SBSampler: 4 point Catmull-Rom between frames[0] and frames[1]
+static inline float SB_InterpolateCubic(const float* frames, float t)
+{
+	const float previous = frames[-1], current = frames[0], next = frames[1], after = frames[2];
+	return current + 0.5f * t * (next - previous + t * (2.0f * previous - 5.0f * current + 4.0f * next - after + t * (3.0f * (current - next) + after - previous)));
+}
+
+static inline float SB_WrapPhase(float phase)
+{
+	return phase - SB_TWO_PI * std::floor(phase / SB_TWO_PI + 0.5f);
+}
+
+//
+// Kernels
+//
+
+#if defined(SB_SIMD_SSE2)
+static inline __m128 SB_Select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Within 1e-5 rad; atan2(0, 0) is 0.
+static inline __m128 SB_Atan2(__m128 y, __m128 x)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 ax = _mm_andnot_ps(sign, x);
+	const __m128 ay = _mm_andnot_ps(sign, y);
+	const __m128 swap = _mm_cmpgt_ps(ay, ax);
+	const __m128 a = _mm_div_ps(SB_Select(swap, ax, ay), _mm_max_ps(SB_Select(swap, ay, ax), _mm_set1_ps(1e-30f)));
+	const __m128 s = _mm_mul_ps(a, a);
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), s), _mm_set1_ps(0.15931422f));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.327622764f));
+	r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+	r = SB_Select(swap, _mm_sub_ps(_mm_set1_ps(1.57079637f), r), r);
+	r = SB_Select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159274f), r), r);
+	return _mm_xor_ps(r, _mm_and_ps(y, sign));
+}
+
+// Quadrant reduction and Taylor polynomials on [-pi/4, pi/4], within 4e-7.
+static inline void SB_SinCos(__m128 x, __m128& sine, __m128& cosine)
+{
+	const __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.636619772f)));
+	const __m128 j = _mm_cvtepi32_ps(quadrant);
+	const __m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(1.57079625f))), _mm_mul_ps(j, _mm_set1_ps(7.54978995e-8f)));
+	const __m128 r2 = _mm_mul_ps(r, r);
+	__m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.0f / 5040.0f), r2), _mm_set1_ps(1.0f / 120.0f));
+	s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-1.0f / 6.0f));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+	__m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.0f / 40320.0f), r2), _mm_set1_ps(-1.0f / 720.0f));
+	c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(1.0f / 24.0f));
+	c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(-0.5f));
+	c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(1.0f));
+
+	// odd quadrants swap sine and cosine; sine is negated in quadrants 2 and 3, cosine in 1 and 2
+	const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	const __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+	const __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+	sine = _mm_xor_ps(SB_Select(swap, c, s), sineSign);
+	cosine = _mm_xor_ps(SB_Select(swap, s, c), cosineSign);
+}
+
+static inline __m128 SB_WrapPhase(__m128 phase)
+{
+	const __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(phase, _mm_set1_ps(1.0f / SB_TWO_PI))));
+	return _mm_sub_ps(phase, _mm_mul_ps(turns, _mm_set1_ps(SB_TWO_PI)));
+}
+
+static inline void SB_LoadComplex4(const SBComplex* values, __m128& real, __m128& imag)
+{
+	const float* data = reinterpret_cast<const float*>(values);
+	const __m128 low = _mm_loadu_ps(data);
+	const __m128 high = _mm_loadu_ps(data + 4);
+	real = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+	imag = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+static inline void SB_StoreComplex4(SBComplex* values, __m128 real, __m128 imag)
+{
+	float* data = reinterpret_cast<float*>(values);
+	_mm_storeu_ps(data, _mm_unpacklo_ps(real, imag));
+	_mm_storeu_ps(data + 4, _mm_unpackhi_ps(real, imag));
+}
+#endif
+
+// Magnitudes of the bins; returns the spectral flux against the previous magnitudes and their sum.
+static float SB_SpectralFlux(const SBComplex* bins, const float* previous, float* magnitude, size_t count, float& previousSum)
+{
+	float flux = 0.0f;
+	float sum = 0.0f;
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	__m128 fluxes = _mm_setzero_ps();
+	__m128 sums = _mm_setzero_ps();
+	for (; index + 4 <= count; index += 4)
+	{
+		__m128 real, imag;
+		SB_LoadComplex4(bins + index, real, imag);
+		const __m128 value = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(real, real), _mm_mul_ps(imag, imag)));
+		const __m128 before = _mm_loadu_ps(previous + index);
+		_mm_storeu_ps(magnitude + index, value);
+		fluxes = _mm_add_ps(fluxes, _mm_max_ps(_mm_sub_ps(value, before), _mm_setzero_ps()));
+		sums = _mm_add_ps(sums, before);
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, fluxes);
+	flux = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm_storeu_ps(lanes, sums);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; index < count; ++index)
+	{
+		magnitude[index] = std::abs(bins[index]);
+		flux += std::max(magnitude[index] - previous[index], 0.0f);
+		sum += previous[index];
+	}
+	previousSum = sum;
+	return flux;
+}
+
+// Per bin: the deviation of the measured phase advance from the bin frequency, scaled from the analysis to the
+// synthesis hop, turns the synthesis phasor; rotation takes the bin from its analysis phase to that phasor.
+static void SB_AdvancePhases(const SBComplex* bins, const SBComplex* previous, const float* magnitude, const float* analysisAdvance,
+	const float* synthesisAdvance, float hopRatio, const SBComplex* phasors, SBComplex* rotation, SBComplex* units, size_t count)
+{
+	size_t index = 0;
+#if defined(SB_SIMD_SSE2)
+	const __m128 ratio = _mm_set1_ps(hopRatio);
+	const __m128 tiny = _mm_set1_ps(1e-20f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; index + 4 <= count; index += 4)
+	{
+		__m128 real, imag, previousReal, previousImag, phasorReal, phasorImag;
+		SB_LoadComplex4(bins + index, real, imag);
+		SB_LoadComplex4(previous + index, previousReal, previousImag);
+		SB_LoadComplex4(phasors + index, phasorReal, phasorImag);
+		const __m128 deltaReal = _mm_add_ps(_mm_mul_ps(real, previousReal), _mm_mul_ps(imag, previousImag));
+		const __m128 deltaImag = _mm_sub_ps(_mm_mul_ps(imag, previousReal), _mm_mul_ps(real, previousImag));
+		const __m128 deviation = SB_WrapPhase(_mm_sub_ps(SB_Atan2(deltaImag, deltaReal), _mm_loadu_ps(analysisAdvance + index)));
+		__m128 sine, cosine;
+		SB_SinCos(_mm_add_ps(_mm_loadu_ps(synthesisAdvance + index), _mm_mul_ps(deviation, ratio)), sine, cosine);
+
+		// renormalized every hop, rounding never builds up in the level
+		__m128 targetReal = _mm_sub_ps(_mm_mul_ps(phasorReal, cosine), _mm_mul_ps(phasorImag, sine));
+		__m128 targetImag = _mm_add_ps(_mm_mul_ps(phasorReal, sine), _mm_mul_ps(phasorImag, cosine));
+		const __m128 length = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(targetReal, targetReal), _mm_mul_ps(targetImag, targetImag)), tiny)));
+		targetReal = _mm_mul_ps(targetReal, length);
+		targetImag = _mm_mul_ps(targetImag, length);
+
+		// unit vector of the bin, (1, 0) for empty bins
+		const __m128 value = _mm_loadu_ps(magnitude + index);
+		const __m128 empty = _mm_cmple_ps(value, tiny);
+		const __m128 inverse = _mm_div_ps(one, _mm_max_ps(value, tiny));
+		const __m128 unitReal = SB_Select(empty, one, _mm_mul_ps(real, inverse));
+		const __m128 unitImag = _mm_andnot_ps(empty, _mm_mul_ps(imag, inverse));
+		SB_StoreComplex4(units + index, unitReal, unitImag);
+		SB_StoreComplex4(rotation + index, _mm_add_ps(_mm_mul_ps(targetReal, unitReal), _mm_mul_ps(targetImag, unitImag)), _mm_sub_ps(_mm_mul_ps(targetImag, unitReal), _mm_mul_ps(targetReal, unitImag)));
+	}
+#endif
+	for (; index < count; ++index)
+	{
+		const SBComplex delta = SB_ComplexMultiply(bins[index], std::conj(previous[index]));
+		const float deviation = SB_WrapPhase(std::atan2(delta.imag(), delta.real()) - analysisAdvance[index]);
+		const float advance = synthesisAdvance[index] + deviation * hopRatio;
+		SBComplex target = SB_ComplexMultiply(phasors[index], SBComplex(std::cos(advance), std::sin(advance)));
+		target /= std::max(std::abs(target), 1e-20f);
+		units[index] = magnitude[index] > 1e-20f ? bins[index] / magnitude[index] : SBComplex(1.0f, 0.0f);
+		rotation[index] = SB_ComplexMultiply(target, std::conj(units[index]));
+	}
+}
+
+// Identity phase locking: the bins around a peak take its rotation, so its main lobe keeps the shape the analysis
+// window gave it instead of every bin drifting on its own. Regions meet halfway between peaks.
+static void SB_LockPhases(const float* magnitude, SBComplex* rotation, uint32_t* peaks, size_t count)
+{
+	size_t peakCount = 0;
+	for (size_t bin = 2; bin + 2 < count; ++bin)
+	{
+		const float value = magnitude[bin];
+		if (value > magnitude[bin - 1] && value > magnitude[bin - 2] && value >= magnitude[bin + 1] && value >= magnitude[bin + 2])
+			peaks[peakCount++] = static_cast<uint32_t>(bin);
+	}
+	size_t bin = 0;
+	for (size_t index = 0; index < peakCount; ++index)
+	{
+		const size_t end = index + 1 < peakCount ? (peaks[index] + peaks[index + 1] + 1) / 2 : count;
+		const SBComplex turn = rotation[peaks[index]];
+		for (; bin < end; ++bin)
+			rotation[bin] = turn;
+	}
+}
+
+static void SB_MultiplyFrames(const float* in, const float* window, float* out, long count)
+{
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	for (; index + 4 <= count; index += 4)
+		_mm_storeu_ps(out + index, _mm_mul_ps(_mm_loadu_ps(in + index), _mm_loadu_ps(window + index)));
+#endif
+	for (; index < count; ++index)
+		out[index] = in[index] * window[index];
+}
+
+// out += in * window
+static void SB_OverlapAdd(const float* in, const float* window, float* out, long count)
+{
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	for (; index + 4 <= count; index += 4)
+		_mm_storeu_ps(out + index, _mm_add_ps(_mm_loadu_ps(out + index), _mm_mul_ps(_mm_loadu_ps(in + index), _mm_loadu_ps(window + index))));
+#endif
+	for (; index < count; ++index)
+		out[index] += in[index] * window[index];
+}
+
+static float SB_DotProduct(const float* a, const float* b, long count)
+{
+	float sum = 0.0f;
+	long index = 0;
+#if defined(SB_SIMD_SSE2)
+	__m128 sums = _mm_setzero_ps();
+	for (; index + 4 <= count; index += 4)
+		sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(a + index), _mm_loadu_ps(b + index)));
+	float lanes[4];
+	_mm_storeu_ps(lanes, sums);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; index < count; ++index)
+		sum += a[index] * b[index];
+	return sum;
+}
+
+//
+// SBTimeStretch
+//
+
+SBTimeStretch::SBTimeStretch(const SBStretchSetup& setup, SBStretchInput inputCallback, void* user)
+	: mode(setup.mode), channels(std::max(setup.numChannels, 1l)), frameSize(SB_StretchFrameSize(setup)),
+	hop(setup.mode == SBStretchMode::PhaseVocoder ? frameSize / 4 : frameSize / 2), tolerance(setup.mode == SBStretchMode::Wsola ? frameSize / 4 : 0),
+	maxFrames(std::max(setup.maxBlockSize, 1l)), transientThreshold(std::max(setup.transientThreshold, 0.0f)),
+	input(inputCallback), userData(user), fft(setup.mode == SBStretchMode::PhaseVocoder ? frameSize : 4)
+{
+	analysisHop = static_cast<double>(hop);
+
+	// a frame, the search on both sides and the largest analysis hop, twice so that compaction stays rare
+	inputCapacity = 2 * (frameSize + 2 * tolerance + 4 * hop + 2);
+	inputs.assign(static_cast<size_t>(channels) * inputCapacity, 0.0f);
+	inputViews.resize(channels);
+
+	// periodic Hann: squared at 75% overlap it sums to 1.5, plain at 50% overlap to 1
+	const double pi = 3.14159265358979323846;
+	analysisWindow.resize(frameSize);
+	synthesisWindow.resize(frameSize);
+	for (long index = 0; index < frameSize; ++index)
+	{
+		const double hann = 0.5 - 0.5 * std::cos(2.0 * pi * static_cast<double>(index) / static_cast<double>(frameSize));
+		analysisWindow[index] = static_cast<float>(hann);
+		synthesisWindow[index] = static_cast<float>(mode == SBStretchMode::PhaseVocoder ? hann / 1.5 : hann);
+	}
+	frame.resize(frameSize);
+	overlap.resize(static_cast<size_t>(channels) * frameSize);
+
+	if (mode == SBStretchMode::PhaseVocoder)
+	{
+		const size_t bins = fft.bins();
+		spectra.resize((channels + 1) * bins);
+		previousSpectra.resize(channels * bins);
+		previousReference.resize(bins);
+		previousMagnitude.resize(bins);
+		magnitude.resize(bins);
+		phasors.resize(bins);
+		units.resize(bins);
+		peaks.resize(bins);
+		analysisAdvance.resize(bins);
+		synthesisAdvance.resize(bins);
+		rotation.resize(bins);
+		for (size_t bin = 0; bin < bins; ++bin)
+			synthesisAdvance[bin] = SB_WrapPhase(SB_TWO_PI * static_cast<float>((bin * hop) % frameSize) / static_cast<float>(frameSize));
+	}
+
+	// up to 4 input frames per output frame, the cubic taps and one hop of overshoot
+	stretchedCapacity = 4 * maxFrames + hop + 8;
+	stretched.resize(static_cast<size_t>(channels) * stretchedCapacity);
+	reset();
+}
+
+void SBTimeStretch::setSpeed(double speed)
+{
+	tempo = std::min(std::max(speed, 0.25), 4.0);
+	analysisHop = static_cast<double>(hop) * std::min(std::max(tempo / pitchRatio, 0.125), 4.0);
+}
+
+void SBTimeStretch::setPitch(double ratio)
+{
+	pitchRatio = std::min(std::max(ratio, 0.25), 4.0);
+	analysisHop = static_cast<double>(hop) * std::min(std::max(tempo / pitchRatio, 0.125), 4.0);
+}
+
+void SBTimeStretch::reset()
+{
+	// the first frame is centred on input frame 0: what comes before it, and its search area, is silence
+	inputOffset = 0;
+	inputCount = frameSize / 2 + tolerance;
+	inputBase = -inputCount;
+	inputEnd = -1;
+	for (long channel = 0; channel < channels; ++channel)
+		std::fill_n(inputs.begin() + static_cast<size_t>(channel) * inputCapacity, inputCount, 0.0f);
+	position = 0.0;
+	lastAnalysisHop = analysisHop;
+
+	std::fill(overlap.begin(), overlap.end(), 0.0f);
+	skip = frameSize / 2;
+	silentHops = 0;
+	drained = false;
+	primed = false;
+	previousStart = 0;
+	previousChosen = 0;
+	std::fill(phasors.begin(), phasors.end(), SBComplex(1.0f, 0.0f));
+	std::fill(previousMagnitude.begin(), previousMagnitude.end(), 0.0f);
+	std::fill(previousSpectra.begin(), previousSpectra.end(), SBComplex());
+
+	std::fill(stretched.begin(), stretched.end(), 0.0f);
+	stretchedCount = 1;
+	liveEnd = -1.0;
+	frameCentre = 1.0;
+	resamplePosition = 1.0;
+}
+
+long SBTimeStretch::render(float* const* outputs, long frameCount)
+{
+	long rendered = 0;
+	for (long done = 0; done < frameCount;)
+	{
+		const long count = std::min(frameCount - done, maxFrames);
+
+		// what the cubic no longer reaches
+		const long consumed = std::min(static_cast<long>(resamplePosition) - 1, stretchedCount);
+		if (consumed > 0)
+		{
+			for (long channel = 0; channel < channels; ++channel)
+			{
+				float* data = stretched.data() + static_cast<size_t>(channel) * stretchedCapacity;
+				memmove(data, data + consumed, (stretchedCount - consumed) * sizeof(float));
+			}
+			stretchedCount -= consumed;
+			if (liveEnd >= 0.0)
+				liveEnd -= static_cast<double>(consumed);
+			frameCentre -= static_cast<double>(consumed);
+			resamplePosition -= static_cast<double>(consumed);
+		}
+
+		const double last = resamplePosition + static_cast<double>(count - 1) * pitchRatio;
+		const long needed = static_cast<long>(last) + 3;
+		while (stretchedCount < needed)
+			stretchHop();
+
+		for (long channel = 0; channel < channels; ++channel)
+		{
+			const float* data = stretched.data() + static_cast<size_t>(channel) * stretchedCapacity;
+			float* out = outputs[channel] + done;
+			if (pitchRatio == 1.0 && resamplePosition == std::floor(resamplePosition))
+			{
+				memcpy(out, data + static_cast<long>(resamplePosition), count * sizeof(float));
+				continue;
+			}
+			double readPosition = resamplePosition;
+			for (long index = 0; index < count; ++index, readPosition += pitchRatio)
+			{
+				const long whole = static_cast<long>(readPosition);
+				out[index] = SB_InterpolateCubic(data + whole, static_cast<float>(readPosition - static_cast<double>(whole)));
+			}
+		}
+
+		// the overlap-add tail flushed after the material is not counted; the margin absorbs the rounding of the
+		// positions, moved back at every compaction
+		if (liveEnd < 0.0)
+			rendered += count;
+		else if (resamplePosition < liveEnd)
+			rendered += std::min(count, static_cast<long>(std::ceil((liveEnd - resamplePosition) / pitchRatio - 1e-6)));
+		resamplePosition += static_cast<double>(count) * pitchRatio;
+		done += count;
+	}
+	return rendered;
+}
+
+bool SBTimeStretch::fillInput(int64_t endFrame)
+{
+	const long needed = static_cast<long>(endFrame - (inputBase + inputCount));
+	if (needed <= 0)
+		return true;
+	if (inputOffset + inputCount + needed > inputCapacity)
+	{
+		for (long channel = 0; channel < channels; ++channel)
+		{
+			float* data = inputs.data() + static_cast<size_t>(channel) * inputCapacity;
+			memmove(data, data + inputOffset, inputCount * sizeof(float));
+		}
+		inputOffset = 0;
+	}
+
+	for (long channel = 0; channel < channels; ++channel)
+		inputViews[channel] = inputs.data() + static_cast<size_t>(channel) * inputCapacity + inputOffset + inputCount;
+	long read = 0;
+	if (inputEnd < 0)
+	{
+		read = input ? std::min(std::max(input(userData, inputViews.data(), needed), 0l), needed) : 0;
+		if (read < needed)
+			inputEnd = inputBase + inputCount + read;
+	}
+	for (long channel = 0; channel < channels; ++channel)
+		std::fill_n(inputViews[channel] + read, needed - read, 0.0f);
+	inputCount += needed;
+	return read == needed;
+}
+
+void SBTimeStretch::discardInput(int64_t frameIndex)
+{
+	const long count = static_cast<long>(std::min<int64_t>(std::max<int64_t>(frameIndex - inputBase, 0), inputCount));
+	inputOffset += count;
+	inputCount -= count;
+	inputBase += count;
+}
+
+void SBTimeStretch::stretchHop()
+{
+	if (drained)
+	{
+		// past the material: silence, without touching the input
+		for (long channel = 0; channel < channels; ++channel)
+			std::fill_n(stretched.begin() + static_cast<size_t>(channel) * stretchedCapacity + stretchedCount, hop, 0.0f);
+		stretchedCount += hop;
+		return;
+	}
+
+	const int64_t start = static_cast<int64_t>(std::floor(position + 0.5)) - frameSize / 2;
+	if (mode == SBStretchMode::PhaseVocoder)
+		analyzePhaseVocoder(start);
+	else
+		analyzeWsola(start);
+	emitHop();
+
+	// once whole frames lie past the material, frameSize / hop more hops flush the overlap-add
+	if (inputEnd >= 0 && start - tolerance >= inputEnd && ++silentHops >= frameSize / hop)
+		drained = true;
+
+	// frame centres map to the stretched stream one hop apart, the input between them at the rate of their hop. The
+	// end of the material lies in this hop, or in the last one when a long analysis hop only reached it now
+	const double end = static_cast<double>(inputEnd);
+	if (inputEnd >= 0 && liveEnd < 0.0 && position + analysisHop >= end)
+	{
+		if (end >= position)
+			liveEnd = frameCentre + (end - position) * static_cast<double>(hop) / analysisHop;
+		else
+			liveEnd = frameCentre - (position - end) * static_cast<double>(hop) / lastAnalysisHop;
+	}
+	frameCentre += static_cast<double>(hop);
+
+	position += analysisHop;
+	lastAnalysisHop = analysisHop;
+	int64_t keep = static_cast<int64_t>(std::floor(position + 0.5)) - frameSize / 2 - tolerance;
+	if (mode == SBStretchMode::Wsola)
+		keep = std::min(keep, previousChosen + hop);
+	discardInput(keep);
+}
+
+void SBTimeStretch::analyzePhaseVocoder(int64_t start)
+{
+	const size_t bins = fft.bins();
+	fillInput(start + frameSize);
+	for (long channel = 0; channel < channels; ++channel)
+	{
+		SB_MultiplyFrames(inputAt(channel, start), analysisWindow.data(), frame.data(), frameSize);
+		fft.forward(frame.data(), spectra.data() + channel * bins);
+	}
+	// the phase reference of a bin is its loudest channel, with that channel's previous frame: unlike the sum,
+	// it cannot cancel when channels are out of phase
+	SBComplex* reference = spectra.data() + channels * bins;
+	std::copy_n(spectra.begin(), bins, reference);
+	std::copy_n(previousSpectra.begin(), bins, previousReference.begin());
+	for (long channel = 1; channel < channels; ++channel)
+	{
+		const SBComplex* spectrum = spectra.data() + channel * bins;
+		const SBComplex* previous = previousSpectra.data() + channel * bins;
+		for (size_t bin = 0; bin < bins; ++bin)
+		{
+			if (std::norm(spectrum[bin]) > std::norm(reference[bin]))
+			{
+				reference[bin] = spectrum[bin];
+				previousReference[bin] = previous[bin];
+			}
+		}
+	}
+	std::copy_n(spectra.begin(), channels * bins, previousSpectra.begin());
+
+	// onsets (and the first frame) take the analysis phases as they are, steady partials keep their advance
+	float previousTotal = 0.0f;
+	const float flux = SB_SpectralFlux(reference, previousMagnitude.data(), magnitude.data(), bins, previousTotal);
+	const int64_t analysisStep = start - previousStart;
+	const bool transient = !primed || analysisStep <= 0 || (transientThreshold > 0.0f && flux > transientThreshold * previousTotal);
+	if (transient)
+	{
+		for (size_t bin = 0; bin < bins; ++bin)
+			phasors[bin] = magnitude[bin] > 1e-20f ? reference[bin] / magnitude[bin] : SBComplex(1.0f, 0.0f);
+	}
+	else
+	{
+		for (size_t bin = 0; bin < bins; ++bin)
+			analysisAdvance[bin] = SB_WrapPhase(SB_TWO_PI * static_cast<float>((static_cast<int64_t>(bin) * analysisStep) % frameSize) / static_cast<float>(frameSize));
+		SB_AdvancePhases(reference, previousReference.data(), magnitude.data(), analysisAdvance.data(), synthesisAdvance.data(),
+			static_cast<float>(hop) / static_cast<float>(analysisStep), phasors.data(), rotation.data(), units.data(), bins);
+		SB_LockPhases(magnitude.data(), rotation.data(), peaks.data(), bins);
+		SB_ComplexMultiplyInPlace(units.data(), rotation.data(), bins);
+		phasors.swap(units);
+	}
+	previousMagnitude.swap(magnitude);
+	previousStart = start;
+	primed = true;
+
+	for (long channel = 0; channel < channels; ++channel)
+	{
+		SBComplex* spectrum = spectra.data() + channel * bins;
+		if (!transient)
+			SB_ComplexMultiplyInPlace(spectrum, rotation.data(), bins);
+		fft.inverse(spectrum, frame.data());
+		SB_OverlapAdd(frame.data(), synthesisWindow.data(), overlap.data() + static_cast<size_t>(channel) * frameSize, frameSize);
+	}
+}
+
+void SBTimeStretch::analyzeWsola(int64_t start)
+{
+	int64_t chosen = start;
+	if (primed)
+	{
+		// the offset around the nominal start that best continues the previous frame; correlations are summed
+		// over the channels rather than taken on their sum, which cancels when they are out of phase
+		const long length = frameSize / 2;
+		const int64_t natural = previousChosen + hop;
+		fillInput(std::max(start + tolerance + frameSize, natural + length));
+		const auto correlate = [&](long offset)
+		{
+			float score = 0.0f;
+			for (long channel = 0; channel < channels; ++channel)
+				score += SB_DotProduct(inputAt(channel, start - tolerance + offset), inputAt(channel, natural), length);
+			return score;
+		};
+
+		// every fourth offset, then the neighbours of the best
+		long best = tolerance;
+		float bestScore = -1e30f;
+		for (long offset = 0; offset <= 2 * tolerance; offset += 4)
+		{
+			const float score = correlate(offset);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				best = offset;
+			}
+		}
+		const long coarse = best;
+		for (long offset = std::max(coarse - 3, 0l); offset <= std::min(coarse + 3, 2 * tolerance); ++offset)
+		{
+			const float score = correlate(offset);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				best = offset;
+			}
+		}
+		chosen = start - tolerance + best;
+	}
+	fillInput(chosen + frameSize);
+	for (long channel = 0; channel < channels; ++channel)
+		SB_OverlapAdd(inputAt(channel, chosen), synthesisWindow.data(), overlap.data() + static_cast<size_t>(channel) * frameSize, frameSize);
+	previousChosen = chosen;
+	primed = true;
+}
+
+void SBTimeStretch::emitHop()
+{
+	const long dropped = std::min(skip, hop);
+	for (long channel = 0; channel < channels; ++channel)
+	{
+		float* accumulator = overlap.data() + static_cast<size_t>(channel) * frameSize;
+		std::copy(accumulator + dropped, accumulator + hop, stretched.begin() + static_cast<size_t>(channel) * stretchedCapacity + stretchedCount);
+		memmove(accumulator, accumulator + hop, (frameSize - hop) * sizeof(float));
+		std::fill_n(accumulator + frameSize - hop, hop, 0.0f);
+	}
+	stretchedCount += hop - dropped;
+	skip -= dropped;
+}
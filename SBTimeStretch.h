@@ -0,0 +1,125 @@
+#pragma once
+
+#include "SBFFT.h"
+
+#include <vector>
+#include <cstdint>
+
+enum class SBStretchMode
+{
+	PhaseVocoder = 0,	// spectral, phases reset on transients; the better choice for tonal and mixed material
+	Wsola,           	// time domain overlap-add at the best matching offset: cheaper, good on speech and drums
+};
+
+struct SBStretchSetup
+{
+	SBStretchMode	mode = SBStretchMode::PhaseVocoder;
+	long         	numChannels = 2;
+	double       	sampleRate = 48000.0;
+	long         	fftSize = 2048;            	// phase vocoder frame, power of two from 256 to 16384; hop fftSize / 4
+	float        	transientThreshold = 1.0f; 	// spectral flux relative to the previous frame that resets the phases; 0: never
+	long         	wsolaFrame = 0;            	// frames; 0: about 20 ms. Hop half of it, offsets searched within a quarter
+	long         	maxBlockSize = 2048;
+};
+
+// Supplies the next frames of a voice (planar, numChannels); returns how many were written, fewer once the material ends.
+// Called from render(), on the audio thread: read from memory or from a ring filled by a disk thread.
+using SBStretchInput = long (*)(void* userData, float* const* channels, long frameCount);
+
+// Streaming time-stretch and pitch-shift of one voice.
+//
+// The stretcher runs at a fixed synthesis hop and moves through the input by hop * speed / pitch; a cubic
+// resampler reading its output at the pitch ratio then restores the tempo and moves the pitch. In phase vocoder
+// mode the phase advance of every bin is computed once, on the loudest channel of the bin (a sum would cancel on
+// out of phase material), locked to the nearest peak and applied as a rotation to each channel so the stereo image
+// holds; atan2 and sin/cos are SSE2 approximations four bins at a time, and frames with a sharp rise in spectral
+// flux restart from their own phases (transients). WSOLA picks its offsets on the correlations summed over the
+// channels. Everything is allocated by the constructor: input, overlap-add
+// and output buffers, the FFT tables and the spectra.
+class SBTimeStretch
+{
+public:
+	SBTimeStretch(const SBStretchSetup& setup, SBStretchInput input, void* userData);
+	SBTimeStretch(const SBTimeStretch&) = delete;
+	SBTimeStretch& operator=(const SBTimeStretch&) = delete;
+
+	// audio thread
+	void setSpeed(double speed);	// input frames per output frame: tempo, 0.25 to 4
+	void setPitch(double ratio);	// frequency ratio, 0.25 to 4 (speed / pitch kept within 1/8 to 4)
+	long render(float* const* outputs, long frameCount);	// overwrites; frames before the end of the material, silence after
+	void reset();               	// back to the start: history cleared, the next input is read again from the callback
+	bool finished() const { return liveEnd >= 0.0 && resamplePosition >= liveEnd; }
+
+	long numChannels() const { return channels; }
+	double speed() const { return tempo; }
+	double pitch() const { return pitchRatio; }
+
+private:
+	bool fillInput(int64_t endFrame);	// false once the material ended before endFrame
+	void discardInput(int64_t frame);
+	void stretchHop();
+	void analyzePhaseVocoder(int64_t start);
+	void analyzeWsola(int64_t start);
+	void emitHop();
+	const float* inputAt(long channel, int64_t frameIndex) const { return inputs.data() + static_cast<size_t>(channel) * inputCapacity + inputOffset + (frameIndex - inputBase); }
+
+	const SBStretchMode   	mode;
+	const long            	channels;
+	const long            	frameSize;  	// fftSize or the WSOLA frame
+	const long            	hop;        	// synthesis
+	const long            	tolerance;  	// WSOLA search, +-frames
+	const long            	maxFrames;
+	const float           	transientThreshold;
+	SBStretchInput        	input;
+	void*                 	userData;
+	double                	tempo = 1.0;
+	double                	pitchRatio = 1.0;
+	double                	analysisHop = 0.0;	// hop * speed / pitch
+
+	// input, planar: absolute frames [inputBase, inputBase + inputCount)
+	std::vector<float>    	inputs;
+	std::vector<float*>   	inputViews;
+	long                  	inputCapacity = 0;
+	long                  	inputOffset = 0;	// buffer index of inputBase
+	int64_t               	inputBase = 0;
+	long                  	inputCount = 0;
+	int64_t               	inputEnd = -1;	// absolute frame where the material ended, -1 before
+	double                	position = 0.0;	// input frame at the centre of the next frame
+	double                	lastAnalysisHop = 0.0;	// the step that led to position
+
+	// frames and overlap-add, planar frameSize per channel
+	std::vector<float>    	analysisWindow;
+	std::vector<float>    	synthesisWindow;
+	std::vector<float>    	frame;
+	std::vector<float>    	overlap;
+	long                  	skip = 0;        	// synthesized frames still to drop: the first window is centred on frame 0
+	long                  	silentHops = 0;  	// hops entirely past the end
+	bool                  	drained = false;
+
+	// phase vocoder
+	SBRealFFT             	fft;
+	std::vector<SBComplex>	spectra;        	// per channel, then the reference: per bin, the loudest channel
+	std::vector<SBComplex>	previousSpectra;	// per channel, as analyzed
+	std::vector<SBComplex>	previousReference;	// previous frame of the channel the reference took
+	std::vector<float>    	previousMagnitude;
+	std::vector<float>    	magnitude;
+	std::vector<SBComplex>	phasors;        	// synthesis phase per bin, as a unit vector
+	std::vector<SBComplex>	units;          	// analysis phase per bin, as a unit vector
+	std::vector<float>    	analysisAdvance;	// expected phase advance per bin over the analysis hop
+	std::vector<float>    	synthesisAdvance;
+	std::vector<SBComplex>	rotation;       	// synthesis minus analysis phase, applied to every channel
+	std::vector<uint32_t> 	peaks;
+	int64_t               	previousStart = 0;
+	bool                  	primed = false; 	// a previous frame exists
+
+	// WSOLA
+	int64_t               	previousChosen = 0;
+
+	// stretched output, read by the resampler
+	std::vector<float>    	stretched;
+	long                  	stretchedCapacity = 0;
+	long                  	stretchedCount = 0;
+	double                	liveEnd = -1.0; 	// stretched frame the end of the material maps to, -1 until the input ended
+	double                	frameCentre = 1.0;	// stretched frame the centre of the next analysis frame maps to
+	double                	resamplePosition = 1.0;	// frame 0 is the history of the cubic
+};
@@ -0,0 +1,537 @@
+#include "SBTrace.h"
+#include "SBFile.h"
+#include "SBLockFreeQueue.h"
+#include "SBThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SB_TRACE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SB_TRACE_TSC
+#endif
+
+using SBClock = std::chrono::steady_clock;
+
+std::atomic<bool> SBTraceDetail::recording = { false };
+
+namespace
+{
+	struct SBTraceEvent
+	{
+		uint64_t            	ticks;
+		const char*         	name;
+		int64_t             	value;
+		SBTraceDetail::Phase	phase;
+		uint32_t            	thread;	// system thread id
+	};
+
+	constexpr SBTraceDetail::Phase SBTraceThreadName = static_cast<SBTraceDetail::Phase>(100);	// name: interned thread name
+
+	// single producer (the thread that claimed it), single consumer (the writer thread)
+	struct SBTraceRing
+	{
+		std::vector<SBTraceEvent>	events;
+		uint64_t             	mask = 0;
+		std::atomic<bool>    	claimed = { false };
+		char                 	padding0[SB_CACHE_LINE_SIZE];
+		std::atomic<uint64_t>	writeIndex = { 0 };
+		std::atomic<uint64_t>	dropped = { 0 };
+		char                 	padding1[SB_CACHE_LINE_SIZE];
+		std::atomic<uint64_t>	readIndex = { 0 };
+
+		// writer thread
+		const char*          	threadName = nullptr;	// last one seen, announced again by the next capture
+		uint32_t             	thread = 0;
+	};
+
+	struct SBTraceThread
+	{
+		SBTraceRing*	ring = nullptr;
+		const char* 	name = nullptr;	// interned
+		uint32_t    	id = 0;
+		uint64_t    	refusedSession = 0;	// no ring left in that capture, not asked again
+		uint64_t    	session = 0;    	// capture the nesting below belongs to
+		uint32_t    	depth = 0;      	// open begins
+		uint64_t    	droppedLevels = 0;	// bit per open begin that did not fit, its end is dropped too
+
+		~SBTraceThread()
+		{
+			if (ring)
+				ring->claimed.store(false, std::memory_order_release);
+		}
+	};
+
+	struct SBTraceState
+	{
+		std::vector<std::unique_ptr<SBTraceRing>>	rings;	// allocated by the first capture, never freed
+		std::atomic<uint64_t>               	session = { 0 };
+		std::atomic<uint64_t>               	refused = { 0 };	// events of threads without a ring
+		std::mutex                          	control;
+		std::mutex                          	namesMutex;
+		std::set<std::string>               	names;
+
+		// capture, writer thread
+		SBTraceSetup                        	setup;
+		std::FILE*                          	file = nullptr;
+		SBThread                            	writer;
+		SBSemaphore                         	wakeUp;
+		std::atomic<bool>                   	stopping = { false };
+		uint64_t                            	originTicks = 0;
+		double                              	nanosecondsPerTick = 1.0;
+		uint64_t                            	written = 0;
+		uint64_t                            	droppedBefore = 0;
+		bool                                	first = true;	// JSON separator, Perfetto sequence flags
+		std::unordered_set<uint32_t>        	announcedThreads;
+		std::unordered_map<const char*, uint64_t>	counterTracks;
+		std::string                         	packet;
+		std::string                         	message;
+		std::string                         	nested;
+	};
+
+	SBTraceState s_trace;
+	thread_local SBTraceThread t_traceThread;
+
+	uint64_t SB_TraceTicks()
+	{
+#ifdef SB_TRACE_TSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(SBClock::now().time_since_epoch()).count());
+#endif
+	}
+
+	uint32_t SB_CurrentThreadId()
+	{
+#ifdef _WIN32
+		return static_cast<uint32_t>(GetCurrentThreadId());
+#elif defined(__linux__)
+		return static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+		return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+	}
+
+	uint32_t SB_CurrentProcessId()
+	{
+#ifdef _WIN32
+		return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+		return static_cast<uint32_t>(getpid());
+#endif
+	}
+
+	bool SB_PushTraceEvent(SBTraceRing& ring, SBTraceDetail::Phase phase, const char* name, int64_t value, uint64_t reserved)
+	{
+		const uint64_t write = ring.writeIndex.load(std::memory_order_relaxed);
+		if (write - ring.readIndex.load(std::memory_order_acquire) + reserved > ring.mask)
+		{
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		SBTraceEvent& event = ring.events[write & ring.mask];
+		event.ticks = SB_TraceTicks();
+		event.name = name;
+		event.value = value;
+		event.phase = phase;
+		event.thread = t_traceThread.id;
+		ring.writeIndex.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	// A full ring drops whole slices: every open begin keeps a slot for its end, and the end of a dropped begin
+	// is dropped with it.
+	void SB_PushNestedTraceEvent(SBTraceThread& thread, SBTraceRing& ring, SBTraceDetail::Phase phase, const char* name, int64_t value)
+	{
+		const uint64_t session = s_trace.session.load(std::memory_order_relaxed);
+		if (thread.session != session)
+		{
+			thread.session = session;
+			thread.depth = 0;
+			thread.droppedLevels = 0;
+		}
+
+		if (phase == SBTraceDetail::Phase::Begin)
+		{
+			const uint64_t level = uint64_t(1) << std::min<uint32_t>(thread.depth, 63);
+			if (!SB_PushTraceEvent(ring, phase, name, value, thread.depth + 1))
+				thread.droppedLevels |= level;
+			++thread.depth;
+		}
+		else if (phase == SBTraceDetail::Phase::End)
+		{
+			if (thread.depth == 0)
+				return;	// begun before this capture
+			--thread.depth;
+			const uint64_t level = uint64_t(1) << std::min<uint32_t>(thread.depth, 63);
+			if (thread.droppedLevels & level)
+				thread.droppedLevels &= ~level;
+			else
+				SB_PushTraceEvent(ring, phase, name, value, 0);
+		}
+		else
+		{
+			SB_PushTraceEvent(ring, phase, name, value, thread.depth);
+		}
+	}
+
+	// first event of a thread: any drained ring nobody owns, without a lock
+	SBTraceRing* SB_ClaimTraceRing()
+	{
+		SBTraceThread& thread = t_traceThread;
+		const uint64_t session = s_trace.session.load(std::memory_order_acquire);
+		if (!SBTraceDetail::recording.load(std::memory_order_acquire) || thread.refusedSession == session)
+			return nullptr;
+		for (const std::unique_ptr<SBTraceRing>& ring : s_trace.rings)
+		{
+			bool expected = false;
+			if (ring->readIndex.load(std::memory_order_acquire) == ring->writeIndex.load(std::memory_order_relaxed)
+				&& ring->claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+			{
+				thread.ring = ring.get();
+				thread.id = SB_CurrentThreadId();
+				if (thread.name)
+					SB_PushTraceEvent(*ring, SBTraceThreadName, thread.name, 0, 0);
+				return ring.get();
+			}
+		}
+		thread.refusedSession = session;
+		return nullptr;
+	}
+
+	//
+	// Chrome JSON
+	//
+	void SB_WriteJsonString(std::FILE* file, const char* text)
+	{
+		std::fputc('"', file);
+		for (const char* character = text; *character; ++character)
+		{
+			const unsigned char code = static_cast<unsigned char>(*character);
+			if (code == '"' || code == '\\')
+				std::fprintf(file, "\\%c", code);
+			else if (code < 0x20)
+				std::fprintf(file, "\\u%04x", code);
+			else
+				std::fputc(code, file);
+		}
+		std::fputc('"', file);
+	}
+
+	void SB_WriteJsonThreadName(SBTraceState& state, uint32_t thread, const char* name)
+	{
+		std::fprintf(state.file, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", state.first ? "" : ",", SB_CurrentProcessId(), thread);
+		SB_WriteJsonString(state.file, name);
+		std::fputs("}}", state.file);
+		state.first = false;
+	}
+
+	void SB_WriteJsonEvent(SBTraceState& state, const SBTraceEvent& event, double nanoseconds)
+	{
+		static const char* const phases[] = { "B", "E", "i", "C" };
+		std::fprintf(state.file, "%s\n{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"name\":", state.first ? "" : ",",
+			phases[static_cast<uint32_t>(event.phase)], nanoseconds * 1e-3, SB_CurrentProcessId(), event.thread);
+		SB_WriteJsonString(state.file, event.name);
+		if (event.phase == SBTraceDetail::Phase::Instant)
+			std::fputs(",\"s\":\"t\"", state.file);
+		else if (event.phase == SBTraceDetail::Phase::Counter)
+			std::fprintf(state.file, ",\"args\":{\"value\":%lld}", static_cast<long long>(event.value));
+		std::fputc('}', state.file);
+		state.first = false;
+	}
+
+	//
+	// Perfetto: TracePacket protobuf, written by hand (field numbers from perfetto/trace/trace_packet.proto)
+	//
+	void SB_PutVarint(std::string& out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		out += static_cast<char>(value);
+	}
+
+	void SB_PutField(std::string& out, uint32_t field, uint64_t value)
+	{
+		SB_PutVarint(out, static_cast<uint64_t>(field) << 3);
+		SB_PutVarint(out, value);
+	}
+
+	void SB_PutField(std::string& out, uint32_t field, const char* data, size_t size)
+	{
+		SB_PutVarint(out, (static_cast<uint64_t>(field) << 3) | 2);
+		SB_PutVarint(out, size);
+		out.append(data, size);
+	}
+
+	void SB_PutField(std::string& out, uint32_t field, const std::string& message)
+	{
+		SB_PutField(out, field, message.data(), message.size());
+	}
+
+	uint64_t SB_ThreadTrack(uint32_t thread)
+	{
+		return (1ull << 32) | thread;
+	}
+
+	void SB_WritePacket(SBTraceState& state, uint32_t field, const std::string& message, uint64_t nanoseconds, bool timed)
+	{
+		std::string& packet = state.packet;
+		packet.clear();
+		if (timed)
+			SB_PutField(packet, 8, nanoseconds);   	// timestamp
+		SB_PutField(packet, 10, 1);                	// trusted_packet_sequence_id
+		if (state.first)
+			SB_PutField(packet, 13, 1);            	// sequence_flags: SEQ_INCREMENTAL_STATE_CLEARED
+		SB_PutField(packet, field, message);
+		std::string framed;
+		SB_PutField(framed, 1, packet);            	// Trace.packet
+		std::fwrite(framed.data(), 1, framed.size(), state.file);
+		state.first = false;
+	}
+
+	void SB_WritePerfettoThread(SBTraceState& state, uint32_t thread, const char* name)
+	{
+		std::string& nested = state.nested;
+		nested.clear();
+		SB_PutField(nested, 1, SB_CurrentProcessId());	// ThreadDescriptor.pid
+		SB_PutField(nested, 2, thread);             	// tid
+		if (name)
+			SB_PutField(nested, 5, name, strlen(name));	// thread_name
+		std::string& message = state.message;
+		message.clear();
+		SB_PutField(message, 1, SB_ThreadTrack(thread));	// TrackDescriptor.uuid
+		SB_PutField(message, 4, nested);            	// thread
+		SB_WritePacket(state, 60, message, 0, false);	// track_descriptor
+	}
+
+	void SB_WritePerfettoEvent(SBTraceState& state, const SBTraceEvent& event, uint64_t nanoseconds)
+	{
+		if (state.announcedThreads.insert(event.thread).second)
+			SB_WritePerfettoThread(state, event.thread, nullptr);
+
+		uint64_t track = SB_ThreadTrack(event.thread);
+		if (event.phase == SBTraceDetail::Phase::Counter)
+		{
+			// one counter track per name, under the process
+			auto found = state.counterTracks.find(event.name);
+			if (found == state.counterTracks.end())
+			{
+				found = state.counterTracks.emplace(event.name, (2ull << 32) | state.counterTracks.size()).first;
+				std::string& message = state.message;
+				message.clear();
+				SB_PutField(message, 1, found->second);	// uuid
+				SB_PutField(message, 2, event.name, strlen(event.name));	// name
+				SB_PutField(message, 8, std::string());	// counter
+				SB_WritePacket(state, 60, message, 0, false);
+			}
+			track = found->second;
+		}
+
+		static const uint64_t types[] = { 1, 2, 3, 4 };	// TYPE_SLICE_BEGIN, TYPE_SLICE_END, TYPE_INSTANT, TYPE_COUNTER
+		std::string& message = state.message;
+		message.clear();
+		SB_PutField(message, 9, types[static_cast<uint32_t>(event.phase)]);	// TrackEvent.type
+		SB_PutField(message, 11, track);                	// track_uuid
+		if (event.phase != SBTraceDetail::Phase::End)
+			SB_PutField(message, 23, event.name, strlen(event.name));	// name
+		if (event.phase == SBTraceDetail::Phase::Counter)
+			SB_PutField(message, 30, static_cast<uint64_t>(event.value));	// counter_value
+		SB_WritePacket(state, 11, message, nanoseconds, true);	// track_event
+	}
+
+	void SB_WriteThreadName(SBTraceState& state, uint32_t thread, const char* name)
+	{
+		if (state.setup.format == SBTraceFormat::ChromeJson)
+			SB_WriteJsonThreadName(state, thread, name);
+		else
+		{
+			state.announcedThreads.insert(thread);
+			SB_WritePerfettoThread(state, thread, name);
+		}
+	}
+
+	void SB_DrainTrace(SBTraceState& state)
+	{
+		for (const std::unique_ptr<SBTraceRing>& ring : state.rings)
+		{
+			const uint64_t read = ring->readIndex.load(std::memory_order_relaxed);
+			const uint64_t write = ring->writeIndex.load(std::memory_order_acquire);
+			for (uint64_t index = read; index < write; ++index)
+			{
+				const SBTraceEvent& event = ring->events[index & ring->mask];
+				if (event.phase == SBTraceThreadName)
+				{
+					ring->threadName = event.name;
+					ring->thread = event.thread;
+					SB_WriteThreadName(state, event.thread, event.name);
+					continue;
+				}
+				if (event.ticks < state.originTicks)
+					continue;	// an end recorded after the previous capture stopped
+				const double nanoseconds = static_cast<double>(event.ticks - state.originTicks) * state.nanosecondsPerTick;
+				if (state.setup.format == SBTraceFormat::ChromeJson)
+					SB_WriteJsonEvent(state, event, nanoseconds);
+				else
+					SB_WritePerfettoEvent(state, event, static_cast<uint64_t>(nanoseconds));
+				++state.written;
+			}
+			ring->readIndex.store(write, std::memory_order_release);
+		}
+	}
+
+	void SB_RunTraceWriter(SBTraceState& state)
+	{
+		while (!state.stopping.load(std::memory_order_acquire))
+		{
+			state.wakeUp.wait(state.setup.drainSeconds);
+			SB_DrainTrace(state);
+		}
+		SB_DrainTrace(state);
+	}
+
+	uint64_t SB_TraceDropped(const SBTraceState& state)
+	{
+		uint64_t dropped = state.refused.load(std::memory_order_relaxed);
+		for (const std::unique_ptr<SBTraceRing>& ring : state.rings)
+			dropped += ring->dropped.load(std::memory_order_relaxed);
+		return dropped;
+	}
+}
+
+void SBTraceDetail::record(Phase phase, const char* name, int64_t value)
+{
+	SBTraceRing* ring = t_traceThread.ring ? t_traceThread.ring : SB_ClaimTraceRing();
+	if (ring)
+		SB_PushNestedTraceEvent(t_traceThread, *ring, phase, name, value);
+	else if (recording.load(std::memory_order_relaxed))
+		s_trace.refused.fetch_add(1, std::memory_order_relaxed);
+}
+
+const char* SB_InternTraceName(const char* name)
+{
+	std::lock_guard<std::mutex> lock(s_trace.namesMutex);
+	return s_trace.names.insert(name ? name : "").first->c_str();
+}
+
+void SB_SetTraceThreadName(const char* name)
+{
+	if (!name || !*name)
+		return;
+	t_traceThread.name = SB_InternTraceName(name);
+	if (t_traceThread.ring)
+		SB_PushTraceEvent(*t_traceThread.ring, SBTraceThreadName, t_traceThread.name, 0, 0);
+}
+
+bool SB_StartTrace(const SBTraceSetup& setup)
+{
+	std::lock_guard<std::mutex> lock(s_trace.control);
+	if (s_trace.file || setup.path.empty())
+		return false;
+	s_trace.file = SB_OpenFile(setup.path, "wb");
+	if (!s_trace.file)
+		return false;
+	std::setvbuf(s_trace.file, nullptr, _IOFBF, 1 << 20);
+	s_trace.setup = setup;
+
+	if (s_trace.rings.empty())
+	{
+		const size_t capacity = SB_RoundUpToPowerOfTwo(std::max<size_t>(setup.eventsPerThread, 1024));
+		for (size_t index = 0; index < std::max<size_t>(setup.maxThreads, 1); ++index)
+		{
+			std::unique_ptr<SBTraceRing> ring(new SBTraceRing);
+			ring->events.resize(capacity);
+			ring->mask = capacity - 1;
+			s_trace.rings.push_back(std::move(ring));
+		}
+	}
+
+	// the tick rate, measured once so that every event of the capture converts the same way
+#ifdef SB_TRACE_TSC
+	const SBClock::time_point clockStart = SBClock::now();
+	const uint64_t tickStart = SB_TraceTicks();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	const uint64_t tickEnd = SB_TraceTicks();
+	const double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(SBClock::now() - clockStart).count());
+	s_trace.nanosecondsPerTick = tickEnd > tickStart ? elapsed / static_cast<double>(tickEnd - tickStart) : 1.0;
+#else
+	s_trace.nanosecondsPerTick = 1.0;
+#endif
+
+	// whatever the previous capture left behind is skipped, the thread names are announced again
+	s_trace.first = true;
+	s_trace.written = 0;
+	s_trace.announcedThreads.clear();
+	s_trace.counterTracks.clear();
+	if (setup.format == SBTraceFormat::ChromeJson)
+		std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", s_trace.file);
+	for (const std::unique_ptr<SBTraceRing>& ring : s_trace.rings)
+	{
+		ring->readIndex.store(ring->writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+		if (ring->threadName && ring->claimed.load(std::memory_order_acquire))
+			SB_WriteThreadName(s_trace, ring->thread, ring->threadName);
+	}
+	s_trace.droppedBefore = SB_TraceDropped(s_trace);
+	s_trace.originTicks = SB_TraceTicks();
+	s_trace.session.fetch_add(1, std::memory_order_release);
+
+	s_trace.stopping.store(false, std::memory_order_relaxed);
+	SBThreadSetup threadSetup;
+	threadSetup.name = "Trace";
+	if (!s_trace.writer.start(threadSetup, []() { SB_RunTraceWriter(s_trace); }))
+	{
+		std::fclose(s_trace.file);
+		s_trace.file = nullptr;
+		return false;
+	}
+	SBTraceDetail::recording.store(true, std::memory_order_release);
+	return true;
+}
+
+SBTraceStats SB_StopTrace()
+{
+	std::lock_guard<std::mutex> lock(s_trace.control);
+	SBTraceStats stats;
+	if (!s_trace.file)
+		return stats;
+
+	SBTraceDetail::recording.store(false, std::memory_order_release);
+	s_trace.stopping.store(true, std::memory_order_release);
+	s_trace.wakeUp.signal();
+	s_trace.writer.join();
+	if (s_trace.setup.format == SBTraceFormat::ChromeJson)
+		std::fputs("\n]}\n", s_trace.file);
+	std::fclose(s_trace.file);
+	s_trace.file = nullptr;
+
+	stats.written = s_trace.written;
+	stats.dropped = SB_TraceDropped(s_trace) - s_trace.droppedBefore;
+	return stats;
+}
+
+bool SB_IsTracing()
+{
+	return SBTraceDetail::recording.load(std::memory_order_relaxed);
+}
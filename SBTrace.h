@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+enum class SBTraceFormat
+{
+	ChromeJson = 0,	// chrome://tracing, Perfetto UI and speedscope all open it
+	Perfetto,      	// protobuf TracePacket stream (TrackEvent), for trace_processor and large captures
+};
+
+struct SBTraceSetup
+{
+	std::wstring 	path;
+	SBTraceFormat	format = SBTraceFormat::ChromeJson;
+	size_t       	eventsPerThread = 1 << 16;	// ring per thread, drained every drainSeconds
+	size_t       	maxThreads = 64;           	// rings are allocated once, by the first SB_StartTrace; later threads are not traced
+	double       	drainSeconds = 0.02;
+};
+
+struct SBTraceStats
+{
+	uint64_t	written = 0;	// events in the file
+	uint64_t	dropped = 0;	// lost to full rings or to threads past maxThreads
+};
+
+// Low overhead timeline tracing, switched on and off at run time.
+//
+// Each thread records into its own single-producer ring, claimed without a lock on its first event, so audio
+// threads can trace: while stopped an event costs a relaxed load, while recording a timestamp (rdtsc where
+// available) and a 32 byte store. A writer thread drains the rings to the file. Names must outlive the capture
+// (string literals); begin/end pairs nest per thread.
+bool SB_StartTrace(const SBTraceSetup& setup);	// false when already recording or the file cannot be created
+SBTraceStats SB_StopTrace();                   	// drains what is left and closes the file
+bool SB_IsTracing();
+
+void SB_SetTraceThreadName(const char* name);	// copied; SB_ConfigureCurrentThread names its threads
+const char* SB_InternTraceName(const char* name);	// stable copy, for names built at run time (takes a lock)
+
+namespace SBTraceDetail
+{
+	enum class Phase : uint32_t
+	{
+		Begin = 0,
+		End,
+		Instant,
+		Counter,
+	};
+
+	extern std::atomic<bool> recording;
+	void record(Phase phase, const char* name, int64_t value);
+}
+
+inline void SB_TraceBegin(const char* name)
+{
+	if (SBTraceDetail::recording.load(std::memory_order_relaxed))
+		SBTraceDetail::record(SBTraceDetail::Phase::Begin, name, 0);
+}
+
+inline void SB_TraceEnd(const char* name)
+{
+	if (SBTraceDetail::recording.load(std::memory_order_relaxed))
+		SBTraceDetail::record(SBTraceDetail::Phase::End, name, 0);
+}
+
+inline void SB_TraceInstant(const char* name)
+{
+	if (SBTraceDetail::recording.load(std::memory_order_relaxed))
+		SBTraceDetail::record(SBTraceDetail::Phase::Instant, name, 0);
+}
+
+inline void SB_TraceCounter(const char* name, int64_t value)
+{
+	if (SBTraceDetail::recording.load(std::memory_order_relaxed))
+		SBTraceDetail::record(SBTraceDetail::Phase::Counter, name, value);
+}
+
+// Begin/end around a scope; the end is only recorded when the begin was, so a capture starting or stopping
+// in the middle never leaves an unbalanced slice.
+class SBTraceScope
+{
+public:
+	explicit SBTraceScope(const char* scopeName)
+		: name(SBTraceDetail::recording.load(std::memory_order_relaxed) ? scopeName : nullptr)
+	{
+		if (name)
+			SBTraceDetail::record(SBTraceDetail::Phase::Begin, name, 0);
+	}
+	SBTraceScope(const SBTraceScope&) = delete;
+	SBTraceScope& operator=(const SBTraceScope&) = delete;
+	~SBTraceScope()
+	{
+		if (name)
+			SBTraceDetail::record(SBTraceDetail::Phase::End, name, 0);
+	}
+
+private:
+	const char*	name;
+};
@@ -1,255 +1,402 @@
-/*
-[Bloc dcrivant le format audio]
-FormatBlocID(4 octets) : Identifiant fmt (0x66, 0x6D, 0x74, 0x20)
-BlocSize(4 octets) : Nombre d'octets du bloc - 16  (0x10)
-
-AudioFormat(2 octets) : Format du stockage dans le fichier(1: PCM, ...)
-NbrCanaux(2 octets) : Nombre de canaux(de 1  6, cf.ci - dessous)
-Frequence(4 octets) : Frquence d'chantillonnage (en hertz) [Valeurs standardises : 11 025, 22 050, 44 100 et ventuellement 48 000 et 96 000]
-BytePerSec(4 octets) : Nombre d'octets  lire par seconde (c.--d., Frequence * BytePerBloc).
-BytePerBloc(2 octets) : Nombre d'octets par bloc d'chantillonnage(c. -  - d., tous canaux confondus : NbrCanaux * BitsPerSample / 8).
-BitsPerSample(2 octets) : Nombre de bits utiliss pour le codage de chaque chantillon(8, 16, 24)
-
-[Bloc des donnes]
-DataBlocID(4 octets) : Constante data(0x64, 0x61, 0x74, 0x61)
-DataSize(4 octets) : Nombre d'octets des donnes (c.--d. "Data[]", c.--d. taille_du_fichier - taille_de_l'entte(qui fait 44 octets normalement).
-DATAS[] : [Octets du Sample 1 du Canal 1] [Octets du Sample 1 du Canal 2] [Octets du Sample 2 du Canal 1] [Octets du Sample 2 du Canal 2]
-
-* Les Canaux :
-1 pour mono,
-2 pour stro
-3 pour gauche, droit et centre
-4 pour face gauche, face droit, arrire gauche, arrire droit
-5 pour gauche, centre, droit, surround(ambiant)
-6 pour centre gauche, gauche, centre, centre droit, droit, surround(ambiant)
-
-NOTES IMPORTANTES : Les octets des mots sont stocks sous la forme(c. -  - d., en "little endian")
-[87654321][16..9][24..17][8..1][16..9][24..17][...
-*/
-
-#include <cstdint>
-using byte_t = unsigned char;
-
-enum class byte_swizzling_t : uint32_t
+#include "SBWav.h"
+#include "../SBFile.h"
+#include "../SBSample.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static constexpr uint32_t SB_WAV_FACT_TAG = fourcc<byte_swizzling_t::big_endian>('f', 'a', 'c', 't');
+static constexpr uint32_t SB_WAV_JUNK_TAG = fourcc<byte_swizzling_t::big_endian>('J', 'U', 'N', 'K');
+static constexpr uint32_t SB_WAV_RF64_TAG = fourcc<byte_swizzling_t::big_endian>('R', 'F', '6', '4');
+static constexpr uint32_t SB_WAV_DS64_TAG = fourcc<byte_swizzling_t::big_endian>('d', 's', '6', '4');
+static constexpr uint32_t SB_WAV_DS64_SIZE = 28;	// RIFF size, data size, sample count (64 bits each), table length
+
+// Tags are kept big endian (as read), every other field little endian.
+static void SB_PutWavTag(std::vector<unsigned char>& bytes, uint32_t tag)
 {
-	big_endian       = 0x00010203u,
-	little_endian    = 0x03020100u,
-	pdp_endian       = 0x01000302u,
-	honeywell_endian = 0x02030001u,
-};
-// SBTODO : cpu_swizzling, gpu_swizzling
-static constexpr byte_swizzling_t cpu_swizzling = byte_swizzling_t::little_endian;
-static constexpr byte_swizzling_t gpu_swizzling = byte_swizzling_t::little_endian;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		bytes.push_back(static_cast<unsigned char>(tag >> shift));
+}
 
-
-//template< byte_swizzling_t swizzling = cpu_swizzling, size_t count >
-//constexpr uint32_t make_cc();
-
-
-template< byte_swizzling_t swizzling = cpu_swizzling >
-constexpr uint32_t fourcc(const byte_t tag0, const byte_t tag1, const byte_t tag2, const byte_t tag3);
-
-template<> constexpr uint32_t fourcc<byte_swizzling_t::little_endian   >(const byte_t tag0, const byte_t tag1, const byte_t tag2, const byte_t tag3) { return (tag3 << 24u) | (tag2 << 16u) | (tag1 << 8u) | (tag0 << 0u); };
-template<> constexpr uint32_t fourcc<byte_swizzling_t::big_endian      >(const byte_t tag0, const byte_t tag1, const byte_t tag2, const byte_t tag3) { return (tag0 << 24u) | (tag1 << 16u) | (tag2 << 8u) | (tag3 << 0u); };
-template<> constexpr uint32_t fourcc<byte_swizzling_t::pdp_endian      >(const byte_t tag0, const byte_t tag1, const byte_t tag2, const byte_t tag3) { return (tag1 << 24u) | (tag0 << 16u) | (tag3 << 8u) | (tag2 << 0u); };
-template<> constexpr uint32_t fourcc<byte_swizzling_t::honeywell_endian>(const byte_t tag0, const byte_t tag1, const byte_t tag2, const byte_t tag3) { return (tag2 << 24u) | (tag3 << 16u) | (tag0 << 8u) | (tag1 << 0u); };
-static_assert( fourcc<byte_swizzling_t::little_endian   >('\0', '\1', '\2', '\3') == static_cast<uint32_t>(byte_swizzling_t::little_endian   ), "Incorrect fourcc" );
-static_assert( fourcc<byte_swizzling_t::big_endian      >('\0', '\1', '\2', '\3') == static_cast<uint32_t>(byte_swizzling_t::big_endian      ), "Incorrect fourcc" );
-static_assert( fourcc<byte_swizzling_t::pdp_endian      >('\0', '\1', '\2', '\3') == static_cast<uint32_t>(byte_swizzling_t::pdp_endian      ), "Incorrect fourcc" );
-static_assert( fourcc<byte_swizzling_t::honeywell_endian>('\0', '\1', '\2', '\3') == static_cast<uint32_t>(byte_swizzling_t::honeywell_endian), "Incorrect fourcc" );
-
-constexpr uint32_t platform_endianness = fourcc('\0', '\1', '\2', '\3');
-static_assert( platform_endianness == static_cast<uint32_t>(cpu_swizzling), "Wrong CPU endianness set" );
-
-
-struct SBWavChunk
+template<typename T>
+static void SB_PutWavValue(std::vector<unsigned char>& bytes, T value)
 {
-	uint32_t tag;      // big endian
-	uint32_t dataSize; // little endian
-};
+	for (size_t index = 0; index < sizeof(T); ++index)
+		bytes.push_back(static_cast<unsigned char>(static_cast<uint64_t>(value) >> (8 * index)));
+}
 
-struct SBWavRiffChunk : SBWavChunk
+static bool SB_PatchWavBytes(std::FILE* file, long offset, const std::vector<unsigned char>& bytes)
 {
-	constexpr SBWavRiffChunk() : SBWavChunk{ fourcc<byte_swizzling_t::big_endian>('R', 'I', 'F', 'F'), 4u } {}
-	uint32_t formatID = fourcc<byte_swizzling_t::big_endian>( 'W', 'A', 'V', 'E' ); // big endian
-};
-static_assert(SBWavRiffChunk().tag == 0x52494646, "Wrong RIFF tag");
-static_assert(SBWavRiffChunk().formatID == 0x57415645, "Wrong WAV tag");
+	return fseek(file, offset, SEEK_SET) == 0 && fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+}
 
-enum class SBWavAudioCodec : uint16_t
+static bool SB_PatchWavValue(std::FILE* file, long offset, uint32_t value)
 {
-	WAVE_FORMAT_UNKNOWN = 				  0x0000u,
-	WAVE_FORMAT_PCM = 					  0x0001u,
-	WAVE_FORMAT_ADPCM = 				  0x0002u,
-	WAVE_FORMAT_IEEE_FLOAT = 			  0x0003u,
-	WAVE_FORMAT_VSELP = 				  0x0004u,
-	WAVE_FORMAT_IBM_CVSD = 				  0x0005u,
-	WAVE_FORMAT_ALAW = 					  0x0006u,
-	WAVE_FORMAT_MULAW = 				  0x0007u,
-
-	WAVE_FORMAT_OKI_ADPCM = 			  0x0010u,
-	WAVE_FORMAT_DVI_ADPCM = 			  0x0011u,
-	WAVE_FORMAT_MEDIASPACE_ADPCM = 		  0x0012u,
-	WAVE_FORMAT_SIERRA_ADPCM = 			  0x0013u,
-	WAVE_FORMAT_G723_ADPCM = 			  0x0014u,
-	WAVE_FORMAT_DIGISTD = 				  0x0015u,
-	WAVE_FORMAT_DIGIFIX = 				  0x0016u,
-	WAVE_FORMAT_DIALOGIC_OKI_ADPCM = 	  0x0017u,
-	WAVE_FORMAT_MEDIAVISION_ADPCM = 	  0x0018u,
-	WAVE_FORMAT_CU_CODEC = 				  0x0019u,
-
-	WAVE_FORMAT_YAMAHA_ADPCM = 			  0x0020u,
-	WAVE_FORMAT_SONARC = 				  0x0021u,
-	WAVE_FORMAT_DSPGROUP_TRUESPEECH = 	  0x0022u,
-	WAVE_FORMAT_ECHOSC1 = 				  0x0023u,
-	WAVE_FORMAT_AUDIOFILE_AF36 = 		  0x0024u,
-	WAVE_FORMAT_APTX = 					  0x0025u,
-	WAVE_FORMAT_AUDIOFILE_AF10 = 		  0x0026u,
-	WAVE_FORMAT_PROSODY_1612 = 			  0x0027u,
-	WAVE_FORMAT_LRC = 					  0x0028u,
-
-	WAVE_FORMAT_DOLBY_AC2 = 			  0x0030u,
-	WAVE_FORMAT_GSM610 = 				  0x0031u,
-	WAVE_FORMAT_MSNAUDIO = 				  0x0032u,
-	WAVE_FORMAT_ANTEX_ADPCME = 			  0x0033u,
-	WAVE_FORMAT_CONTROL_RES_VQLPC = 	  0x0034u,
-	WAVE_FORMAT_DIGIREAL = 				  0x0035u,
-	WAVE_FORMAT_DIGIADPCM = 			  0x0036u,
-	WAVE_FORMAT_CONTROL_RES_CR10 = 		  0x0037u,
-	WAVE_FORMAT_NMS_VBXADPCM = 			  0x0038u,
-	WAVE_FORMAT_ROLAND_RDAC = 			  0x0039u,
-	WAVE_FORMAT_ECHOSC3 = 				  0x003Au,
-	WAVE_FORMAT_ROCKWELL_ADPCM = 		  0x003Bu,
-	WAVE_FORMAT_ROCKWELL_DIGITALK = 	  0x003Cu,
-	WAVE_FORMAT_XEBEC = 				  0x003Du,
-
-	WAVE_FORMAT_G721_ADPCM = 			  0x0040u,
-	WAVE_FORMAT_G728_CELP = 			  0x0041u,
-	WAVE_FORMAT_MSG723 = 				  0x0042u,
-
-	WAVE_FORMAT_MPEG = 					  0x0050u,
-
-	WAVE_FORMAT_RT24 = 					  0x0052u,
-	WAVE_FORMAT_PAC = 					  0x0053u,
-
-	WAVE_FORMAT_MPEGLAYER3 = 			  0x0055u,
-
-	WAVE_FORMAT_LUCENT_G723 = 			  0x0059u,
-
-	WAVE_FORMAT_CIRRUS = 				  0x0060u,
-	WAVE_FORMAT_ESPCM = 				  0x0061u,
-	WAVE_FORMAT_VOXWARE = 				  0x0062u,
-	WAVE_FORMAT_CANOPUS_ATRAC = 		  0x0063u,
-	WAVE_FORMAT_G726_ADPCM = 			  0x0064u,
-	WAVE_FORMAT_G722_ADPCM = 			  0x0065u,
-	WAVE_FORMAT_DSAT = 					  0x0066u,
-	WAVE_FORMAT_DSAT_DISPLAY = 			  0x0067u,
-
-	WAVE_FORMAT_VOXWARE_BYTE_ALIGNED = 	  0x0069u,
-
-	WAVE_FORMAT_VOXWARE_AC8 = 			  0x0070u,
-	WAVE_FORMAT_VOXWARE_AC10 = 			  0x0071u,
-	WAVE_FORMAT_VOXWARE_AC16 = 			  0x0072u,
-	WAVE_FORMAT_VOXWARE_AC20 = 			  0x0073u,
-	WAVE_FORMAT_VOXWARE_RT24 = 			  0x0074u,
-	WAVE_FORMAT_VOXWARE_RT29 = 			  0x0075u,
-	WAVE_FORMAT_VOXWARE_RT29HW = 		  0x0076u,
-	WAVE_FORMAT_VOXWARE_VR12 = 			  0x0077u,
-	WAVE_FORMAT_VOXWARE_VR18 = 			  0x0078u,
-	WAVE_FORMAT_VOXWARE_TQ40 = 			  0x0079u,
-
-	WAVE_FORMAT_SOFTSOUND = 			  0x0080u,
-	WAVE_FORMAT_VOXWARE_TQ60 = 			  0x0081u,
-	WAVE_FORMAT_MSRT24 = 				  0x0082u,
-	WAVE_FORMAT_G729A = 				  0x0083u,
-	WAVE_FORMAT_MVI_MV12 = 				  0x0084u,
-	WAVE_FORMAT_DF_G726 = 				  0x0085u,
-	WAVE_FORMAT_DF_GSM610 = 			  0x0086u,
-	WAVE_FORMAT_ISIAUDIO = 				  0x0088u,
-	WAVE_FORMAT_ONLIVE = 				  0x0089u,
-
-	WAVE_FORMAT_SBC24 = 				  0x0091u,
-	WAVE_FORMAT_DOLBY_AC3_SPDIF = 		  0x0092u,
-
-	WAVE_FORMAT_ZYXEL_ADPCM = 			  0x0097u,
-	WAVE_FORMAT_PHILIPS_LPCBB = 		  0x0098u,
-	WAVE_FORMAT_PACKED = 				  0x0099u,
-
-	WAVE_FORMAT_RHETOREX_ADPCM = 		  0x0100u,
-	WAVE_FORMAT_IRAT = 					  0x0101u,
-
-	WAVE_FORMAT_VIVO_G723 = 			  0x0111u,
-	WAVE_FORMAT_VIVO_SIREN = 			  0x0112u,
-
-	WAVE_FORMAT_DIGITAL_G723 = 			  0x0123u,
-
-	WAVE_FORMAT_CREATIVE_ADPCM = 		  0x0200u,
-
-	WAVE_FORMAT_CREATIVE_FASTSPEECH8 = 	  0x0202u,
-	WAVE_FORMAT_CREATIVE_FASTSPEECH10 =   0x0203u,
-
-	WAVE_FORMAT_QUARTERDECK = 			  0x0220u,
-
-	WAVE_FORMAT_FM_TOWNS_SND = 			  0x0300u,
-
-	WAVE_FORMAT_BTV_DIGITAL = 			  0x0400u,
-
-	WAVE_FORMAT_VME_VMPCM = 			  0x0680u,
-
-	WAVE_FORMAT_OLIGSM = 				  0x1000u,
-	WAVE_FORMAT_OLIADPCM = 				  0x1001u,
-	WAVE_FORMAT_OLICELP = 				  0x1002u,
-	WAVE_FORMAT_OLISBC = 				  0x1003u,
-	WAVE_FORMAT_OLIOPR = 				  0x1004u,
-
-	WAVE_FORMAT_LH_CODEC = 				  0x1100u,
-
-	WAVE_FORMAT_NORRIS = 				  0x1400u,
-	WAVE_FORMAT_ISIAUDIO_2 = 			  0x1401u,
+	std::vector<unsigned char> bytes;
+	SB_PutWavValue(bytes, value);
+	return SB_PatchWavBytes(file, offset, bytes);
+}
+
+//
+// SBWavWriter
+//
+bool SBWavWriter::open(const std::wstring& path, uint16_t numChannels, uint32_t sampleRate, SBWavSampleFormat format, bool largeFile)
+{
+	close();
+	if (numChannels == 0 || sampleRate == 0)
+		return false;
+
+	uint16_t bitsPerSample = 32;
+	switch (format)
+	{
+	case SBWavSampleFormat::Int16: bitsPerSample = 16; break;
+	case SBWavSampleFormat::Int24: bitsPerSample = 24; break;
+	default:                       bitsPerSample = 32; break;
+	}
+	const bool isFloat = format == SBWavSampleFormat::Float32;
+	const uint16_t blockAlign = static_cast<uint16_t>(numChannels * (bitsPerSample / 8));
+	this->format = SBWavFmtChunk(SBWavFmtChunk().tag, isFloat ? 18u : 16u,
+		isFloat ? SBWavAudioCodec::WAVE_FORMAT_IEEE_FLOAT : SBWavAudioCodec::WAVE_FORMAT_PCM,
+		numChannels, sampleRate, sampleRate * blockAlign, blockAlign, bitsPerSample);
+	sampleFormat = format;
+
+	file = SB_OpenFile(path, "wb");
+	if (!file)
+		return false;
+	setvbuf(file, nullptr, _IOFBF, 1 << 20);
+	setDither(ditherSetup, ditherStream);
+
+	// RIFF, [JUNK], fmt (+ cbSize for non-PCM), fact (non-PCM only), data; sizes are patched on close
+	const SBWavRiffChunk riff;
+	std::vector<unsigned char> header;
+	SB_PutWavTag(header, riff.tag);
+	SB_PutWavValue(header, uint32_t(0));
+	SB_PutWavTag(header, riff.formatID);
+	rf64 = largeFile;
+	if (rf64)
+	{
+		// room for the ds64 chunk, in case the file outgrows 32 bits sizes (EBU Tech 3306)
+		SB_PutWavTag(header, SB_WAV_JUNK_TAG);
+		SB_PutWavValue(header, SB_WAV_DS64_SIZE);
+		header.resize(header.size() + SB_WAV_DS64_SIZE, 0);
+	}
+
+	SB_PutWavTag(header, this->format.tag);
+	SB_PutWavValue(header, this->format.dataSize);
+	SB_PutWavValue(header, static_cast<uint16_t>(this->format.codecID));
+	SB_PutWavValue(header, this->format.numChannels);
+	SB_PutWavValue(header, this->format.sampleRate);
+	SB_PutWavValue(header, this->format.byteRate);
+	SB_PutWavValue(header, this->format.blockAlign);
+	SB_PutWavValue(header, this->format.bitsPerSample);
+	if (isFloat)
+	{
+		SB_PutWavValue(header, uint16_t(0));	// SBWavFmtEXChunk::extraParamSize
+
+		SB_PutWavTag(header, SB_WAV_FACT_TAG);
+		SB_PutWavValue(header, uint32_t(4));
+		factOffset = static_cast<long>(header.size());
+		SB_PutWavValue(header, uint32_t(0));	// frames per channel
+	}
+
+	SB_PutWavTag(header, SBWavDataChunk().tag);
+	SB_PutWavValue(header, uint32_t(0));
+	dataOffset = static_cast<long>(header.size());
+
+	failed = fwrite(header.data(), 1, header.size(), file) != header.size();
+	return !failed;
+}
+
+bool SBWavWriter::write(const float* const* channels, size_t frameCount)
+{
+	if (!file || failed)
+		return false;
+
+	const size_t bytesPerSample = format.bitsPerSample / 8;
+	const size_t size = frameCount * format.blockAlign;
+	if (!rf64 && (frames + frameCount) * format.blockAlign + static_cast<uint64_t>(dataOffset) > std::numeric_limits<uint32_t>::max() - 1)
+	{
+		failed = true;	// RIFF sizes are 32 bits
+		return false;
+	}
+
+	interleaved.resize(size);
+	if (dither.active())
+	{
+		codes.resize(frameCount * format.numChannels);
+		codeChannels.resize(format.numChannels);
+		for (uint16_t channel = 0; channel < format.numChannels; ++channel)
+			codeChannels[channel] = codes.data() + channel * frameCount;
+		dither.quantize(channels, codeChannels.data(), static_cast<long>(frameCount));
+	}
+	for (uint16_t channel = 0; channel < format.numChannels; ++channel)
+	{
+		const float* source = channels[channel];
+		unsigned char* target = interleaved.data() + channel * bytesPerSample;
+		if (dither.active())
+		{
+			const int32_t* channelCodes = codeChannels[channel];
+			for (size_t frame = 0; frame < frameCount; ++frame, target += format.blockAlign)
+			{
+				if (sampleFormat == SBWavSampleFormat::Int16)
+				{
+					const int16_t sample = static_cast<int16_t>(channelCodes[frame]);
+					memcpy(target, &sample, sizeof(sample));
+				}
+				else
+				{
+					SB_WriteInt24(target, channelCodes[frame]);
+				}
+			}
+			continue;
+		}
+		switch (sampleFormat)
+		{
+		case SBWavSampleFormat::Int16:
+			for (size_t frame = 0; frame < frameCount; ++frame, target += format.blockAlign)
+			{
+				const int16_t sample = static_cast<int16_t>(SB_QuantizeSample(source[frame], 16));
+				memcpy(target, &sample, sizeof(sample));
+			}
+			break;
+		case SBWavSampleFormat::Int24:
+			for (size_t frame = 0; frame < frameCount; ++frame, target += format.blockAlign)
+				SB_WriteInt24(target, SB_QuantizeSample(source[frame], 24));
+			break;
+		case SBWavSampleFormat::Int32:
+			for (size_t frame = 0; frame < frameCount; ++frame, target += format.blockAlign)
+			{
+				const int32_t sample = SB_QuantizeSample(source[frame], 32);
+				memcpy(target, &sample, sizeof(sample));
+			}
+			break;
+		case SBWavSampleFormat::Float32:
+			for (size_t frame = 0; frame < frameCount; ++frame, target += format.blockAlign)
+				memcpy(target, source + frame, sizeof(float));
+			break;
+		}
+	}
+
+	failed = fwrite(interleaved.data(), 1, size, file) != size;
+	frames += failed ? 0 : frameCount;
+	return !failed;
+}
+
+void SBWavWriter::setDither(const SBDitherSetup& setup, uint32_t stream)
+{
+	ditherSetup = setup;
+	ditherStream = stream;
+	const bool narrow = sampleFormat == SBWavSampleFormat::Int16 || sampleFormat == SBWavSampleFormat::Int24;
+	dither.prepare(file && narrow ? setup : SBDitherSetup(), format.numChannels, format.bitsPerSample, stream);
+}
 
-	WAVE_FORMAT_SOUNDSPACE_MUSICOMPRESS = 0x1500u,
+bool SBWavWriter::close()
+{
+	if (!file)
+		return false;
+
+	const uint64_t dataSize = frames * format.blockAlign;
+	bool succeeded = !failed;
+	if (succeeded && (dataSize & 1u))
+		succeeded = fputc(0, file) != EOF;	// chunks are word aligned
+	const uint64_t riffSize = static_cast<uint64_t>(dataOffset - 8) + dataSize + (dataSize & 1u);
+	if (riffSize <= std::numeric_limits<uint32_t>::max())
+	{
+		succeeded = succeeded && SB_PatchWavValue(file, 4, static_cast<uint32_t>(riffSize));
+		succeeded = succeeded && SB_PatchWavValue(file, dataOffset - 4, static_cast<uint32_t>(dataSize));
+		if (factOffset)
+			succeeded = succeeded && SB_PatchWavValue(file, factOffset, static_cast<uint32_t>(frames));
+	}
+	else
+	{
+		// RF64: the 32 bits sizes are saturated, the real ones go to ds64 in place of the JUNK chunk
+		std::vector<unsigned char> header;
+		SB_PutWavTag(header, SB_WAV_RF64_TAG);
+		SB_PutWavValue(header, std::numeric_limits<uint32_t>::max());
+		SB_PutWavTag(header, SBWavRiffChunk().formatID);
+		SB_PutWavTag(header, SB_WAV_DS64_TAG);
+		SB_PutWavValue(header, SB_WAV_DS64_SIZE);
+		SB_PutWavValue(header, riffSize);
+		SB_PutWavValue(header, dataSize);
+		SB_PutWavValue(header, frames);
+		SB_PutWavValue(header, uint32_t(0));
+		succeeded = succeeded && SB_PatchWavBytes(file, 0, header);
+		succeeded = succeeded && SB_PatchWavValue(file, dataOffset - 4, std::numeric_limits<uint32_t>::max());
+		if (factOffset)
+			succeeded = succeeded && SB_PatchWavValue(file, factOffset, std::numeric_limits<uint32_t>::max());
+	}
+	succeeded = fclose(file) == 0 && succeeded;
+
+	file = nullptr;
+	frames = 0;
+	factOffset = 0;
+	dataOffset = 0;
+	rf64 = false;
+	failed = false;
+	return succeeded;
+}
+
+//
+// Reader
+//
+static uint32_t SB_GetWavTag(const unsigned char* bytes)
+{
+	return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
 
-	WAVE_FORMAT_DVM = 					  0x2000u,
-};
+template<typename T>
+static T SB_GetWavValue(const unsigned char* bytes)
+{
+	uint64_t value = 0;
+	for (size_t index = 0; index < sizeof(T); ++index)
+		value |= static_cast<uint64_t>(bytes[index]) << (8 * index);
+	return static_cast<T>(value);
+}
 
-struct SBWavFmtChunk : SBWavChunk
+bool SBWavInfo::decodable() const
 {
-	constexpr SBWavFmtChunk(
-			uint32_t tag = fourcc<byte_swizzling_t::big_endian>('f', 'm', 't', ' '), uint32_t dataSize = 16u,
-			SBWavAudioCodec codecID = SBWavAudioCodec::WAVE_FORMAT_PCM,
-			uint16_t     numChannels = 0,
-			uint32_t     sampleRate = 0,
-			uint32_t     byteRate = 0,      // sampleRate * numChannels * ( bitsPerSample / CHAR_BIT )
-			uint16_t     blockAlign = 0,    // numChannels * ( bitsPerSample / CHAR_BIT )
-			uint16_t     bitsPerSample = 0  // numChannels * ( bitsPerSample / CHAR_BIT )
-		)
-		: SBWavChunk{ tag, dataSize },
-			codecID(codecID),
-			numChannels(numChannels),
-			sampleRate(sampleRate),
-			byteRate(byteRate),      // sampleRate * numChannels * ( bitsPerSample / CHAR_BIT )
-			blockAlign(blockAlign),    // numChannels * ( bitsPerSample / CHAR_BIT )
-			bitsPerSample(bitsPerSample)  // numChannels * ( bitsPerSample / CHAR_BIT )
-	{}
-	SBWavAudioCodec codecID = SBWavAudioCodec::WAVE_FORMAT_PCM;
-	uint16_t     numChannels = 0;   // little endian
-	uint32_t     sampleRate = 0;    // little endian
-	uint32_t     byteRate = 0;      // little endian; sampleRate * numChannels * ( bitsPerSample / CHAR_BIT )
-	uint16_t     blockAlign = 0;    // little endian; numChannels * ( bitsPerSample / CHAR_BIT )
-	uint16_t     bitsPerSample = 0; // little endian; numChannels * ( bitsPerSample / CHAR_BIT )
-};
-static_assert(SBWavFmtChunk().tag == 0x666d7420, "Wrong wav fmt tag");
-
-struct SBWavFmtEXChunk : SBWavFmtChunk
+	if (format.numChannels == 0 || format.blockAlign != format.numChannels * (format.bitsPerSample / 8))
+		return false;
+	switch (sampleCodec)
+	{
+	case SBWavAudioCodec::WAVE_FORMAT_PCM:
+		return format.bitsPerSample == 8 || format.bitsPerSample == 16 || format.bitsPerSample == 24 || format.bitsPerSample == 32;
+	case SBWavAudioCodec::WAVE_FORMAT_IEEE_FLOAT:
+		return format.bitsPerSample == 32 || format.bitsPerSample == 64;
+	default:
+		return false;
+	}
+}
+
+bool SB_ReadWavInfo(const void* data, size_t size, SBWavInfo& info)
 {
-	constexpr SBWavFmtEXChunk() : SBWavFmtChunk{ fourcc<byte_swizzling_t::big_endian>('f', 'm', 't', ' '), 18u, SBWavAudioCodec::WAVE_FORMAT_UNKNOWN } {}
-	uint16_t     extraParamSize = 0; // little endian; doesn't exist for PCM
-};
-static_assert(SBWavFmtEXChunk().tag == 0x666d7420, "Wrong wav fmt ex tag");
+	return SB_ReadWavHeader(data, size, size, info);
+}
 
-struct SBWavDataChunk : SBWavChunk
+bool SB_ReadWavHeader(const void* data, size_t size, uint64_t fileSize, SBWavInfo& info)
 {
-	constexpr SBWavDataChunk() : SBWavChunk{ fourcc<byte_swizzling_t::big_endian>('d', 'a', 't', 'a'), 0u } {}
-};
-static_assert(SBWavDataChunk().tag == 0x64617461, "Wrong wav data tag");
-
+	info = SBWavInfo();
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	const SBWavRiffChunk riff;
+	const uint32_t fileTag = size >= 12 ? SB_GetWavTag(bytes) : 0;
+	if ((fileTag != riff.tag && fileTag != SB_WAV_RF64_TAG) || SB_GetWavTag(bytes + 8) != riff.formatID)
+		return false;
+
+	uint64_t largeDataSize = 0;	// RF64
+	bool hasFormat = false;
+	bool hasData = false;
+	uint64_t offset = 12;	// 64 bits even in 32 bit builds, where a chunk size could wrap a size_t
+	while (offset + 8 <= size && !hasData)
+	{
+		const unsigned char* header = bytes + static_cast<size_t>(offset);
+		const uint32_t tag = SB_GetWavTag(header);
+		uint64_t chunkSize = SB_GetWavValue<uint32_t>(header + 4);
+		const unsigned char* chunk = header + 8;
+		const uint64_t available = size - offset - 8;
+		if (tag == SBWavDataChunk().tag && chunkSize == std::numeric_limits<uint32_t>::max() && largeDataSize)
+			chunkSize = largeDataSize;
+
+		if (tag == SB_WAV_DS64_TAG && fileTag == SB_WAV_RF64_TAG && chunkSize >= SB_WAV_DS64_SIZE && chunkSize <= available)
+		{
+			largeDataSize = SB_GetWavValue<uint64_t>(chunk + 8);
+		}
+		else if (tag == info.format.tag && chunkSize >= 16 && chunkSize <= available)
+		{
+			info.format = SBWavFmtChunk(tag, static_cast<uint32_t>(chunkSize),
+				static_cast<SBWavAudioCodec>(SB_GetWavValue<uint16_t>(chunk)),
+				SB_GetWavValue<uint16_t>(chunk + 2), SB_GetWavValue<uint32_t>(chunk + 4), SB_GetWavValue<uint32_t>(chunk + 8),
+				SB_GetWavValue<uint16_t>(chunk + 12), SB_GetWavValue<uint16_t>(chunk + 14));
+			info.sampleCodec = info.format.codecID;
+			// WAVEFORMATEXTENSIBLE: cbSize, valid bits, channel mask, then the sub-format GUID
+			if (info.format.codecID == SBWavAudioCodec::WAVE_FORMAT_EXTENSIBLE && chunkSize >= 40)
+			{
+				info.channelMask = SB_GetWavValue<uint32_t>(chunk + 20);
+				info.sampleCodec = static_cast<SBWavAudioCodec>(SB_GetWavValue<uint16_t>(chunk + 24));
+			}
+			hasFormat = true;
+		}
+		else if (tag == SBWavDataChunk().tag)
+		{
+			// streams that never patched the size (or were cut) keep whatever is there
+			info.dataOffset = static_cast<size_t>(offset + 8);
+			info.dataSize = static_cast<size_t>(std::min<uint64_t>(chunkSize, fileSize - std::min<uint64_t>(fileSize, offset + 8)));
+			hasData = true;
+		}
+		const uint64_t next = offset + 8 + chunkSize + (chunkSize & 1u);
+		if (next <= offset)
+			break;	// no progress: an RF64 size that wraps 64 bits
+		offset = next;
+	}
+	if (!hasFormat || !hasData || info.format.blockAlign == 0)
+		return false;
+	info.frameCount = info.dataSize / info.format.blockAlign;
+	return true;
+}
+
+size_t SB_DecodeWavFrames(const void* data, const SBWavInfo& info, uint64_t firstFrame, size_t frameCount, float* const* channels)
+{
+	if (!info.decodable() || firstFrame >= info.frameCount)
+		return 0;
+	frameCount = static_cast<size_t>(std::min<uint64_t>(frameCount, info.frameCount - firstFrame));
+
+	const size_t bytesPerSample = info.format.bitsPerSample / 8;
+	const unsigned char* frames = static_cast<const unsigned char*>(data) + info.dataOffset + firstFrame * info.format.blockAlign;
+	const bool isFloat = info.sampleCodec == SBWavAudioCodec::WAVE_FORMAT_IEEE_FLOAT;
+	for (uint16_t channel = 0; channel < info.format.numChannels; ++channel)
+	{
+		float* target = channels[channel];
+		if (!target)
+			continue;
+		const unsigned char* source = frames + channel * bytesPerSample;
+		switch (info.format.bitsPerSample)
+		{
+		case 8:	// unsigned
+			for (size_t frame = 0; frame < frameCount; ++frame, source += info.format.blockAlign)
+				target[frame] = (static_cast<float>(*source) - 128.0f) * (1.0f / 128.0f);
+			break;
+		case 16:
+			for (size_t frame = 0; frame < frameCount; ++frame, source += info.format.blockAlign)
+				target[frame] = static_cast<float>(SB_GetWavValue<int16_t>(source)) * (1.0f / 32768.0f);
+			break;
+		case 24:
+			for (size_t frame = 0; frame < frameCount; ++frame, source += info.format.blockAlign)
+				target[frame] = static_cast<float>(SB_ReadInt24(source)) * (1.0f / 8388608.0f);
+			break;
+		case 32:
+			for (size_t frame = 0; frame < frameCount; ++frame, source += info.format.blockAlign)
+			{
+				if (isFloat)
+					memcpy(target + frame, source, sizeof(float));
+				else
+					target[frame] = static_cast<float>(static_cast<double>(SB_GetWavValue<int32_t>(source)) * (1.0 / 2147483648.0));
+			}
+			break;
+		case 64:
+			for (size_t frame = 0; frame < frameCount; ++frame, source += info.format.blockAlign)
+			{
+				double sample;
+				memcpy(&sample, source, sizeof(sample));
+				target[frame] = static_cast<float>(sample);
+			}
+			break;
+		}
+	}
+	return frameCount;
+}
+
+bool SB_ReadWavFile(const std::wstring& path, SBWavAudio& audio)
+{
+	audio = SBWavAudio();
+	SBMappedFile file;
+	SBWavInfo info;
+	if (!file.open(path) || !SB_ReadWavInfo(file.data(), file.size(), info) || !info.decodable())
+		return false;
+
+	audio.sampleRate = info.format.sampleRate;
+	audio.channels.assign(info.format.numChannels, std::vector<float>(static_cast<size_t>(info.frameCount)));
+	std::vector<float*> channels;
+	for (std::vector<float>& channel : audio.channels)
+		channels.push_back(channel.data());
+	return SB_DecodeWavFrames(file.data(), info, 0, static_cast<size_t>(info.frameCount), channels.data()) == info.frameCount;
+}